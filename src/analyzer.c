@@ -12,6 +12,24 @@
 
 #define _POSIX_C_SOURCE 200809L
 
+// Fills group_desc with the 32-byte part of every descriptor; 64-bit filesystems store
+// wider records, whose high halves are left on disk
+static int load_group_descs(fs_info_t *fs_info) {
+    uint64_t table = group_desc_offset(fs_info, 0);
+
+    if (fs_info->desc_size == sizeof(struct ext2_group_desc)) {
+        return read_bytes(fs_info, table, fs_info->group_desc, sizeof(struct ext2_group_desc) * fs_info->groups_count);
+    }
+
+    uint8_t *raw = (uint8_t *)malloc((size_t)fs_info->desc_size * fs_info->groups_count);
+    int rc = raw ? read_bytes(fs_info, table, raw, (size_t)fs_info->desc_size * fs_info->groups_count) : -1;
+    for (uint32_t g = 0; rc == 0 && g < fs_info->groups_count; g++) {
+        memcpy(&fs_info->group_desc[g], raw + (size_t)g * fs_info->desc_size, sizeof(struct ext2_group_desc));
+    }
+    free(raw);
+    return rc;
+}
+
 fs_info_t *analyzer_init(const char *device_path) {
     fs_info_t *fs_info = NULL;
     int fd = -1;
@@ -70,10 +88,13 @@ fs_info_t *analyzer_init(const char *device_path) {
     fs_info->groups_count = (sb.s_blocks_count + sb.s_blocks_per_group - 1) / sb.s_blocks_per_group;
 
     fs_info->is_ext4 = (sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) != 0;
+    // Only 64bit filesystems use s_desc_size, which the kernel wants to be a power of two of at least 64
+    bool desc_valid = sb.s_desc_size >= EXT2_MIN_DESC_SIZE_64BIT && sb.s_desc_size <= EXT2_MAX_DESC_SIZE &&
+                      (sb.s_desc_size & (sb.s_desc_size - 1)) == 0;
+    fs_info->desc_size = !(sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) ? EXT2_MIN_DESC_SIZE
+                         : desc_valid ? sb.s_desc_size : EXT2_MIN_DESC_SIZE_64BIT;
 
-    size_t gd_size = fs_info->is_ext4 ? sizeof(struct ext2_group_desc) : 
-                                     sizeof(struct ext2_group_desc);
-    size_t gd_table_size = gd_size * fs_info->groups_count;
+    size_t gd_table_size = sizeof(struct ext2_group_desc) * fs_info->groups_count;
     
     fs_info->group_desc = (struct ext2_group_desc *)malloc(gd_table_size);
     if (!fs_info->group_desc) {
@@ -84,9 +105,7 @@ fs_info_t *analyzer_init(const char *device_path) {
         return NULL;
     }
 
-    uint32_t gdt_block = (1024 / fs_info->block_size) + 1;
-    
-    if (pread(fd, fs_info->group_desc, gd_table_size, gdt_block * fs_info->block_size) != (ssize_t)gd_table_size) {
+    if (load_group_descs(fs_info) != 0) {
         perror("Failed to read group descriptors");
         free(fs_info->group_desc);
         close(fd);
@@ -112,6 +131,10 @@ void analyzer_cleanup(fs_info_t *fs_info) {
             free(fs_info->group_desc);
             fs_info->group_desc = NULL;
         }
+        if (fs_info->overlay) {
+            overlay_close(fs_info->overlay);
+            fs_info->overlay = NULL;
+        }
         free(fs_info);
     }
 }
@@ -122,10 +145,9 @@ int read_block(fs_info_t *fs_info, uint32_t block_num, void *buffer) {
         return -1;
     }
 
-    off_t offset = (off_t)block_num * fs_info->block_size;
-    ssize_t bytes_read = pread(fs_info->fd, buffer, fs_info->block_size, offset);
+    uint64_t offset = (uint64_t)block_num * fs_info->block_size;
     
-    if (bytes_read != fs_info->block_size) {
+    if (read_bytes(fs_info, offset, buffer, fs_info->block_size) != 0) {
         perror("Failed to read block");
         return -1;
     }
@@ -139,10 +161,9 @@ int write_block(fs_info_t *fs_info, uint32_t block_num, void *buffer) {
         return -1;
     }
 
-    off_t offset = (off_t)block_num * fs_info->block_size;
-    ssize_t bytes_written = pwrite(fs_info->fd, buffer, fs_info->block_size, offset);
+    uint64_t offset = (uint64_t)block_num * fs_info->block_size;
     
-    if (bytes_written != fs_info->block_size) {
+    if (write_bytes(fs_info, offset, buffer, fs_info->block_size) != 0) {
         perror("Failed to write block");
         return -1;
     }
@@ -150,6 +171,152 @@ int write_block(fs_info_t *fs_info, uint32_t block_num, void *buffer) {
     return 0;
 }
 
+int read_bytes(fs_info_t *fs_info, uint64_t offset, void *buffer, size_t length) {
+    if (fs_info->overlay) {
+        return overlay_read(fs_info->overlay, fs_info->fd, offset, buffer, length);
+    }
+
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t bytes_read = pread(fs_info->fd, (uint8_t *)buffer + done, length - done, (off_t)(offset + done));
+        if (bytes_read <= 0) {
+            return -1;
+        }
+        done += bytes_read;
+    }
+
+    return 0;
+}
+
+int write_bytes(fs_info_t *fs_info, uint64_t offset, const void *buffer, size_t length) {
+    atomic_fetch_add(&fs_info->generation, 1);
+    if (fs_info->overlay) {
+        return overlay_write(fs_info->overlay, fs_info->fd, offset, buffer, length);
+    }
+
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t bytes_written = pwrite(fs_info->fd, (const uint8_t *)buffer + done, length - done, (off_t)(offset + done));
+        if (bytes_written <= 0) {
+            return -1;
+        }
+        done += bytes_written;
+    }
+
+    return 0;
+}
+
+// Re-reads the cached superblock and group descriptors after they were written behind our back
+int analyzer_reload_metadata(fs_info_t *fs_info) {
+    if (!fs_info) {
+        return -1;
+    }
+    atomic_fetch_add(&fs_info->generation, 1);
+
+    if (read_bytes(fs_info, 1024, &fs_info->sb, sizeof(struct ext2_super_block)) != 0) {
+        return -1;
+    }
+
+    return load_group_descs(fs_info);
+}
+
+// Sends all further writes to a copy-on-write overlay and reopens the device
+// read-only, so nothing reaches the device until the overlay is committed
+int analyzer_attach_overlay(fs_info_t *fs_info, const char *overlay_path) {
+    if (!fs_info || !overlay_path || fs_info->overlay) {
+        return -1;
+    }
+
+    int fd = open(fs_info->device_path, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to reopen device read-only");
+        return -1;
+    }
+
+    overlay_t *ov = overlay_open(overlay_path, fs_info->block_size);
+    if (!ov) {
+        close(fd);
+        return -1;
+    }
+
+    close(fs_info->fd);
+    fs_info->fd = fd;
+    fs_info->overlay = ov;
+
+    // Metadata may already differ in the overlay from an earlier session
+    return analyzer_reload_metadata(fs_info);
+}
+
+// Flushes written data to wherever writes go: the overlay or the device
+int analyzer_sync(fs_info_t *fs_info) {
+    if (!fs_info) {
+        return -1;
+    }
+    return fs_info->overlay ? overlay_sync(fs_info->overlay) : fsync(fs_info->fd);
+}
+
+int read_blocks(fs_info_t *fs_info, uint32_t first_block, uint32_t count, void *buffer) {
+    if (!fs_info || !buffer || count == 0 || first_block >= fs_info->sb.s_blocks_count ||
+        count > fs_info->sb.s_blocks_count - first_block) {
+        return -1;
+    }
+
+    if (read_bytes(fs_info, (uint64_t)first_block * fs_info->block_size, buffer,
+                   (size_t)count * fs_info->block_size) != 0) {
+        perror("Failed to read blocks");
+        return -1;
+    }
+
+    return 0;
+}
+
+uint32_t group_block_count(const fs_info_t *fs_info, uint32_t group_num) {
+    if (!fs_info || group_num >= fs_info->groups_count) {
+        return 0;
+    }
+
+    uint32_t first = fs_info->sb.s_first_data_block + group_num * fs_info->blocks_per_group;
+    if (first >= fs_info->sb.s_blocks_count) {
+        return 0;
+    }
+    uint32_t remaining = fs_info->sb.s_blocks_count - first;
+
+    return remaining < fs_info->blocks_per_group ? remaining : fs_info->blocks_per_group;
+}
+
+uint32_t inode_table_blocks(const fs_info_t *fs_info) {
+    uint32_t inode_size = fs_info->sb.s_inode_size ? fs_info->sb.s_inode_size : EXT2_GOOD_OLD_INODE_SIZE;
+
+    return ((uint64_t)fs_info->inodes_per_group * inode_size + fs_info->block_size - 1) / fs_info->block_size;
+}
+
+uint64_t fs_total_bytes(const fs_info_t *fs_info) {
+    return (uint64_t)fs_info->sb.s_blocks_count * fs_info->block_size;
+}
+
+uint64_t inode_offset(const fs_info_t *fs_info, uint32_t inode_num) {
+    uint32_t group = (inode_num - 1) / fs_info->inodes_per_group;
+    uint32_t index = (inode_num - 1) % fs_info->inodes_per_group;
+
+    return (uint64_t)fs_info->group_desc[group].bg_inode_table * fs_info->block_size +
+           (uint64_t)index * fs_info->sb.s_inode_size;
+}
+
+uint64_t group_desc_offset(const fs_info_t *fs_info, uint32_t group_num) {
+    uint32_t gdt_block = (1024 / fs_info->block_size) + 1;
+
+    return (uint64_t)gdt_block * fs_info->block_size + (uint64_t)group_num * fs_info->desc_size;
+}
+
+// Whether a device range overlaps the primary superblock or group descriptors cached in fs_info
+bool range_has_metadata(const fs_info_t *fs_info, uint64_t offset, uint64_t length) {
+    uint64_t meta_end = group_desc_offset(fs_info, fs_info->groups_count);
+
+    return offset < meta_end && offset + length > 1024;
+}
+
 bool is_block_allocated(fs_info_t *fs_info, uint32_t block_num) {
     if (!fs_info || block_num <= 0 || block_num >= fs_info->sb.s_blocks_count) {
         return false;
@@ -218,12 +385,10 @@ int read_inode(fs_info_t *fs_info, uint32_t inode_num, struct ext2_inode *inode)
     
     uint32_t index = (inode_num - 1) % fs_info->inodes_per_group;
 
-    off_t offset = (off_t)inode_table_block * fs_info->block_size + 
-                   (off_t)index * fs_info->sb.s_inode_size;
+    uint64_t offset = (uint64_t)inode_table_block * fs_info->block_size + 
+                      (uint64_t)index * fs_info->sb.s_inode_size;
     
-    ssize_t bytes_read = pread(fs_info->fd, inode, sizeof(struct ext2_inode), offset);
-    
-    if (bytes_read != sizeof(struct ext2_inode)) {
+    if (read_bytes(fs_info, offset, inode, sizeof(struct ext2_inode)) != 0) {
         perror("Failed to read inode");
         return -1;
     }
@@ -243,12 +408,10 @@ int write_inode(fs_info_t *fs_info, uint32_t inode_num, struct ext2_inode *inode
     
     uint32_t index = (inode_num - 1) % fs_info->inodes_per_group;
     
-    off_t offset = (off_t)inode_table_block * fs_info->block_size + 
-                   (off_t)index * fs_info->sb.s_inode_size;
-    
-    ssize_t bytes_written = pwrite(fs_info->fd, inode, sizeof(struct ext2_inode), offset);
+    uint64_t offset = (uint64_t)inode_table_block * fs_info->block_size + 
+                      (uint64_t)index * fs_info->sb.s_inode_size;
     
-    if (bytes_written != sizeof(struct ext2_inode)) {
+    if (write_bytes(fs_info, offset, inode, sizeof(struct ext2_inode)) != 0) {
         perror("Failed to write inode");
         return -1;
     }
@@ -5,9 +5,11 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <string.h>
 #include <stdio.h>
 #include <ext2fs/ext2_fs.h>
+#include "overlay.h"
 #define _POSIX_C_SOURCE 200809L
 
 typedef struct {
@@ -18,8 +20,11 @@ typedef struct {
     uint32_t inodes_per_group;      // Number of inodes per group
     uint32_t blocks_per_group;      // Number of blocks per group
     uint32_t groups_count;          // Number of block groups
-    struct ext2_group_desc *group_desc; // Group descriptors
+    struct ext2_group_desc *group_desc; // Group descriptors, the 32-byte part of each
+    uint32_t desc_size;             // On-disk size of one group descriptor
     bool is_ext4;                   // Whether filesystem is ext4
+    overlay_t *overlay;             // Copy-on-write delta taking all writes, NULL to write the device
+    _Atomic uint64_t generation;    // Bumped whenever what reads return may have changed
 } fs_info_t;
 
 fs_info_t *analyzer_init(const char *device_path);
@@ -30,6 +35,30 @@ int read_block(fs_info_t *fs_info, uint32_t block_num, void *buffer);
 
 int write_block(fs_info_t *fs_info, uint32_t block_num, void *buffer);
 
+int read_bytes(fs_info_t *fs_info, uint64_t offset, void *buffer, size_t length);
+
+int write_bytes(fs_info_t *fs_info, uint64_t offset, const void *buffer, size_t length);
+
+int analyzer_reload_metadata(fs_info_t *fs_info);
+
+int analyzer_attach_overlay(fs_info_t *fs_info, const char *overlay_path);
+
+int analyzer_sync(fs_info_t *fs_info);
+
+int read_blocks(fs_info_t *fs_info, uint32_t first_block, uint32_t count, void *buffer);
+
+uint32_t group_block_count(const fs_info_t *fs_info, uint32_t group_num);
+
+uint32_t inode_table_blocks(const fs_info_t *fs_info);
+
+uint64_t fs_total_bytes(const fs_info_t *fs_info);
+
+uint64_t inode_offset(const fs_info_t *fs_info, uint32_t inode_num);
+
+uint64_t group_desc_offset(const fs_info_t *fs_info, uint32_t group_num);
+
+bool range_has_metadata(const fs_info_t *fs_info, uint64_t offset, uint64_t length);
+
 bool is_block_allocated(fs_info_t *fs_info, uint32_t block_num);
 
 bool is_inode_allocated(fs_info_t *fs_info, uint32_t inode_num);
@@ -0,0 +1,540 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ncurses.h>
+#include <ext2fs/ext2_fs.h>
+#include "bitmapedit.h"
+#include "txn.h"
+#include "csum.h"
+#include "utils.h"
+
+bitmap_editor_t *bitmap_editor_init(fs_info_t *fs_info) {
+    bitmap_editor_t *ed = (bitmap_editor_t *)calloc(1, sizeof(bitmap_editor_t));
+    if (!ed) {
+        return NULL;
+    }
+
+    ed->fs_info = fs_info;
+    ed->bitmap = (unsigned char *)malloc(fs_info->block_size);
+    ed->original = (unsigned char *)malloc(fs_info->block_size);
+    if (!ed->bitmap || !ed->original) {
+        bitmap_editor_cleanup(ed);
+        return NULL;
+    }
+
+    ed->mark = -1;
+    ed->cells_per_row = 64;
+    ed->view_rows = 1;
+    ed->full_redraw = true;
+    ed->damage_first = -1;
+    return ed;
+}
+
+void bitmap_editor_cleanup(bitmap_editor_t *ed) {
+    if (!ed) {
+        return;
+    }
+
+    free(ed->bitmap);
+    free(ed->original);
+    free(ed);
+}
+
+static void bitmap_editor_set_message(bitmap_editor_t *ed, const char *message) {
+    snprintf(ed->message, sizeof(ed->message), "%s", message);
+}
+
+// Marks the cells of bits first..last for the next render
+static void bitmap_editor_damage(bitmap_editor_t *ed, uint32_t first, uint32_t last) {
+    if (first > last) {
+        uint32_t t = first;
+        first = last;
+        last = t;
+    }
+    if (ed->damage_first < 0) {
+        ed->damage_first = first;
+        ed->damage_last = last;
+        return;
+    }
+    if ((int64_t)first < ed->damage_first) {
+        ed->damage_first = first;
+    }
+    if ((int64_t)last > ed->damage_last) {
+        ed->damage_last = last;
+    }
+}
+
+void bitmap_editor_invalidate(bitmap_editor_t *ed) {
+    if (ed) {
+        ed->full_redraw = true;
+    }
+}
+
+// What the kernel assumes an uninitialised group holds: its own metadata at the start of
+// the group in use and everything else free, or no inode in use. Padding bits are set.
+static void bitmap_editor_build_uninit(const bitmap_editor_t *ed, unsigned char *bitmap) {
+    const fs_info_t *fs_info = ed->fs_info;
+    uint32_t bits = fs_info->block_size * 8;
+
+    memset(bitmap, 0, fs_info->block_size);
+    if (ed->kind == BITMAP_BLOCKS) {
+        uint32_t free_blocks = fs_info->group_desc[ed->group].bg_free_blocks_count;
+        fill_bitmap_range(bitmap, 0, ed->bit_count - (free_blocks < ed->bit_count ? free_blocks : ed->bit_count), true);
+    }
+    fill_bitmap_range(bitmap, ed->bit_count, bits - ed->bit_count, true);
+}
+
+// Block or inode number that a bit of the open bitmap stands for
+uint64_t bitmap_editor_object(const bitmap_editor_t *ed, uint32_t bit) {
+    const fs_info_t *fs_info = ed->fs_info;
+
+    if (ed->kind == BITMAP_BLOCKS) {
+        return (uint64_t)fs_info->sb.s_first_data_block + (uint64_t)ed->group * fs_info->blocks_per_group + bit;
+    }
+    return (uint64_t)ed->group * fs_info->inodes_per_group + bit + 1;
+}
+
+int bitmap_editor_open(bitmap_editor_t *ed, bitmap_kind_t kind, uint32_t group) {
+    if (!ed || group >= ed->fs_info->groups_count) {
+        return -1;
+    }
+
+    uint16_t flags = ed->fs_info->group_desc[group].bg_flags;
+    bool uninit = (flags & (kind == BITMAP_BLOCKS ? EXT2_BG_BLOCK_UNINIT : EXT2_BG_INODE_UNINIT)) != 0;
+    if (!uninit && (kind == BITMAP_BLOCKS ? get_block_bitmap(ed->fs_info, group, ed->original)
+                                          : get_inode_bitmap(ed->fs_info, group, ed->original)) != 0) {
+        return -1;
+    }
+
+    ed->kind = kind;
+    ed->group = group;
+    ed->uninit = uninit;
+    ed->bit_count = kind == BITMAP_BLOCKS ? group_block_count(ed->fs_info, group) : ed->fs_info->inodes_per_group;
+    if (ed->bit_count > ed->fs_info->block_size * 8) {
+        ed->bit_count = ed->fs_info->block_size * 8;
+    }
+    // The bitmap block of an uninitialised group holds nothing meaningful
+    if (uninit) {
+        bitmap_editor_build_uninit(ed, ed->original);
+    }
+    memcpy(ed->bitmap, ed->original, ed->fs_info->block_size);
+    ed->modified = false;
+    ed->cursor = 0;
+    ed->top_row = 0;
+    ed->mark = -1;
+    ed->message[0] = '\0';
+    ed->full_redraw = true;
+    return 0;
+}
+
+void bitmap_editor_revert(bitmap_editor_t *ed) {
+    if (!ed) {
+        return;
+    }
+
+    memcpy(ed->bitmap, ed->original, ed->fs_info->block_size);
+    ed->modified = false;
+    ed->mark = -1;
+    ed->full_redraw = true;
+}
+
+// Marks the blocks or inodes first..last (inclusive, absolute numbers) used or free
+int bitmap_editor_fill(bitmap_editor_t *ed, uint64_t first, uint64_t last, bool used) {
+    if (!ed || ed->bit_count == 0) {
+        return -1;
+    }
+
+    uint64_t base = bitmap_editor_object(ed, 0);
+    if (first > last || first < base || last >= base + ed->bit_count) {
+        return -1;
+    }
+
+    uint32_t changed = fill_bitmap_range(ed->bitmap, (uint32_t)(first - base), (uint32_t)(last - first + 1), used);
+    if (changed > 0) {
+        bitmap_editor_damage(ed, (uint32_t)(first - base), (uint32_t)(last - base));
+        ed->modified = memcmp(ed->bitmap, ed->original, ed->fs_info->block_size) != 0;
+    }
+
+    snprintf(ed->message, sizeof(ed->message), "%u %s marked %s", changed,
+             ed->kind == BITMAP_BLOCKS ? "blocks" : "inodes", used ? "used" : "free");
+    return (int)changed;
+}
+
+static uint64_t bitmap_editor_clamp_free(int64_t value, uint64_t max) {
+    if (value < 0) {
+        return 0;
+    }
+    return (uint64_t)value > max ? max : (uint64_t)value;
+}
+
+// Writes the bitmap together with the group and superblock free counters in one
+// transaction. The group counter is recounted from the bitmap, the superblock
+// counter moves by the same difference. Both keep their high halves on 64-bit
+// filesystems, and a group written this way is no longer uninitialised.
+int bitmap_editor_save(bitmap_editor_t *ed) {
+    if (!ed) {
+        return -1;
+    }
+    if (!ed->modified && !ed->uninit) {
+        return 0;
+    }
+
+    fs_info_t *fs_info = ed->fs_info;
+    int64_t used_before = count_bitmap_bits(ed->original, ed->bit_count);
+    int64_t used_after = count_bitmap_bits(ed->bitmap, ed->bit_count);
+    int64_t delta = used_after - used_before;
+    uint32_t free_after = ed->bit_count - (uint32_t)used_after;
+
+    struct ext2_super_block sb = fs_info->sb;
+    bool is_64 = (sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) != 0;
+    bool wide = fs_info->desc_size >= EXT2_MIN_DESC_SIZE_64BIT;
+    uint64_t desc_at = group_desc_offset(fs_info, ed->group);
+    size_t desc_len = wide ? sizeof(struct ext4_group_desc) : sizeof(struct ext2_group_desc);
+    struct ext4_group_desc gd;
+
+    txn_t *txn = txn_begin(fs_info);
+    if (!txn) {
+        return -1;
+    }
+    memset(&gd, 0, sizeof(gd));
+    if (txn_read(txn, desc_at, &gd, desc_len) != 0) {
+        txn_abort(txn);
+        return -1;
+    }
+
+    if (ed->kind == BITMAP_BLOCKS) {
+        uint64_t free_blocks = sb.s_free_blocks_count | (is_64 ? (uint64_t)sb.s_free_blocks_hi << 32 : 0);
+        uint64_t blocks = sb.s_blocks_count | (is_64 ? (uint64_t)sb.s_blocks_count_hi << 32 : 0);
+        free_blocks = bitmap_editor_clamp_free((int64_t)free_blocks - delta, blocks);
+        sb.s_free_blocks_count = (uint32_t)free_blocks;
+        if (is_64) {
+            sb.s_free_blocks_hi = (uint32_t)(free_blocks >> 32);
+        }
+        gd.bg_free_blocks_count = (uint16_t)free_after;
+        if (wide) {
+            gd.bg_free_blocks_count_hi = (uint16_t)(free_after >> 16);
+        }
+        gd.bg_flags &= (uint16_t)~EXT2_BG_BLOCK_UNINIT;
+    } else {
+        sb.s_free_inodes_count = (uint32_t)bitmap_editor_clamp_free((int64_t)sb.s_free_inodes_count - delta,
+                                                                    sb.s_inodes_count);
+        gd.bg_free_inodes_count = (uint16_t)free_after;
+        if (wide) {
+            gd.bg_free_inodes_count_hi = (uint16_t)(free_after >> 16);
+        }
+        gd.bg_flags &= (uint16_t)~EXT2_BG_INODE_UNINIT;
+
+        // Inodes marked used must lie before the part of the table the kernel treats as unused
+        uint32_t end = ed->bit_count;
+        while (end > 0 && !check_bitmap_bit(ed->bitmap, end - 1)) {
+            end--;
+        }
+        uint32_t unused = gd.bg_itable_unused | (wide ? (uint32_t)gd.bg_itable_unused_hi << 16 : 0);
+        if (ed->bit_count - end < unused) {
+            unused = ed->bit_count - end;
+            gd.bg_itable_unused = (uint16_t)unused;
+            if (wide) {
+                gd.bg_itable_unused_hi = (uint16_t)(unused >> 16);
+            }
+        }
+    }
+
+    int rc = ed->kind == BITMAP_BLOCKS ? txn_stage_block_bitmap(txn, ed->group, ed->bitmap)
+                                       : txn_stage_inode_bitmap(txn, ed->group, ed->bitmap);
+    if (rc == 0) {
+        rc = txn_stage(txn, desc_at, &gd, desc_len);
+    }
+    if (rc == 0) {
+        rc = txn_stage_superblock(txn, &sb);
+    }
+    // Recomputes the bitmap and group descriptor checksums over the staged bytes
+    if (rc == 0) {
+        rc = csum_stage_updates(txn);
+    }
+    if (rc != 0) {
+        txn_abort(txn);
+        return -1;
+    }
+
+    if (txn_commit(txn) != 0) {
+        return -1;
+    }
+
+    memcpy(ed->original, ed->bitmap, fs_info->block_size);
+    ed->modified = false;
+    ed->uninit = false;
+    ed->full_redraw = true;
+    return 0;
+}
+
+void bitmap_editor_set_cursor(bitmap_editor_t *ed, uint32_t bit) {
+    if (!ed || bit >= ed->bit_count) {
+        return;
+    }
+
+    // With a selection every bit between the old and the new cursor changes its look
+    bitmap_editor_damage(ed, ed->cursor, ed->mark >= 0 ? bit : ed->cursor);
+    bitmap_editor_damage(ed, bit, bit);
+    ed->cursor = bit;
+}
+
+void bitmap_editor_set_window(bitmap_editor_t *ed, WINDOW *win) {
+    if (ed) {
+        ed->win = win;
+    }
+}
+
+// Fits the grid to the window and scrolls the cursor into view. Returns true when
+// anything moved, which means every cell has to be drawn again.
+static bool bitmap_editor_layout(bitmap_editor_t *ed) {
+    int max_y, max_x;
+    getmaxyx(ed->win, max_y, max_x);
+    uint32_t old_cells = ed->cells_per_row, old_rows = ed->view_rows, old_top = ed->top_row;
+
+    // Cells come in groups of eight, one byte of the bitmap, followed by a space
+    int groups = (max_x - BITMAP_EDITOR_LABEL_WIDTH) / 9;
+    ed->cells_per_row = groups > 0 ? (uint32_t)groups * 8 : 8;
+    if (ed->cells_per_row > BITMAP_EDITOR_MAX_CELLS) {
+        ed->cells_per_row = BITMAP_EDITOR_MAX_CELLS;
+    }
+    ed->view_rows = max_y > 3 ? (uint32_t)(max_y - 3) : 1;
+
+    uint32_t cursor_row = ed->cursor / ed->cells_per_row;
+    if (cursor_row < ed->top_row) {
+        ed->top_row = cursor_row;
+    } else if (cursor_row >= ed->top_row + ed->view_rows) {
+        ed->top_row = cursor_row - ed->view_rows + 1;
+    }
+    return ed->cells_per_row != old_cells || ed->view_rows != old_rows || ed->top_row != old_top;
+}
+
+static void bitmap_editor_selection(const bitmap_editor_t *ed, uint32_t *first, uint32_t *last) {
+    if (ed->mark < 0) {
+        *first = *last = ed->cursor;
+    } else if ((uint32_t)ed->mark < ed->cursor) {
+        *first = (uint32_t)ed->mark;
+        *last = ed->cursor;
+    } else {
+        *first = ed->cursor;
+        *last = (uint32_t)ed->mark;
+    }
+}
+
+static void bitmap_editor_draw_cell(bitmap_editor_t *ed, uint32_t bit, uint32_t sel_first, uint32_t sel_last) {
+    uint32_t row = bit / ed->cells_per_row - ed->top_row;
+    uint32_t i = bit % ed->cells_per_row;
+    bool set = check_bitmap_bit(ed->bitmap, bit);
+    attr_t attrs = A_NORMAL;
+
+    if (bit == ed->cursor) {
+        attrs |= COLOR_PAIR(5) | A_BOLD;
+    } else if (set != check_bitmap_bit(ed->original, bit)) {
+        attrs |= COLOR_PAIR(7);
+    }
+    if (ed->mark >= 0 && bit >= sel_first && bit <= sel_last) {
+        attrs |= A_REVERSE;
+    }
+
+    wattron(ed->win, attrs);
+    mvwaddch(ed->win, row + 2, BITMAP_EDITOR_LABEL_WIDTH + i + i / 8, set ? '#' : '.');
+    wattroff(ed->win, attrs);
+}
+
+// Draws the header and mode line every time, but only the cells that changed since the
+// last render unless the grid moved
+void bitmap_editor_render(bitmap_editor_t *ed) {
+    if (!ed || !ed->win) {
+        return;
+    }
+
+    WINDOW *win = ed->win;
+    int max_y, max_x;
+    getmaxyx(win, max_y, max_x);
+    bool full = bitmap_editor_layout(ed) || ed->full_redraw;
+
+    const char *what = ed->kind == BITMAP_BLOCKS ? "Block" : "Inode";
+    uint32_t used = count_bitmap_bits(ed->bitmap, ed->bit_count);
+    uint32_t sel_first, sel_last;
+    bitmap_editor_selection(ed, &sel_first, &sel_last);
+
+    if (full) {
+        werase(win);
+    }
+    wattron(win, COLOR_PAIR(1));
+    mvwprintw(win, 0, 0, "Bitmap Editor - %s Bitmap, Group %u - %ss %lu-%lu - %u used, %u free%s",
+              what, ed->group, what, (unsigned long)bitmap_editor_object(ed, 0),
+              (unsigned long)bitmap_editor_object(ed, ed->bit_count ? ed->bit_count - 1 : 0),
+              used, ed->bit_count - used, ed->uninit ? " [uninitialised]" : "");
+    wclrtoeol(win);
+    wattroff(win, COLOR_PAIR(1));
+
+    uint32_t first_shown = ed->top_row * ed->cells_per_row;
+    uint32_t end_shown = first_shown + ed->view_rows * ed->cells_per_row;
+    if (end_shown > ed->bit_count) {
+        end_shown = ed->bit_count;
+    }
+
+    if (full) {
+        for (uint32_t row = 0; row < ed->view_rows; row++) {
+            uint32_t first_bit = (ed->top_row + row) * ed->cells_per_row;
+            if (first_bit >= ed->bit_count) {
+                break;
+            }
+            mvwprintw(win, row + 2, 0, "%10lu: ", (unsigned long)bitmap_editor_object(ed, first_bit));
+        }
+        for (uint32_t bit = first_shown; bit < end_shown; bit++) {
+            bitmap_editor_draw_cell(ed, bit, sel_first, sel_last);
+        }
+    } else if (ed->damage_first >= 0) {
+        uint32_t first = ed->damage_first > first_shown ? (uint32_t)ed->damage_first : first_shown;
+        uint32_t end = ed->damage_last + 1 < end_shown ? (uint32_t)ed->damage_last + 1 : end_shown;
+        for (uint32_t bit = first; bit < end; bit++) {
+            bitmap_editor_draw_cell(ed, bit, sel_first, sel_last);
+        }
+    }
+    ed->full_redraw = false;
+    ed->damage_first = -1;
+
+    wattron(win, COLOR_PAIR(2));
+    mvwprintw(win, max_y - 1, 0, "%-*.*s", max_x, max_x, "");
+    if (ed->mark >= 0) {
+        mvwprintw(win, max_y - 1, 0, "%s %lu: %s | selection %lu-%lu (%u)%s%s%s", what,
+                  (unsigned long)bitmap_editor_object(ed, ed->cursor),
+                  check_bitmap_bit(ed->bitmap, ed->cursor) ? "used" : "free",
+                  (unsigned long)bitmap_editor_object(ed, sel_first), (unsigned long)bitmap_editor_object(ed, sel_last),
+                  sel_last - sel_first + 1, ed->modified ? " [modified]" : "",
+                  ed->message[0] ? " - " : "", ed->message);
+    } else {
+        mvwprintw(win, max_y - 1, 0, "%s %lu: %s%s%s%s", what,
+                  (unsigned long)bitmap_editor_object(ed, ed->cursor),
+                  check_bitmap_bit(ed->bitmap, ed->cursor) ? "used" : "free",
+                  ed->modified ? " [modified]" : "", ed->message[0] ? " - " : "", ed->message);
+    }
+    wattroff(win, COLOR_PAIR(2));
+
+    wnoutrefresh(win);
+}
+
+static void bitmap_editor_move(bitmap_editor_t *ed, int64_t delta) {
+    int64_t target = (int64_t)ed->cursor + delta;
+
+    if (ed->bit_count == 0) {
+        return;
+    }
+    if (target < 0) {
+        target = 0;
+    } else if (target >= (int64_t)ed->bit_count) {
+        target = ed->bit_count - 1;
+    }
+    bitmap_editor_set_cursor(ed, (uint32_t)target);
+}
+
+// Applies to the selection when there is one, otherwise to the bit under the cursor
+static void bitmap_editor_fill_selection(bitmap_editor_t *ed, bool used) {
+    uint32_t first, last;
+
+    bitmap_editor_selection(ed, &first, &last);
+    bitmap_editor_fill(ed, bitmap_editor_object(ed, first), bitmap_editor_object(ed, last), used);
+    // Dropping the selection changes the look of every selected cell
+    bitmap_editor_damage(ed, first, last);
+    ed->mark = -1;
+}
+
+static bool bitmap_editor_switch(bitmap_editor_t *ed, bitmap_kind_t kind, int64_t group) {
+    if (ed->modified) {
+        bitmap_editor_set_message(ed, "Save (S) or revert (X) first");
+        return false;
+    }
+    if (group < 0 || group >= (int64_t)ed->fs_info->groups_count) {
+        return false;
+    }
+    if (bitmap_editor_open(ed, kind, (uint32_t)group) != 0) {
+        bitmap_editor_set_message(ed, "Error reading bitmap");
+        return false;
+    }
+    return true;
+}
+
+bool bitmap_editor_handle_key(bitmap_editor_t *ed, int key) {
+    if (!ed) {
+        return false;
+    }
+
+    ed->message[0] = '\0';
+
+    switch (key) {
+        case KEY_LEFT:
+            bitmap_editor_move(ed, -1);
+            break;
+        case KEY_RIGHT:
+            bitmap_editor_move(ed, 1);
+            break;
+        case KEY_UP:
+            bitmap_editor_move(ed, -(int64_t)ed->cells_per_row);
+            break;
+        case KEY_DOWN:
+            bitmap_editor_move(ed, ed->cells_per_row);
+            break;
+        case KEY_PPAGE:
+            bitmap_editor_move(ed, -(int64_t)ed->cells_per_row * ed->view_rows);
+            break;
+        case KEY_NPAGE:
+            bitmap_editor_move(ed, (int64_t)ed->cells_per_row * ed->view_rows);
+            break;
+        case KEY_HOME:
+            bitmap_editor_set_cursor(ed, 0);
+            break;
+        case KEY_END:
+            bitmap_editor_move(ed, ed->bit_count);
+            break;
+        case ' ':
+            if (ed->bit_count > 0) {
+                uint64_t object = bitmap_editor_object(ed, ed->cursor);
+                bitmap_editor_fill(ed, object, object, !check_bitmap_bit(ed->bitmap, ed->cursor));
+            }
+            break;
+        case 'v':
+        case 'V': {
+            uint32_t first, last;
+            bitmap_editor_selection(ed, &first, &last);
+            bitmap_editor_damage(ed, first, last);
+            ed->mark = ed->mark < 0 ? (int64_t)ed->cursor : -1;
+            break;
+        }
+        case '+':
+            bitmap_editor_fill_selection(ed, true);
+            break;
+        case '-':
+            bitmap_editor_fill_selection(ed, false);
+            break;
+        case '[':
+            bitmap_editor_switch(ed, ed->kind, (int64_t)ed->group - 1);
+            break;
+        case ']':
+            bitmap_editor_switch(ed, ed->kind, (int64_t)ed->group + 1);
+            break;
+        case '\t':
+            bitmap_editor_switch(ed, ed->kind == BITMAP_BLOCKS ? BITMAP_INODES : BITMAP_BLOCKS, ed->group);
+            break;
+        case 'x':
+        case 'X':
+            bitmap_editor_revert(ed);
+            bitmap_editor_set_message(ed, "Changes reverted");
+            break;
+        case 's':
+        case 'S':
+            if (bitmap_editor_save(ed) == 0) {
+                bitmap_editor_set_message(ed, "Bitmap and free counts saved");
+            } else {
+                bitmap_editor_set_message(ed, "Error saving bitmap!");
+            }
+            break;
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            break;
+    }
+
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef BITMAPEDIT_H
+#define BITMAPEDIT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ncurses.h>
+#include "analyzer.h"
+
+#define _POSIX_C_SOURCE 200809L
+
+#define BITMAP_EDITOR_LABEL_WIDTH 12    // "%10lu: " column
+#define BITMAP_EDITOR_MAX_CELLS 128     // Cells per row on very wide terminals
+
+typedef enum {
+    BITMAP_BLOCKS,              // Block bitmap of a group
+    BITMAP_INODES               // Inode bitmap of a group
+} bitmap_kind_t;
+
+typedef struct {
+    fs_info_t *fs_info;         // Filesystem information
+    bitmap_kind_t kind;         // Which bitmap of the group is open
+    uint32_t group;             // Group the bitmap belongs to
+    uint32_t bit_count;         // Bits that stand for real blocks or inodes
+    unsigned char *bitmap;      // Working copy of the bitmap block
+    unsigned char *original;    // Bitmap block as last read from or saved to disk
+    bool modified;              // Working copy differs from the original
+    bool uninit;                // Group is flagged uninitialised, the bitmap was built in memory
+    uint32_t cursor;            // Bit under the cursor
+    uint32_t top_row;           // First row shown
+    int64_t mark;               // Bit where the selection started, -1 without selection
+    uint32_t cells_per_row;     // Bits shown per row, a multiple of 8
+    uint32_t view_rows;         // Number of rows in the view
+    WINDOW *win;                // Window the editor renders into
+    char message[80];           // Result of the last action, shown in the mode line
+    bool full_redraw;           // Whole window must be repainted
+    int64_t damage_first;       // First bit whose cell must be repainted, -1 when none
+    int64_t damage_last;        // Last such bit
+} bitmap_editor_t;
+
+bitmap_editor_t *bitmap_editor_init(fs_info_t *fs_info);
+
+void bitmap_editor_cleanup(bitmap_editor_t *ed);
+
+int bitmap_editor_open(bitmap_editor_t *ed, bitmap_kind_t kind, uint32_t group);
+
+void bitmap_editor_revert(bitmap_editor_t *ed);
+
+int bitmap_editor_fill(bitmap_editor_t *ed, uint64_t first, uint64_t last, bool used);
+
+int bitmap_editor_save(bitmap_editor_t *ed);
+
+uint64_t bitmap_editor_object(const bitmap_editor_t *ed, uint32_t bit);
+
+void bitmap_editor_set_cursor(bitmap_editor_t *ed, uint32_t bit);
+
+void bitmap_editor_set_window(bitmap_editor_t *ed, WINDOW *win);
+
+void bitmap_editor_invalidate(bitmap_editor_t *ed);
+
+void bitmap_editor_render(bitmap_editor_t *ed);
+
+bool bitmap_editor_handle_key(bitmap_editor_t *ed, int key);
+
+#endif /* BITMAPEDIT_H */
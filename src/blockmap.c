@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "blockmap.h"
+#include "utils.h"
+
+typedef struct {
+    fs_info_t *fs_info;
+    blockmap_fn_t fn;           // Data runs, may be NULL
+    blockmap_node_fn_t node_fn; // Index blocks, may be NULL
+    void *arg;
+    uint64_t logical;           // Pending run not yet passed to fn
+    uint64_t physical;
+    uint32_t count;
+    bool unwritten;
+    unsigned char *buffers[BLOCKMAP_MAX_DEPTH]; // One node or indirect block per level
+} blockmap_walk_t;
+
+static int flush_run(blockmap_walk_t *w) {
+    int rc = 0;
+
+    if (w->count && w->fn) {
+        rc = w->fn(w->logical, w->physical, w->count, w->unwritten, w->arg);
+        w->count = 0;
+    }
+    return rc;
+}
+
+// Extends the pending run when the blocks follow it, otherwise hands it over and starts a new one
+static int add_run(blockmap_walk_t *w, uint64_t logical, uint64_t physical, uint32_t count, bool unwritten) {
+    if (w->count && logical == w->logical + w->count && physical == w->physical + w->count &&
+        unwritten == w->unwritten && w->count + count > w->count) {
+        w->count += count;
+        return 0;
+    }
+
+    int rc = flush_run(w);
+    w->logical = logical;
+    w->physical = physical;
+    w->count = count;
+    w->unwritten = unwritten;
+    return rc;
+}
+
+static unsigned char *level_buffer(blockmap_walk_t *w, uint32_t level) {
+    if (!w->buffers[level]) {
+        w->buffers[level] = (unsigned char *)malloc(w->fs_info->block_size);
+    }
+    return w->buffers[level];
+}
+
+static bool valid_block(const fs_info_t *fs_info, uint64_t block) {
+    return block >= fs_info->sb.s_first_data_block && block < fs_info->sb.s_blocks_count;
+}
+
+// Walks an indirect block whose pointers each cover span blocks, level 0 pointing at data
+static int walk_indirect(blockmap_walk_t *w, uint32_t block, uint32_t level, uint64_t logical, uint64_t span) {
+    uint32_t per_block = w->fs_info->block_size / 4;
+    unsigned char *buffer = level_buffer(w, level);
+
+    if (!buffer || !valid_block(w->fs_info, block) || read_block(w->fs_info, block, buffer) != 0) {
+        return -1;
+    }
+    if (w->node_fn) {
+        int rc = w->node_fn(block, buffer, w->arg);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    for (uint32_t i = 0; i < per_block; i++) {
+        uint32_t ptr;
+        memcpy(&ptr, buffer + (size_t)i * 4, 4);
+        if (ptr == 0) {
+            continue;
+        }
+
+        int rc = level == 0 ? add_run(w, logical + i, ptr, 1, false)
+                            : walk_indirect(w, ptr, level - 1, logical + (uint64_t)i * span, span / per_block);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+    return 0;
+}
+
+// Walks one extent tree node of size bytes, the root being the 60 bytes of i_block
+static int walk_extents(blockmap_walk_t *w, const unsigned char *node, uint32_t size, uint32_t level) {
+    uint16_t magic, entries, max, depth;
+
+    memcpy(&magic, node, 2);
+    memcpy(&entries, node + 2, 2);
+    memcpy(&max, node + 4, 2);
+    memcpy(&depth, node + 6, 2);
+    if (magic != BLOCKMAP_EXTENT_MAGIC || entries > max || 12 + (uint32_t)max * 12 > size ||
+        level + depth >= BLOCKMAP_MAX_DEPTH) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < entries; i++) {
+        const unsigned char *entry = node + 12 + i * 12;
+        uint32_t first, lo;
+        uint16_t hi;
+        int rc;
+
+        memcpy(&first, entry, 4);
+        if (depth == 0) {
+            uint16_t len;
+            memcpy(&len, entry + 4, 2);
+            memcpy(&hi, entry + 6, 2);
+            memcpy(&lo, entry + 8, 4);
+            bool unwritten = len > 32768;           // Uninitialized extents still own their blocks
+            len = unwritten ? len - 32768 : len;
+            rc = len ? add_run(w, first, ((uint64_t)hi << 32) | lo, len, unwritten) : 0;
+        } else {
+            memcpy(&lo, entry + 4, 4);
+            memcpy(&hi, entry + 8, 2);
+            uint64_t child = ((uint64_t)hi << 32) | lo;
+            unsigned char *buffer = level_buffer(w, level + 1);
+            if (!buffer || !valid_block(w->fs_info, child) || read_block(w->fs_info, (uint32_t)child, buffer) != 0) {
+                return -1;
+            }
+            rc = w->node_fn ? w->node_fn(child, buffer, w->arg) : 0;
+            if (rc == 0) {
+                rc = walk_extents(w, buffer, w->fs_info->block_size, level + 1);
+            }
+        }
+        if (rc != 0) {
+            return rc;
+        }
+    }
+    return 0;
+}
+
+// Whether i_block holds a block map rather than device numbers, a fast symlink target or inline data
+bool blockmap_has_blocks(const struct ext2_inode *inode) {
+    if (inode->i_flags & EXT4_INLINE_DATA_FL) {
+        return false;
+    }
+    if (S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)) {
+        return true;
+    }
+    if (S_ISLNK(inode->i_mode)) {
+        // The extended attribute block is counted in i_blocks but is not part of the map
+        uint64_t sectors = inode_block_count(inode);
+        return inode->i_file_acl ? sectors > 8 : sectors > 0;
+    }
+    return false;
+}
+
+// Reports the data blocks of an inode in logical order, merged into contiguous runs. Holes are
+// skipped and the indirect or extent index blocks themselves are not reported.
+// Returns 0 when the whole map was walked, -1 when a map block is invalid or unreadable,
+// or the first non-zero value returned by fn.
+int blockmap_walk(fs_info_t *fs_info, const struct ext2_inode *inode, blockmap_fn_t fn, void *arg) {
+    return blockmap_walk_nodes(fs_info, inode, fn, NULL, arg);
+}
+
+// Like blockmap_walk, also handing every index block to node_fn before its entries are followed
+int blockmap_walk_nodes(fs_info_t *fs_info, const struct ext2_inode *inode, blockmap_fn_t fn,
+                        blockmap_node_fn_t node_fn, void *arg) {
+    blockmap_walk_t w;
+    int rc = 0;
+
+    if (!blockmap_has_blocks(inode)) {
+        return 0;
+    }
+
+    memset(&w, 0, sizeof(w));
+    w.fs_info = fs_info;
+    w.fn = fn;
+    w.node_fn = node_fn;
+    w.arg = arg;
+
+    if (inode->i_flags & EXT4_EXTENTS_FL) {
+        rc = walk_extents(&w, (const unsigned char *)inode->i_block, sizeof(inode->i_block), 0);
+    } else {
+        uint64_t per_block = fs_info->block_size / 4;
+        uint64_t logical = EXT2_NDIR_BLOCKS;
+
+        for (uint32_t i = 0; i < EXT2_NDIR_BLOCKS && rc == 0; i++) {
+            if (inode->i_block[i]) {
+                rc = add_run(&w, i, inode->i_block[i], 1, false);
+            }
+        }
+        if (rc == 0 && inode->i_block[EXT2_IND_BLOCK]) {
+            rc = walk_indirect(&w, inode->i_block[EXT2_IND_BLOCK], 0, logical, 1);
+        }
+        logical += per_block;
+        if (rc == 0 && inode->i_block[EXT2_DIND_BLOCK]) {
+            rc = walk_indirect(&w, inode->i_block[EXT2_DIND_BLOCK], 1, logical, per_block);
+        }
+        logical += per_block * per_block;
+        if (rc == 0 && inode->i_block[EXT2_TIND_BLOCK]) {
+            rc = walk_indirect(&w, inode->i_block[EXT2_TIND_BLOCK], 2, logical, per_block * per_block);
+        }
+    }
+
+    if (rc == 0) {
+        rc = flush_run(&w);
+    }
+    for (uint32_t i = 0; i < BLOCKMAP_MAX_DEPTH; i++) {
+        free(w.buffers[i]);
+    }
+    return rc;
+}
@@ -0,0 +1,30 @@
+#ifndef BLOCKMAP_H
+#define BLOCKMAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ext2fs/ext2_fs.h>
+#include "analyzer.h"
+
+#define BLOCKMAP_EXTENT_MAGIC 0xF30A    // eh_magic of every extent tree node
+#define BLOCKMAP_MAX_DEPTH 5            // Deepest extent tree accepted
+
+// Called once per run of data blocks that are contiguous both logically and on disk. Blocks of
+// unwritten (uninitialized) extents are owned by the file but read back as zeros; they come in
+// runs of their own with unwritten set. A non-zero return stops the walk and is passed back.
+typedef int (*blockmap_fn_t)(uint64_t logical, uint64_t physical, uint32_t count, bool unwritten, void *arg);
+
+// Called once per index block read during the walk: an extent tree node below the root or an
+// indirect block, with its contents. A non-zero return stops the walk like for blockmap_fn_t.
+typedef int (*blockmap_node_fn_t)(uint64_t block, const unsigned char *data, void *arg);
+
+bool blockmap_has_blocks(const struct ext2_inode *inode);
+
+int blockmap_walk(fs_info_t *fs_info, const struct ext2_inode *inode, blockmap_fn_t fn, void *arg);
+
+int blockmap_walk_nodes(fs_info_t *fs_info, const struct ext2_inode *inode, blockmap_fn_t fn,
+                        blockmap_node_fn_t node_fn, void *arg);
+
+#endif /* BLOCKMAP_H */
@@ -0,0 +1,512 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "carve.h"
+#include "freespace.h"
+#include "parallel.h"
+#include "utils.h"
+
+// Magic bytes and their length, embedded NULs included
+#define MAGIC(s) (const unsigned char *)(s), sizeof(s) - 1
+
+typedef struct {
+    const char *name;
+    const unsigned char *magic;
+    uint32_t length;
+    uint32_t offset;            // Bytes of the file in front of the magic
+} carve_signature_t;
+
+static const carve_signature_t signatures[] = {
+    { "jpeg", MAGIC("\xFF\xD8\xFF"), 0 },
+    { "png", MAGIC("\x89PNG\r\n\x1A\n"), 0 },
+    { "gif", MAGIC("GIF8"), 0 },
+    { "pdf", MAGIC("%PDF-"), 0 },
+    { "postscript", MAGIC("%!PS"), 0 },
+    { "zip", MAGIC("PK\x03\x04"), 0 },
+    { "gzip", MAGIC("\x1F\x8B\x08"), 0 },
+    { "bzip2", MAGIC("BZh91AY&SY"), 0 },
+    { "xz", MAGIC("\xFD" "7zXZ\0"), 0 },
+    { "7z", MAGIC("7z\xBC\xAF\x27\x1C"), 0 },
+    { "rar", MAGIC("Rar!\x1A\x07"), 0 },
+    { "tar", MAGIC("ustar"), 257 },
+    { "sqlite", MAGIC("SQLite format 3\0"), 0 },
+    { "elf", MAGIC("\x7F" "ELF"), 0 },
+    { "ole", MAGIC("\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1"), 0 },
+    { "mp4", MAGIC("ftyp"), 4 },
+    { "ogg", MAGIC("OggS"), 0 },
+    { "flac", MAGIC("fLaC"), 0 },
+    { "riff", MAGIC("RIFF"), 0 },
+    { "mp3", MAGIC("ID3"), 0 },
+};
+
+#define SIGNATURE_COUNT ((uint32_t)(sizeof(signatures) / sizeof(signatures[0])))
+
+_Static_assert(sizeof(signatures) / sizeof(signatures[0]) <= CARVE_MAX_SIGNATURES, "signature mask too narrow");
+
+typedef struct {
+    uint16_t (*next)[256];      // Transition per state and byte, failure links folded in
+    uint32_t *out;              // Mask of the signatures whose magic ends in each state
+    unsigned char first[256];   // Bytes some magic starts with
+    uint32_t states;
+    uint32_t longest;           // Longest magic
+} carve_matcher_t;
+
+typedef struct {
+    uint32_t start;
+    uint32_t length;
+    uint32_t first_chunk;       // Work item of the extent's first chunk
+} carve_extent_t;
+
+typedef struct {
+    unsigned char *buffer;      // One chunk plus the bytes a magic crossing its end needs
+    carve_hit_t *hits;          // Hits of the current chunk
+    uint32_t count;
+    uint32_t capacity;
+    uint64_t dropped;
+    uint64_t counts[CARVE_MAX_SIGNATURES];
+    uint64_t aligned[CARVE_MAX_SIGNATURES];
+    uint32_t blocks;            // Free blocks in the current chunk
+    bool unreadable;
+} carve_worker_t;
+
+typedef struct {
+    fs_info_t *fs_info;
+    job_t *job;
+    carve_matcher_t matcher;
+    carve_extent_t *extents;
+    uint32_t extent_count;
+    uint32_t chunk_blocks;
+    carve_report_fn_t report;
+    void *report_arg;
+    carve_result_t *result;
+} carve_state_t;
+
+uint32_t carve_signature_count(void) {
+    return SIGNATURE_COUNT;
+}
+
+const char *carve_signature_name(uint32_t signature) {
+    return signature < SIGNATURE_COUNT ? signatures[signature].name : "?";
+}
+
+static void matcher_free(carve_matcher_t *m) {
+    free(m->next);
+    free(m->out);
+    memset(m, 0, sizeof(*m));
+}
+
+// Aho-Corasick automaton over every magic. Failure links are resolved into the transition
+// table up front, so matching costs one lookup per byte whatever the signature count.
+static int matcher_build(carve_matcher_t *m) {
+    uint32_t capacity = 1;
+
+    memset(m, 0, sizeof(*m));
+    for (uint32_t i = 0; i < SIGNATURE_COUNT; i++) {
+        capacity += signatures[i].length;
+        if (signatures[i].length > m->longest) {
+            m->longest = signatures[i].length;
+        }
+    }
+
+    m->next = (uint16_t (*)[256])calloc(capacity, sizeof(*m->next));
+    m->out = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+    uint32_t *fail = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+    uint32_t *queue = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+    if (!m->next || !m->out || !fail || !queue) {
+        free(fail);
+        free(queue);
+        matcher_free(m);
+        return -1;
+    }
+
+    m->states = 1;
+    for (uint32_t i = 0; i < SIGNATURE_COUNT; i++) {
+        uint32_t s = 0;
+        for (uint32_t j = 0; j < signatures[i].length; j++) {
+            unsigned char c = signatures[i].magic[j];
+            if (!m->next[s][c]) {
+                m->next[s][c] = (uint16_t)m->states++;
+            }
+            s = m->next[s][c];
+        }
+        m->out[s] |= 1u << i;
+        m->first[signatures[i].magic[0]] = 1;
+    }
+
+    // Breadth first, so the failure state of a state is complete before its children use it
+    uint32_t head = 0, tail = 0;
+    for (uint32_t c = 0; c < 256; c++) {
+        if (m->next[0][c]) {
+            queue[tail++] = m->next[0][c];
+        }
+    }
+    while (head < tail) {
+        uint32_t s = queue[head++];
+        for (uint32_t c = 0; c < 256; c++) {
+            uint32_t t = m->next[s][c];
+            if (t) {
+                fail[t] = m->next[fail[s]][c];
+                m->out[t] |= m->out[fail[t]];
+                queue[tail++] = t;
+            } else {
+                m->next[s][c] = m->next[fail[s]][c];
+            }
+        }
+    }
+
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+// Free extents in block order, with runs that only a group boundary split joined again
+static int load_extents(carve_state_t *st, uint32_t threads) {
+    freespace_t *fs = freespace_scan(st->fs_info, threads, st->job);
+    if (!fs) {
+        return -1;
+    }
+
+    st->extents = (carve_extent_t *)calloc(fs->extent_count ? fs->extent_count : 1, sizeof(carve_extent_t));
+    if (!st->extents) {
+        freespace_free(fs);
+        return -1;
+    }
+
+    carve_result_t *r = st->result;
+    for (uint32_t i = 0; i < fs->extent_count; i++) {
+        const free_extent_t *e = &fs->extents[i];
+        carve_extent_t *last = st->extent_count ? &st->extents[st->extent_count - 1] : NULL;
+        if (e->length == 0) {
+            continue;
+        }
+        r->free_blocks += e->length;
+        if (last && (uint64_t)last->start + last->length == e->start && last->length <= UINT32_MAX - e->length) {
+            last->length += e->length;
+        } else {
+            st->extents[st->extent_count++] = (carve_extent_t){ e->start, e->length, 0 };
+        }
+    }
+    r->extents = st->extent_count;
+    r->unreadable_bitmaps = fs->unreadable;
+    freespace_free(fs);
+    return 0;
+}
+
+// Extent holding a work item, by binary search over the first chunk of each extent
+static const carve_extent_t *find_extent(const carve_state_t *st, uint32_t item) {
+    uint32_t lo = 0, hi = st->extent_count;
+
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (st->extents[mid].first_chunk <= item) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return &st->extents[lo];
+}
+
+static int carve_worker_init(void *worker, void *arg) {
+    carve_worker_t *w = (carve_worker_t *)worker;
+    carve_state_t *st = (carve_state_t *)arg;
+
+    w->buffer = (unsigned char *)malloc((size_t)st->chunk_blocks * st->fs_info->block_size + st->matcher.longest);
+    return w->buffer ? 0 : -1;
+}
+
+// Records the signatures of matched whose magic ends at byte end of the chunk buffer
+static int record_hits(const carve_state_t *st, carve_worker_t *w, uint32_t matched, const carve_extent_t *e,
+                       uint64_t first, size_t end, size_t own) {
+    uint32_t block_size = st->fs_info->block_size;
+
+    while (matched) {
+        uint32_t sig = (uint32_t)__builtin_ctz(matched);
+        const carve_signature_t *s = &signatures[sig];
+        matched &= matched - 1;
+
+        // Magics starting past the chunk belong to the next one, files starting before the extent are allocated
+        size_t magic = end + 1 - s->length;
+        uint64_t pos = first * block_size + magic;
+        if (magic >= own || pos < (uint64_t)e->start * block_size + s->offset) {
+            continue;
+        }
+        pos -= s->offset;
+
+        w->counts[sig]++;
+        w->aligned[sig] += pos % block_size == 0;
+        if (w->count >= CARVE_MAX_HITS) {
+            w->dropped++;
+            continue;
+        }
+        if (w->count == w->capacity) {
+            uint32_t capacity = w->capacity ? w->capacity * 2 : 64;
+            carve_hit_t *hits = (carve_hit_t *)realloc(w->hits, capacity * sizeof(carve_hit_t));
+            if (!hits) {
+                return -1;
+            }
+            w->hits = hits;
+            w->capacity = capacity;
+        }
+        w->hits[w->count++] = (carve_hit_t){ pos / block_size, (uint32_t)(pos % block_size), (uint16_t)sig };
+    }
+    return 0;
+}
+
+static int carve_chunk(uint32_t item, void *worker, void *arg) {
+    carve_worker_t *w = (carve_worker_t *)worker;
+    carve_state_t *st = (carve_state_t *)arg;
+    uint32_t block_size = st->fs_info->block_size;
+
+    w->count = 0;
+    w->dropped = 0;
+    w->blocks = 0;
+    w->unreadable = false;
+    memset(w->counts, 0, sizeof(w->counts));
+    memset(w->aligned, 0, sizeof(w->aligned));
+
+    // A cancelled scan drains the remaining items without reading them
+    if (job_is_cancelled(st->job)) {
+        return 0;
+    }
+
+    const carve_extent_t *e = find_extent(st, item);
+    uint64_t first = e->start + (uint64_t)(item - e->first_chunk) * st->chunk_blocks;
+    uint64_t end = (uint64_t)e->start + e->length;
+    w->blocks = end - first < st->chunk_blocks ? (uint32_t)(end - first) : st->chunk_blocks;
+
+    // A magic starting in the last bytes of the chunk may end in the next chunk of the same extent
+    size_t own = (size_t)w->blocks * block_size;
+    size_t length = own + (first + w->blocks < end ? st->matcher.longest - 1 : 0);
+    if (read_bytes(st->fs_info, first * block_size, w->buffer, length) != 0) {
+        w->unreadable = true;
+        job_advance(st->job, w->blocks);
+        return 0;
+    }
+
+    uint16_t (*next)[256] = st->matcher.next;
+    const uint32_t *out = st->matcher.out;
+    const unsigned char *starts = st->matcher.first;
+    uint32_t state = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (state == 0) {
+            // Outside a partial match, skip bytes no magic starts with without waiting on the table
+            while (i < length && !starts[w->buffer[i]]) {
+                i++;
+            }
+            if (i == length) {
+                break;
+            }
+        }
+        state = next[state][w->buffer[i]];
+        if (out[state] && record_hits(st, w, out[state], e, first, i, own) != 0) {
+            return -1;
+        }
+    }
+
+    job_advance(st->job, w->blocks);
+    return 0;
+}
+
+// Publishes a chunk's hits in free space order
+static int carve_emit(uint32_t item, void *worker, void *arg) {
+    carve_worker_t *w = (carve_worker_t *)worker;
+    carve_state_t *st = (carve_state_t *)arg;
+    carve_result_t *r = st->result;
+    (void)item;
+
+    if (w->unreadable) {
+        r->unreadable += w->blocks;
+        return 0;
+    }
+    r->scanned += w->blocks;
+    r->dropped += w->dropped;
+    for (uint32_t i = 0; i < SIGNATURE_COUNT; i++) {
+        r->counts[i] += w->counts[i];
+        r->aligned[i] += w->aligned[i];
+    }
+
+    for (uint32_t i = 0; i < w->count; i++) {
+        if (r->hit_count < CARVE_MAX_HITS) {
+            r->hits[r->hit_count++] = w->hits[i];
+        } else {
+            r->dropped++;
+        }
+        if (st->report) {
+            st->report(&w->hits[i], st->report_arg);
+        }
+    }
+    return 0;
+}
+
+static int carve_worker_finish(void *worker, void *arg) {
+    carve_worker_t *w = (carve_worker_t *)worker;
+    carve_state_t *st = (carve_state_t *)arg;
+
+    st->result->memory += (size_t)st->chunk_blocks * st->fs_info->block_size + st->matcher.longest +
+                          (size_t)w->capacity * sizeof(carve_hit_t);
+    free(w->buffer);
+    free(w->hits);
+    return 0;
+}
+
+// Reads only the blocks the bitmaps mark free, in chunks spread over the workers, and matches
+// every signature in one pass. Memory stays at one chunk per worker plus the kept hits.
+carve_result_t *carve_scan(fs_info_t *fs_info, uint32_t threads, job_t *job, carve_report_fn_t report, void *report_arg) {
+    carve_state_t st;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(&st, 0, sizeof(st));
+    st.fs_info = fs_info;
+    st.job = job;
+    st.report = report;
+    st.report_arg = report_arg;
+    st.chunk_blocks = CARVE_CHUNK_BYTES / fs_info->block_size ? CARVE_CHUNK_BYTES / fs_info->block_size : 1;
+    st.result = (carve_result_t *)calloc(1, sizeof(carve_result_t));
+    if (!st.result || matcher_build(&st.matcher) != 0) {
+        goto fail;
+    }
+    st.result->hits = (carve_hit_t *)malloc(CARVE_MAX_HITS * sizeof(carve_hit_t));
+    if (!st.result->hits || load_extents(&st, threads) != 0 || job_is_cancelled(job)) {
+        goto fail;
+    }
+
+    uint32_t chunks = 0;
+    for (uint32_t i = 0; i < st.extent_count; i++) {
+        st.extents[i].first_chunk = chunks;
+        chunks += (st.extents[i].length + st.chunk_blocks - 1) / st.chunk_blocks;
+    }
+    st.result->memory = st.extent_count * sizeof(carve_extent_t) + CARVE_MAX_HITS * sizeof(carve_hit_t) +
+                        st.matcher.states * (sizeof(*st.matcher.next) + sizeof(uint32_t));
+
+    // Progress continues from the bitmap pass, counted in free blocks
+    job_set_total(job, fs_info->groups_count + st.result->free_blocks);
+
+    parallel_t p;
+    memset(&p, 0, sizeof(p));
+    p.items = chunks;
+    p.threads = threads;
+    p.worker_size = sizeof(carve_worker_t);
+    p.arg = &st;
+    p.init = carve_worker_init;
+    p.work = carve_chunk;
+    p.emit = carve_emit;
+    p.finish = carve_worker_finish;
+    if (chunks && parallel_run(&p) != 0) {
+        goto fail;
+    }
+    if (job_is_cancelled(job)) {
+        goto fail;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    st.result->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    matcher_free(&st.matcher);
+    free(st.extents);
+    return st.result;
+
+fail:
+    matcher_free(&st.matcher);
+    free(st.extents);
+    carve_free(st.result);
+    return NULL;
+}
+
+void carve_free(carve_result_t *result) {
+    if (!result) {
+        return;
+    }
+
+    free(result->hits);
+    free(result);
+}
+
+void carve_format_hit(const carve_hit_t *hit, char *buffer, size_t buffer_size) {
+    snprintf(buffer, buffer_size, "Block %lu offset %u: %s%s", (unsigned long)hit->block, hit->offset,
+             carve_signature_name(hit->signature), hit->offset == 0 ? "" : " (unaligned)");
+}
+
+void carve_print_summary(const carve_result_t *result, uint32_t block_size, FILE *out) {
+    char bytes[32], memory[32];
+
+    format_value(result->scanned * block_size, bytes, sizeof(bytes), true);
+    format_value(result->memory, memory, sizeof(memory), true);
+    fprintf(out, "Carved %lu of %lu free block(s) (%s) in %lu extent(s) in %.2f s, %s of buffers\n",
+            (unsigned long)result->scanned, (unsigned long)result->free_blocks, bytes, (unsigned long)result->extents,
+            result->seconds, memory);
+    if (result->unreadable) {
+        fprintf(out, "Unreadable free blocks: %lu\n", (unsigned long)result->unreadable);
+    }
+    if (result->unreadable_bitmaps) {
+        fprintf(out, "Unreadable block bitmaps, their groups were skipped: %u\n", result->unreadable_bitmaps);
+    }
+    if (result->dropped) {
+        fprintf(out, "Hits beyond the first %u were counted but not listed: %lu\n", CARVE_MAX_HITS,
+                (unsigned long)result->dropped);
+    }
+
+    fprintf(out, "\n%-12s %12s %12s\n", "Signature", "Hits", "Aligned");
+    for (uint32_t i = 0; i < SIGNATURE_COUNT; i++) {
+        if (result->counts[i]) {
+            fprintf(out, "%-12s %12lu %12lu\n", signatures[i].name, (unsigned long)result->counts[i],
+                    (unsigned long)result->aligned[i]);
+        }
+    }
+}
+
+// Makes each hit visible to the UI as soon as the scan reaches it, in the partial result of
+// the slot. Its hit array doubles from 1024 entries whenever the count reaches a power of two.
+static void carve_report_live(const carve_hit_t *hit, void *arg) {
+    job_slot_t *slot = (job_slot_t *)arg;
+
+    pthread_mutex_lock(&slot->lock);
+    carve_result_t *live = (carve_result_t *)slot->partial;
+    uint32_t count = live ? live->hit_count : 0;
+    if (live && count < CARVE_MAX_HITS && (count == 0 || (count >= 1024 && (count & (count - 1)) == 0))) {
+        uint32_t capacity = count ? count * 2 : 1024;
+        if (capacity > CARVE_MAX_HITS) {
+            capacity = CARVE_MAX_HITS;
+        }
+        carve_hit_t *hits = (carve_hit_t *)realloc(live->hits, capacity * sizeof(carve_hit_t));
+        if (hits) {
+            live->hits = hits;
+        } else {
+            live = NULL;
+        }
+    }
+    if (live && count < CARVE_MAX_HITS) {
+        live->hits[live->hit_count++] = *hit;
+    }
+    pthread_mutex_unlock(&slot->lock);
+}
+
+// Job body: carves the free space of the filesystem in the job_slot_t passed as arg, showing the
+// hits there as they are found
+int carve_job(job_t *job, void *arg) {
+    job_slot_t *slot = (job_slot_t *)arg;
+    carve_result_t *live = (carve_result_t *)calloc(1, sizeof(carve_result_t));
+
+    pthread_mutex_lock(&slot->lock);
+    slot->free_result(slot->partial);
+    slot->partial = live;
+    pthread_mutex_unlock(&slot->lock);
+
+    carve_result_t *result = carve_scan((fs_info_t *)slot->source, 0, job, carve_report_live, slot);
+
+    if (result) {
+        uint64_t hits = 0, aligned = 0;
+        for (uint32_t i = 0; i < SIGNATURE_COUNT; i++) {
+            hits += result->counts[i];
+            aligned += result->aligned[i];
+        }
+        job_printf(job, "%lu signature hit(s), %lu block aligned, in %lu free block(s), %.2f s", (unsigned long)hits,
+                   (unsigned long)aligned, (unsigned long)result->scanned, result->seconds);
+    } else {
+        job_printf(job, "%s", job_is_cancelled(job) ? "Carving cancelled" : "Carving failed");
+    }
+    // The slot owns the result from here on and a later job may free it, so this is the last use
+    job_slot_finish(slot, job, result);
+    return result || job_is_cancelled(job) ? 0 : -1;
+}
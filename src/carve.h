@@ -0,0 +1,54 @@
+#ifndef CARVE_H
+#define CARVE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "analyzer.h"
+#include "job.h"
+
+#define CARVE_MAX_SIGNATURES 32     // Signatures the matcher can report per state
+#define CARVE_CHUNK_BYTES (4u << 20) // Free space one worker reads and matches at a time
+#define CARVE_MAX_HITS 100000       // Hits kept in a result, the rest are only counted
+
+typedef struct {
+    uint64_t block;             // Block holding the first byte of the carved file
+    uint32_t offset;            // Byte of that block the file starts at
+    uint16_t signature;         // Index into the signature table
+} carve_hit_t;
+
+// Receives every hit in free space order while the scan runs
+typedef void (*carve_report_fn_t)(const carve_hit_t *hit, void *arg);
+
+typedef struct {
+    uint64_t free_blocks;       // Unallocated blocks according to the bitmaps
+    uint64_t extents;           // Free runs, merged across group boundaries
+    uint64_t scanned;           // Free blocks read and matched
+    uint64_t unreadable;        // Free blocks that could not be read
+    uint32_t unreadable_bitmaps; // Groups whose bitmap could not be read, skipped
+    uint64_t counts[CARVE_MAX_SIGNATURES];  // Hits per signature
+    uint64_t aligned[CARVE_MAX_SIGNATURES]; // Of those, starting on a block boundary
+    carve_hit_t *hits;          // First CARVE_MAX_HITS in block order
+    uint32_t hit_count;
+    uint64_t dropped;           // Hits beyond CARVE_MAX_HITS
+    size_t memory;              // Bytes of read buffers, matcher and extent list
+    double seconds;             // Wall time of the scan
+} carve_result_t;
+
+uint32_t carve_signature_count(void);
+
+const char *carve_signature_name(uint32_t signature);
+
+carve_result_t *carve_scan(fs_info_t *fs_info, uint32_t threads, job_t *job, carve_report_fn_t report, void *report_arg);
+
+void carve_free(carve_result_t *result);
+
+void carve_format_hit(const carve_hit_t *hit, char *buffer, size_t buffer_size);
+
+void carve_print_summary(const carve_result_t *result, uint32_t block_size, FILE *out);
+
+int carve_job(job_t *job, void *arg);
+
+#endif /* CARVE_H */
@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "content.h"
+#include "blockmap.h"
+#include "inodeiter.h"
+#include "parallel.h"
+#include "topn.h"
+#include "utils.h"
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#define CONTENT_HAVE_SSE2 1
+#endif
+
+typedef struct {
+    inode_iter_t it;            // Reads one group at a time
+    unsigned char *buffer;      // CONTENT_READ_BYTES of file data
+    content_counts_t *groups;   // Per group counts of this worker
+    content_result_t counts;    // Totals and histogram, lists unused
+    topn_t zero_top;            // Files with the most zero blocks seen by this worker
+    topn_t dense_top;           // Files with the most incompressible blocks
+} content_worker_t;
+
+typedef struct {
+    fs_info_t *fs_info;
+    uint32_t top;
+    uint32_t read_blocks;       // Blocks per read
+    double *xlogx;              // c * log2(c) for every count a block can hold
+    topn_t zero_top;            // Merged from the workers
+    topn_t dense_top;
+    content_result_t *result;
+} content_state_t;
+
+typedef struct {
+    const content_state_t *st;
+    content_worker_t *w;
+    content_counts_t file;      // Counts of the file being walked
+} content_walk_t;
+
+// True when every byte of the block is zero. ORs 64 bytes per step and stops at the first
+// step with a bit set, which for data blocks is almost always the first.
+static bool block_is_zero(const unsigned char *p, uint32_t size) {
+#ifdef CONTENT_HAVE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (uint32_t i = 0; i < size; i += 64) {
+        __m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i)),
+                                 _mm_loadu_si128((const __m128i *)(p + i + 16)));
+        __m128i b = _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i + 32)),
+                                 _mm_loadu_si128((const __m128i *)(p + i + 48)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(a, b), zero)) != 0xFFFF) {
+            return false;
+        }
+    }
+    return true;
+#else
+    for (uint32_t i = 0; i < size; i += 64) {
+        uint64_t w[8];
+        memcpy(w, p + i, sizeof(w));
+        if ((w[0] | w[1] | w[2] | w[3] | w[4] | w[5] | w[6] | w[7]) != 0) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+// Shannon entropy of the byte histogram in bits per byte: log2(n) - sum(c log2 c) / n.
+// Four interleaved histograms keep repeated bytes from stalling on the same counter.
+static double block_entropy(const content_state_t *st, const unsigned char *p, uint32_t size) {
+    uint32_t hist[4][256];
+    double sum = 0.0;
+
+    memset(hist, 0, sizeof(hist));
+    for (uint32_t i = 0; i < size; i += 4) {
+        hist[0][p[i]]++;
+        hist[1][p[i + 1]]++;
+        hist[2][p[i + 2]]++;
+        hist[3][p[i + 3]]++;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+        sum += st->xlogx[hist[0][b] + hist[1][b] + hist[2][b] + hist[3][b]];
+    }
+    return log2((double)size) - sum / size;
+}
+
+static void classify_block(const content_state_t *st, content_worker_t *w, content_walk_t *walk,
+                           const unsigned char *data, uint64_t block) {
+    fs_info_t *fs_info = st->fs_info;
+    uint32_t group = (uint32_t)((block - fs_info->sb.s_first_data_block) / fs_info->blocks_per_group);
+    content_counts_t *g = &w->groups[group];
+
+    walk->file.blocks++;
+    g->blocks++;
+    if (block_is_zero(data, fs_info->block_size)) {
+        walk->file.zero++;
+        g->zero++;
+        return;
+    }
+
+    double bits = block_entropy(st, data, fs_info->block_size);
+    uint64_t milli = (uint64_t)(bits * 1000.0 + 0.5);
+    uint32_t bucket = (uint32_t)(bits * 2.0);
+    w->counts.by_entropy[bucket < CONTENT_ENTROPY_BUCKETS ? bucket : CONTENT_ENTROPY_BUCKETS - 1]++;
+    walk->file.entropy_milli += milli;
+    g->entropy_milli += milli;
+    if (bits >= CONTENT_DENSE_BITS) {
+        walk->file.dense++;
+        g->dense++;
+    }
+}
+
+// Counts a run of an unwritten extent as zero blocks: they read back as zeros whatever the
+// device holds, so the stale bytes are not read
+static void count_unwritten(const content_state_t *st, content_worker_t *w, content_walk_t *walk,
+                            uint64_t physical, uint32_t count) {
+    fs_info_t *fs_info = st->fs_info;
+
+    while (count) {
+        uint64_t offset = physical - fs_info->sb.s_first_data_block;
+        uint32_t group = (uint32_t)(offset / fs_info->blocks_per_group);
+        uint32_t left = fs_info->blocks_per_group - (uint32_t)(offset % fs_info->blocks_per_group);
+        uint32_t n = count < left ? count : left;
+        content_counts_t *g = &w->groups[group];
+
+        walk->file.blocks += n;
+        walk->file.zero += n;
+        g->blocks += n;
+        g->zero += n;
+        physical += n;
+        count -= n;
+    }
+}
+
+// Reads a run of file data in CONTENT_READ_BYTES pieces and classifies every block of it
+static int classify_run(uint64_t logical, uint64_t physical, uint32_t count, bool unwritten, void *arg) {
+    content_walk_t *walk = (content_walk_t *)arg;
+    const content_state_t *st = walk->st;
+    content_worker_t *w = walk->w;
+    uint32_t block_size = st->fs_info->block_size;
+    (void)logical;
+
+    if (physical < st->fs_info->sb.s_first_data_block || physical + count > st->fs_info->sb.s_blocks_count) {
+        return -1;
+    }
+    if (unwritten) {
+        count_unwritten(st, w, walk, physical, count);
+        return 0;
+    }
+
+    while (count) {
+        uint32_t n = count < st->read_blocks ? count : st->read_blocks;
+        if (read_bytes(st->fs_info, physical * block_size, w->buffer, (size_t)n * block_size) != 0) {
+            w->counts.unreadable += n;
+        } else {
+            for (uint32_t i = 0; i < n; i++) {
+                classify_block(st, w, walk, w->buffer + (size_t)i * block_size, physical + i);
+            }
+        }
+        physical += n;
+        count -= n;
+    }
+    return 0;
+}
+
+static int content_worker_init(void *worker, void *arg) {
+    content_worker_t *w = (content_worker_t *)worker;
+    content_state_t *st = (content_state_t *)arg;
+
+    if (inode_iter_init(&w->it, st->fs_info, 0, 0, false) != 0) {
+        return -1;
+    }
+    w->buffer = (unsigned char *)malloc((size_t)st->read_blocks * st->fs_info->block_size);
+    w->groups = (content_counts_t *)calloc(st->fs_info->groups_count, sizeof(content_counts_t));
+    if (!w->buffer || !w->groups || topn_init(&w->zero_top, st->top) != 0 || topn_init(&w->dense_top, st->top) != 0) {
+        topn_free(&w->zero_top);
+        free(w->groups);
+        free(w->buffer);
+        inode_iter_cleanup(&w->it);
+        return -1;
+    }
+    return 0;
+}
+
+static int content_scan_group(uint32_t group, void *worker, void *arg) {
+    content_worker_t *w = (content_worker_t *)worker;
+    content_state_t *st = (content_state_t *)arg;
+    const struct ext2_super_block *sb = &st->fs_info->sb;
+    inode_iter_t *it = &w->it;
+    uint32_t first_ino = sb->s_rev_level ? sb->s_first_ino : EXT2_GOOD_OLD_FIRST_INO;
+    int rc;
+
+    inode_iter_reset(it, group, group + 1);
+    while ((rc = inode_iter_next(it)) > 0) {
+        for (uint32_t i = 0; i < it->count; i++) {
+            uint32_t ino = it->first_inode + i;
+            if (!inode_iter_used(it, i)) {
+                continue;
+            }
+            // Of the reserved inodes only the root directory and the journal hold plain data
+            if (ino < first_ino && ino != EXT2_ROOT_INO && ino != sb->s_journal_inum) {
+                continue;
+            }
+            const struct ext2_inode *inode = inode_iter_inode(it, i);
+            if ((!S_ISREG(inode->i_mode) && !S_ISDIR(inode->i_mode)) || inode->i_links_count == 0 ||
+                !blockmap_has_blocks(inode)) {
+                continue;
+            }
+
+            content_walk_t walk = { st, w, { 0, 0, 0, 0 } };
+            if (blockmap_walk(st->fs_info, inode, classify_run, &walk) != 0) {
+                w->counts.bad_maps++;
+            }
+            if (walk.file.blocks == 0) {
+                continue;
+            }
+            w->counts.files++;
+            // Block counts of a file fit the aux field, block numbers being 32 bits wide
+            if (walk.file.zero) {
+                topn_push(&w->zero_top, walk.file.zero, ino, (uint32_t)walk.file.blocks);
+            }
+            if (walk.file.dense) {
+                topn_push(&w->dense_top, walk.file.dense, ino, (uint32_t)walk.file.blocks);
+            }
+        }
+    }
+    if (rc < 0) {
+        w->counts.unreadable_tables++;
+    }
+    return 0;
+}
+
+static int content_worker_finish(void *worker, void *arg) {
+    content_worker_t *w = (content_worker_t *)worker;
+    content_state_t *st = (content_state_t *)arg;
+    content_result_t *r = st->result;
+
+    r->files += w->counts.files;
+    r->bad_maps += w->counts.bad_maps;
+    r->unreadable += w->counts.unreadable;
+    r->unreadable_tables += w->counts.unreadable_tables;
+    for (uint32_t b = 0; b < CONTENT_ENTROPY_BUCKETS; b++) {
+        r->by_entropy[b] += w->counts.by_entropy[b];
+    }
+    for (uint32_t g = 0; g < r->groups; g++) {
+        r->by_group[g].blocks += w->groups[g].blocks;
+        r->by_group[g].zero += w->groups[g].zero;
+        r->by_group[g].dense += w->groups[g].dense;
+        r->by_group[g].entropy_milli += w->groups[g].entropy_milli;
+    }
+    topn_merge(&st->zero_top, &w->zero_top);
+    topn_merge(&st->dense_top, &w->dense_top);
+
+    topn_free(&w->zero_top);
+    topn_free(&w->dense_top);
+    free(w->groups);
+    free(w->buffer);
+    inode_iter_cleanup(&w->it);
+    return 0;
+}
+
+static content_file_t *ranked_files(topn_t *top, uint32_t *count) {
+    uint32_t n = topn_sorted(top);
+    content_file_t *files = (content_file_t *)calloc(n ? n : 1, sizeof(content_file_t));
+
+    if (!files) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        files[i].ino = top->heap[i].id;
+        files[i].blocks = top->heap[i].aux;
+        files[i].count = top->heap[i].key;
+    }
+    *count = n;
+    return files;
+}
+
+// Reads the data blocks of every file and directory once, files spread over the workers by
+// inode group, and counts zero and incompressible blocks per file and per block group
+content_result_t *content_scan(fs_info_t *fs_info, uint32_t top, uint32_t threads, job_t *job) {
+    content_state_t st;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(&st, 0, sizeof(st));
+    st.fs_info = fs_info;
+    st.top = top;
+    st.read_blocks = CONTENT_READ_BYTES / fs_info->block_size ? CONTENT_READ_BYTES / fs_info->block_size : 1;
+    st.result = (content_result_t *)calloc(1, sizeof(content_result_t));
+    st.xlogx = (double *)malloc(((size_t)fs_info->block_size + 1) * sizeof(double));
+    if (!st.result || !st.xlogx || topn_init(&st.zero_top, top) != 0 || topn_init(&st.dense_top, top) != 0) {
+        goto fail;
+    }
+    st.result->groups = fs_info->groups_count;
+    st.result->by_group = (content_counts_t *)calloc(fs_info->groups_count ? fs_info->groups_count : 1,
+                                                     sizeof(content_counts_t));
+    if (!st.result->by_group) {
+        goto fail;
+    }
+    st.xlogx[0] = 0.0;
+    for (uint32_t c = 1; c <= fs_info->block_size; c++) {
+        st.xlogx[c] = c * log2((double)c);
+    }
+
+    parallel_t p;
+    memset(&p, 0, sizeof(p));
+    p.items = fs_info->groups_count;
+    p.threads = threads;
+    p.worker_size = sizeof(content_worker_t);
+    p.arg = &st;
+    p.job = job;
+    p.init = content_worker_init;
+    p.work = content_scan_group;
+    p.finish = content_worker_finish;
+    if (parallel_run(&p) != 0 || job_is_cancelled(job)) {
+        goto fail;
+    }
+
+    content_result_t *r = st.result;
+    for (uint32_t g = 0; g < r->groups; g++) {
+        r->total.blocks += r->by_group[g].blocks;
+        r->total.zero += r->by_group[g].zero;
+        r->total.dense += r->by_group[g].dense;
+        r->total.entropy_milli += r->by_group[g].entropy_milli;
+    }
+    r->zero_files = ranked_files(&st.zero_top, &r->zero_count);
+    r->dense_files = ranked_files(&st.dense_top, &r->dense_count);
+    if (!r->zero_files || !r->dense_files) {
+        goto fail;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    r->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    topn_free(&st.zero_top);
+    topn_free(&st.dense_top);
+    free(st.xlogx);
+    return r;
+
+fail:
+    topn_free(&st.zero_top);
+    topn_free(&st.dense_top);
+    free(st.xlogx);
+    content_free(st.result);
+    return NULL;
+}
+
+void content_free(content_result_t *result) {
+    if (!result) {
+        return;
+    }
+
+    free(result->by_group);
+    free(result->zero_files);
+    free(result->dense_files);
+    free(result);
+}
+
+// Mean entropy of the blocks that are not all zeros, in bits per byte
+double content_mean_entropy(const content_counts_t *counts) {
+    uint64_t data = counts->blocks - counts->zero;
+    return data ? (double)counts->entropy_milli / 1000.0 / (double)data : 0.0;
+}
+
+static double share(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+void content_print(const content_result_t *result, uint32_t block_size, FILE *out) {
+    const content_counts_t *t = &result->total;
+    char bytes[32], zero[32], dense[32];
+
+    format_value(t->blocks * block_size, bytes, sizeof(bytes), true);
+    format_value(t->zero * block_size, zero, sizeof(zero), true);
+    format_value(t->dense * block_size, dense, sizeof(dense), true);
+    fprintf(out, "Read %lu data block(s) (%s) of %lu file(s) in %.2f s\n", (unsigned long)t->blocks, bytes,
+            (unsigned long)result->files, result->seconds);
+    fprintf(out, "Zero: %lu block(s), %s, %.1f%%\n", (unsigned long)t->zero, zero, share(t->zero, t->blocks));
+    fprintf(out, "Incompressible (>= %.1f bits/byte): %lu block(s), %s, %.1f%%\n", CONTENT_DENSE_BITS,
+            (unsigned long)t->dense, dense, share(t->dense, t->blocks));
+    fprintf(out, "Mean entropy of the other blocks: %.2f bits/byte\n", content_mean_entropy(t));
+    if (result->bad_maps || result->unreadable || result->unreadable_tables) {
+        fprintf(out, "Unreadable block maps: %u, unreadable blocks: %lu, unreadable inode tables: %u\n",
+                result->bad_maps, (unsigned long)result->unreadable, result->unreadable_tables);
+    }
+
+    fprintf(out, "\n%-14s %12s\n", "Bits/byte", "Blocks");
+    for (uint32_t b = 0; b < CONTENT_ENTROPY_BUCKETS; b++) {
+        if (result->by_entropy[b]) {
+            fprintf(out, "%4.1f - %-7.1f %12lu\n", b / 2.0, (b + 1) / 2.0, (unsigned long)result->by_entropy[b]);
+        }
+    }
+
+    fprintf(out, "\n%-8s %12s %7s %7s %9s\n", "Group", "Blocks", "Zero%", "Dense%", "Entropy");
+    for (uint32_t g = 0; g < result->groups; g++) {
+        const content_counts_t *c = &result->by_group[g];
+        if (c->blocks) {
+            fprintf(out, "%-8u %12lu %6.1f%% %6.1f%% %9.2f\n", g, (unsigned long)c->blocks, share(c->zero, c->blocks),
+                    share(c->dense, c->blocks), content_mean_entropy(c));
+        }
+    }
+
+    fprintf(out, "\nMost zero blocks:\n%-10s %12s %12s %7s\n", "Inode", "Blocks", "Zero", "Share");
+    for (uint32_t i = 0; i < result->zero_count; i++) {
+        const content_file_t *f = &result->zero_files[i];
+        fprintf(out, "%-10u %12lu %12lu %6.1f%%\n", f->ino, (unsigned long)f->blocks, (unsigned long)f->count,
+                share(f->count, f->blocks));
+    }
+    fprintf(out, "\nMost incompressible blocks:\n%-10s %12s %12s %7s\n", "Inode", "Blocks", "Dense", "Share");
+    for (uint32_t i = 0; i < result->dense_count; i++) {
+        const content_file_t *f = &result->dense_files[i];
+        fprintf(out, "%-10u %12lu %12lu %6.1f%%\n", f->ino, (unsigned long)f->blocks, (unsigned long)f->count,
+                share(f->count, f->blocks));
+    }
+}
+
+int content_job(job_t *job, void *arg) {
+    job_slot_t *slot = (job_slot_t *)arg;
+
+    content_result_t *result = content_scan((fs_info_t *)slot->source, slot->top, 0, job);
+
+    if (result) {
+        const content_counts_t *t = &result->total;
+        job_printf(job, "%lu block(s): %.1f%% zero, %.1f%% incompressible, %.2f bits/byte, %.2f s",
+                   (unsigned long)t->blocks, share(t->zero, t->blocks), share(t->dense, t->blocks),
+                   content_mean_entropy(t), result->seconds);
+    } else {
+        job_printf(job, "%s", job_is_cancelled(job) ? "Content scan cancelled" : "Content scan failed");
+    }
+    // The slot owns the result from here on and a later job may free it, so this is the last use
+    job_slot_finish(slot, job, result);
+    return result || job_is_cancelled(job) ? 0 : -1;
+}
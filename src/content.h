@@ -0,0 +1,56 @@
+#ifndef CONTENT_H
+#define CONTENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "analyzer.h"
+#include "job.h"
+
+#define CONTENT_DEFAULT_TOP 20          // Files listed per ranking unless asked otherwise
+#define CONTENT_ENTROPY_BUCKETS 16      // Half a bit per byte each, 0 to 8
+#define CONTENT_DENSE_BITS 7.5          // Entropy from which a block counts as incompressible
+#define CONTENT_READ_BYTES (1u << 20)   // File data read per request
+
+typedef struct {
+    uint64_t blocks;            // Data blocks read
+    uint64_t zero;              // Of those, holding only zero bytes
+    uint64_t dense;             // Of those, at or above CONTENT_DENSE_BITS
+    uint64_t entropy_milli;     // Sum of the block entropies in thousandths of a bit per byte
+} content_counts_t;
+
+typedef struct {
+    uint32_t ino;
+    uint64_t blocks;            // Data blocks of the file
+    uint64_t count;             // Zero or incompressible blocks, after the ranking
+} content_file_t;
+
+typedef struct {
+    content_counts_t total;
+    uint64_t by_entropy[CONTENT_ENTROPY_BUCKETS]; // Non-zero blocks per entropy bucket
+    uint64_t files;             // Files and directories read
+    uint32_t bad_maps;          // Block maps that could not be followed
+    uint64_t unreadable;        // Blocks that could not be read
+    uint32_t unreadable_tables; // Groups whose inode bitmap or table could not be read, not scanned further
+    uint32_t groups;
+    content_counts_t *by_group; // Per group of the block, not of the inode
+    content_file_t *zero_files; // Most zero blocks first
+    uint32_t zero_count;
+    content_file_t *dense_files; // Most incompressible blocks first
+    uint32_t dense_count;
+    double seconds;             // Wall time of the scan
+} content_result_t;
+
+content_result_t *content_scan(fs_info_t *fs_info, uint32_t top, uint32_t threads, job_t *job);
+
+void content_free(content_result_t *result);
+
+double content_mean_entropy(const content_counts_t *counts);
+
+void content_print(const content_result_t *result, uint32_t block_size, FILE *out);
+
+int content_job(job_t *job, void *arg);
+
+#endif /* CONTENT_H */
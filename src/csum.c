@@ -0,0 +1,803 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "csum.h"
+#include "blockmap.h"
+#include "inodeiter.h"
+#include "parallel.h"
+#include "utils.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define CSUM_HAVE_SSE42 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78u     // Castagnoli, reflected
+#define CRC16_POLY 0xA001u          // CRC-16/ARC, reflected
+
+#define DESC_BLOCK_CSUM_HI_END 0x3A // Descriptor sizes from which the bitmap checksums have high halves
+#define DESC_INODE_CSUM_HI_END 0x3C
+#define INODE_CSUM_HI_EXTRA 4       // i_extra_isize from which inodes have i_checksum_hi
+#define DIR_TAIL_SIZE 12            // Fake entry at the end of a leaf block holding its checksum
+#define DIR_TAIL_FT 0xDE
+#define DX_TAIL_SIZE 8              // dt_reserved and dt_checksum after the htree node entries
+
+typedef uint32_t (*crc32c_fn_t)(uint32_t crc, const uint8_t *p, size_t length);
+
+static pthread_once_t csum_once = PTHREAD_ONCE_INIT;
+static uint32_t crc32c_table[8][256];
+static uint16_t crc16_table[256];
+static crc32c_fn_t crc32c_impl;
+static const char *crc32c_name;
+
+// Slicing-by-8: eight table lookups per 8 bytes instead of one per byte
+static uint32_t crc32c_sliced(uint32_t crc, const uint8_t *p, size_t length) {
+    while (length && ((uintptr_t)p & 7)) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        length--;
+    }
+    while (length >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        v ^= crc;
+        crc = crc32c_table[7][v & 0xFF] ^ crc32c_table[6][(v >> 8) & 0xFF] ^
+              crc32c_table[5][(v >> 16) & 0xFF] ^ crc32c_table[4][(v >> 24) & 0xFF] ^
+              crc32c_table[3][(v >> 32) & 0xFF] ^ crc32c_table[2][(v >> 40) & 0xFF] ^
+              crc32c_table[1][(v >> 48) & 0xFF] ^ crc32c_table[0][v >> 56];
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CSUM_HAVE_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t length) {
+    uint64_t c = crc;
+
+    while (length && ((uintptr_t)p & 7)) {
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+        length--;
+    }
+    while (length >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+    }
+    return (uint32_t)c;
+}
+#endif
+
+static void csum_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        uint16_t h = (uint16_t)i;
+        for (int b = 0; b < 8; b++) {
+            c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+            h = h & 1 ? (uint16_t)((h >> 1) ^ CRC16_POLY) : (uint16_t)(h >> 1);
+        }
+        crc32c_table[0][i] = c;
+        crc16_table[i] = h;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            uint32_t prev = crc32c_table[k - 1][i];
+            crc32c_table[k][i] = (prev >> 8) ^ crc32c_table[0][prev & 0xFF];
+        }
+    }
+
+    crc32c_impl = crc32c_sliced;
+    crc32c_name = "table";
+#ifdef CSUM_HAVE_SSE42
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_impl = crc32c_sse42;
+        crc32c_name = "sse4.2";
+    }
+#endif
+}
+
+// Raw crc32c update as ext4 uses it: no inversion on the way in or out
+uint32_t csum_crc32c(uint32_t crc, const void *data, size_t length) {
+    pthread_once(&csum_once, csum_init);
+    return crc32c_impl(crc, (const uint8_t *)data, length);
+}
+
+uint16_t csum_crc16(uint16_t crc, const void *data, size_t length) {
+    const uint8_t *p = (const uint8_t *)data;
+
+    pthread_once(&csum_once, csum_init);
+    while (length--) {
+        crc = (uint16_t)((crc >> 8) ^ crc16_table[(crc ^ *p++) & 0xFF]);
+    }
+    return crc;
+}
+
+const char *csum_engine(void) {
+    pthread_once(&csum_once, csum_init);
+    return crc32c_name;
+}
+
+static bool has_metadata_csum(const struct ext2_super_block *sb) {
+    return sb->s_feature_ro_compat & EXT4_FEATURE_RO_COMPAT_METADATA_CSUM;
+}
+
+static bool has_gdt_csum(const struct ext2_super_block *sb) {
+    return sb->s_feature_ro_compat & EXT4_FEATURE_RO_COMPAT_GDT_CSUM;
+}
+
+bool csum_enabled(const struct ext2_super_block *sb) {
+    return has_metadata_csum(sb) || has_gdt_csum(sb);
+}
+
+const char *csum_kind_name(csum_kind_t kind) {
+    switch (kind) {
+        case CSUM_SUPERBLOCK:   return "Superblock";
+        case CSUM_GROUP_DESC:   return "Group descriptor";
+        case CSUM_BLOCK_BITMAP: return "Block bitmap";
+        case CSUM_INODE_BITMAP: return "Inode bitmap";
+        case CSUM_INODE:        return "Inode";
+        case CSUM_EXTENT_BLOCK: return "Extent block";
+        case CSUM_DIR_BLOCK:    return "Directory block";
+        default:                return "Unknown";
+    }
+}
+
+static uint32_t fs_seed(const struct ext2_super_block *sb) {
+    if (sb->s_feature_incompat & EXT4_FEATURE_INCOMPAT_CSUM_SEED) {
+        return sb->s_checksum_seed;
+    }
+    return csum_crc32c(~0u, sb->s_uuid, sizeof(sb->s_uuid));
+}
+
+static uint16_t get16(const uint8_t *p, size_t at) {
+    uint16_t v;
+    memcpy(&v, p + at, 2);
+    return v;
+}
+
+static uint32_t get32(const uint8_t *p, size_t at) {
+    uint32_t v;
+    memcpy(&v, p + at, 4);
+    return v;
+}
+
+static void put16(uint8_t *p, size_t at, uint16_t v) {
+    memcpy(p + at, &v, 2);
+}
+
+// crc32c of length bytes with the 2-byte field at hole treated as zero
+static uint32_t crc32c_skip(uint32_t crc, const uint8_t *p, size_t length, size_t hole) {
+    static const uint8_t zero[2];
+
+    crc = csum_crc32c(crc, p, hole);
+    crc = csum_crc32c(crc, zero, 2);
+    return csum_crc32c(crc, p + hole + 2, length - hole - 2);
+}
+
+static uint32_t superblock_csum(const struct ext2_super_block *sb) {
+    return csum_crc32c(~0u, sb, offsetof(struct ext2_super_block, s_checksum));
+}
+
+static uint16_t group_desc_csum(const struct ext2_super_block *sb, uint32_t seed, uint32_t group, const uint8_t *desc,
+                                uint32_t size) {
+    size_t hole = offsetof(struct ext2_group_desc, bg_checksum);
+
+    if (has_metadata_csum(sb)) {
+        uint32_t crc = csum_crc32c(seed, &group, 4);
+        return (uint16_t)(crc32c_skip(crc, desc, size, hole) & 0xFFFF);
+    }
+
+    uint16_t crc = csum_crc16(0xFFFF, sb->s_uuid, sizeof(sb->s_uuid));
+    crc = csum_crc16(crc, &group, 4);
+    crc = csum_crc16(crc, desc, hole);
+    if (size > hole + 2) {
+        crc = csum_crc16(crc, desc + hole + 2, size - hole - 2);
+    }
+    return crc;
+}
+
+// Seed for the blocks an inode owns: the filesystem seed extended with its number and generation
+static uint32_t inode_seed(uint32_t seed, uint32_t ino, const uint8_t *raw) {
+    uint32_t crc = csum_crc32c(seed, &ino, 4);
+    return csum_crc32c(crc, raw + offsetof(struct ext2_inode, i_generation), 4);
+}
+
+static bool inode_has_csum_hi(const uint8_t *raw, uint32_t inode_size) {
+    return inode_size > EXT2_GOOD_OLD_INODE_SIZE &&
+           get16(raw, offsetof(struct ext2_inode_large, i_extra_isize)) >= INODE_CSUM_HI_EXTRA;
+}
+
+static uint32_t inode_stored_csum(const uint8_t *raw, uint32_t inode_size) {
+    uint32_t lo = get16(raw, offsetof(struct ext2_inode, osd2.linux2.l_i_checksum_lo));
+    if (!inode_has_csum_hi(raw, inode_size)) {
+        return lo;
+    }
+    return lo | (uint32_t)get16(raw, offsetof(struct ext2_inode_large, i_checksum_hi)) << 16;
+}
+
+static uint32_t inode_csum(uint32_t seed, uint32_t ino, const uint8_t *raw, uint32_t inode_size) {
+    size_t lo = offsetof(struct ext2_inode, osd2.linux2.l_i_checksum_lo);
+    size_t hi = offsetof(struct ext2_inode_large, i_checksum_hi);
+    uint32_t crc = inode_seed(seed, ino, raw);
+
+    if (!inode_has_csum_hi(raw, inode_size)) {
+        return crc32c_skip(crc, raw, inode_size, lo) & 0xFFFF;
+    }
+    crc = crc32c_skip(crc, raw, hi, lo);
+    return crc32c_skip(crc, raw + hi, inode_size - hi, 0);
+}
+
+// Bitmap checksums live in the descriptor, split in halves when it is large enough
+static uint32_t bitmap_stored_csum(const uint8_t *desc, uint32_t size, bool blocks) {
+    uint32_t lo = get16(desc, blocks ? offsetof(struct ext4_group_desc, bg_block_bitmap_csum_lo)
+                                     : offsetof(struct ext4_group_desc, bg_inode_bitmap_csum_lo));
+    if (size < (blocks ? DESC_BLOCK_CSUM_HI_END : DESC_INODE_CSUM_HI_END)) {
+        return lo;
+    }
+    return lo | (uint32_t)get16(desc, blocks ? offsetof(struct ext4_group_desc, bg_block_bitmap_csum_hi)
+                                             : offsetof(struct ext4_group_desc, bg_inode_bitmap_csum_hi)) << 16;
+}
+
+static uint32_t bitmap_csum(uint32_t seed, const uint8_t *bitmap, uint32_t bytes, uint32_t size, bool blocks) {
+    uint32_t crc = csum_crc32c(seed, bitmap, bytes);
+    return size < (blocks ? DESC_BLOCK_CSUM_HI_END : DESC_INODE_CSUM_HI_END) ? crc & 0xFFFF : crc;
+}
+
+static void bitmap_store_csum(uint8_t *desc, uint32_t size, bool blocks, uint32_t crc) {
+    put16(desc, blocks ? offsetof(struct ext4_group_desc, bg_block_bitmap_csum_lo)
+                       : offsetof(struct ext4_group_desc, bg_inode_bitmap_csum_lo), (uint16_t)crc);
+    if (size >= (blocks ? DESC_BLOCK_CSUM_HI_END : DESC_INODE_CSUM_HI_END)) {
+        put16(desc, blocks ? offsetof(struct ext4_group_desc, bg_block_bitmap_csum_hi)
+                           : offsetof(struct ext4_group_desc, bg_inode_bitmap_csum_hi), (uint16_t)(crc >> 16));
+    }
+}
+
+// Where the checksum of an extent tree node sits, 0 when eh_max leaves no room for it
+static uint32_t extent_tail(const uint8_t *node, uint32_t block_size) {
+    uint32_t tail = 12 + (uint32_t)get16(node, 4) * 12;
+    return tail + 4 <= block_size ? tail : 0;
+}
+
+// Offset of the htree count/limit pair in a directory block, 0 when the block is not an htree node
+static uint32_t dx_count_offset(const uint8_t *block, uint32_t block_size) {
+    uint16_t rec_len = get16(block, 4);
+
+    if (rec_len == block_size && block[6] == 0) {
+        return 8;
+    }
+    if (rec_len == 12 && get16(block, 16) == block_size - 12 && get32(block, 24) == 0 && block[29] == 8) {
+        return 32;
+    }
+    return 0;
+}
+
+// Checks a directory block: leaf blocks end in a fake entry holding the checksum, htree nodes keep
+// theirs after the last possible index entry. Returns 1 when it matches, 0 when it does not and
+// -1 when the block has no room for one.
+static int dir_block_csum(uint32_t iseed, const uint8_t *block, uint32_t block_size, uint32_t *stored,
+                          uint32_t *computed) {
+    const uint8_t *tail = block + block_size - DIR_TAIL_SIZE;
+
+    if (get32(tail, 0) == 0 && get16(tail, 4) == DIR_TAIL_SIZE && tail[6] == 0 && tail[7] == DIR_TAIL_FT) {
+        *stored = get32(tail, 8);
+        *computed = csum_crc32c(iseed, block, block_size - DIR_TAIL_SIZE);
+        return *stored == *computed;
+    }
+
+    static const uint32_t zero;
+    uint32_t at = dx_count_offset(block, block_size);
+    if (at == 0) {
+        return -1;
+    }
+    uint32_t limit = get16(block, at), count = get16(block, at + 2);
+    uint32_t dx_tail = at + limit * 8;
+    if (count > limit || dx_tail + DX_TAIL_SIZE > block_size) {
+        return -1;
+    }
+    uint32_t crc = csum_crc32c(iseed, block, at + count * 8);
+    *stored = get32(block, dx_tail + 4);
+    crc = csum_crc32c(crc, block + dx_tail, 4);
+    *computed = csum_crc32c(crc, &zero, 4);
+    return *stored == *computed;
+}
+
+typedef struct {
+    inode_iter_t it;            // Reads one group at a time
+    uint8_t *block;             // Scratch block for bitmaps and directory blocks
+    csum_count_t counts[CSUM_KINDS];
+    uint64_t unreadable;
+    csum_error_t *errors;       // Mismatches of the current group, handed over in emit
+    uint32_t error_count;
+    uint32_t error_capacity;
+    uint32_t group;             // Context of the block map walk
+    uint32_t ino;
+    uint32_t iseed;
+    bool failed;                // Out of memory
+} csum_worker_t;
+
+typedef struct {
+    fs_info_t *fs_info;
+    uint8_t *descs;             // Raw descriptor table
+    uint32_t desc_size;
+    csum_report_t *report;
+    job_t *job;
+} csum_state_t;
+
+static void record(csum_worker_t *w, csum_kind_t kind, uint64_t block, uint32_t stored, uint32_t computed) {
+    w->counts[kind].checked++;
+    if (stored == computed) {
+        return;
+    }
+
+    w->counts[kind].bad++;
+    if (w->error_count == w->error_capacity) {
+        uint32_t capacity = w->error_capacity ? w->error_capacity * 2 : 16;
+        csum_error_t *errors = (csum_error_t *)realloc(w->errors, capacity * sizeof(csum_error_t));
+        if (!errors) {
+            w->failed = true;
+            return;
+        }
+        w->errors = errors;
+        w->error_capacity = capacity;
+    }
+    w->errors[w->error_count++] = (csum_error_t){ kind, w->group, kind >= CSUM_INODE ? w->ino : 0, block, stored, computed };
+}
+
+static int check_extent_node(uint64_t block, const unsigned char *data, void *arg) {
+    csum_worker_t *w = (csum_worker_t *)arg;
+    uint32_t block_size = w->it.fs_info->block_size;
+
+    if (get16(data, 0) != BLOCKMAP_EXTENT_MAGIC) {
+        return 0;
+    }
+    uint32_t tail = extent_tail(data, block_size);
+    if (tail == 0) {
+        w->counts[CSUM_EXTENT_BLOCK].missing++;
+        return 0;
+    }
+    record(w, CSUM_EXTENT_BLOCK, block, get32(data, tail), csum_crc32c(w->iseed, data, tail));
+    return w->failed ? -1 : 0;
+}
+
+static int check_dir_run(uint64_t logical, uint64_t physical, uint32_t count, bool unwritten, void *arg) {
+    csum_worker_t *w = (csum_worker_t *)arg;
+    fs_info_t *fs_info = w->it.fs_info;
+    (void)logical;
+    (void)unwritten;
+
+    for (uint32_t b = 0; b < count; b++) {
+        uint32_t stored, computed;
+        if (read_block(fs_info, (uint32_t)(physical + b), w->block) != 0) {
+            w->unreadable++;
+            continue;
+        }
+        int rc = dir_block_csum(w->iseed, w->block, fs_info->block_size, &stored, &computed);
+        if (rc < 0) {
+            w->counts[CSUM_DIR_BLOCK].missing++;
+        } else {
+            record(w, CSUM_DIR_BLOCK, physical + b, stored, computed);
+        }
+    }
+    return w->failed ? -1 : 0;
+}
+
+static int csum_worker_init(void *worker, void *arg) {
+    csum_worker_t *w = (csum_worker_t *)worker;
+    csum_state_t *st = (csum_state_t *)arg;
+
+    if (inode_iter_init(&w->it, st->fs_info, 0, 0, false) != 0) {
+        return -1;
+    }
+    w->block = (uint8_t *)malloc(st->fs_info->block_size);
+    if (!w->block) {
+        inode_iter_cleanup(&w->it);
+        return -1;
+    }
+    return 0;
+}
+
+static void check_bitmap(csum_worker_t *w, csum_state_t *st, uint32_t group, const uint8_t *desc, bool blocks) {
+    fs_info_t *fs_info = st->fs_info;
+    uint32_t seed = st->report->seed;
+    uint32_t bytes = (blocks ? fs_info->blocks_per_group : fs_info->inodes_per_group) / 8;
+    int rc = blocks ? get_block_bitmap(fs_info, group, w->block) : get_inode_bitmap(fs_info, group, w->block);
+
+    if (rc != 0) {
+        w->unreadable++;
+        return;
+    }
+    record(w, blocks ? CSUM_BLOCK_BITMAP : CSUM_INODE_BITMAP,
+           blocks ? fs_info->group_desc[group].bg_block_bitmap : fs_info->group_desc[group].bg_inode_bitmap,
+           bitmap_stored_csum(desc, st->desc_size, blocks), bitmap_csum(seed, w->block, bytes, st->desc_size, blocks));
+}
+
+// Verifies everything a group holds: its descriptor, both bitmaps, the allocated inodes and the
+// extent tree and directory blocks those inodes own
+static int csum_scan_group(uint32_t group, void *worker, void *arg) {
+    csum_worker_t *w = (csum_worker_t *)worker;
+    csum_state_t *st = (csum_state_t *)arg;
+    fs_info_t *fs_info = st->fs_info;
+    const csum_report_t *report = st->report;
+    const uint8_t *desc = st->descs + (size_t)group * st->desc_size;
+    uint16_t flags = fs_info->group_desc[group].bg_flags;
+    uint32_t inode_size = w->it.inode_size;
+    inode_iter_t *it = &w->it;
+    int rc;
+
+    w->error_count = 0;
+    w->group = group;
+    w->ino = 0;
+    record(w, CSUM_GROUP_DESC, group_desc_offset(fs_info, group) / fs_info->block_size,
+           get16(desc, offsetof(struct ext2_group_desc, bg_checksum)),
+           group_desc_csum(&fs_info->sb, report->seed, group, desc, st->desc_size));
+    if (!report->metadata_csum) {
+        return w->failed ? -1 : 0;
+    }
+
+    if (!(flags & EXT2_BG_BLOCK_UNINIT)) {
+        check_bitmap(w, st, group, desc, true);
+    }
+    if (!(flags & EXT2_BG_INODE_UNINIT)) {
+        check_bitmap(w, st, group, desc, false);
+    }
+
+    inode_iter_reset(it, group, group + 1);
+    while ((rc = inode_iter_next(it)) > 0) {
+        for (uint32_t i = 0; i < it->count; i++) {
+            if (!inode_iter_used(it, i)) {
+                continue;
+            }
+            const struct ext2_inode *inode = inode_iter_inode(it, i);
+            const uint8_t *raw = (const uint8_t *)inode;
+            uint32_t ino = it->first_inode + i;
+            uint64_t block = fs_info->group_desc[group].bg_inode_table +
+                             (uint64_t)(it->first_index + i) * inode_size / fs_info->block_size;
+
+            w->ino = ino;
+            w->iseed = inode_seed(report->seed, ino, raw);
+            record(w, CSUM_INODE, block, inode_stored_csum(raw, inode_size),
+                   inode_csum(report->seed, ino, raw, inode_size));
+
+            bool extents = (inode->i_flags & EXT4_EXTENTS_FL) != 0;
+            bool dir = S_ISDIR(inode->i_mode);
+            if ((extents || dir) && blockmap_has_blocks(inode) &&
+                blockmap_walk_nodes(fs_info, inode, dir ? check_dir_run : NULL, extents ? check_extent_node : NULL, w) != 0) {
+                if (w->failed) {
+                    return -1;
+                }
+                w->unreadable++;
+            }
+        }
+    }
+    if (rc < 0) {
+        w->unreadable++;
+    }
+    return w->failed ? -1 : 0;
+}
+
+// Keeps the first mismatches in group order and streams them to the job as they come
+static int csum_emit(uint32_t group, void *worker, void *arg) {
+    csum_worker_t *w = (csum_worker_t *)worker;
+    csum_state_t *st = (csum_state_t *)arg;
+    csum_report_t *r = st->report;
+    (void)group;
+
+    for (uint32_t i = 0; i < w->error_count; i++) {
+        if (r->error_count == CSUM_MAX_ERRORS) {
+            r->dropped += w->error_count - i;
+            break;
+        }
+        r->errors[r->error_count] = w->errors[i];
+        if (st->job) {
+            char line[128];
+            csum_format_error(&r->errors[r->error_count], line, sizeof(line));
+            job_printf(st->job, "%s", line);
+        }
+        r->error_count++;
+    }
+    return 0;
+}
+
+static int csum_worker_finish(void *worker, void *arg) {
+    csum_worker_t *w = (csum_worker_t *)worker;
+    csum_state_t *st = (csum_state_t *)arg;
+    csum_report_t *r = st->report;
+
+    for (int k = 0; k < CSUM_KINDS; k++) {
+        r->counts[k].checked += w->counts[k].checked;
+        r->counts[k].bad += w->counts[k].bad;
+        r->counts[k].missing += w->counts[k].missing;
+    }
+    r->unreadable += w->unreadable;
+
+    free(w->errors);
+    free(w->block);
+    inode_iter_cleanup(&w->it);
+    return 0;
+}
+
+// Verifies the checksums of all metadata on the group pool. Without metadata_csum only the
+// group descriptors carry checksums; without either feature nothing is checked.
+csum_report_t *csum_audit(fs_info_t *fs_info, uint32_t threads, job_t *job) {
+    csum_report_t *r = (csum_report_t *)calloc(1, sizeof(csum_report_t));
+    csum_state_t st;
+    struct timespec start, end;
+
+    if (!r) {
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(&st, 0, sizeof(st));
+    r->metadata_csum = has_metadata_csum(&fs_info->sb);
+    r->gdt_csum = has_gdt_csum(&fs_info->sb);
+    r->engine = csum_engine();
+    if (!r->metadata_csum && !r->gdt_csum) {
+        return r;
+    }
+
+    r->seed = fs_seed(&fs_info->sb);
+    r->errors = (csum_error_t *)malloc(CSUM_MAX_ERRORS * sizeof(csum_error_t));
+    st.fs_info = fs_info;
+    st.report = r;
+    st.job = job;
+    st.desc_size = fs_info->desc_size;
+    st.descs = (uint8_t *)malloc((size_t)fs_info->groups_count * st.desc_size);
+    if (!r->errors || !st.descs ||
+        read_bytes(fs_info, group_desc_offset(fs_info, 0), st.descs, (size_t)fs_info->groups_count * st.desc_size) != 0) {
+        goto fail;
+    }
+
+    if (r->metadata_csum) {
+        struct ext2_super_block sb;
+        r->counts[CSUM_SUPERBLOCK].checked++;
+        if (read_bytes(fs_info, 1024, &sb, sizeof(sb)) != 0) {
+            r->unreadable++;
+        } else if (superblock_csum(&sb) != sb.s_checksum) {
+            r->counts[CSUM_SUPERBLOCK].bad++;
+            r->errors[r->error_count++] = (csum_error_t){ CSUM_SUPERBLOCK, 0, 0, 1024 / fs_info->block_size,
+                                                          sb.s_checksum, superblock_csum(&sb) };
+            if (job) {
+                char line[128];
+                csum_format_error(&r->errors[0], line, sizeof(line));
+                job_printf(job, "%s", line);
+            }
+        }
+    }
+
+    parallel_t p;
+    memset(&p, 0, sizeof(p));
+    p.items = fs_info->groups_count;
+    p.threads = threads;
+    p.worker_size = sizeof(csum_worker_t);
+    p.arg = &st;
+    p.job = job;
+    p.init = csum_worker_init;
+    p.work = csum_scan_group;
+    p.emit = csum_emit;
+    p.finish = csum_worker_finish;
+    if (parallel_run(&p) != 0 || job_is_cancelled(job)) {
+        goto fail;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    r->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    free(st.descs);
+    return r;
+
+fail:
+    free(st.descs);
+    csum_free(r);
+    return NULL;
+}
+
+void csum_free(csum_report_t *report) {
+    if (!report) {
+        return;
+    }
+
+    free(report->errors);
+    free(report);
+}
+
+void csum_format_error(const csum_error_t *error, char *buffer, size_t buffer_size) {
+    int n = snprintf(buffer, buffer_size, "%s", csum_kind_name(error->kind));
+
+    if (n >= 0 && (size_t)n < buffer_size) {
+        if (error->ino) {
+            n += snprintf(buffer + n, buffer_size - n, " of inode %u", error->ino);
+        } else if (error->kind != CSUM_SUPERBLOCK) {
+            n += snprintf(buffer + n, buffer_size - n, " of group %u", error->group);
+        }
+    }
+    if (n >= 0 && (size_t)n < buffer_size) {
+        snprintf(buffer + n, buffer_size - n, " at block %lu: stored 0x%08x, computed 0x%08x",
+                 (unsigned long)error->block, error->stored, error->computed);
+    }
+}
+
+void csum_print(const csum_report_t *report, FILE *out) {
+    char line[128];
+
+    if (!report->metadata_csum && !report->gdt_csum) {
+        fprintf(out, "Neither metadata_csum nor gdt_csum is enabled, nothing to verify\n");
+        return;
+    }
+
+    if (report->metadata_csum) {
+        fprintf(out, "Checksums: metadata_csum, crc32c engine %s, seed 0x%08x, %.2f s\n", report->engine,
+                report->seed, report->seconds);
+    } else {
+        fprintf(out, "Checksums: gdt_csum, %.2f s\n", report->seconds);
+    }
+    fprintf(out, "%-18s %12s %10s %10s\n", "Structure", "Checked", "Bad", "No room");
+    for (int k = 0; k < CSUM_KINDS; k++) {
+        const csum_count_t *c = &report->counts[k];
+        if (c->checked || c->missing) {
+            fprintf(out, "%-18s %12lu %10lu %10lu\n", csum_kind_name((csum_kind_t)k), (unsigned long)c->checked,
+                    (unsigned long)c->bad, (unsigned long)c->missing);
+        }
+    }
+    if (report->unreadable) {
+        fprintf(out, "Unreadable structures: %lu\n", (unsigned long)report->unreadable);
+    }
+
+    for (uint32_t i = 0; i < report->error_count; i++) {
+        csum_format_error(&report->errors[i], line, sizeof(line));
+        fprintf(out, "%s\n", line);
+    }
+    if (report->dropped) {
+        fprintf(out, "... and %lu more mismatch(es)\n", (unsigned long)report->dropped);
+    }
+}
+
+static bool txn_touches(const txn_t *txn, uint32_t writes, uint64_t offset, uint64_t length) {
+    for (uint32_t i = 0; i < writes; i++) {
+        if (txn->writes[i].offset < offset + length && offset < txn->writes[i].offset + txn->writes[i].length) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Stages fresh checksums for every inode of the table range [first, last] that the first writes touch
+static int stage_inode_csums(txn_t *txn, uint32_t writes, uint32_t seed) {
+    fs_info_t *fs_info = txn->fs_info;
+    uint32_t inode_size = fs_info->sb.s_inode_size;
+    uint64_t table_bytes = (uint64_t)fs_info->inodes_per_group * inode_size;
+    uint8_t *raw = (uint8_t *)malloc(inode_size);
+    size_t lo = offsetof(struct ext2_inode, osd2.linux2.l_i_checksum_lo);
+    size_t hi = offsetof(struct ext2_inode_large, i_checksum_hi);
+    int rc = 0;
+
+    if (!raw) {
+        return -1;
+    }
+    for (uint32_t g = 0; g < fs_info->groups_count && rc == 0; g++) {
+        uint64_t table = (uint64_t)fs_info->group_desc[g].bg_inode_table * fs_info->block_size;
+        for (uint32_t i = 0; i < writes && rc == 0; i++) {
+            const txn_write_t *w = &txn->writes[i];
+            if (w->offset >= table + table_bytes || w->offset + w->length <= table) {
+                continue;
+            }
+            uint64_t first = w->offset > table ? (w->offset - table) / inode_size : 0;
+            uint64_t end = w->offset + w->length < table + table_bytes ? w->offset + w->length - table : table_bytes;
+            for (uint64_t index = first; index * inode_size < end && rc == 0; index++) {
+                uint32_t ino = g * fs_info->inodes_per_group + (uint32_t)index + 1;
+                uint64_t at = table + index * inode_size;
+                rc = txn_read(txn, at, raw, inode_size);
+                if (rc == 0) {
+                    uint32_t crc = inode_csum(seed, ino, raw, inode_size);
+                    put16(raw, lo, (uint16_t)crc);
+                    if (inode_has_csum_hi(raw, inode_size)) {
+                        put16(raw, hi, (uint16_t)(crc >> 16));
+                    }
+                    rc = txn_stage(txn, at, raw, inode_size);
+                }
+            }
+        }
+    }
+    free(raw);
+    return rc;
+}
+
+// Adds writes to a transaction that bring every checksum covering what it changes up to date:
+// inodes, bitmaps, group descriptors and the superblock. Extent tree and directory blocks are
+// left alone since their owner is not known from the bytes written. Does nothing when the
+// filesystem carries no checksums.
+int csum_stage_updates(txn_t *txn) {
+    fs_info_t *fs_info = txn->fs_info;
+    struct ext2_super_block sb;
+    uint32_t writes = txn->count;
+
+    if (txn_read(txn, 1024, &sb, sizeof(sb)) != 0) {
+        return -1;
+    }
+    if (!csum_enabled(&sb) || writes == 0) {
+        return 0;
+    }
+
+    bool meta = has_metadata_csum(&sb);
+    uint32_t seed = fs_seed(&sb);
+    uint32_t size = fs_info->desc_size;
+    uint64_t table = group_desc_offset(fs_info, 0);
+    size_t table_size = (size_t)fs_info->groups_count * size;
+    uint8_t *descs = (uint8_t *)malloc(table_size);
+    uint8_t *bitmap = (uint8_t *)malloc(fs_info->block_size);
+    int rc = descs && bitmap ? txn_read(txn, table, descs, table_size) : -1;
+
+    if (rc == 0 && meta) {
+        rc = stage_inode_csums(txn, writes, seed);
+    }
+
+    for (uint32_t g = 0; g < fs_info->groups_count && rc == 0; g++) {
+        uint8_t *desc = descs + (size_t)g * size;
+        bool touched = txn_touches(txn, writes, table + (uint64_t)g * size, size);
+
+        for (int blocks = 1; blocks >= 0 && meta && rc == 0; blocks--) {
+            uint64_t at = (uint64_t)(blocks ? fs_info->group_desc[g].bg_block_bitmap
+                                            : fs_info->group_desc[g].bg_inode_bitmap) * fs_info->block_size;
+            uint32_t bytes = (blocks ? fs_info->blocks_per_group : fs_info->inodes_per_group) / 8;
+            if (!txn_touches(txn, writes, at, bytes)) {
+                continue;
+            }
+            rc = txn_read(txn, at, bitmap, bytes);
+            if (rc == 0) {
+                bitmap_store_csum(desc, size, blocks, bitmap_csum(seed, bitmap, bytes, size, blocks));
+                touched = true;
+            }
+        }
+        if (touched && rc == 0) {
+            put16(desc, offsetof(struct ext2_group_desc, bg_checksum), group_desc_csum(&sb, seed, g, desc, size));
+            rc = txn_stage(txn, table + (uint64_t)g * size, desc, size);
+        }
+    }
+
+    if (rc == 0 && meta && txn_touches(txn, writes, 1024, sizeof(sb))) {
+        sb.s_checksum = superblock_csum(&sb);
+        rc = txn_stage(txn, 1024, &sb, sizeof(sb));
+    }
+
+    free(descs);
+    free(bitmap);
+    return rc;
+}
+
+// Job body: audits all checksums of the filesystem passed as arg, mismatches appear as they are found
+int csum_job(job_t *job, void *arg) {
+    fs_info_t *fs_info = (fs_info_t *)arg;
+
+    csum_report_t *report = csum_audit(fs_info, 0, job);
+    if (!report) {
+        job_printf(job, "%s", job_is_cancelled(job) ? "Checksum audit cancelled" : "Checksum audit failed");
+        return job_is_cancelled(job) ? 0 : -1;
+    }
+    if (!report->metadata_csum && !report->gdt_csum) {
+        job_printf(job, "Neither metadata_csum nor gdt_csum is enabled, nothing to verify");
+        csum_free(report);
+        return 0;
+    }
+
+    uint64_t checked = 0, bad = 0, missing = 0;
+    for (int k = 0; k < CSUM_KINDS; k++) {
+        checked += report->counts[k].checked;
+        bad += report->counts[k].bad;
+        missing += report->counts[k].missing;
+    }
+    job_printf(job, "Checksum audit finished: %lu checked, %lu bad, %lu without room, %lu unreadable (%s, %.2f s)",
+               (unsigned long)checked, (unsigned long)bad, (unsigned long)missing,
+               (unsigned long)report->unreadable, report->engine, report->seconds);
+    csum_free(report);
+    return 0;
+}
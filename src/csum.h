@@ -0,0 +1,76 @@
+#ifndef CSUM_H
+#define CSUM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ext2fs/ext2_fs.h>
+#include "analyzer.h"
+#include "job.h"
+#include "txn.h"
+
+#define CSUM_MAX_ERRORS 256         // Mismatches kept in a report, the rest are only counted
+
+typedef enum {
+    CSUM_SUPERBLOCK,
+    CSUM_GROUP_DESC,
+    CSUM_BLOCK_BITMAP,
+    CSUM_INODE_BITMAP,
+    CSUM_INODE,
+    CSUM_EXTENT_BLOCK,          // Extent tree node below the root
+    CSUM_DIR_BLOCK,             // Directory leaf or htree node
+    CSUM_KINDS
+} csum_kind_t;
+
+typedef struct {
+    uint64_t checked;           // Structures whose checksum was computed
+    uint64_t bad;               // Stored and computed checksums differ
+    uint64_t missing;           // No room for a checksum, e.g. a directory block without a tail
+} csum_count_t;
+
+typedef struct {
+    csum_kind_t kind;
+    uint32_t group;             // Group of descriptors and bitmaps, or of the owning inode
+    uint32_t ino;               // Owning inode, 0 for group metadata
+    uint64_t block;             // Block holding the structure
+    uint32_t stored;            // Checksum found on disk
+    uint32_t computed;          // Checksum of the contents
+} csum_error_t;
+
+typedef struct {
+    bool metadata_csum;         // crc32c on all metadata
+    bool gdt_csum;              // crc16 on group descriptors only
+    uint32_t seed;              // crc32c seed derived from the UUID or stored in the superblock
+    const char *engine;         // crc32c implementation in use
+    csum_count_t counts[CSUM_KINDS];
+    uint64_t unreadable;        // Structures that could not be read
+    csum_error_t *errors;       // First CSUM_MAX_ERRORS mismatches in group order
+    uint32_t error_count;
+    uint64_t dropped;           // Mismatches beyond CSUM_MAX_ERRORS
+    double seconds;             // Wall time of the audit
+} csum_report_t;
+
+uint32_t csum_crc32c(uint32_t crc, const void *data, size_t length);
+
+uint16_t csum_crc16(uint16_t crc, const void *data, size_t length);
+
+const char *csum_engine(void);
+
+bool csum_enabled(const struct ext2_super_block *sb);
+
+const char *csum_kind_name(csum_kind_t kind);
+
+csum_report_t *csum_audit(fs_info_t *fs_info, uint32_t threads, job_t *job);
+
+void csum_free(csum_report_t *report);
+
+void csum_format_error(const csum_error_t *error, char *buffer, size_t buffer_size);
+
+void csum_print(const csum_report_t *report, FILE *out);
+
+int csum_stage_updates(txn_t *txn);
+
+int csum_job(job_t *job, void *arg);
+
+#endif /* CSUM_H */
@@ -0,0 +1,630 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "du.h"
+#include "blockmap.h"
+#include "inodeiter.h"
+#include "parallel.h"
+#include "topn.h"
+#include "utils.h"
+
+#define DEPTH_UNKNOWN UINT32_MAX        // Not visited yet
+#define DEPTH_ACTIVE (UINT32_MAX - 1)   // On the chain being resolved, seeing it again means a cycle
+#define DEPTH_ORPHAN (UINT32_MAX - 2)   // Not connected to the root
+#define MAX_PATH_DEPTH 4096
+
+typedef struct {
+    uint32_t ino;               // Directory inode
+    uint32_t parent;            // Directory holding its entry, 0 until one is found
+    uint32_t depth;             // Distance from the root or one of the DEPTH_ markers
+    uint64_t blocks;            // Own blocks plus files directly inside, then everything below
+    uint64_t inodes;            // Likewise for inodes
+} du_dir_t;
+
+// Data blocks of a directory, joined with the entries in physical order
+typedef struct {
+    uint64_t physical;
+    uint32_t count;
+    uint32_t dir;
+} du_run_t;
+
+typedef struct {
+    inode_iter_t it;            // Reads one group at a time
+    du_run_t *runs;             // Directory block runs found by this worker
+    size_t run_count;
+    size_t run_capacity;
+    uint32_t *dirs;             // Directory inodes found by this worker
+    size_t dir_count;
+    size_t dir_capacity;
+    uint32_t current;           // Directory whose map is being walked
+    uint32_t bad_dirs;
+    bool failed;                // Out of memory
+} du_worker_t;
+
+typedef struct {
+    fs_info_t *fs_info;
+    uint32_t *usage;            // Allocated blocks per inode, indexed by inode number
+    unsigned char *used;        // Inode bitmap over the whole filesystem, bit ino - 1
+    unsigned char *seen;        // Non-directories already charged to a directory
+    du_run_t *runs;             // All directory block runs
+    size_t run_count;
+    uint32_t *dir_inos;         // All directory inodes
+    size_t dir_count;
+    du_dir_t *dirs;             // Directory table sorted by inode
+    topn_t top_files;
+    du_result_t *result;
+} du_state_t;
+
+typedef struct {
+    fs_info_t *fs_info;
+    uint32_t child;             // Inode whose name is wanted
+    char *name;                 // Receives the name
+    size_t name_size;
+    unsigned char *block;       // Scratch block
+} du_name_lookup_t;
+
+static void *grow(void *array, size_t *capacity, size_t item_size) {
+    size_t grown = *capacity ? *capacity * 2 : 64;
+    void *p = realloc(array, grown * item_size);
+    if (p) {
+        *capacity = grown;
+    }
+    return p;
+}
+
+static uint32_t usage_blocks(const fs_info_t *fs_info, const struct ext2_inode *inode) {
+    uint64_t bytes = inode_block_count(inode) * 512;
+    uint64_t blocks = (bytes + fs_info->block_size - 1) / fs_info->block_size;
+    return blocks > UINT32_MAX ? UINT32_MAX : (uint32_t)blocks;
+}
+
+static int collect_dir_run(uint64_t logical, uint64_t physical, uint32_t count, bool unwritten, void *arg) {
+    du_worker_t *w = (du_worker_t *)arg;
+    (void)logical;
+    (void)unwritten;
+
+    if (w->run_count == w->run_capacity) {
+        du_run_t *runs = (du_run_t *)grow(w->runs, &w->run_capacity, sizeof(du_run_t));
+        if (!runs) {
+            w->failed = true;
+            return -1;
+        }
+        w->runs = runs;
+    }
+    w->runs[w->run_count++] = (du_run_t){ physical, count, w->current };
+    return 0;
+}
+
+static int du_worker_init(void *worker, void *arg) {
+    du_worker_t *w = (du_worker_t *)worker;
+    du_state_t *st = (du_state_t *)arg;
+
+    return inode_iter_init(&w->it, st->fs_info, 0, 0, false);
+}
+
+// Records usage of every allocated inode of a group and the block runs of its directories
+static int du_scan_group(uint32_t group, void *worker, void *arg) {
+    du_worker_t *w = (du_worker_t *)worker;
+    du_state_t *st = (du_state_t *)arg;
+    inode_iter_t *it = &w->it;
+    int rc;
+
+    inode_iter_reset(it, group, group + 1);
+    while ((rc = inode_iter_next(it)) > 0) {
+        for (uint32_t i = 0; i < it->count; i++) {
+            if (!inode_iter_used(it, i)) {
+                continue;
+            }
+            const struct ext2_inode *inode = inode_iter_inode(it, i);
+            uint32_t ino = it->first_inode + i;
+
+            // Groups cover whole bytes of the bitmap since inodes_per_group is a multiple of 8
+            st->usage[ino] = usage_blocks(st->fs_info, inode);
+            set_bitmap_bit(st->used, ino - 1);
+            if (!S_ISDIR(inode->i_mode)) {
+                continue;
+            }
+
+            if (w->dir_count == w->dir_capacity) {
+                uint32_t *dirs = (uint32_t *)grow(w->dirs, &w->dir_capacity, sizeof(uint32_t));
+                if (!dirs) {
+                    return -1;
+                }
+                w->dirs = dirs;
+            }
+            w->dirs[w->dir_count++] = ino;
+            w->current = ino;
+            if (blockmap_walk(st->fs_info, inode, collect_dir_run, w) != 0) {
+                if (w->failed) {
+                    return -1;
+                }
+                w->bad_dirs++;
+            }
+        }
+    }
+    return rc;
+}
+
+static int du_worker_finish(void *worker, void *arg) {
+    du_worker_t *w = (du_worker_t *)worker;
+    du_state_t *st = (du_state_t *)arg;
+    int rc = 0;
+
+    du_run_t *runs = (du_run_t *)realloc(st->runs, (st->run_count + w->run_count + 1) * sizeof(du_run_t));
+    uint32_t *dirs = runs ? (uint32_t *)realloc(st->dir_inos, (st->dir_count + w->dir_count + 1) * sizeof(uint32_t)) : NULL;
+    if (runs) {
+        st->runs = runs;
+        memcpy(st->runs + st->run_count, w->runs, w->run_count * sizeof(du_run_t));
+        st->run_count += w->run_count;
+    }
+    if (dirs) {
+        st->dir_inos = dirs;
+        memcpy(st->dir_inos + st->dir_count, w->dirs, w->dir_count * sizeof(uint32_t));
+        st->dir_count += w->dir_count;
+    } else {
+        rc = -1;
+    }
+    st->result->bad_dirs += w->bad_dirs;
+
+    free(w->runs);
+    free(w->dirs);
+    inode_iter_cleanup(&w->it);
+    return rc;
+}
+
+static du_dir_t *find_dir(const du_state_t *st, uint32_t ino) {
+    size_t lo = 0, hi = st->dir_count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (st->dirs[mid].ino < ino) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < st->dir_count && st->dirs[lo].ino == ino ? &st->dirs[lo] : NULL;
+}
+
+// Charges every entry of one directory block: subdirectories learn their parent,
+// other inodes are added to the directory the first time any of their links is seen
+static void join_dir_block(du_state_t *st, const unsigned char *block, uint32_t dir_ino) {
+    fs_info_t *fs_info = st->fs_info;
+    du_dir_t *dir = find_dir(st, dir_ino);
+    uint32_t pos = 0;
+
+    while (dir && fs_info->block_size - pos >= 8) {
+        const struct ext2_dir_entry_2 *entry = (const struct ext2_dir_entry_2 *)(block + pos);
+        uint32_t rec_len = entry->rec_len;
+        uint32_t child = entry->inode;
+
+        if (rec_len < 8 || rec_len % 4 != 0 || rec_len > fs_info->block_size - pos || entry->name_len + 8u > rec_len) {
+            break;
+        }
+        pos += rec_len;
+
+        if (child == 0 || child > fs_info->sb.s_inodes_count || !check_bitmap_bit(st->used, child - 1) ||
+            (entry->name_len == 1 && entry->name[0] == '.') ||
+            (entry->name_len == 2 && entry->name[0] == '.' && entry->name[1] == '.')) {
+            continue;
+        }
+
+        du_dir_t *sub = find_dir(st, child);
+        if (sub) {
+            if (sub->parent == 0 && child != EXT2_ROOT_INO) {
+                sub->parent = dir_ino;
+            }
+        } else if (!check_bitmap_bit(st->seen, child - 1)) {
+            set_bitmap_bit(st->seen, child - 1);
+            dir->blocks += st->usage[child];
+            dir->inodes++;
+            topn_push(&st->top_files, (uint64_t)st->usage[child] * fs_info->block_size, child, dir_ino);
+        }
+    }
+}
+
+static int compare_run(const void *a, const void *b) {
+    const du_run_t *x = (const du_run_t *)a, *y = (const du_run_t *)b;
+    return x->physical < y->physical ? -1 : x->physical > y->physical;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int compare_u64_desc(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x > y ? -1 : x < y;
+}
+
+// Reads all directory blocks in physical order, batching neighbouring runs into one request
+static int join_directories(du_state_t *st, job_t *job) {
+    fs_info_t *fs_info = st->fs_info;
+    unsigned char *buffer = (unsigned char *)malloc((size_t)DU_READ_BLOCKS * fs_info->block_size);
+    uint32_t owners[DU_READ_BLOCKS];
+    uint64_t batch_start = 0;
+    uint32_t batch_count = 0;
+
+    if (!buffer) {
+        return -1;
+    }
+    qsort(st->runs, st->run_count, sizeof(du_run_t), compare_run);
+
+    for (size_t i = 0; i <= st->run_count && !job_is_cancelled(job); i++) {
+        const du_run_t *run = i < st->run_count ? &st->runs[i] : NULL;
+        uint32_t offset = 0;
+
+        do {
+            bool flush = batch_count > 0 &&
+                         (!run || batch_count == DU_READ_BLOCKS || run->physical + offset != batch_start + batch_count);
+            if (flush) {
+                if (read_blocks(fs_info, (uint32_t)batch_start, batch_count, buffer) != 0) {
+                    st->result->bad_blocks += batch_count;
+                } else {
+                    for (uint32_t b = 0; b < batch_count; b++) {
+                        join_dir_block(st, buffer + (size_t)b * fs_info->block_size, owners[b]);
+                    }
+                }
+                job_advance(job, batch_count);
+                batch_count = 0;
+            }
+            if (!run) {
+                break;
+            }
+
+            if (batch_count == 0) {
+                batch_start = run->physical + offset;
+            }
+            uint32_t take = run->count - offset < DU_READ_BLOCKS - batch_count ? run->count - offset : DU_READ_BLOCKS - batch_count;
+            for (uint32_t b = 0; b < take; b++) {
+                owners[batch_count + b] = run->dir;
+            }
+            batch_count += take;
+            offset += take;
+        } while (offset < run->count);
+    }
+
+    free(buffer);
+    return 0;
+}
+
+// Gives every directory its depth below the root, or DEPTH_ORPHAN when its parent chain does not
+// reach the root, resolving each chain once
+static int resolve_depths(du_state_t *st) {
+    uint32_t *chain = (uint32_t *)malloc((st->dir_count + 1) * sizeof(uint32_t));
+    if (!chain) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < st->dir_count; i++) {
+        st->dirs[i].depth = st->dirs[i].ino == EXT2_ROOT_INO ? 0 : DEPTH_UNKNOWN;
+    }
+
+    for (size_t i = 0; i < st->dir_count; i++) {
+        size_t length = 0;
+        du_dir_t *d = &st->dirs[i];
+        uint32_t base;
+
+        while (d->depth == DEPTH_UNKNOWN) {
+            d->depth = DEPTH_ACTIVE;
+            chain[length++] = (uint32_t)(d - st->dirs);
+            du_dir_t *parent = d->parent ? find_dir(st, d->parent) : NULL;
+            if (!parent) {
+                break;
+            }
+            d = parent;
+        }
+        base = d->depth;
+        if (base == DEPTH_ACTIVE) {
+            base = DEPTH_ORPHAN;
+        }
+
+        while (length > 0) {
+            du_dir_t *c = &st->dirs[chain[--length]];
+            base = base == DEPTH_ORPHAN || base == DEPTH_ACTIVE ? DEPTH_ORPHAN : base + 1;
+            c->depth = base;
+        }
+    }
+
+    free(chain);
+    return 0;
+}
+
+// Adds every directory to its parent, deepest first, so each total covers its whole subtree
+static int roll_up(du_state_t *st) {
+    uint64_t *order = (uint64_t *)malloc((st->dir_count + 1) * sizeof(uint64_t));
+    size_t count = 0;
+
+    if (!order) {
+        return -1;
+    }
+    for (size_t i = 0; i < st->dir_count; i++) {
+        du_dir_t *d = &st->dirs[i];
+        d->blocks += st->usage[d->ino];
+        d->inodes++;
+        if (d->depth == DEPTH_ORPHAN) {
+            st->result->unreachable_bytes += d->blocks * st->fs_info->block_size;
+            st->result->unreachable_inodes += d->inodes;
+        } else {
+            order[count++] = ((uint64_t)d->depth << 32) | (uint32_t)i;
+        }
+    }
+    qsort(order, count, sizeof(uint64_t), compare_u64_desc);
+
+    for (size_t k = 0; k < count; k++) {
+        du_dir_t *d = &st->dirs[(uint32_t)order[k]];
+        du_dir_t *parent = d->depth > 0 ? find_dir(st, d->parent) : NULL;
+        if (parent) {
+            parent->blocks += d->blocks;
+            parent->inodes += d->inodes;
+        }
+    }
+
+    free(order);
+    return 0;
+}
+
+static int find_name(uint64_t logical, uint64_t physical, uint32_t count, bool unwritten, void *arg) {
+    du_name_lookup_t *lookup = (du_name_lookup_t *)arg;
+    uint32_t block_size = lookup->fs_info->block_size;
+    (void)logical;
+    (void)unwritten;
+
+    for (uint32_t b = 0; b < count; b++) {
+        if (read_block(lookup->fs_info, (uint32_t)(physical + b), lookup->block) != 0) {
+            return -1;
+        }
+        for (uint32_t pos = 0; block_size - pos >= 8;) {
+            const struct ext2_dir_entry_2 *entry = (const struct ext2_dir_entry_2 *)(lookup->block + pos);
+            if (entry->rec_len < 8 || entry->rec_len > block_size - pos || entry->name_len + 8u > entry->rec_len) {
+                break;
+            }
+            if (entry->inode == lookup->child) {
+                size_t len = entry->name_len < lookup->name_size - 1 ? entry->name_len : lookup->name_size - 1;
+                memcpy(lookup->name, entry->name, len);
+                lookup->name[len] = '\0';
+                return 1;
+            }
+            pos += entry->rec_len;
+        }
+    }
+    return 0;
+}
+
+static bool lookup_name(fs_info_t *fs_info, uint32_t dir, uint32_t child, char *name, size_t name_size) {
+    du_name_lookup_t lookup = { fs_info, child, name, name_size, NULL };
+    struct ext2_inode inode;
+
+    lookup.block = (unsigned char *)malloc(fs_info->block_size);
+    bool found = lookup.block && read_inode(fs_info, dir, &inode) == 0 &&
+                 blockmap_walk(fs_info, &inode, find_name, &lookup) == 1;
+    free(lookup.block);
+    return found;
+}
+
+// Builds the path of ino, whose entry lives in directory parent, from the tail towards the root
+static void build_path(du_state_t *st, uint32_t ino, uint32_t parent, char *path) {
+    char name[EXT2_NAME_LEN + 1];
+    size_t pos = DU_PATH_MAX - 1;
+
+    path[pos] = '\0';
+    for (uint32_t steps = 0; ino != EXT2_ROOT_INO; steps++) {
+        const char *part = name;
+        if (parent == 0 || steps > MAX_PATH_DEPTH || !lookup_name(st->fs_info, parent, ino, name, sizeof(name))) {
+            part = "?";
+        }
+
+        size_t len = strlen(part);
+        if (len + 1 > pos) {
+            if (pos >= 3) {
+                pos -= 3;
+                memcpy(path + pos, "...", 3);
+            }
+            break;
+        }
+        pos -= len;
+        memcpy(path + pos, part, len);
+        path[--pos] = '/';
+        if (part[0] == '?' && part[1] == '\0') {
+            break;
+        }
+
+        ino = parent;
+        du_dir_t *d = find_dir(st, parent);
+        parent = d ? d->parent : 0;
+    }
+
+    if (pos == DU_PATH_MAX - 1) {
+        path[--pos] = '/';
+    }
+    memmove(path, path + pos, DU_PATH_MAX - pos);
+}
+
+static du_entry_t *ranked_entries(du_state_t *st, topn_t *top, bool dirs, uint32_t *count) {
+    uint32_t n = topn_sorted(top);
+    du_entry_t *entries = (du_entry_t *)calloc(n ? n : 1, sizeof(du_entry_t));
+
+    if (!entries) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        const topn_entry_t *e = &top->heap[i];
+        entries[i].ino = e->id;
+        entries[i].bytes = e->key;
+        if (dirs) {
+            const du_dir_t *d = &st->dirs[e->aux];
+            entries[i].inodes = d->inodes;
+            build_path(st, d->ino, d->parent, entries[i].path);
+        } else {
+            entries[i].inodes = 1;
+            build_path(st, e->id, e->aux, entries[i].path);
+        }
+    }
+    *count = n;
+    return entries;
+}
+
+static void du_state_free(du_state_t *st) {
+    free(st->usage);
+    free(st->used);
+    free(st->seen);
+    free(st->runs);
+    free(st->dir_inos);
+    free(st->dirs);
+    topn_free(&st->top_files);
+}
+
+// Charges every allocated inode to the directory tree in two passes: the inode tables on the
+// group pool, then all directory blocks in disk order. The largest directories and files are
+// kept in bounded heaps of top entries.
+du_result_t *du_collect(fs_info_t *fs_info, uint32_t top, uint32_t threads, job_t *job) {
+    uint32_t inodes = fs_info->sb.s_inodes_count;
+    du_state_t st;
+    topn_t top_dirs = { NULL, 0, 0 };
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(&st, 0, sizeof(st));
+    st.fs_info = fs_info;
+    st.result = (du_result_t *)calloc(1, sizeof(du_result_t));
+    st.usage = (uint32_t *)calloc((size_t)inodes + 1, sizeof(uint32_t));
+    st.used = (unsigned char *)calloc((size_t)inodes / 8 + 1, 1);
+    st.seen = (unsigned char *)calloc((size_t)inodes / 8 + 1, 1);
+    if (!st.result || !st.usage || !st.used || !st.seen || topn_init(&st.top_files, top) != 0 ||
+        topn_init(&top_dirs, top) != 0) {
+        goto fail;
+    }
+
+    parallel_t p;
+    memset(&p, 0, sizeof(p));
+    p.items = fs_info->groups_count;
+    p.threads = fs_info->inodes_per_group % 8 ? 1 : threads;
+    p.worker_size = sizeof(du_worker_t);
+    p.arg = &st;
+    p.job = job;
+    p.init = du_worker_init;
+    p.work = du_scan_group;
+    p.finish = du_worker_finish;
+    if (parallel_run(&p) != 0 || job_is_cancelled(job)) {
+        goto fail;
+    }
+
+    qsort(st.dir_inos, st.dir_count, sizeof(uint32_t), compare_u32);
+    st.dirs = (du_dir_t *)calloc(st.dir_count + 1, sizeof(du_dir_t));
+    if (!st.dirs) {
+        goto fail;
+    }
+    for (size_t i = 0; i < st.dir_count; i++) {
+        st.dirs[i].ino = st.dir_inos[i];
+    }
+
+    uint64_t dir_blocks = 0;
+    for (size_t i = 0; i < st.run_count; i++) {
+        dir_blocks += st.runs[i].count;
+    }
+    job_set_total(job, fs_info->groups_count + dir_blocks);
+    if (join_directories(&st, job) != 0 || job_is_cancelled(job) || resolve_depths(&st) != 0 || roll_up(&st) != 0) {
+        goto fail;
+    }
+
+    du_result_t *r = st.result;
+    uint32_t first_ino = fs_info->sb.s_rev_level ? fs_info->sb.s_first_ino : EXT2_GOOD_OLD_FIRST_INO;
+    for (uint32_t ino = 1; ino <= inodes; ino++) {
+        if (!check_bitmap_bit(st.used, ino - 1) || check_bitmap_bit(st.seen, ino - 1) || find_dir(&st, ino)) {
+            continue;
+        }
+        if (ino < first_ino) {
+            r->reserved_bytes += (uint64_t)st.usage[ino] * fs_info->block_size;
+        } else {
+            r->unreachable_bytes += (uint64_t)st.usage[ino] * fs_info->block_size;
+            r->unreachable_inodes++;
+        }
+    }
+    for (size_t i = 0; i < st.dir_count; i++) {
+        const du_dir_t *d = &st.dirs[i];
+        if (d->depth != DEPTH_ORPHAN) {
+            topn_push(&top_dirs, d->blocks * fs_info->block_size, d->ino, (uint32_t)i);
+        }
+    }
+
+    du_dir_t *root = find_dir(&st, EXT2_ROOT_INO);
+    r->dirs = (uint32_t)st.dir_count;
+    r->tree_bytes = root ? root->blocks * fs_info->block_size : 0;
+    r->tree_inodes = root ? root->inodes : 0;
+    r->used_bytes = (uint64_t)(fs_info->sb.s_blocks_count - fs_info->sb.s_free_blocks_count) * fs_info->block_size;
+    r->top_dirs = ranked_entries(&st, &top_dirs, true, &r->top_dir_count);
+    r->top_files = ranked_entries(&st, &st.top_files, false, &r->top_file_count);
+    if (!r->top_dirs || !r->top_files) {
+        goto fail;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    r->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    topn_free(&top_dirs);
+    du_state_free(&st);
+    return r;
+
+fail:
+    topn_free(&top_dirs);
+    du_free(st.result);
+    du_state_free(&st);
+    return NULL;
+}
+
+void du_free(du_result_t *result) {
+    if (!result) {
+        return;
+    }
+
+    free(result->top_dirs);
+    free(result->top_files);
+    free(result);
+}
+
+// du -b style output: byte counts and paths separated by a tab, summary lines start with #
+void du_print(const du_result_t *result, FILE *out) {
+    uint64_t accounted = result->tree_bytes + result->unreachable_bytes + result->reserved_bytes;
+
+    fprintf(out, "# %lu bytes allocated, %lu in the directory tree (%lu inodes, %u directories)\n",
+            (unsigned long)result->used_bytes, (unsigned long)result->tree_bytes,
+            (unsigned long)result->tree_inodes, result->dirs);
+    fprintf(out, "# %lu bytes in %lu unreachable inode(s), %lu in reserved inodes, %lu in filesystem metadata\n",
+            (unsigned long)result->unreachable_bytes, (unsigned long)result->unreachable_inodes,
+            (unsigned long)result->reserved_bytes,
+            (unsigned long)(result->used_bytes > accounted ? result->used_bytes - accounted : 0));
+    if (result->bad_dirs || result->bad_blocks) {
+        fprintf(out, "# %u directory map(s) and %u directory block(s) could not be read\n",
+                result->bad_dirs, result->bad_blocks);
+    }
+
+    fprintf(out, "# Largest directories\n");
+    for (uint32_t i = 0; i < result->top_dir_count; i++) {
+        fprintf(out, "%lu\t%s\n", (unsigned long)result->top_dirs[i].bytes, result->top_dirs[i].path);
+    }
+    fprintf(out, "# Largest files\n");
+    for (uint32_t i = 0; i < result->top_file_count; i++) {
+        fprintf(out, "%lu\t%s\n", (unsigned long)result->top_files[i].bytes, result->top_files[i].path);
+    }
+}
+
+// Job body: accounts space per directory and publishes the result in the job_slot_t passed as arg
+int du_job(job_t *job, void *arg) {
+    job_slot_t *slot = (job_slot_t *)arg;
+
+    du_result_t *result = du_collect((fs_info_t *)slot->source, slot->top, 0, job);
+
+    if (result) {
+        char size_str[32];
+        format_value(result->tree_bytes, size_str, sizeof(size_str), true);
+        job_printf(job, "%s in %lu inode(s) under /, %u directories, %.2f s", size_str,
+                   (unsigned long)result->tree_inodes, result->dirs, result->seconds);
+    } else {
+        job_printf(job, "%s", job_is_cancelled(job) ? "Space accounting cancelled" : "Space accounting failed");
+    }
+    // The slot owns the result from here on and a later job may free it, so this is the last use
+    job_slot_finish(slot, job, result);
+    return result || job_is_cancelled(job) ? 0 : -1;
+}
@@ -0,0 +1,48 @@
+#ifndef DU_H
+#define DU_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "analyzer.h"
+#include "job.h"
+
+#define DU_DEFAULT_TOP 20           // Entries kept per ranking unless asked otherwise
+#define DU_PATH_MAX 512             // Longer paths keep their tail
+#define DU_READ_BLOCKS 256          // Directory blocks per read in the join pass
+
+typedef struct {
+    uint32_t ino;               // Inode number
+    uint64_t bytes;             // Allocated bytes, for directories including everything below
+    uint64_t inodes;            // Inodes counted, 1 for files
+    char path[DU_PATH_MAX];     // Path from the root, "?" where the tree is broken
+} du_entry_t;
+
+typedef struct {
+    uint64_t used_bytes;        // Allocated according to the superblock
+    uint64_t tree_bytes;        // Reachable from the root directory
+    uint64_t tree_inodes;
+    uint64_t unreachable_bytes; // Allocated inodes no directory leads to
+    uint64_t unreachable_inodes;
+    uint64_t reserved_bytes;    // Reserved inodes such as the resize inode and journal
+    uint32_t dirs;              // Directories found in the inode tables
+    uint32_t bad_dirs;          // Directories with an unreadable block map
+    uint32_t bad_blocks;        // Directory blocks that could not be read
+    du_entry_t *top_dirs;       // Largest directories, largest first
+    uint32_t top_dir_count;
+    du_entry_t *top_files;      // Largest non-directories, largest first
+    uint32_t top_file_count;
+    double seconds;             // Wall time of the collection
+} du_result_t;
+
+du_result_t *du_collect(fs_info_t *fs_info, uint32_t top, uint32_t threads, job_t *job);
+
+void du_free(du_result_t *result);
+
+void du_print(const du_result_t *result, FILE *out);
+
+int du_job(job_t *job, void *arg);
+
+#endif /* DU_H */
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "editlog.h"
+
+static int edit_log_reserve(void **array, uint32_t *capacity, uint32_t needed, size_t elem_size) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+
+    uint32_t new_capacity = *capacity ? *capacity : 64;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+
+    void *grown = realloc(*array, (size_t)new_capacity * elem_size);
+    if (!grown) {
+        return -1;
+    }
+
+    *array = grown;
+    *capacity = new_capacity;
+    return 0;
+}
+
+// Index of the last piece starting at or before offset, or -1
+static int64_t edit_log_find(const edit_log_t *log, uint64_t offset) {
+    int64_t lo = 0, hi = (int64_t)log->piece_count - 1, found = -1;
+
+    while (lo <= hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (log->pieces[mid].offset <= offset) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return found;
+}
+
+static bool edit_log_contains(const edit_log_t *log, int64_t index, uint64_t offset) {
+    return index >= 0 && offset < log->pieces[index].offset + log->pieces[index].length;
+}
+
+static int edit_log_insert_piece(edit_log_t *log, uint32_t position, edit_piece_t piece) {
+    if (edit_log_reserve((void **)&log->pieces, &log->piece_capacity, log->piece_count + 1, sizeof(edit_piece_t)) != 0) {
+        return -1;
+    }
+
+    memmove(&log->pieces[position + 1], &log->pieces[position],
+            (log->piece_count - position) * sizeof(edit_piece_t));
+    log->pieces[position] = piece;
+    log->piece_count++;
+    return 0;
+}
+
+static int edit_log_append(edit_log_t *log, uint8_t value) {
+    if (edit_log_reserve((void **)&log->add, &log->add_capacity, log->add_len + 1, 1) != 0) {
+        return -1;
+    }
+
+    log->add[log->add_len++] = value;
+    return 0;
+}
+
+// Makes offset read as value, reusing the add buffer slot when the byte is already modified
+static int edit_log_put(edit_log_t *log, uint64_t offset, uint8_t value) {
+    int64_t index = edit_log_find(log, offset);
+
+    if (edit_log_contains(log, index, offset)) {
+        edit_piece_t *piece = &log->pieces[index];
+        log->add[piece->data + (offset - piece->offset)] = value;
+        return 0;
+    }
+
+    // Typing forward extends the previous piece without creating a new one
+    if (index >= 0) {
+        edit_piece_t *piece = &log->pieces[index];
+        if (piece->offset + piece->length == offset && piece->data + piece->length == log->add_len) {
+            if (edit_log_append(log, value) != 0) {
+                return -1;
+            }
+            piece->length++;
+            return 0;
+        }
+    }
+
+    if (edit_log_append(log, value) != 0) {
+        return -1;
+    }
+
+    edit_piece_t piece = { offset, 1, log->add_len - 1 };
+    return edit_log_insert_piece(log, (uint32_t)(index + 1), piece);
+}
+
+// Makes offset read from the device again
+static int edit_log_remove(edit_log_t *log, uint64_t offset) {
+    int64_t index = edit_log_find(log, offset);
+
+    if (!edit_log_contains(log, index, offset)) {
+        return 0;
+    }
+
+    edit_piece_t *piece = &log->pieces[index];
+    uint32_t at = (uint32_t)(offset - piece->offset);
+
+    if (piece->length == 1) {
+        memmove(piece, piece + 1, (log->piece_count - index - 1) * sizeof(edit_piece_t));
+        log->piece_count--;
+    } else if (at == 0) {
+        piece->offset++;
+        piece->data++;
+        piece->length--;
+    } else if (at == piece->length - 1) {
+        piece->length--;
+    } else {
+        edit_piece_t tail = { offset + 1, piece->length - at - 1, piece->data + at + 1 };
+        piece->length = at;
+        return edit_log_insert_piece(log, (uint32_t)(index + 1), tail);
+    }
+
+    return 0;
+}
+
+edit_log_t *edit_log_init(void) {
+    return (edit_log_t *)calloc(1, sizeof(edit_log_t));
+}
+
+void edit_log_cleanup(edit_log_t *log) {
+    if (!log) {
+        return;
+    }
+
+    free(log->pieces);
+    free(log->add);
+    free(log->ops);
+    free(log);
+}
+
+void edit_log_clear(edit_log_t *log) {
+    if (!log) {
+        return;
+    }
+
+    log->piece_count = 0;
+    log->add_len = 0;
+    log->op_count = 0;
+    log->op_top = 0;
+}
+
+int edit_log_set(edit_log_t *log, uint64_t offset, uint8_t old_value, uint8_t new_value) {
+    if (!log) {
+        return -1;
+    }
+    if (old_value == new_value) {
+        return 0;
+    }
+
+    if (edit_log_reserve((void **)&log->ops, &log->op_capacity, log->op_count + 1, sizeof(edit_op_t)) != 0) {
+        return -1;
+    }
+
+    uint8_t current;
+    edit_op_t op = { offset, old_value, new_value, edit_log_lookup(log, offset, &current) };
+
+    if (edit_log_put(log, offset, new_value) != 0) {
+        return -1;
+    }
+
+    // A new edit discards whatever could have been redone
+    log->ops[log->op_count++] = op;
+    log->op_top = log->op_count;
+    return 0;
+}
+
+int edit_log_undo(edit_log_t *log, uint64_t *offset) {
+    if (!log || log->op_count == 0) {
+        return -1;
+    }
+
+    const edit_op_t *op = &log->ops[log->op_count - 1];
+    int rc = op->was_modified ? edit_log_put(log, op->offset, op->old_value)
+                              : edit_log_remove(log, op->offset);
+    if (rc != 0) {
+        return -1;
+    }
+
+    log->op_count--;
+    if (offset) {
+        *offset = op->offset;
+    }
+    return 0;
+}
+
+int edit_log_redo(edit_log_t *log, uint64_t *offset) {
+    if (!log || log->op_count >= log->op_top) {
+        return -1;
+    }
+
+    const edit_op_t *op = &log->ops[log->op_count];
+    if (edit_log_put(log, op->offset, op->new_value) != 0) {
+        return -1;
+    }
+
+    log->op_count++;
+    if (offset) {
+        *offset = op->offset;
+    }
+    return 0;
+}
+
+bool edit_log_lookup(const edit_log_t *log, uint64_t offset, uint8_t *value) {
+    if (!log) {
+        return false;
+    }
+
+    int64_t index = edit_log_find(log, offset);
+    if (!edit_log_contains(log, index, offset)) {
+        return false;
+    }
+
+    if (value) {
+        const edit_piece_t *piece = &log->pieces[index];
+        *value = log->add[piece->data + (offset - piece->offset)];
+    }
+    return true;
+}
+
+// Overlays the edited bytes onto a copy of [offset, offset + length) read from the device
+void edit_log_apply(const edit_log_t *log, uint64_t offset, uint8_t *buffer, size_t length) {
+    if (!log || log->piece_count == 0) {
+        return;
+    }
+
+    int64_t index = edit_log_find(log, offset);
+    if (index < 0) {
+        index = 0;
+    }
+
+    uint64_t end = offset + length;
+    for (uint32_t i = (uint32_t)index; i < log->piece_count && log->pieces[i].offset < end; i++) {
+        const edit_piece_t *piece = &log->pieces[i];
+        uint64_t from = piece->offset > offset ? piece->offset : offset;
+        uint64_t to = piece->offset + piece->length < end ? piece->offset + piece->length : end;
+
+        if (from < to) {
+            memcpy(buffer + (from - offset), log->add + piece->data + (from - piece->offset), to - from);
+        }
+    }
+}
+
+bool edit_log_is_dirty(const edit_log_t *log) {
+    return log && log->piece_count > 0;
+}
@@ -0,0 +1,55 @@
+#ifndef EDITLOG_H
+#define EDITLOG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// A modified range of the device whose current bytes live in the add buffer
+typedef struct {
+    uint64_t offset;            // Device offset of the first byte
+    uint32_t length;            // Number of bytes in the range
+    uint32_t data;              // Index of the first byte in the add buffer
+} edit_piece_t;
+
+// One byte edit, enough to undo and redo it
+typedef struct {
+    uint64_t offset;            // Device offset of the edited byte
+    uint8_t old_value;          // Value before the edit
+    uint8_t new_value;          // Value after the edit
+    uint8_t was_modified;       // Whether the byte already differed from the device
+} edit_op_t;
+
+typedef struct {
+    edit_piece_t *pieces;       // Modified ranges sorted by offset, never overlapping
+    uint32_t piece_count;
+    uint32_t piece_capacity;
+    uint8_t *add;               // Append-only store of edited byte values
+    uint32_t add_len;
+    uint32_t add_capacity;
+    edit_op_t *ops;             // Undo history; ops[op_count..op_top) can be redone
+    uint32_t op_count;          // Number of applied ops
+    uint32_t op_top;            // Number of recorded ops, applied or undone
+    uint32_t op_capacity;
+} edit_log_t;
+
+edit_log_t *edit_log_init(void);
+
+void edit_log_cleanup(edit_log_t *log);
+
+void edit_log_clear(edit_log_t *log);
+
+int edit_log_set(edit_log_t *log, uint64_t offset, uint8_t old_value, uint8_t new_value);
+
+int edit_log_undo(edit_log_t *log, uint64_t *offset);
+
+int edit_log_redo(edit_log_t *log, uint64_t *offset);
+
+bool edit_log_lookup(const edit_log_t *log, uint64_t offset, uint8_t *value);
+
+void edit_log_apply(const edit_log_t *log, uint64_t offset, uint8_t *buffer, size_t length);
+
+bool edit_log_is_dirty(const edit_log_t *log);
+
+#endif /* EDITLOG_H */
@@ -8,10 +8,18 @@
 #include <ncurses.h>
 #include <ext2fs/ext2_fs.h>
 #include <ctype.h>
+#include <stddef.h>
+#include <time.h>
 #include "analyzer.h"
 #include "editor.h"
+#include "txn.h"
+#include "csum.h"
 #include "utils.h"
 
+#define EDITOR_OFFSET_WIDTH 14     // "%012lx: " column
+#define EDITOR_HELP_WIDTH 24
+#define EDITOR_MAX_BYTES_PER_ROW 64
+
 editor_context_t *editor_init(fs_info_t *fs_info) {
     editor_context_t *ctx = (editor_context_t *)calloc(1, sizeof(editor_context_t));
     if (!ctx) {
@@ -20,18 +28,34 @@ editor_context_t *editor_init(fs_info_t *fs_info) {
 
     ctx->fs_info = fs_info;
     ctx->current_offset = 0;
-    ctx->buffer_size = fs_info->block_size * 2;
+    ctx->device_size = fs_total_bytes(fs_info);
+
+    // The window always holds whole blocks and at least two of them
+    ctx->buffer_size = EDITOR_WINDOW_BYTES - EDITOR_WINDOW_BYTES % fs_info->block_size;
+    if (ctx->buffer_size < (size_t)fs_info->block_size * 2) {
+        ctx->buffer_size = (size_t)fs_info->block_size * 2;
+    }
     ctx->buffer = (uint8_t *)malloc(ctx->buffer_size);
     if (!ctx->buffer) {
         free(ctx);
         return NULL;
     }
 
+    ctx->edits = edit_log_init();
+    if (!ctx->edits) {
+        free(ctx->buffer);
+        free(ctx);
+        return NULL;
+    }
+
     ctx->bytes_per_row = 16;
     ctx->view_rows = 16;
     ctx->cursor_x = 0;
     ctx->cursor_y = 0;
     ctx->editing_mode = false;
+    ctx->field_highlight = true;
+    ctx->win = stdscr;
+    ctx->full_redraw = true;
 
     return ctx;
 }
@@ -44,126 +68,328 @@ void editor_cleanup(editor_context_t *ctx) {
             free(ctx->buffer);
             ctx->buffer = NULL;
         }
+        edit_log_cleanup(ctx->edits);
         free(ctx);
     }
 }
 
-int editor_open_structure(editor_context_t *ctx, structure_type_t type, uint32_t id) {
-    if (!ctx) {
+static uint64_t editor_cursor_offset(const editor_context_t *ctx) {
+    return ctx->current_offset + (uint64_t)ctx->cursor_y * ctx->bytes_per_row + ctx->cursor_x;
+}
+
+static bool editor_is_dirty(const editor_context_t *ctx) {
+    return edit_log_is_dirty(ctx->edits);
+}
+
+static bool editor_in_window(const editor_context_t *ctx, uint64_t offset) {
+    return offset >= ctx->window_offset && offset < ctx->window_offset + ctx->window_len;
+}
+
+// Current value of a byte: the pending edit if there is one, otherwise the device data
+static uint8_t editor_byte_at(const editor_context_t *ctx, uint64_t offset, bool *modified) {
+    uint8_t value;
+
+    if (edit_log_lookup(ctx->edits, offset, &value)) {
+        if (modified) *modified = true;
+        return value;
+    }
+    if (modified) *modified = false;
+    return ctx->buffer[offset - ctx->window_offset];
+}
+
+// An on-disk field located on the device
+typedef struct {
+    const field_desc_t *field;  // Field description, NULL when there is no field
+    uint64_t base;              // Device offset of the structure holding the field
+    uint64_t start;             // Device offset of the field
+    uint32_t length;            // Bytes the field occupies
+} editor_field_t;
+
+// Finds the structure and field under a device offset: the superblock and group
+// descriptors anywhere, the opened inode, and directory entries in an opened block
+static bool editor_field_at(const editor_context_t *ctx, uint64_t offset, editor_field_t *out) {
+    const fs_info_t *fs_info = ctx->fs_info;
+    const schema_t *schema = NULL;
+    uint64_t base = 0;
+    uint64_t gdt_start = group_desc_offset(fs_info, 0);
+    uint32_t desc_size = fs_info->desc_size;
+
+    if (offset >= 1024 && offset < 1024 + schema_superblock.size) {
+        schema = &schema_superblock;
+        base = 1024;
+    } else if (offset >= gdt_start && offset < gdt_start + (uint64_t)fs_info->groups_count * desc_size) {
+        schema = desc_size >= schema_group_desc64.size ? &schema_group_desc64 : &schema_group_desc32;
+        base = offset - (offset - gdt_start) % desc_size;
+    } else if (offset < ctx->struct_offset || offset >= ctx->struct_offset + ctx->struct_size) {
+        return false;
+    } else if (ctx->edited_structure == STRUCTURE_INODE) {
+        schema = ctx->struct_size > schema_inode.size ? &schema_inode_large : &schema_inode;
+        base = ctx->struct_offset;
+    } else if (ctx->edited_structure == STRUCTURE_BLOCK &&
+               editor_in_window(ctx, ctx->struct_offset) &&
+               editor_in_window(ctx, ctx->struct_offset + ctx->struct_size - 1)) {
+        // The entry chain is walked on the device bytes; edits to it show after saving
+        uint32_t entry;
+        if (!schema_dir_entry_at(ctx->buffer + (ctx->struct_offset - ctx->window_offset), ctx->struct_size,
+                                 (uint32_t)(offset - ctx->struct_offset), &entry)) {
+            return false;
+        }
+        schema = &schema_dir_entry;
+        base = ctx->struct_offset + entry;
+    } else {
+        return false;
+    }
+
+    const field_desc_t *field = schema_field_at(schema, (uint32_t)(offset - base));
+    if (!field) {
+        return false;
+    }
+
+    uint32_t length = field->width;
+    if (field->type == FIELD_NAME) {
+        uint64_t name_len_at = base + offsetof(struct ext2_dir_entry_2, name_len);
+        length = editor_in_window(ctx, name_len_at) ? editor_byte_at(ctx, name_len_at, NULL) : 0;
+        if (offset >= base + field->offset + length) {
+            return false;
+        }
+    }
+
+    out->field = field;
+    out->base = base;
+    out->start = base + field->offset;
+    out->length = length;
+    return true;
+}
+
+static void editor_set_message(editor_context_t *ctx, const char *message) {
+    snprintf(ctx->message, sizeof(ctx->message), "%s", message);
+    ctx->status_dirty = true;
+}
+
+// Makes sure [start, end) of the device is inside the window. When the window has to move
+// it is placed so most of it lies ahead in the direction of travel.
+static int editor_load_window(editor_context_t *ctx, uint64_t start, uint64_t end) {
+    if (ctx->window_len > 0 && start >= ctx->window_offset && end <= ctx->window_offset + ctx->window_len) {
+        return 0;
+    }
+
+    uint64_t span = ctx->buffer_size;
+    uint64_t slack = span / 8;
+    uint64_t block_size = ctx->fs_info->block_size;
+    uint64_t new_offset;
+
+    if (ctx->window_len == 0 || start >= ctx->window_offset) {
+        new_offset = start > slack ? start - slack : 0;
+    } else {
+        new_offset = end + slack > span ? end + slack - span : 0;
+    }
+    if (new_offset + span > ctx->device_size) {
+        new_offset = ctx->device_size > span ? ctx->device_size - span : 0;
+    }
+    new_offset -= new_offset % block_size;
+
+    uint64_t length = ctx->device_size - new_offset < span ? ctx->device_size - new_offset : span;
+    uint32_t count = (uint32_t)(length / block_size);
+
+    if (count == 0 || read_blocks(ctx->fs_info, (uint32_t)(new_offset / block_size), count, ctx->buffer) != 0) {
+        ctx->window_len = 0;
+        editor_set_message(ctx, "Error reading device");
         return -1;
     }
 
-    ctx->edited_structure = type;
-    ctx->edited_id = id;
+    ctx->window_offset = new_offset;
+    ctx->window_len = (size_t)count * block_size;
+    return 0;
+}
+
+static int editor_set_view(editor_context_t *ctx, uint64_t top) {
+    uint64_t view_bytes = (uint64_t)ctx->view_rows * ctx->bytes_per_row;
+    uint64_t end = top + view_bytes < ctx->device_size ? top + view_bytes : ctx->device_size;
+
+    if (editor_load_window(ctx, top, end) != 0) {
+        return -1;
+    }
+
+    if (top != ctx->current_offset) {
+        ctx->current_offset = top;
+        ctx->full_redraw = true;
+    }
+    return 0;
+}
 
+// Fits bytes_per_row and view_rows to the window, keeping the cursor on the same byte
+static void editor_layout(editor_context_t *ctx) {
+    int max_y, max_x;
+    getmaxyx(ctx->win, max_y, max_x);
+
+    uint32_t bytes_per_row = 8;
+    while (bytes_per_row + 8 <= EDITOR_MAX_BYTES_PER_ROW &&
+           EDITOR_OFFSET_WIDTH + (bytes_per_row + 8) * 4 + 2 <= (uint32_t)max_x) {
+        bytes_per_row += 8;
+    }
+    uint32_t view_rows = max_y > 4 ? (uint32_t)max_y - 3 : 1;
+
+    if (bytes_per_row == ctx->bytes_per_row && view_rows == ctx->view_rows) {
+        return;
+    }
+
+    uint64_t cursor = editor_cursor_offset(ctx);
+    ctx->bytes_per_row = bytes_per_row;
+    ctx->view_rows = view_rows;
+    ctx->current_offset -= ctx->current_offset % bytes_per_row;
     ctx->cursor_x = 0;
     ctx->cursor_y = 0;
-    
-    memset(ctx->buffer, 0, ctx->buffer_size);
-    
+    editor_goto(ctx, cursor);
+}
+
+int editor_open_structure(editor_context_t *ctx, structure_type_t type, uint32_t id) {
+    if (!ctx) {
+        return -1;
+    }
+
+    fs_info_t *fs_info = ctx->fs_info;
+    uint64_t offset;
+    uint32_t size;
+
     switch (type) {
-        case STRUCTURE_SUPERBLOCK: {
-            ctx->current_offset = 1024;
-            memcpy(ctx->buffer, &ctx->fs_info->sb, sizeof(struct ext2_super_block));
+        case STRUCTURE_SUPERBLOCK:
+            offset = 1024;
+            size = sizeof(struct ext2_super_block);
             break;
-        }
-        
+
         case STRUCTURE_GROUP_DESC: {
-            if (id >= ctx->fs_info->groups_count) {
+            if (id >= fs_info->groups_count) {
                 return -1;
             }
-            ctx->current_offset = ctx->fs_info->block_size + id * sizeof(struct ext2_group_desc);
-            memcpy(ctx->buffer, &ctx->fs_info->group_desc[id], sizeof(struct ext2_group_desc));
+            offset = group_desc_offset(fs_info, id);
+            size = sizeof(struct ext2_group_desc);
             break;
         }
-        
-        case STRUCTURE_INODE: {
-            struct ext2_inode inode;
-            if (read_inode(ctx->fs_info, id, &inode) != 0) {
+
+        case STRUCTURE_INODE:
+            if (id == 0 || id > fs_info->sb.s_inodes_count) {
                 return -1;
             }
-            memcpy(ctx->buffer, &inode, sizeof(struct ext2_inode));
+            offset = inode_offset(fs_info, id);
+            size = fs_info->sb.s_inode_size;
             break;
-        }
-        
-        case STRUCTURE_BLOCK: {
-            if (read_block(ctx->fs_info, id, ctx->buffer) != 0) {
+
+        case STRUCTURE_BLOCK:
+            if (id >= fs_info->sb.s_blocks_count) {
                 return -1;
             }
+            offset = (uint64_t)id * fs_info->block_size;
+            size = fs_info->block_size;
             break;
-        }
-        
-        case STRUCTURE_BLOCK_BITMAP: {
-            if (id >= ctx->fs_info->groups_count) {
-                return -1;
-            }
-            unsigned char *bitmap = (unsigned char *)malloc(ctx->fs_info->blocks_per_group / 8);
-            if (!bitmap) {
-                return -1;
-            }
-            
-            if (get_block_bitmap(ctx->fs_info, id, bitmap) != 0) {
-                free(bitmap);
+
+        case STRUCTURE_BLOCK_BITMAP:
+            if (id >= fs_info->groups_count) {
                 return -1;
             }
-            
-            memcpy(ctx->buffer, bitmap, ctx->fs_info->blocks_per_group / 8);
-            free(bitmap);
+            offset = (uint64_t)fs_info->group_desc[id].bg_block_bitmap * fs_info->block_size;
+            size = fs_info->blocks_per_group / 8;
             break;
-        }
-        
-        case STRUCTURE_INODE_BITMAP: {
-            if (id >= ctx->fs_info->groups_count) {
-                return -1;
-            }
-            unsigned char *bitmap = (unsigned char *)malloc(ctx->fs_info->inodes_per_group / 8);
-            if (!bitmap) {
-                return -1;
-            }
-            
-            if (get_inode_bitmap(ctx->fs_info, id, bitmap) != 0) {
-                free(bitmap);
+
+        case STRUCTURE_INODE_BITMAP:
+            if (id >= fs_info->groups_count) {
                 return -1;
             }
-            
-            memcpy(ctx->buffer, bitmap, ctx->fs_info->inodes_per_group / 8);
-            free(bitmap);
+            offset = (uint64_t)fs_info->group_desc[id].bg_inode_bitmap * fs_info->block_size;
+            size = fs_info->inodes_per_group / 8;
             break;
-        }
-        
+
         default:
             return -1;
     }
-    
-    return 0;
+
+    // Pending edits are addressed by device offset, so they survive switching structures
+    ctx->window_len = 0;
+
+    ctx->edited_structure = type;
+    ctx->edited_id = id;
+    ctx->current_structure = type;
+    ctx->current_id = id;
+    ctx->struct_offset = offset;
+    ctx->struct_size = size;
+    ctx->message[0] = '\0';
+    ctx->full_redraw = true;
+
+    editor_layout(ctx);
+    ctx->cursor_x = 0;
+    ctx->cursor_y = 0;
+    if (editor_set_view(ctx, offset - offset % ctx->bytes_per_row) != 0) {
+        return -1;
+    }
+    return editor_goto(ctx, offset);
 }
 
 int editor_save_changes(editor_context_t *ctx) {
     if (!ctx) return -1;
 
-    switch (ctx->edited_structure) {
-        case STRUCTURE_SUPERBLOCK:
-            if (ctx->buffer_size >= sizeof(struct ext2_super_block)) {
-                memcpy(&ctx->fs_info->sb, ctx->buffer, sizeof(struct ext2_super_block));
-                lseek(ctx->fs_info->fd, 1024, SEEK_SET);
-                write(ctx->fs_info->fd, &ctx->fs_info->sb, sizeof(struct ext2_super_block));
-                return 0;
-            }
-            break;
+    if (!editor_is_dirty(ctx)) {
+        return 0;
+    }
 
-        case STRUCTURE_INODE: {
-            struct ext2_inode *inode = (struct ext2_inode *)ctx->buffer;
-            return write_inode(ctx->fs_info, ctx->edited_id, inode);
+    txn_t *txn = txn_begin(ctx->fs_info);
+    if (!txn) {
+        return -1;
+    }
+
+    // Every modified range goes to disk in one transaction, so a save that spans
+    // several structures lands completely or not at all
+    const edit_log_t *log = ctx->edits;
+    for (uint32_t i = 0; i < log->piece_count; i++) {
+        const edit_piece_t *piece = &log->pieces[i];
+        if (txn_stage(txn, piece->offset, log->add + piece->data, piece->length) != 0) {
+            txn_abort(txn);
+            return -1;
         }
+    }
 
-        case STRUCTURE_BLOCK:
-            return write_block(ctx->fs_info, ctx->edited_id, ctx->buffer);
+    if (ctx->fix_checksums && csum_stage_updates(txn) != 0) {
+        txn_abort(txn);
+        return -1;
+    }
 
-        default:
-            break;
+    if (txn_commit(txn) != 0) {
+        return -1;
+    }
+
+    // Fold the saved bytes into the window so it matches the device again
+    edit_log_apply(ctx->edits, ctx->window_offset, ctx->buffer, ctx->window_len);
+    edit_log_clear(ctx->edits);
+    ctx->full_redraw = true;
+    return 0;
+}
+
+// Moves the view so that offset is visible and puts the cursor on it
+int editor_goto(editor_context_t *ctx, uint64_t offset) {
+    if (!ctx || ctx->device_size == 0) {
+        return -1;
     }
 
-    return -1;
+    if (offset >= ctx->device_size) {
+        offset = ctx->device_size - 1;
+    }
+
+    uint64_t view_bytes = (uint64_t)ctx->view_rows * ctx->bytes_per_row;
+    uint64_t row_start = offset - offset % ctx->bytes_per_row;
+    uint64_t top = ctx->current_offset;
+
+    if (offset < top) {
+        top = row_start;
+    } else if (offset >= top + view_bytes) {
+        top = row_start - (uint64_t)(ctx->view_rows - 1) * ctx->bytes_per_row;
+    }
+
+    if (editor_set_view(ctx, top) != 0) {
+        return -1;
+    }
+
+    ctx->cursor_y = (uint32_t)((offset - top) / ctx->bytes_per_row);
+    ctx->cursor_x = (uint32_t)((offset - top) % ctx->bytes_per_row);
+    ctx->status_dirty = true;
+    return 0;
 }
 
 void editor_move_cursor(editor_context_t *ctx, int dx, int dy) {
@@ -171,28 +397,46 @@ void editor_move_cursor(editor_context_t *ctx, int dx, int dy) {
         return;
     }
     
-    int new_x = ctx->cursor_x + dx;
-    int new_y = ctx->cursor_y + dy;
+    int64_t delta = (int64_t)dx + (int64_t)dy * ctx->bytes_per_row;
+    uint64_t cursor = editor_cursor_offset(ctx);
     
-    if (new_x < 0) {
-        new_x = 0;
-    } else if ((uint32_t)new_x >= ctx->bytes_per_row) {
-        new_x = ctx->bytes_per_row - 1;
+    if (delta < 0 && (uint64_t)(-delta) > cursor) {
+        return;
     }
-    
-    if (new_y < 0) {
-        new_y = 0;
-    } else if ((uint32_t)new_y >= ctx->view_rows) {
-        new_y = ctx->view_rows - 1;
+    if (delta > 0 && cursor + (uint64_t)delta >= ctx->device_size) {
+        return;
     }
     
-    size_t new_pos = new_y * ctx->bytes_per_row + new_x;
-    if (new_pos >= ctx->buffer_size) {
+    editor_goto(ctx, cursor + delta);
+}
+
+// Scrolls the view by whole rows, keeping the cursor at the same screen position
+void editor_scroll(editor_context_t *ctx, int rows) {
+    if (!ctx) {
         return;
     }
-    
-    ctx->cursor_x = new_x;
-    ctx->cursor_y = new_y;
+
+    uint64_t last_top = ctx->device_size - ctx->device_size % ctx->bytes_per_row;
+    if (last_top == ctx->device_size && last_top > 0) {
+        last_top -= ctx->bytes_per_row;
+    }
+
+    uint64_t distance = (uint64_t)(rows < 0 ? -rows : rows) * ctx->bytes_per_row;
+    uint64_t top;
+    if (rows < 0) {
+        top = ctx->current_offset > distance ? ctx->current_offset - distance : 0;
+    } else {
+        top = ctx->current_offset + distance < last_top ? ctx->current_offset + distance : last_top;
+    }
+
+    if (editor_set_view(ctx, top) != 0) {
+        return;
+    }
+
+    if (editor_cursor_offset(ctx) >= ctx->device_size) {
+        editor_goto(ctx, ctx->device_size - 1);
+    }
+    ctx->status_dirty = true;
 }
 
 void editor_set_byte(editor_context_t *ctx, uint8_t value) {
@@ -200,106 +444,390 @@ void editor_set_byte(editor_context_t *ctx, uint8_t value) {
         return;
     }
     
-    size_t index = ctx->cursor_y * ctx->bytes_per_row + ctx->cursor_x;
+    uint64_t offset = editor_cursor_offset(ctx);
+    
+    if (!editor_in_window(ctx, offset)) {
+        return;
+    }
     
-    if (index < ctx->buffer_size) {
-        ctx->buffer[index] = value;
+    if (edit_log_set(ctx->edits, offset, editor_byte_at(ctx, offset, NULL), value) != 0) {
+        editor_set_message(ctx, "Out of memory recording edit");
     }
 }
 
-void editor_render(editor_context_t *ctx) {
+void editor_set_window(editor_context_t *ctx, WINDOW *win) {
     if (!ctx) {
         return;
     }
 
-    clear();
+    ctx->win = win ? win : stdscr;
+    ctx->full_redraw = true;
+}
+
+void editor_invalidate(editor_context_t *ctx) {
+    if (ctx) {
+        ctx->full_redraw = true;
+    }
+}
+
+// Drops the window and reads it again, for when the device changed underneath it
+int editor_reload(editor_context_t *ctx) {
+    if (!ctx) {
+        return -1;
+    }
+    editor_invalidate(ctx);
+    // Nothing cached yet, the next structure opened reads it fresh
+    if (ctx->window_len == 0) {
+        return 0;
+    }
+
+    uint64_t view_bytes = (uint64_t)ctx->view_rows * ctx->bytes_per_row;
+    uint64_t end = ctx->current_offset + view_bytes < ctx->device_size ? ctx->current_offset + view_bytes
+                                                                       : ctx->device_size;
+    ctx->window_len = 0;
+    return editor_load_window(ctx, ctx->current_offset, end);
+}
+
+static const char *editor_structure_name(structure_type_t type) {
+    switch (type) {
+        case STRUCTURE_SUPERBLOCK:     return "Superblock";
+        case STRUCTURE_GROUP_DESC:     return "Group Descriptor";
+        case STRUCTURE_INODE:          return "Inode";
+        case STRUCTURE_BLOCK:          return "Block";
+        case STRUCTURE_BLOCK_BITMAP:   return "Block Bitmap";
+        case STRUCTURE_INODE_BITMAP:   return "Inode Bitmap";
+    }
+    return "Device";
+}
+
+static void editor_draw_cell(editor_context_t *ctx, uint32_t x, uint32_t y) {
+    WINDOW *win = ctx->win;
+    uint64_t offset = ctx->current_offset + (uint64_t)y * ctx->bytes_per_row + x;
+    int hex_start = EDITOR_OFFSET_WIDTH;
+    int ascii_start = hex_start + ctx->bytes_per_row * 3 + 2;
+    bool is_cursor = (x == ctx->cursor_x && y == ctx->cursor_y);
+
+    if (offset >= ctx->device_size || !editor_in_window(ctx, offset)) {
+        mvwprintw(win, y + 2, hex_start + x * 3, "  ");
+        mvwaddch(win, y + 2, ascii_start + x, ' ');
+        return;
+    }
+
+    bool modified;
+    uint8_t value = editor_byte_at(ctx, offset, &modified);
+    char c = (char)value;
+    // Bytes outside the opened structure are dimmed, unsaved edits use the "modified" pair
+    attr_t attrs = A_NORMAL;
+    if (offset < ctx->struct_offset || offset >= ctx->struct_offset + ctx->struct_size) {
+        attrs |= A_DIM;
+    }
+    if (is_cursor) {
+        attrs |= COLOR_PAIR(5) | (modified ? A_BOLD : 0);
+    } else if (modified) {
+        attrs |= COLOR_PAIR(7);
+    } else if (offset >= ctx->field_start && offset < ctx->field_start + ctx->field_len) {
+        attrs |= COLOR_PAIR(6);
+    }
+    if (offset >= ctx->field_start && offset < ctx->field_start + ctx->field_len) {
+        attrs |= A_UNDERLINE;
+    }
+
+    wattron(win, attrs);
+    mvwprintw(win, y + 2, hex_start + x * 3, "%02x", value);
+    mvwaddch(win, y + 2, ascii_start + x, isprint((unsigned char)c) ? c : '.');
+    wattroff(win, attrs);
+}
+
+// Names and decodes the field under the cursor, including unsaved edits
+static void editor_describe_field(const editor_context_t *ctx, char *buffer, size_t buffer_size) {
+    editor_field_t found;
+    uint8_t data[1024];
+
+    buffer[0] = '\0';
+    if (!ctx->field_highlight || !editor_field_at(ctx, editor_cursor_offset(ctx), &found)) {
+        return;
+    }
+
+    // Only the structure up to the end of the field is needed to decode it
+    uint32_t needed = found.field->offset + found.length;
+    if (needed > sizeof(data) || !editor_in_window(ctx, found.base) || !editor_in_window(ctx, found.base + needed - 1)) {
+        snprintf(buffer, buffer_size, " | %s", found.field->name);
+        return;
+    }
+    for (uint32_t i = 0; i < needed; i++) {
+        data[i] = editor_byte_at(ctx, found.base + i, NULL);
+    }
+
+    char value[96];
+    schema_format_field(found.field, data, value, sizeof(value));
+    snprintf(buffer, buffer_size, " | %s = %s", found.field->name, value);
+}
 
+static void editor_draw_status(editor_context_t *ctx) {
     int max_y, max_x;
-    getmaxyx(stdscr, max_y, max_x);
-    
-    int hex_start = 10; 
-    int ascii_start = hex_start + (16 * 3); 
-    int help_start = ascii_start + 16 + 4; 
+    getmaxyx(ctx->win, max_y, max_x);
+
+    uint64_t cursor = editor_cursor_offset(ctx);
+    uint32_t block_size = ctx->fs_info->block_size;
+    char field[160];
+    editor_describe_field(ctx, field, sizeof(field));
+
+    wattron(ctx->win, COLOR_PAIR(2));
+    mvwprintw(ctx->win, max_y - 1, 0, "%-*.*s", max_x, max_x, "");
+    mvwprintw(ctx->win, max_y - 1, 0, "%s | 0x%012lx (block %lu +0x%03lx)%s%s%s%s%s",
+              ctx->editing_mode ? "EDIT MODE" : "VIEW MODE",
+              (unsigned long)cursor, (unsigned long)(cursor / block_size), (unsigned long)(cursor % block_size),
+              field, editor_is_dirty(ctx) ? " [modified]" : "", ctx->fix_checksums ? " [csum]" : "",
+              ctx->message[0] ? " - " : "", ctx->message);
+    wattroff(ctx->win, COLOR_PAIR(2));
+}
 
-    attron(COLOR_PAIR(1));
-    mvprintw(0, 0, "Binary Editor - Offset: 0x%08lx", ctx->current_offset);
-    attroff(COLOR_PAIR(1));
+static void editor_draw_help(editor_context_t *ctx, int help_start, int max_y) {
+    WINDOW *win = ctx->win;
 
-    for (uint32_t y = 0; y < ctx->view_rows; y++) {
-        mvprintw(y + 2, 0, "%08lx: ", ctx->current_offset + y * ctx->bytes_per_row);
+    for (int y = 1; y < max_y - 1; y++) {
+        mvwaddch(win, y, help_start - 2, ACS_VLINE);
+    }
 
-        for (uint32_t x = 0; x < ctx->bytes_per_row; x++) {
-            size_t index = y * ctx->bytes_per_row + x;
-            
-            if (index >= ctx->buffer_size) {
-                mvprintw(y + 2, hex_start + x * 3, "   ");
-            } else {
-                if (x == ctx->cursor_x && y == ctx->cursor_y) {
-                    attron(COLOR_PAIR(5));
-                    mvprintw(y + 2, hex_start + x * 3, "%02x ", ctx->buffer[index]);
-                    attroff(COLOR_PAIR(5));
-                } else {
-                    mvprintw(y + 2, hex_start + x * 3, "%02x ", ctx->buffer[index]);
-                }
-            }
+    wattron(win, COLOR_PAIR(3) | A_BOLD);
+    mvwprintw(win, 1, help_start, "EDIT MODE HELP");
+    wattroff(win, COLOR_PAIR(3) | A_BOLD);
+
+    int help_line = 3;
+    mvwprintw(win, help_line++, help_start, "Navigation:");
+    mvwprintw(win, help_line++, help_start + 2, "Arrows - Move cursor");
+    mvwprintw(win, help_line++, help_start + 2, "PgUp/Dn - Scroll");
+    mvwprintw(win, help_line++, help_start + 2, "Home/End - Dev start/end");
+    mvwprintw(win, help_line++, help_start + 2, "H - Field highlight");
+    mvwprintw(win, help_line++, help_start + 2, "/ ? - Find fwd/back");
+    mvwprintw(win, help_line++, help_start + 2, "N/Shift-N - Next/Prev");
+    help_line++;
+
+    mvwprintw(win, help_line++, help_start, "Editing:");
+    mvwprintw(win, help_line++, help_start + 2, "0-9,A-F - Hex input");
+    mvwprintw(win, help_line++, help_start + 2, "TAB - Toggle edit");
+    mvwprintw(win, help_line++, help_start + 2, "U/R - Undo/Redo");
+    mvwprintw(win, help_line++, help_start + 2, "ESC - Cancel");
+    help_line++;
+
+    mvwprintw(win, help_line++, help_start, "Actions:");
+    mvwprintw(win, help_line++, help_start + 2, "S - Save changes");
+    mvwprintw(win, help_line++, help_start + 2, "K - Fix checksums %s", ctx->fix_checksums ? "(on)" : "(off)");
+    help_line++;
+
+    wattron(win, COLOR_PAIR(4));
+    mvwprintw(win, help_line++, help_start, "Warning:");
+    mvwprintw(win, help_line++, help_start + 2, "Changes written");
+    mvwprintw(win, help_line++, help_start + 2, "directly to disk!");
+    wattroff(win, COLOR_PAIR(4));
+}
+
+static void editor_draw_range(editor_context_t *ctx, uint64_t start, uint32_t length) {
+    uint64_t view_end = ctx->current_offset + (uint64_t)ctx->view_rows * ctx->bytes_per_row;
+
+    for (uint64_t offset = start; offset < start + length; offset++) {
+        if (offset < ctx->current_offset || offset >= view_end) {
+            continue;
         }
+        uint64_t rel = offset - ctx->current_offset;
+        editor_draw_cell(ctx, (uint32_t)(rel % ctx->bytes_per_row), (uint32_t)(rel / ctx->bytes_per_row));
+    }
+}
 
-        mvprintw(y + 2, ascii_start, "| ");
-        for (uint32_t x = 0; x < ctx->bytes_per_row; x++) {
-            size_t index = y * ctx->bytes_per_row + x;
-            
-            if (index < ctx->buffer_size) {
-                char c = ctx->buffer[index];
-                if (x == ctx->cursor_x && y == ctx->cursor_y) {
-                    attron(COLOR_PAIR(5));
-                    addch(isprint(c) ? c : '.');
-                    attroff(COLOR_PAIR(5));
-                } else {
-                    addch(isprint(c) ? c : '.');
-                }
-            } else {
-                addch(' ');
+// Points the highlight at the field under the cursor. Returns whether it moved.
+static bool editor_update_field(editor_context_t *ctx, uint64_t *old_start, uint32_t *old_len) {
+    editor_field_t found;
+    uint64_t start = 0;
+    uint32_t length = 0;
+
+    if (ctx->field_highlight && editor_field_at(ctx, editor_cursor_offset(ctx), &found)) {
+        start = found.start;
+        length = found.length;
+    }
+
+    *old_start = ctx->field_start;
+    *old_len = ctx->field_len;
+    ctx->field_start = start;
+    ctx->field_len = length;
+    return start != *old_start || length != *old_len;
+}
+
+// Repaints only what changed since the last call unless a full redraw was requested.
+// The caller flushes the terminal with doupdate().
+void editor_render(editor_context_t *ctx) {
+    if (!ctx) {
+        return;
+    }
+
+    WINDOW *win = ctx->win;
+    uint64_t old_field_start;
+    uint32_t old_field_len;
+
+    if (ctx->full_redraw) {
+        editor_layout(ctx);
+
+        int max_y, max_x;
+        getmaxyx(win, max_y, max_x);
+
+        int ascii_start = EDITOR_OFFSET_WIDTH + ctx->bytes_per_row * 3 + 2;
+        int help_start = ascii_start + ctx->bytes_per_row + 4;
+
+        werase(win);
+        editor_update_field(ctx, &old_field_start, &old_field_len);
+
+        wattron(win, COLOR_PAIR(1));
+        mvwprintw(win, 0, 0, "Binary Editor - %s %u - Offset: 0x%012lx of 0x%012lx",
+                  editor_structure_name(ctx->edited_structure), ctx->edited_id,
+                  (unsigned long)ctx->current_offset, (unsigned long)ctx->device_size);
+        wattroff(win, COLOR_PAIR(1));
+
+        for (uint32_t y = 0; y < ctx->view_rows; y++) {
+            uint64_t row_offset = ctx->current_offset + (uint64_t)y * ctx->bytes_per_row;
+            if (row_offset >= ctx->device_size) {
+                break;
+            }
+            mvwprintw(win, y + 2, 0, "%012lx: ", (unsigned long)row_offset);
+            mvwprintw(win, y + 2, ascii_start - 2, "| ");
+            for (uint32_t x = 0; x < ctx->bytes_per_row; x++) {
+                editor_draw_cell(ctx, x, y);
             }
         }
-    }
 
-    if (ctx->editing_mode && help_start + 20 < max_x) {
-        for (int y = 1; y < max_y - 2; y++) {
-            mvaddch(y, help_start - 2, ACS_VLINE);
+        if (ctx->editing_mode && help_start + EDITOR_HELP_WIDTH <= max_x) {
+            editor_draw_help(ctx, help_start, max_y);
         }
 
-        attron(COLOR_PAIR(3) | A_BOLD);
-        mvprintw(1, help_start, "EDIT MODE HELP");
-        attroff(COLOR_PAIR(3) | A_BOLD);
+        editor_draw_status(ctx);
+        ctx->full_redraw = false;
+        ctx->status_dirty = false;
+    } else {
+        // Moving onto another field repaints the old and the new field
+        if (editor_update_field(ctx, &old_field_start, &old_field_len)) {
+            editor_draw_range(ctx, old_field_start, old_field_len);
+            editor_draw_range(ctx, ctx->field_start, ctx->field_len);
+        }
 
-        int help_line = 3;
-        mvprintw(help_line++, help_start, "Navigation:");
-        mvprintw(help_line++, help_start + 2, "Arrows - Move cursor");
-        mvprintw(help_line++, help_start + 2, "PgUp/Dn - Scroll");
-        help_line++;
+        // A cursor move or nibble edit damages at most the old and the new cursor cell
+        if (ctx->drawn_cursor_x != ctx->cursor_x || ctx->drawn_cursor_y != ctx->cursor_y) {
+            editor_draw_cell(ctx, ctx->drawn_cursor_x, ctx->drawn_cursor_y);
+        }
+        editor_draw_cell(ctx, ctx->cursor_x, ctx->cursor_y);
 
-        mvprintw(help_line++, help_start, "Editing:");
-        mvprintw(help_line++, help_start + 2, "0-9,A-F - Hex input");
-        mvprintw(help_line++, help_start + 2, "TAB - Toggle edit");
-        mvprintw(help_line++, help_start + 2, "ESC - Cancel");
-        help_line++;
+        if (ctx->status_dirty) {
+            editor_draw_status(ctx);
+            ctx->status_dirty = false;
+        }
+    }
 
-        mvprintw(help_line++, help_start, "Actions:");
-        mvprintw(help_line++, help_start + 2, "S - Save changes");
-        help_line++;
+    ctx->drawn_cursor_x = ctx->cursor_x;
+    ctx->drawn_cursor_y = ctx->cursor_y;
+    wnoutrefresh(win);
+}
 
-        attron(COLOR_PAIR(4));
-        mvprintw(help_line++, help_start, "Warning:");
-        mvprintw(help_line++, help_start + 2, "Changes written");
-        mvprintw(help_line++, help_start + 2, "directly to disk!");
-        attroff(COLOR_PAIR(4));
+void editor_set_search(editor_context_t *ctx, const uint8_t *pattern, size_t length) {
+    if (!ctx || length > SEARCH_PATTERN_MAX) {
+        return;
     }
 
-    attron(COLOR_PAIR(2));
-    mvprintw(max_y - 2, 0, "%-80s", ctx->editing_mode ? "EDIT MODE" : "VIEW MODE");
-    attroff(COLOR_PAIR(2));
+    memcpy(ctx->search, pattern, length);
+    ctx->search_len = length;
+}
 
-    refresh();
+// Shows how far a search got every tenth of a second. Returns true when a key press asks to stop.
+static bool editor_search_progress(editor_context_t *ctx, struct timespec *shown, uint64_t done, uint64_t total) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((now.tv_sec - shown->tv_sec) * 1000 + (now.tv_nsec - shown->tv_nsec) / 1000000 < 100) {
+        return false;
+    }
+    *shown = now;
+
+    snprintf(ctx->message, sizeof(ctx->message), "Searching... %.0f%%, any key cancels", 100.0 * done / total);
+    editor_draw_status(ctx);
+    // wgetch refreshes the window, which is what puts the progress on screen
+    return wgetch(ctx->win) != ERR;
+}
+
+// Moves the cursor to the next match of the search pattern after it, or the previous one before
+// it. Reads the device as saved in large chunks, so pending edits are not matched.
+int editor_find(editor_context_t *ctx, bool backward) {
+    if (!ctx) {
+        return -1;
+    }
+    if (ctx->search_len == 0) {
+        editor_set_message(ctx, "Nothing to search for, press / first");
+        return -1;
+    }
+
+    size_t pattern_len = ctx->search_len;
+    uint64_t cursor = editor_cursor_offset(ctx);
+    uint64_t lo = backward ? 0 : cursor + 1;
+    uint64_t hi = backward ? cursor : ctx->device_size;
+    uint64_t total = hi > lo ? hi - lo : 0;
+    uint64_t done = 0;
+    int64_t found = -1;
+    bool cancelled = false;
+    int rc = 0;
+
+    uint8_t *buffer = (uint8_t *)malloc(EDITOR_SEARCH_CHUNK + SEARCH_PATTERN_MAX);
+    if (!buffer) {
+        editor_set_message(ctx, "Out of memory");
+        return -1;
+    }
+
+    struct timespec shown;
+    clock_gettime(CLOCK_MONOTONIC, &shown);
+    nodelay(ctx->win, TRUE);
+    while (done < total) {
+        // Each step covers the starts of one chunk plus the bytes a match crossing its end needs
+        uint64_t step = total - done < EDITOR_SEARCH_CHUNK ? total - done : EDITOR_SEARCH_CHUNK;
+        uint64_t start = backward ? hi - done - step : lo + done;
+        uint64_t length = step + pattern_len - 1;
+        if (length > ctx->device_size - start) {
+            length = ctx->device_size - start;
+        }
+        if (read_bytes(ctx->fs_info, start, buffer, (size_t)length) != 0) {
+            rc = -1;
+            break;
+        }
+
+        int64_t at = find_pattern(buffer, (size_t)step, (size_t)length, ctx->search, pattern_len, backward);
+        if (at >= 0) {
+            found = (int64_t)start + at;
+            break;
+        }
+        done += step;
+        if (done < total && editor_search_progress(ctx, &shown, done, total)) {
+            cancelled = true;
+            break;
+        }
+    }
+    nodelay(ctx->win, FALSE);
+    free(buffer);
+
+    if (cancelled) {
+        // The key that stopped the search may be the start of an escape sequence
+        flushinp();
+        snprintf(ctx->message, sizeof(ctx->message), "Search cancelled at 0x%lx",
+                 (unsigned long)(backward ? hi - done : lo + done));
+        ctx->status_dirty = true;
+        return -1;
+    }
+    if (rc != 0) {
+        editor_set_message(ctx, "Error reading device");
+        return -1;
+    }
+    if (found < 0) {
+        editor_set_message(ctx, backward ? "Not found before the cursor" : "Not found after the cursor");
+        return -1;
+    }
+
+    editor_goto(ctx, (uint64_t)found);
+    snprintf(ctx->message, sizeof(ctx->message), "Found at 0x%lx (block %lu)", (unsigned long)found,
+             (unsigned long)((uint64_t)found / ctx->fs_info->block_size));
+    ctx->status_dirty = true;
+    return 0;
 }
 
 bool editor_handle_key(editor_context_t *ctx, int key) {
@@ -324,18 +852,81 @@ bool editor_handle_key(editor_context_t *ctx, int key) {
             editor_move_cursor(ctx, 1, 0);
             break;
             
+        case KEY_PPAGE:
+            editor_scroll(ctx, -(int)ctx->view_rows);
+            break;
+            
+        case KEY_NPAGE:
+            editor_scroll(ctx, (int)ctx->view_rows);
+            break;
+            
+        case KEY_HOME:
+            editor_goto(ctx, 0);
+            break;
+            
+        case KEY_END:
+            editor_goto(ctx, ctx->device_size - 1);
+            break;
+            
+        case KEY_RESIZE:
+            ctx->full_redraw = true;
+            break;
+            
+        case 'h':
+        case 'H':
+            ctx->field_highlight = !ctx->field_highlight;
+            ctx->status_dirty = true;
+            break;
+            
+        case 'k':
+        case 'K':
+            ctx->fix_checksums = !ctx->fix_checksums;
+            editor_set_message(ctx, ctx->fix_checksums ? "Checksums recomputed on save" : "Checksums left as edited");
+            break;
+            
         case '\t':
             ctx->editing_mode = !ctx->editing_mode;
+            ctx->message[0] = '\0';
+            ctx->full_redraw = true;
+            break;
+            
+        case 'u':
+        case 'U': {
+            uint64_t offset;
+            if (edit_log_undo(ctx->edits, &offset) == 0) {
+                editor_goto(ctx, offset);
+            } else {
+                editor_set_message(ctx, "Nothing to undo");
+            }
+            break;
+        }
+            
+        case 'r':
+        case 'R': {
+            uint64_t offset;
+            if (edit_log_redo(ctx->edits, &offset) == 0) {
+                editor_goto(ctx, offset);
+            } else {
+                editor_set_message(ctx, "Nothing to redo");
+            }
             break;
+        }
             
         case 's':
         case 'S':
             if (editor_save_changes(ctx) == 0) {
-                mvprintw(ctx->view_rows + 4, 0, "Changes saved successfully.");
+                editor_set_message(ctx, "Changes saved successfully.");
             } else {
-                mvprintw(ctx->view_rows + 4, 0, "Error saving changes!");
+                editor_set_message(ctx, "Error saving changes!");
             }
-            refresh();
+            break;
+            
+        case 'n':
+            editor_find(ctx, false);
+            break;
+            
+        case 'N':
+            editor_find(ctx, true);
             break;
             
         case 'q':
@@ -355,10 +946,14 @@ bool editor_handle_key(editor_context_t *ctx, int key) {
                 }
                 
                 if (value >= 0) {
-                    size_t index = ctx->cursor_y * ctx->bytes_per_row + ctx->cursor_x;
+                    uint64_t offset = editor_cursor_offset(ctx);
+                    if (!editor_in_window(ctx, offset)) {
+                        break;
+                    }
                     
-                    uint8_t current = ctx->buffer[index];
-                    ctx->buffer[index] = (current & 0x0F) | (value << 4);
+                    uint8_t current = editor_byte_at(ctx, offset, NULL);
+                    editor_set_byte(ctx, (current & 0x0F) | (value << 4));
+                    ctx->status_dirty = true;
                     
                     editor_move_cursor(ctx, 1, 0);
                 }
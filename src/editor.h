@@ -6,10 +6,17 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <unistd.h> 
+#include <ncurses.h>
 #include "analyzer.h"
+#include "editlog.h"
+#include "schema.h"
+#include "utils.h"
 
 #define _POSIX_C_SOURCE 200809L
 
+#define EDITOR_WINDOW_BYTES (256 * 1024)
+#define EDITOR_SEARCH_CHUNK (8u << 20)  // Device bytes read ahead per search step
+
 typedef enum {
     STRUCTURE_SUPERBLOCK,       // Superblock
     STRUCTURE_GROUP_DESC,       // Group descriptor
@@ -21,21 +28,39 @@ typedef enum {
 
 typedef struct {
     fs_info_t *fs_info;         // Filesystem information
-    uint64_t current_offset;    // Current offset in the file/device
-    uint8_t *buffer;            // Buffer for the current view
-    size_t buffer_size;         // Size of the buffer
+    uint64_t current_offset;    // Device offset of the top-left byte of the view
+    uint8_t *buffer;            // Sliding read-ahead window of device blocks
+    size_t buffer_size;         // Capacity of the window in bytes
+    uint64_t window_offset;     // Device offset of buffer[0]
+    size_t window_len;          // Number of valid bytes in the window
+    uint64_t device_size;       // Number of addressable bytes on the device
     uint32_t cursor_x;          // Cursor X position (column)
     uint32_t cursor_y;          // Cursor Y position (row)
     uint32_t bytes_per_row;     // Number of bytes displayed per row
     uint32_t view_rows;         // Number of rows in the view
     bool editing_mode;          // Whether in editing mode
     bool field_highlight;       // Whether to highlight structure fields
+    bool fix_checksums;         // Recompute metadata checksums covering the edits on save
     structure_type_t current_structure; // Current structure being edited
     uint32_t current_id;        // ID of current structure (block/inode number)
     bool should_exit;           // Flag to indicate if editor should exit
 
     structure_type_t edited_structure;
     uint32_t edited_id;
+    uint64_t struct_offset;     // Device offset of the opened structure
+    uint32_t struct_size;       // Size of the opened structure in bytes
+    edit_log_t *edits;          // Unsaved edits with undo/redo history
+
+    WINDOW *win;                // Window the editor renders into
+    bool full_redraw;           // Whole view must be repainted on next render
+    bool status_dirty;          // Mode line must be repainted on next render
+    uint32_t drawn_cursor_x;    // Cursor column painted by the last render
+    uint32_t drawn_cursor_y;    // Cursor row painted by the last render
+    uint64_t field_start;       // Device offset of the highlighted field
+    uint32_t field_len;         // Length of the highlighted field, 0 when none
+    char message[80];           // Result of the last action, shown in the mode line
+    uint8_t search[SEARCH_PATTERN_MAX]; // Pattern of the last search
+    size_t search_len;          // Bytes in search, 0 before the first search
 } editor_context_t;
 
 editor_context_t *editor_init(fs_info_t *fs_info);
@@ -43,8 +68,15 @@ void editor_cleanup(editor_context_t *ctx);
 int editor_open_structure(editor_context_t *ctx, structure_type_t type, uint32_t id);
 int editor_save_changes(editor_context_t *ctx);
 void editor_move_cursor(editor_context_t *ctx, int dx, int dy);
+int editor_goto(editor_context_t *ctx, uint64_t offset);
+void editor_scroll(editor_context_t *ctx, int rows);
 void editor_set_byte(editor_context_t *ctx, uint8_t value);
+void editor_set_window(editor_context_t *ctx, WINDOW *win);
+void editor_invalidate(editor_context_t *ctx);
+int editor_reload(editor_context_t *ctx);
 void editor_render(editor_context_t *ctx);
 bool editor_handle_key(editor_context_t *ctx, int key);
+void editor_set_search(editor_context_t *ctx, const uint8_t *pattern, size_t length);
+int editor_find(editor_context_t *ctx, bool backward);
 
 #endif /* EDITOR_H */
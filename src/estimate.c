@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "estimate.h"
+#include "parallel.h"
+#include "utils.h"
+
+#define Z95 1.959964                // Normal quantile of a two-sided 95% interval
+#define EXTENT_MAGIC 0xF30A         // Extent tree header magic
+#define PROGRESS_STEPS 1000         // Job progress resolution
+
+// Per sampled unit values. Inode table blocks fill the first four and the size buckets,
+// bitmap words fill EV_FREE and EV_RUNS.
+enum {
+    EV_FILES,
+    EV_BYTES,
+    EV_MAPPED,
+    EV_FRAGMENTED,
+    EV_FREE,
+    EV_RUNS,
+    EV_SIZES,
+    EV_COUNT = EV_SIZES + STATS_SIZE_BUCKETS
+};
+
+// Ratio estimators and the cross products they need
+enum {
+    ER_AVG_SIZE,                // EV_BYTES / EV_FILES
+    ER_FRAGMENTED,              // EV_FRAGMENTED / EV_MAPPED
+    ER_RUN_LENGTH,              // EV_FREE / EV_RUNS
+    ER_COUNT
+};
+
+// Running sums of one kind of sample unit, enough for means, variances and ratio variances
+typedef struct {
+    uint64_t n;                 // Units sampled
+    double sum[EV_COUNT];
+    double sumsq[EV_COUNT];
+    double cross[ER_COUNT];
+} estimate_acc_t;
+
+// Visits 0..n-1 in a random order without repeats: a full period LCG modulo the next power of two,
+// scrambled by an invertible mix and cycle-walked back into range
+typedef struct {
+    uint64_t n;
+    uint64_t mask;
+    uint32_t shift;
+    uint64_t state;
+    uint64_t mul;
+    uint64_t inc;
+    uint64_t key;
+} sample_order_t;
+
+typedef struct {
+    estimate_acc_t table;       // Partial sums over inode table blocks
+    estimate_acc_t bitmap;      // Partial sums over bitmap words
+    unsigned char *block;       // One inode table block
+    unsigned char bits[72];     // Inode bitmap bytes covering that block, up to 512 inodes
+} estimate_worker_t;
+
+typedef struct {
+    fs_info_t *fs_info;
+    uint32_t inode_size;
+    uint32_t per_block;         // Inodes per table block
+    uint32_t table_per_group;   // Inode table blocks per group
+    uint32_t words_per_group;   // Bitmap words per group
+    uint64_t *indices;          // Units of this round: block_count table blocks, then word_count words
+    uint32_t block_count;
+    uint32_t word_count;
+    estimate_acc_t table;       // Totals over all rounds
+    estimate_acc_t bitmap;
+} estimate_state_t;
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static void order_init(sample_order_t *o, uint64_t n, uint64_t *seed) {
+    uint32_t bits = 1;
+
+    while (bits < 64 && (1ull << bits) < n) {
+        bits++;
+    }
+    o->n = n;
+    o->mask = bits == 64 ? ~0ull : (1ull << bits) - 1;
+    o->shift = bits / 2 + 1;
+    o->mul = ((splitmix64(seed) & o->mask) & ~3ull) | 1;   // a = 1 mod 4 and c odd give the full period
+    o->inc = (splitmix64(seed) & o->mask) | 1;
+    o->key = splitmix64(seed) | 1;
+    o->state = splitmix64(seed) & o->mask;
+}
+
+static uint64_t order_next(sample_order_t *o) {
+    uint64_t x;
+
+    do {
+        o->state = (o->state * o->mul + o->inc) & o->mask;
+        x = o->state;
+        x ^= x >> o->shift;
+        x = (x * o->key) & o->mask;
+        x ^= x >> o->shift;
+    } while (x >= o->n);
+    return x;
+}
+
+static void acc_add(estimate_acc_t *acc, const double *v) {
+    acc->n++;
+    for (uint32_t i = 0; i < EV_COUNT; i++) {
+        acc->sum[i] += v[i];
+        acc->sumsq[i] += v[i] * v[i];
+    }
+    acc->cross[ER_AVG_SIZE] += v[EV_BYTES] * v[EV_FILES];
+    acc->cross[ER_FRAGMENTED] += v[EV_FRAGMENTED] * v[EV_MAPPED];
+    acc->cross[ER_RUN_LENGTH] += v[EV_FREE] * v[EV_RUNS];
+}
+
+static void acc_merge(estimate_acc_t *into, const estimate_acc_t *from) {
+    into->n += from->n;
+    for (uint32_t i = 0; i < EV_COUNT; i++) {
+        into->sum[i] += from->sum[i];
+        into->sumsq[i] += from->sumsq[i];
+    }
+    for (uint32_t i = 0; i < ER_COUNT; i++) {
+        into->cross[i] += from->cross[i];
+    }
+}
+
+// Population total of a variable from a simple random sample of n out of population units
+static estimate_value_t acc_total(const estimate_acc_t *acc, uint32_t var, uint64_t population) {
+    estimate_value_t e = { 0.0, INFINITY };
+    double n = (double)acc->n;
+    double N = (double)population;
+
+    if (acc->n == 0) {
+        return e;
+    }
+    double mean = acc->sum[var] / n;
+    e.value = mean * N;
+    if (acc->n == population) {
+        e.margin = 0.0;
+    } else if (acc->n > 1) {
+        double s2 = (acc->sumsq[var] - acc->sum[var] * mean) / (n - 1);
+        double fpc = 1.0 - n / N;
+        e.margin = Z95 * N * sqrt((s2 > 0 ? s2 : 0) * fpc / n);
+    }
+    return e;
+}
+
+// Ratio of two population totals, with the linearised variance of the ratio estimator
+static estimate_value_t acc_ratio(const estimate_acc_t *acc, uint32_t y, uint32_t x, uint32_t cross, uint64_t population) {
+    estimate_value_t e = { 0.0, INFINITY };
+    double n = (double)acc->n;
+
+    if (acc->n == 0 || acc->sum[x] == 0) {
+        return e;
+    }
+    double r = acc->sum[y] / acc->sum[x];
+    e.value = r;
+    if (acc->n == population) {
+        e.margin = 0.0;
+    } else if (acc->n > 1) {
+        double xbar = acc->sum[x] / n;
+        double s2 = (acc->sumsq[y] - 2 * r * acc->cross[cross] + r * r * acc->sumsq[x]) / (n - 1);
+        double fpc = 1.0 - n / (double)population;
+        e.margin = Z95 * sqrt((s2 > 0 ? s2 : 0) * fpc / n) / xbar;
+    }
+    return e;
+}
+
+static double relative_margin(estimate_value_t e) {
+    if (e.value == 0) {
+        return e.margin == 0 ? 0.0 : INFINITY;
+    }
+    return e.margin / fabs(e.value);
+}
+
+// Whether the block map stored inside the inode references at least two blocks, and whether they
+// are out of order. Deeper maps are not followed; an extent tree that needs index blocks is
+// counted as fragmented.
+static void inline_map_fragmentation(const struct ext2_inode *inode, double *mapped, double *fragmented) {
+    if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)) || (inode->i_flags & EXT4_INLINE_DATA_FL)) {
+        return;
+    }
+
+    if (inode->i_flags & EXT4_EXTENTS_FL) {
+        const unsigned char *raw = (const unsigned char *)inode->i_block;
+        uint16_t magic, entries, depth;
+        memcpy(&magic, raw, 2);
+        memcpy(&entries, raw + 2, 2);
+        memcpy(&depth, raw + 6, 2);
+        if (magic != EXTENT_MAGIC) {
+            return;
+        }
+        if (depth > 0) {
+            *mapped = 1;
+            *fragmented = 1;
+            return;
+        }
+
+        uint64_t blocks = 0, next = 0;
+        bool broken = false;
+        for (uint32_t i = 0; i < entries && i < 4; i++) {
+            const unsigned char *ext = raw + 12 + i * 12;
+            uint16_t len, start_hi;
+            uint32_t start_lo;
+            memcpy(&len, ext + 4, 2);
+            memcpy(&start_hi, ext + 6, 2);
+            memcpy(&start_lo, ext + 8, 4);
+            len = len > 32768 ? len - 32768 : len;
+            uint64_t start = ((uint64_t)start_hi << 32) | start_lo;
+            broken |= i > 0 && start != next;
+            next = start + len;
+            blocks += len;
+        }
+        *mapped = blocks > 1;
+        *fragmented = blocks > 1 && broken;
+        return;
+    }
+
+    // Direct pointers plus the first indirect block, which ext2 places right after them
+    uint32_t prev = 0, count = 0;
+    bool broken = false;
+    for (uint32_t i = 0; i <= EXT2_IND_BLOCK; i++) {
+        uint32_t block = inode->i_block[i];
+        if (block == 0) {
+            continue;
+        }
+        broken |= count > 0 && block != prev + 1;
+        prev = block;
+        count++;
+    }
+    *mapped = count > 1;
+    *fragmented = count > 1 && broken;
+}
+
+static int estimate_worker_init(void *worker, void *arg) {
+    estimate_worker_t *w = (estimate_worker_t *)worker;
+    estimate_state_t *st = (estimate_state_t *)arg;
+
+    w->block = (unsigned char *)malloc(st->fs_info->block_size);
+    return w->block ? 0 : -1;
+}
+
+static int sample_table_block(estimate_state_t *st, estimate_worker_t *w, uint64_t index) {
+    fs_info_t *fs_info = st->fs_info;
+    uint32_t group = (uint32_t)(index / st->table_per_group);
+    uint32_t block = (uint32_t)(index % st->table_per_group);
+    struct ext2_group_desc *gd = &fs_info->group_desc[group];
+    uint32_t first = block * st->per_block;
+    double v[EV_COUNT] = { 0 };
+
+    if (!(gd->bg_flags & EXT2_BG_INODE_UNINIT) && first < fs_info->inodes_per_group) {
+        uint32_t count = fs_info->inodes_per_group - first < st->per_block ? fs_info->inodes_per_group - first : st->per_block;
+        uint32_t lo = first / 8, hi = (first + count - 1) / 8;
+
+        if (read_bytes(fs_info, (uint64_t)gd->bg_inode_bitmap * fs_info->block_size + lo, w->bits, hi - lo + 1) != 0 ||
+            read_block(fs_info, gd->bg_inode_table + block, w->block) != 0) {
+            return -1;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (!check_bitmap_bit(w->bits, first + i - lo * 8)) {
+                continue;
+            }
+            const struct ext2_inode *inode = (const struct ext2_inode *)(w->block + (size_t)i * st->inode_size);
+            uint64_t size = inode_file_size(inode);
+            double mapped = 0, fragmented = 0;
+
+            inline_map_fragmentation(inode, &mapped, &fragmented);
+            v[EV_FILES]++;
+            v[EV_BYTES] += (double)size;
+            v[EV_MAPPED] += mapped;
+            v[EV_FRAGMENTED] += fragmented;
+            v[EV_SIZES + stats_size_bucket(size)]++;
+        }
+    }
+
+    acc_add(&w->table, v);
+    return 0;
+}
+
+// Free blocks and starts of free runs in one bitmap word. The bit before the word is read along
+// with it; a group's first bit counts as preceded by a used one.
+static int sample_bitmap_word(estimate_state_t *st, estimate_worker_t *w, uint64_t index) {
+    fs_info_t *fs_info = st->fs_info;
+    uint32_t group = (uint32_t)(index / st->words_per_group);
+    uint32_t word = (uint32_t)(index % st->words_per_group);
+    struct ext2_group_desc *gd = &fs_info->group_desc[group];
+    uint32_t valid = group_block_count(fs_info, group) - word * 64;
+    uint64_t bits = 0, prev = 1;
+    double v[EV_COUNT] = { 0 };
+
+    valid = valid < 64 ? valid : 64;
+    if (!(gd->bg_flags & EXT2_BG_BLOCK_UNINIT)) {
+        unsigned char raw[9];
+        uint32_t before = word > 0;
+        uint32_t length = (valid + 7) / 8 + before;
+
+        if (read_bytes(fs_info, (uint64_t)gd->bg_block_bitmap * fs_info->block_size + (uint64_t)word * 8 - before,
+                       raw, length) != 0) {
+            return -1;
+        }
+        for (uint32_t i = before; i < length; i++) {
+            bits |= (uint64_t)raw[i] << ((i - before) * 8);
+        }
+        prev = before ? raw[0] >> 7 : 1;
+    }
+
+    uint64_t mask = valid == 64 ? ~0ull : (1ull << valid) - 1;
+    uint64_t free_bits = ~bits & mask;
+    v[EV_FREE] = __builtin_popcountll(free_bits);
+    v[EV_RUNS] = __builtin_popcountll(free_bits & ((bits << 1) | prev));
+
+    acc_add(&w->bitmap, v);
+    return 0;
+}
+
+static int estimate_sample(uint32_t item, void *worker, void *arg) {
+    estimate_state_t *st = (estimate_state_t *)arg;
+    estimate_worker_t *w = (estimate_worker_t *)worker;
+
+    if (item < st->block_count) {
+        return sample_table_block(st, w, st->indices[item]);
+    }
+    return sample_bitmap_word(st, w, st->indices[item]);
+}
+
+static int estimate_worker_finish(void *worker, void *arg) {
+    estimate_worker_t *w = (estimate_worker_t *)worker;
+    estimate_state_t *st = (estimate_state_t *)arg;
+
+    acc_merge(&st->table, &w->table);
+    acc_merge(&st->bitmap, &w->bitmap);
+    free(w->block);
+    return 0;
+}
+
+static void estimate_fill(const estimate_state_t *st, fs_estimate_t *est) {
+    const estimate_acc_t *t = &st->table, *b = &st->bitmap;
+    uint64_t N = est->table_blocks, W = est->bitmap_words;
+
+    est->blocks_sampled = t->n;
+    est->words_sampled = b->n;
+    est->files = acc_total(t, EV_FILES, N);
+    est->bytes = acc_total(t, EV_BYTES, N);
+    est->avg_size = acc_ratio(t, EV_BYTES, EV_FILES, ER_AVG_SIZE, N);
+    est->fragmented = acc_ratio(t, EV_FRAGMENTED, EV_MAPPED, ER_FRAGMENTED, N);
+    est->free_blocks = acc_total(b, EV_FREE, W);
+    est->free_extents = acc_total(b, EV_RUNS, W);
+    est->extent_length = acc_ratio(b, EV_FREE, EV_RUNS, ER_RUN_LENGTH, W);
+    for (uint32_t i = 0; i < STATS_SIZE_BUCKETS; i++) {
+        est->sizes[i] = acc_total(t, EV_SIZES + i, N);
+    }
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double elapsed_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Samples inode table blocks and block bitmap words in doubling rounds until the file count and free
+// extent count are known to within precision (relative 95% half width), everything has been read,
+// or seconds have passed (0 = no limit). Each round's estimate is published to slot when one is given.
+int estimate_run(fs_info_t *fs_info, double precision, double seconds, uint32_t threads, job_t *job,
+                 job_slot_t *slot, fs_estimate_t *out) {
+    estimate_state_t st;
+    fs_estimate_t est;
+    memset(&st, 0, sizeof(st));
+    memset(&est, 0, sizeof(est));
+
+    st.fs_info = fs_info;
+    st.inode_size = fs_info->sb.s_inode_size ? fs_info->sb.s_inode_size : EXT2_GOOD_OLD_INODE_SIZE;
+    st.per_block = fs_info->block_size / st.inode_size;
+    st.table_per_group = inode_table_blocks(fs_info);
+    st.words_per_group = (fs_info->blocks_per_group + 63) / 64;
+    if (fs_info->groups_count == 0 || st.per_block == 0 || st.per_block > 512) {
+        return -1;
+    }
+
+    est.table_blocks = (uint64_t)fs_info->groups_count * st.table_per_group;
+    est.bitmap_words = (uint64_t)(fs_info->groups_count - 1) * st.words_per_group +
+                       (group_block_count(fs_info, fs_info->groups_count - 1) + 63) / 64;
+    est.sb_used_inodes = fs_info->sb.s_inodes_count - fs_info->sb.s_free_inodes_count;
+    est.sb_free_blocks = fs_info->sb.s_free_blocks_count;
+
+    st.indices = (uint64_t *)malloc((size_t)ESTIMATE_MAX_ROUND * 9 * sizeof(uint64_t));
+    if (!st.indices) {
+        return -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t seed = (uint64_t)start.tv_nsec ^ ((uint64_t)start.tv_sec << 20) ^ (uint64_t)getpid();
+    sample_order_t block_order, word_order;
+    order_init(&block_order, est.table_blocks, &seed);
+    order_init(&word_order, est.bitmap_words, &seed);
+
+    job_set_total(job, PROGRESS_STEPS);
+    uint64_t progress = 0;
+    uint32_t round = ESTIMATE_FIRST_ROUND;
+    int rc = 0;
+
+    while (!est.done) {
+        if (job_is_cancelled(job)) {
+            rc = -1;
+            break;
+        }
+
+        uint64_t blocks_left = est.table_blocks - st.table.n, words_left = est.bitmap_words - st.bitmap.n;
+        st.block_count = (uint32_t)(blocks_left < round ? blocks_left : round);
+        st.word_count = (uint32_t)(words_left < (uint64_t)round * 8 ? words_left : (uint64_t)round * 8);
+        for (uint32_t i = 0; i < st.block_count; i++) {
+            st.indices[i] = order_next(&block_order);
+        }
+        for (uint32_t i = 0; i < st.word_count; i++) {
+            st.indices[st.block_count + i] = order_next(&word_order);
+        }
+        // Visiting each round in disk order keeps the reads mostly forward
+        qsort(st.indices, st.block_count, sizeof(uint64_t), compare_u64);
+        qsort(st.indices + st.block_count, st.word_count, sizeof(uint64_t), compare_u64);
+
+        parallel_t p;
+        memset(&p, 0, sizeof(p));
+        p.items = st.block_count + st.word_count;
+        p.threads = threads;
+        p.worker_size = sizeof(estimate_worker_t);
+        p.arg = &st;
+        p.init = estimate_worker_init;
+        p.work = estimate_sample;
+        p.finish = estimate_worker_finish;
+        if (parallel_run(&p) != 0) {
+            rc = -1;
+            break;
+        }
+
+        estimate_fill(&st, &est);
+        est.seconds = elapsed_since(&start);
+
+        double worst = fmax(relative_margin(est.files), relative_margin(est.free_extents));
+        bool exhausted = st.table.n == est.table_blocks && st.bitmap.n == est.bitmap_words;
+        bool precise = st.table.n >= ESTIMATE_MIN_SAMPLES && st.bitmap.n >= ESTIMATE_MIN_SAMPLES && worst <= precision;
+        est.done = exhausted || precise;
+
+        fs_estimate_t *copy = slot ? (fs_estimate_t *)malloc(sizeof(fs_estimate_t)) : NULL;
+        if (copy) {
+            *copy = est;
+            job_slot_publish(slot, copy);
+        }
+
+        // The interval narrows with the square root of the sample, so (precision / worst)^2 is the
+        // share of the needed sample already taken
+        double share = est.done ? 1.0 : (isfinite(worst) && worst > 0 ? fmin(1.0, pow(precision / worst, 2)) : 0.0);
+        share = fmax(share, (double)(st.table.n + st.bitmap.n) / (double)(est.table_blocks + est.bitmap_words));
+        uint64_t target = (uint64_t)(share * PROGRESS_STEPS);
+        if (target > progress) {
+            job_advance(job, target - progress);
+            progress = target;
+        }
+
+        if (seconds > 0 && est.seconds >= seconds) {
+            break;
+        }
+        round = round * 2 < ESTIMATE_MAX_ROUND ? round * 2 : ESTIMATE_MAX_ROUND;
+    }
+
+    free(st.indices);
+    if (out) {
+        *out = est;
+    }
+    return rc;
+}
+
+static void json_estimate(FILE *out, const char *name, estimate_value_t e, bool last) {
+    if (isfinite(e.margin)) {
+        fprintf(out, "  \"%s\": {\"value\": %.6g, \"margin\": %.6g}%s\n", name, e.value, e.margin, last ? "" : ",");
+    } else {
+        fprintf(out, "  \"%s\": {\"value\": %.6g, \"margin\": null}%s\n", name, e.value, last ? "" : ",");
+    }
+}
+
+// Writes an estimate as one JSON object. Every estimate carries the half width of its 95% interval.
+void estimate_write_json(const fs_estimate_t *est, FILE *out) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"seconds\": %.3f,\n", est->seconds);
+    fprintf(out, "  \"done\": %s,\n", est->done ? "true" : "false");
+    fprintf(out, "  \"table_blocks\": %lu,\n", (unsigned long)est->table_blocks);
+    fprintf(out, "  \"blocks_sampled\": %lu,\n", (unsigned long)est->blocks_sampled);
+    fprintf(out, "  \"bitmap_words\": %lu,\n", (unsigned long)est->bitmap_words);
+    fprintf(out, "  \"words_sampled\": %lu,\n", (unsigned long)est->words_sampled);
+    fprintf(out, "  \"superblock_inodes\": %lu,\n", (unsigned long)est->sb_used_inodes);
+    fprintf(out, "  \"superblock_free_blocks\": %lu,\n", (unsigned long)est->sb_free_blocks);
+    json_estimate(out, "inodes", est->files, false);
+    json_estimate(out, "bytes", est->bytes, false);
+    json_estimate(out, "average_size", est->avg_size, false);
+    json_estimate(out, "fragmented_fraction", est->fragmented, false);
+    json_estimate(out, "free_blocks", est->free_blocks, false);
+    json_estimate(out, "free_extents", est->free_extents, false);
+    json_estimate(out, "free_extent_length", est->extent_length, false);
+
+    fprintf(out, "  \"size_count\": [");
+    for (uint32_t i = 0; i < STATS_SIZE_BUCKETS; i++) {
+        const estimate_value_t *e = &est->sizes[i];
+        if (isfinite(e->margin)) {
+            fprintf(out, "%s{\"value\": %.6g, \"margin\": %.6g}", i ? ", " : "", e->value, e->margin);
+        } else {
+            fprintf(out, "%s{\"value\": %.6g, \"margin\": null}", i ? ", " : "", e->value);
+        }
+    }
+    fprintf(out, "]\n}\n");
+}
+
+// Job body: refines an estimate in the job_slot_t passed as arg until it is precise enough
+int estimate_job(job_t *job, void *arg) {
+    job_slot_t *slot = (job_slot_t *)arg;
+    fs_estimate_t est;
+
+    job_slot_publish(slot, NULL);
+    int rc = estimate_run((fs_info_t *)slot->source, ESTIMATE_PRECISION, 0, 0, job, slot, &est);
+    job_slot_finish(slot, job, NULL);
+
+    if (rc != 0) {
+        job_printf(job, "%s", job_is_cancelled(job) ? "Estimate stopped" : "Estimate failed");
+        return job_is_cancelled(job) ? 0 : -1;
+    }
+
+    job_printf(job, "%.0f +/- %.0f inode(s) from %lu of %lu table blocks in %.2f s", est.files.value, est.files.margin,
+               (unsigned long)est.blocks_sampled, (unsigned long)est.table_blocks, est.seconds);
+    return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "analyzer.h"
+#include "job.h"
+#include "stats.h"
+
+#define ESTIMATE_PRECISION 0.01     // Stop once the main 95% intervals are within 1% of their estimate
+#define ESTIMATE_MIN_SAMPLES 32     // Units of each kind sampled before the precision test applies
+#define ESTIMATE_FIRST_ROUND 64     // Inode table blocks in the first round, bitmap words are 8 times that
+#define ESTIMATE_MAX_ROUND 2048     // Inode table blocks per round once rounds stop doubling
+
+// Estimate with the half width of its 95% confidence interval, margin is INFINITY with too few samples
+typedef struct {
+    double value;
+    double margin;
+} estimate_value_t;
+
+typedef struct {
+    uint64_t table_blocks;      // Inode table blocks in the filesystem
+    uint64_t blocks_sampled;    // Of those read so far
+    uint64_t bitmap_words;      // 64-bit words of block bitmap
+    uint64_t words_sampled;     // Of those read so far
+    double seconds;             // Time spent sampling
+    bool done;                  // Precision reached or everything sampled
+    uint64_t sb_used_inodes;    // Superblock counters, for comparison
+    uint64_t sb_free_blocks;
+    estimate_value_t files;     // Allocated inodes
+    estimate_value_t bytes;     // Sum of file sizes
+    estimate_value_t avg_size;  // Bytes per allocated inode
+    estimate_value_t fragmented; // Fraction of multi-block files whose inline block map is not contiguous
+    estimate_value_t free_blocks; // Free blocks in the block bitmaps
+    estimate_value_t free_extents; // Runs of free blocks, split at group boundaries
+    estimate_value_t extent_length; // Mean free run length in blocks
+    estimate_value_t sizes[STATS_SIZE_BUCKETS]; // Inodes per size bucket, as in stats_hist_t
+} fs_estimate_t;
+
+int estimate_run(fs_info_t *fs_info, double precision, double seconds, uint32_t threads, job_t *job,
+                 job_slot_t *slot, fs_estimate_t *out);
+
+void estimate_write_json(const fs_estimate_t *est, FILE *out);
+
+int estimate_job(job_t *job, void *arg);
+
+#endif /* ESTIMATE_H */
@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "export.h"
+#include "inodeiter.h"
+#include "parallel.h"
+#include "utils.h"
+
+typedef struct {
+    inode_iter_t it;            // Reads the inode table of one group at a time
+    char *data;                 // Formatted records of the current group
+    size_t length;              // Bytes used in data
+    size_t capacity;            // Bytes allocated for data
+    uint64_t records;           // Records formatted for the current group
+} export_worker_t;
+
+typedef struct {
+    fs_info_t *fs_info;         // Filesystem to export
+    export_format_t format;     // Output format
+    int fd;                     // Destination
+    const unsigned char *filter; // Inodes to export, bit ino - 1, NULL for all
+    char *out;                  // Pending output shared by all workers, written by emit only
+    size_t out_length;          // Bytes pending in out
+    uint64_t exported;          // Records written so far
+} export_state_t;
+
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Decimal without snprintf, two digits per step from the right
+static char *put_u64(char *p, uint64_t value) {
+    char digits[20];
+    char *end = digits + sizeof(digits);
+    char *d = end;
+
+    while (value >= 100) {
+        uint32_t pair = (uint32_t)(value % 100) * 2;
+        value /= 100;
+        *--d = digit_pairs[pair + 1];
+        *--d = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        *--d = digit_pairs[value * 2 + 1];
+        *--d = digit_pairs[value * 2];
+    } else {
+        *--d = (char)('0' + value);
+    }
+
+    memcpy(p, d, end - d);
+    return p + (end - d);
+}
+
+static char *put_hex(char *p, uint64_t value) {
+    static const char hex[] = "0123456789abcdef";
+    int shift = 60;
+
+    *p++ = '0';
+    *p++ = 'x';
+    while (shift > 0 && ((value >> shift) & 0xf) == 0) {
+        shift -= 4;
+    }
+    for (; shift >= 0; shift -= 4) {
+        *p++ = hex[(value >> shift) & 0xf];
+    }
+    return p;
+}
+
+// Permission bits as four octal digits, like 0755
+static char *put_mode(char *p, uint16_t mode) {
+    p[0] = (char)('0' + ((mode >> 9) & 7));
+    p[1] = (char)('0' + ((mode >> 6) & 7));
+    p[2] = (char)('0' + ((mode >> 3) & 7));
+    p[3] = (char)('0' + (mode & 7));
+    return p + 4;
+}
+
+static char *put_str(char *p, const char *text) {
+    size_t length = strlen(text);
+
+    memcpy(p, text, length);
+    return p + length;
+}
+
+#define PUT_LITERAL(p, text) (memcpy((p), (text), sizeof(text) - 1), (p) + sizeof(text) - 1)
+
+static const char csv_header[] =
+    "inode,type,mode,uid,gid,size,links,blocks,atime,ctime,mtime,dtime,flags,generation,file_acl\n";
+
+static char *format_csv(char *p, uint32_t ino, const struct ext2_inode *inode) {
+    p = put_u64(p, ino);                            *p++ = ',';
+    p = put_str(p, inode_type_name(inode->i_mode)); *p++ = ',';
+    p = put_mode(p, inode->i_mode);                 *p++ = ',';
+    p = put_u64(p, inode_uid(inode));               *p++ = ',';
+    p = put_u64(p, inode_gid(inode));               *p++ = ',';
+    p = put_u64(p, inode_file_size(inode));         *p++ = ',';
+    p = put_u64(p, inode->i_links_count);           *p++ = ',';
+    p = put_u64(p, inode_block_count(inode));       *p++ = ',';
+    p = put_u64(p, inode->i_atime);                 *p++ = ',';
+    p = put_u64(p, inode->i_ctime);                 *p++ = ',';
+    p = put_u64(p, inode->i_mtime);                 *p++ = ',';
+    p = put_u64(p, inode->i_dtime);                 *p++ = ',';
+    p = put_hex(p, inode->i_flags);                 *p++ = ',';
+    p = put_u64(p, inode->i_generation);            *p++ = ',';
+    p = put_u64(p, inode->i_file_acl | ((uint64_t)inode->osd2.linux2.l_i_file_acl_high << 32));
+    *p++ = '\n';
+    return p;
+}
+
+static char *format_ndjson(char *p, uint32_t ino, const struct ext2_inode *inode) {
+    p = PUT_LITERAL(p, "{\"inode\":");       p = put_u64(p, ino);
+    p = PUT_LITERAL(p, ",\"type\":\"");      p = put_str(p, inode_type_name(inode->i_mode));
+    p = PUT_LITERAL(p, "\",\"mode\":\"");    p = put_mode(p, inode->i_mode);
+    p = PUT_LITERAL(p, "\",\"uid\":");       p = put_u64(p, inode_uid(inode));
+    p = PUT_LITERAL(p, ",\"gid\":");         p = put_u64(p, inode_gid(inode));
+    p = PUT_LITERAL(p, ",\"size\":");        p = put_u64(p, inode_file_size(inode));
+    p = PUT_LITERAL(p, ",\"links\":");       p = put_u64(p, inode->i_links_count);
+    p = PUT_LITERAL(p, ",\"blocks\":");      p = put_u64(p, inode_block_count(inode));
+    p = PUT_LITERAL(p, ",\"atime\":");       p = put_u64(p, inode->i_atime);
+    p = PUT_LITERAL(p, ",\"ctime\":");       p = put_u64(p, inode->i_ctime);
+    p = PUT_LITERAL(p, ",\"mtime\":");       p = put_u64(p, inode->i_mtime);
+    p = PUT_LITERAL(p, ",\"dtime\":");       p = put_u64(p, inode->i_dtime);
+    p = PUT_LITERAL(p, ",\"flags\":\"");     p = put_hex(p, inode->i_flags);
+    p = PUT_LITERAL(p, "\",\"generation\":"); p = put_u64(p, inode->i_generation);
+    p = PUT_LITERAL(p, ",\"file_acl\":");
+    p = put_u64(p, inode->i_file_acl | ((uint64_t)inode->osd2.linux2.l_i_file_acl_high << 32));
+    p = PUT_LITERAL(p, "}\n");
+    return p;
+}
+
+static int export_write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            perror("Failed to write export");
+            return -1;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+static int export_worker_init(void *worker, void *arg) {
+    export_worker_t *w = (export_worker_t *)worker;
+    export_state_t *state = (export_state_t *)arg;
+
+    if (inode_iter_init(&w->it, state->fs_info, 0, 0, false) != 0) {
+        return -1;
+    }
+
+    // A full group of records usually fits, the buffer grows for the rest
+    w->capacity = (size_t)state->fs_info->inodes_per_group * 160 + EXPORT_RECORD_MAX;
+    w->data = (char *)malloc(w->capacity);
+    if (!w->data) {
+        inode_iter_cleanup(&w->it);
+        return -1;
+    }
+    return 0;
+}
+
+static int export_worker_finish(void *worker, void *arg) {
+    export_worker_t *w = (export_worker_t *)worker;
+    (void)arg;
+
+    inode_iter_cleanup(&w->it);
+    free(w->data);
+    return 0;
+}
+
+// Formats every allocated inode of a group into the worker's buffer
+static int export_group(uint32_t group, void *worker, void *arg) {
+    export_worker_t *w = (export_worker_t *)worker;
+    export_state_t *state = (export_state_t *)arg;
+    inode_iter_t *it = &w->it;
+    int rc;
+
+    w->length = 0;
+    w->records = 0;
+    inode_iter_reset(it, group, group + 1);
+
+    while ((rc = inode_iter_next(it)) > 0) {
+        for (uint32_t i = 0; i < it->count; i++) {
+            if (!inode_iter_used(it, i) ||
+                (state->filter && !check_bitmap_bit(state->filter, it->first_inode + i - 1))) {
+                continue;
+            }
+
+            if (w->capacity - w->length < EXPORT_RECORD_MAX) {
+                char *grown = (char *)realloc(w->data, w->capacity * 2);
+                if (!grown) {
+                    return -1;
+                }
+                w->data = grown;
+                w->capacity *= 2;
+            }
+
+            const struct ext2_inode *inode = inode_iter_inode(it, i);
+            char *p = w->data + w->length;
+            p = state->format == EXPORT_CSV ? format_csv(p, it->first_inode + i, inode)
+                                            : format_ndjson(p, it->first_inode + i, inode);
+            w->length = (size_t)(p - w->data);
+            w->records++;
+        }
+    }
+
+    return rc;
+}
+
+// Runs in group order, so the output is sorted by inode number whatever the thread count
+static int export_emit(uint32_t group, void *worker, void *arg) {
+    export_worker_t *w = (export_worker_t *)worker;
+    export_state_t *state = (export_state_t *)arg;
+    (void)group;
+
+    if (state->out_length + w->length > EXPORT_WRITE_SIZE) {
+        if (export_write_all(state->fd, state->out, state->out_length) != 0) {
+            return -1;
+        }
+        state->out_length = 0;
+    }
+
+    if (w->length >= EXPORT_WRITE_SIZE) {
+        if (export_write_all(state->fd, w->data, w->length) != 0) {
+            return -1;
+        }
+    } else {
+        memcpy(state->out + state->out_length, w->data, w->length);
+        state->out_length += w->length;
+    }
+
+    state->exported += w->records;
+    return 0;
+}
+
+int export_parse_format(const char *name, export_format_t *format) {
+    if (strcmp(name, "csv") == 0) {
+        *format = EXPORT_CSV;
+    } else if (strcmp(name, "ndjson") == 0 || strcmp(name, "json") == 0) {
+        *format = EXPORT_NDJSON;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Writes one record per allocated inode to fd, ordered by inode number.
+// filter, when given, is a bitmap over inode numbers (bit ino - 1) selecting what to write.
+int export_inodes(fs_info_t *fs_info, int fd, export_format_t format, const unsigned char *filter,
+                  uint32_t threads, job_t *job, uint64_t *exported) {
+    export_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.fs_info = fs_info;
+    state.format = format;
+    state.fd = fd;
+    state.filter = filter;
+    state.out = (char *)malloc(EXPORT_WRITE_SIZE);
+    if (!state.out) {
+        return -1;
+    }
+
+    if (format == EXPORT_CSV) {
+        memcpy(state.out, csv_header, sizeof(csv_header) - 1);
+        state.out_length = sizeof(csv_header) - 1;
+    }
+
+    parallel_t p;
+    memset(&p, 0, sizeof(p));
+    p.items = fs_info->groups_count;
+    p.threads = threads;
+    p.worker_size = sizeof(export_worker_t);
+    p.arg = &state;
+    p.job = job;
+    p.init = export_worker_init;
+    p.work = export_group;
+    p.emit = export_emit;
+    p.finish = export_worker_finish;
+
+    int rc = parallel_run(&p);
+    if (rc == 0 && state.out_length > 0) {
+        rc = export_write_all(fd, state.out, state.out_length);
+    }
+
+    free(state.out);
+    if (exported) {
+        *exported = state.exported;
+    }
+    return rc;
+}
+
+int export_inodes_job(job_t *job, void *arg) {
+    export_job_arg_t *ex = (export_job_arg_t *)arg;
+    uint64_t exported = 0;
+
+    int fd = open(ex->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        job_printf(job, "Cannot create %s: %s", ex->path, strerror(errno));
+        return -1;
+    }
+
+    int rc = export_inodes(ex->fs_info, fd, ex->format, NULL, 0, job, &exported);
+    if (close(fd) != 0) {
+        rc = -1;
+    }
+
+    if (rc != 0) {
+        job_printf(job, "Export to %s failed after %lu inode(s)", ex->path, (unsigned long)exported);
+        return -1;
+    }
+    job_printf(job, "Exported %lu inode(s) to %s%s", (unsigned long)exported, ex->path,
+               job_is_cancelled(job) ? " (cancelled, incomplete)" : "");
+    return 0;
+}
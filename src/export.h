@@ -0,0 +1,32 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "analyzer.h"
+#include "job.h"
+
+#define EXPORT_WRITE_SIZE (4u << 20)    // Output is handed to write() in pieces of this size
+#define EXPORT_RECORD_MAX 512           // Upper bound of one formatted record
+
+typedef enum {
+    EXPORT_CSV,                 // Header line plus one comma separated line per inode
+    EXPORT_NDJSON               // One JSON object per line
+} export_format_t;
+
+typedef struct {
+    fs_info_t *fs_info;         // Filesystem to export
+    export_format_t format;     // Output format
+    char path[256];             // Destination file
+} export_job_arg_t;
+
+int export_parse_format(const char *name, export_format_t *format);
+
+int export_inodes(fs_info_t *fs_info, int fd, export_format_t format, const unsigned char *filter,
+                  uint32_t threads, job_t *job, uint64_t *exported);
+
+int export_inodes_job(job_t *job, void *arg);
+
+#endif /* EXPORT_H */
@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "frag.h"
+#include "blockmap.h"
+#include "inodeiter.h"
+#include "parallel.h"
+#include "topn.h"
+#include "utils.h"
+
+typedef struct {
+    frag_layout_t *layout;
+    uint64_t next;              // Physical block that would continue the current piece
+    bool indirect;              // Block map interleaves index blocks with the data
+} frag_walk_t;
+
+typedef struct {
+    inode_iter_t it;            // Reads one group at a time
+    topn_t top;                 // Worst files seen by this worker, aux indexes files
+    frag_file_t *files;         // Layouts of the ranked files, one slot per topn entry
+    frag_result_t counts;       // Totals and histograms, worst unused
+} frag_worker_t;
+
+typedef struct {
+    fs_info_t *fs_info;
+    uint32_t top;
+    topn_t worst;               // Merged from the workers, aux indexes files
+    frag_file_t *files;         // Layouts of every worker's ranked files
+    uint32_t file_count;
+    frag_result_t *result;
+} frag_state_t;
+
+// Starts a new piece unless the run continues the previous one on disk
+static int measure_run(uint64_t logical, uint64_t physical, uint32_t count, bool unwritten, void *arg) {
+    frag_walk_t *w = (frag_walk_t *)arg;
+    frag_layout_t *l = w->layout;
+    (void)logical;
+    (void)unwritten;
+
+    if (l->fragments == 0) {
+        l->fragments = 1;
+    } else if (physical != w->next) {
+        bool slack = w->indirect && physical > w->next && physical - w->next <= FRAG_INDIRECT_SLACK;
+        if (!slack) {
+            l->fragments++;
+            l->gap_blocks += physical > w->next ? physical - w->next : w->next - physical;
+        }
+    }
+    l->blocks += count;
+    w->next = physical + count;
+    return 0;
+}
+
+// Counts the physical pieces of a file's data and scores them against the fewest possible,
+// one piece per block group. Index blocks that ext2 places inline between the data do not
+// split a piece. Returns -1 when the block map cannot be read.
+int frag_measure(fs_info_t *fs_info, const struct ext2_inode *inode, frag_layout_t *layout) {
+    frag_walk_t w = { layout, 0, !(inode->i_flags & EXT4_EXTENTS_FL) };
+
+    memset(layout, 0, sizeof(*layout));
+    if (blockmap_walk(fs_info, inode, measure_run, &w) != 0) {
+        return -1;
+    }
+    if (layout->blocks == 0) {
+        return 0;
+    }
+
+    layout->ideal = (uint32_t)((layout->blocks + fs_info->blocks_per_group - 1) / fs_info->blocks_per_group);
+    if (layout->fragments > layout->ideal) {
+        layout->score = 100.0 * (double)(layout->fragments - layout->ideal) / (double)(layout->blocks - layout->ideal);
+    }
+    return 0;
+}
+
+static uint32_t count_bucket(uint32_t fragments) {
+    return 31 - (uint32_t)__builtin_clz(fragments);
+}
+
+static uint32_t score_bucket(double score) {
+    if (score <= 0.0) {
+        return 0;
+    }
+    uint32_t b = (uint32_t)ceil(score / 10.0);
+    return b < FRAG_SCORE_BUCKETS ? b : FRAG_SCORE_BUCKETS - 1;
+}
+
+static int frag_worker_init(void *worker, void *arg) {
+    frag_worker_t *w = (frag_worker_t *)worker;
+    frag_state_t *st = (frag_state_t *)arg;
+
+    if (inode_iter_init(&w->it, st->fs_info, 0, 0, false) != 0) {
+        return -1;
+    }
+    w->files = (frag_file_t *)calloc(st->top ? st->top : 1, sizeof(frag_file_t));
+    if (!w->files || topn_init(&w->top, st->top) != 0) {
+        free(w->files);
+        inode_iter_cleanup(&w->it);
+        return -1;
+    }
+    return 0;
+}
+
+static int frag_scan_group(uint32_t group, void *worker, void *arg) {
+    frag_worker_t *w = (frag_worker_t *)worker;
+    frag_state_t *st = (frag_state_t *)arg;
+    frag_result_t *c = &w->counts;
+    inode_iter_t *it = &w->it;
+    uint32_t first_ino = st->fs_info->sb.s_rev_level ? st->fs_info->sb.s_first_ino : EXT2_GOOD_OLD_FIRST_INO;
+    int rc;
+
+    inode_iter_reset(it, group, group + 1);
+    while ((rc = inode_iter_next(it)) > 0) {
+        for (uint32_t i = 0; i < it->count; i++) {
+            if (!inode_iter_used(it, i)) {
+                continue;
+            }
+            const struct ext2_inode *inode = inode_iter_inode(it, i);
+            frag_layout_t l;
+            if (it->first_inode + i < first_ino || !S_ISREG(inode->i_mode) || inode->i_links_count == 0) {
+                continue;
+            }
+            if (frag_measure(st->fs_info, inode, &l) != 0) {
+                c->bad_maps++;
+                continue;
+            }
+            if (l.blocks == 0) {
+                continue;
+            }
+
+            uint64_t excess = l.fragments > l.ideal ? l.fragments - l.ideal : 0;
+            c->files++;
+            c->fragmented += excess > 0;
+            c->blocks += l.blocks;
+            c->fragments += l.fragments;
+            c->excess += excess;
+            c->movable += l.blocks - l.ideal;
+            c->gap_blocks += l.gap_blocks;
+            c->by_count[count_bucket(l.fragments)]++;
+            c->by_score[score_bucket(l.score)]++;
+            if (excess) {
+                // A full ranking hands the slot of the entry it pushes out to the new one
+                uint32_t slot = w->top.count < w->top.capacity ? w->top.count : w->top.heap[0].aux;
+                if (topn_push(&w->top, excess, it->first_inode + i, slot)) {
+                    frag_file_t *f = &w->files[slot];
+                    f->ino = it->first_inode + i;
+                    f->layout = l;
+                    f->avg_gap = l.fragments > 1 ? (double)l.gap_blocks / (l.fragments - 1) : 0.0;
+                }
+            }
+        }
+    }
+    return rc;
+}
+
+static int frag_worker_finish(void *worker, void *arg) {
+    frag_worker_t *w = (frag_worker_t *)worker;
+    frag_state_t *st = (frag_state_t *)arg;
+    frag_result_t *r = st->result;
+    const frag_result_t *c = &w->counts;
+
+    r->files += c->files;
+    r->fragmented += c->fragmented;
+    r->blocks += c->blocks;
+    r->fragments += c->fragments;
+    r->excess += c->excess;
+    r->movable += c->movable;
+    r->gap_blocks += c->gap_blocks;
+    r->bad_maps += c->bad_maps;
+    for (uint32_t b = 0; b < FRAG_COUNT_BUCKETS; b++) {
+        r->by_count[b] += c->by_count[b];
+    }
+    for (uint32_t b = 0; b < FRAG_SCORE_BUCKETS; b++) {
+        r->by_score[b] += c->by_score[b];
+    }
+
+    int rc = 0;
+    frag_file_t *files = (frag_file_t *)realloc(st->files, (st->file_count + w->top.count + 1) * sizeof(frag_file_t));
+    if (files) {
+        st->files = files;
+        for (uint32_t i = 0; i < w->top.count; i++) {
+            st->files[st->file_count] = w->files[w->top.heap[i].aux];
+            topn_push(&st->worst, w->top.heap[i].key, w->top.heap[i].id, st->file_count++);
+        }
+    } else {
+        rc = -1;
+    }
+
+    free(w->files);
+    topn_free(&w->top);
+    inode_iter_cleanup(&w->it);
+    return rc;
+}
+
+// Scores every regular file outside the reserved inodes on the group pool and ranks the top files with the most excess pieces
+frag_result_t *frag_scan(fs_info_t *fs_info, uint32_t top, uint32_t threads, job_t *job) {
+    frag_state_t st;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(&st, 0, sizeof(st));
+    st.fs_info = fs_info;
+    st.top = top;
+    st.result = (frag_result_t *)calloc(1, sizeof(frag_result_t));
+    if (!st.result || topn_init(&st.worst, top) != 0) {
+        goto fail;
+    }
+
+    parallel_t p;
+    memset(&p, 0, sizeof(p));
+    p.items = fs_info->groups_count;
+    p.threads = threads;
+    p.worker_size = sizeof(frag_worker_t);
+    p.arg = &st;
+    p.job = job;
+    p.init = frag_worker_init;
+    p.work = frag_scan_group;
+    p.finish = frag_worker_finish;
+    if (parallel_run(&p) != 0 || job_is_cancelled(job)) {
+        goto fail;
+    }
+
+    frag_result_t *r = st.result;
+    uint32_t n = topn_sorted(&st.worst);
+    r->worst = (frag_file_t *)calloc(n ? n : 1, sizeof(frag_file_t));
+    if (!r->worst) {
+        goto fail;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        r->worst[r->worst_count++] = st.files[st.worst.heap[i].aux];
+    }
+    // Every file of p pieces jumps p - 1 times
+    if (r->fragments > r->files) {
+        r->avg_gap = (double)r->gap_blocks / (double)(r->fragments - r->files);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    r->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    topn_free(&st.worst);
+    free(st.files);
+    return r;
+
+fail:
+    topn_free(&st.worst);
+    free(st.files);
+    frag_free(st.result);
+    return NULL;
+}
+
+void frag_free(frag_result_t *result) {
+    if (!result) {
+        return;
+    }
+
+    free(result->worst);
+    free(result);
+}
+
+// Excess pieces over all blocks that could have been placed better, in percent
+double frag_volume_score(const frag_result_t *result) {
+    return result->movable ? 100.0 * (double)result->excess / (double)result->movable : 0.0;
+}
+
+const char *frag_verdict(double score) {
+    if (score <= 30.0) {
+        return "no defragmentation needed";
+    }
+    return score <= 55.0 ? "a little fragmented" : "defragmentation recommended";
+}
+
+void frag_count_label(uint32_t bucket, char *buffer, size_t buffer_size) {
+    if (bucket == 0) {
+        snprintf(buffer, buffer_size, "1");
+    } else {
+        snprintf(buffer, buffer_size, "%lu-%lu", 1ul << bucket, (1ul << (bucket + 1)) - 1);
+    }
+}
+
+void frag_score_label(uint32_t bucket, char *buffer, size_t buffer_size) {
+    if (bucket == 0) {
+        snprintf(buffer, buffer_size, "0");
+    } else {
+        snprintf(buffer, buffer_size, "%u-%u", (bucket - 1) * 10, bucket * 10);
+    }
+}
+
+void frag_print(const frag_result_t *result, FILE *out) {
+    double score = frag_volume_score(result);
+    char label[32];
+
+    fprintf(out, "Files: %lu with %lu blocks in %lu pieces, %lu fragmented (%.1f%%)\n",
+            (unsigned long)result->files, (unsigned long)result->blocks, (unsigned long)result->fragments,
+            (unsigned long)result->fragmented,
+            result->files ? 100.0 * (double)result->fragmented / (double)result->files : 0.0);
+    fprintf(out, "Score: %.1f, %s\n", score, frag_verdict(score));
+    fprintf(out, "Average gap between pieces: %.1f blocks\n", result->avg_gap);
+    if (result->bad_maps) {
+        fprintf(out, "Unreadable block maps: %u\n", result->bad_maps);
+    }
+
+    fprintf(out, "\n%-14s %12s\n", "Pieces", "Files");
+    for (uint32_t b = 0; b < FRAG_COUNT_BUCKETS; b++) {
+        if (result->by_count[b]) {
+            frag_count_label(b, label, sizeof(label));
+            fprintf(out, "%-14s %12lu\n", label, (unsigned long)result->by_count[b]);
+        }
+    }
+    fprintf(out, "\n%-14s %12s\n", "Score", "Files");
+    for (uint32_t b = 0; b < FRAG_SCORE_BUCKETS; b++) {
+        frag_score_label(b, label, sizeof(label));
+        fprintf(out, "%-14s %12lu\n", label, (unsigned long)result->by_score[b]);
+    }
+
+    fprintf(out, "\n%-10s %10s %8s %6s %10s %7s\n", "Inode", "Blocks", "Pieces", "Ideal", "Avg gap", "Score");
+    for (uint32_t i = 0; i < result->worst_count; i++) {
+        const frag_file_t *f = &result->worst[i];
+        fprintf(out, "%-10u %10lu %8u %6u %10.1f %7.1f\n", f->ino, (unsigned long)f->layout.blocks,
+                f->layout.fragments, f->layout.ideal, f->avg_gap, f->layout.score);
+    }
+}
+
+static int print_run(uint64_t logical, uint64_t physical, uint32_t count, bool unwritten, void *arg) {
+    fprintf((FILE *)arg, "%12lu %12lu %10u%s\n", (unsigned long)logical, (unsigned long)physical, count,
+            unwritten ? "  unwritten" : "");
+    return 0;
+}
+
+// Lists the runs of an inode's data blocks, one line per run
+int frag_print_map(fs_info_t *fs_info, uint32_t ino, FILE *out) {
+    struct ext2_inode inode;
+    frag_layout_t l;
+
+    if (ino == 0 || ino > fs_info->sb.s_inodes_count || read_inode(fs_info, ino, &inode) != 0) {
+        return -1;
+    }
+
+    fprintf(out, "%12s %12s %10s\n", "Logical", "Physical", "Blocks");
+    if (blockmap_walk(fs_info, &inode, print_run, out) != 0 || frag_measure(fs_info, &inode, &l) != 0) {
+        fprintf(out, "Block map of inode %u is damaged\n", ino);
+        return -1;
+    }
+    fprintf(out, "Inode %u: %lu blocks in %u pieces, ideal %u, score %.1f\n", ino, (unsigned long)l.blocks,
+            l.fragments, l.ideal, l.score);
+    return 0;
+}
+
+// Job body: scores file fragmentation and publishes the result in the job_slot_t passed as arg
+int frag_job(job_t *job, void *arg) {
+    job_slot_t *slot = (job_slot_t *)arg;
+
+    frag_result_t *result = frag_scan((fs_info_t *)slot->source, slot->top, 0, job);
+
+    if (result) {
+        double score = frag_volume_score(result);
+        job_printf(job, "%lu of %lu file(s) fragmented, score %.1f, %.2f s", (unsigned long)result->fragmented,
+                   (unsigned long)result->files, score, result->seconds);
+    } else {
+        job_printf(job, "%s", job_is_cancelled(job) ? "Fragmentation scan cancelled" : "Fragmentation scan failed");
+    }
+    // The slot owns the result from here on and a later job may free it, so this is the last use
+    job_slot_finish(slot, job, result);
+    return result || job_is_cancelled(job) ? 0 : -1;
+}
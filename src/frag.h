@@ -0,0 +1,70 @@
+#ifndef FRAG_H
+#define FRAG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <ext2fs/ext2_fs.h>
+#include "analyzer.h"
+#include "job.h"
+
+#define FRAG_DEFAULT_TOP 20         // Files listed unless asked otherwise
+#define FRAG_COUNT_BUCKETS 33       // Fragment counts [2^b, 2^(b+1)) for b = 0..32
+#define FRAG_SCORE_BUCKETS 11       // Score 0, then (0, 10], (10, 20] ... (90, 100]
+#define FRAG_INDIRECT_SLACK 3       // Forward gap left by inline indirect blocks, not a fragment
+
+// Layout of one file's data blocks
+typedef struct {
+    uint64_t blocks;            // Mapped data blocks
+    uint32_t fragments;         // Physically contiguous pieces
+    uint32_t ideal;             // Fewest pieces the file could have, one per group
+    uint64_t gap_blocks;        // Sum of the distances jumped between pieces
+    double score;               // 0 when laid out ideally, 100 when no two blocks are adjacent
+} frag_layout_t;
+
+typedef struct {
+    uint32_t ino;               // Inode number
+    frag_layout_t layout;
+    double avg_gap;             // Mean distance between pieces in blocks
+} frag_file_t;
+
+typedef struct {
+    uint64_t files;             // Regular files with data blocks
+    uint64_t fragmented;        // Files with more pieces than ideal
+    uint64_t blocks;            // Their data blocks
+    uint64_t fragments;         // Their pieces
+    uint64_t excess;            // Pieces beyond ideal, summed
+    uint64_t movable;           // Blocks beyond ideal pieces, the score denominator, summed
+    uint64_t gap_blocks;        // Distances jumped between pieces, summed
+    double avg_gap;             // Mean distance between pieces over all files in blocks
+    uint32_t bad_maps;          // Files whose block map could not be read
+    uint64_t by_count[FRAG_COUNT_BUCKETS];  // Files per fragment count bucket
+    uint64_t by_score[FRAG_SCORE_BUCKETS];  // Files per score bucket
+    frag_file_t *worst;         // Most excess pieces first
+    uint32_t worst_count;
+    double seconds;             // Wall time of the scan
+} frag_result_t;
+
+int frag_measure(fs_info_t *fs_info, const struct ext2_inode *inode, frag_layout_t *layout);
+
+frag_result_t *frag_scan(fs_info_t *fs_info, uint32_t top, uint32_t threads, job_t *job);
+
+void frag_free(frag_result_t *result);
+
+double frag_volume_score(const frag_result_t *result);
+
+const char *frag_verdict(double score);
+
+void frag_count_label(uint32_t bucket, char *buffer, size_t buffer_size);
+
+void frag_score_label(uint32_t bucket, char *buffer, size_t buffer_size);
+
+void frag_print(const frag_result_t *result, FILE *out);
+
+int frag_print_map(fs_info_t *fs_info, uint32_t ino, FILE *out);
+
+int frag_job(job_t *job, void *arg);
+
+#endif /* FRAG_H */
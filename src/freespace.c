@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "freespace.h"
+#include "parallel.h"
+#include "utils.h"
+
+typedef struct {
+    unsigned char *bitmap;      // Block bitmap of the current group
+    free_extent_t *extents;     // Extents of the current group, handed over in emit
+    uint32_t count;
+    uint32_t capacity;
+    bool unreadable;            // Bitmap of the current group could not be read
+} freespace_worker_t;
+
+typedef struct {
+    fs_info_t *fs_info;
+    freespace_t *fs;
+    uint32_t capacity;          // Extents allocated in fs->extents
+} freespace_run_t;
+
+static uint32_t length_bucket(uint32_t length) {
+    return 31 - (uint32_t)__builtin_clz(length);
+}
+
+static void hist_add(freespace_hist_t *hist, uint32_t length) {
+    uint32_t b = length_bucket(length);
+
+    hist->count[b]++;
+    hist->blocks[b] += length;
+    hist->extents++;
+    hist->free_blocks += length;
+    hist->largest = length > hist->largest ? length : hist->largest;
+}
+
+static void hist_merge(freespace_hist_t *into, const freespace_hist_t *from) {
+    for (uint32_t b = 0; b < FREESPACE_BUCKETS; b++) {
+        into->count[b] += from->count[b];
+        into->blocks[b] += from->blocks[b];
+    }
+    into->extents += from->extents;
+    into->free_blocks += from->free_blocks;
+    into->largest = from->largest > into->largest ? from->largest : into->largest;
+}
+
+static int push_extent(freespace_worker_t *w, uint32_t start, uint32_t length) {
+    if (w->count == w->capacity) {
+        uint32_t capacity = w->capacity ? w->capacity * 2 : 256;
+        free_extent_t *extents = (free_extent_t *)realloc(w->extents, capacity * sizeof(free_extent_t));
+        if (!extents) {
+            return -1;
+        }
+        w->extents = extents;
+        w->capacity = capacity;
+    }
+    w->extents[w->count++] = (free_extent_t){ start, length };
+    return 0;
+}
+
+static int freespace_worker_init(void *worker, void *arg) {
+    freespace_worker_t *w = (freespace_worker_t *)worker;
+    freespace_run_t *run = (freespace_run_t *)arg;
+
+    w->bitmap = (unsigned char *)malloc(run->fs_info->block_size);
+    return w->bitmap ? 0 : -1;
+}
+
+// Extracts the free runs of one group, skipping whole words of used or free blocks at a time
+static int freespace_group(uint32_t group, void *worker, void *arg) {
+    freespace_worker_t *w = (freespace_worker_t *)worker;
+    freespace_run_t *run = (freespace_run_t *)arg;
+    fs_info_t *fs_info = run->fs_info;
+    struct ext2_group_desc *gd = &fs_info->group_desc[group];
+    freespace_hist_t *hist = &run->fs->group_hist[group];
+    uint32_t blocks = group_block_count(fs_info, group);
+    uint32_t base = fs_info->sb.s_first_data_block + group * fs_info->blocks_per_group;
+
+    w->count = 0;
+    w->unreadable = false;
+
+    if (gd->bg_flags & EXT2_BG_BLOCK_UNINIT) {
+        // Never initialised: only the group's own metadata at its start is in use
+        uint32_t free_blocks = gd->bg_free_blocks_count < blocks ? gd->bg_free_blocks_count : blocks;
+        if (free_blocks) {
+            hist_add(hist, free_blocks);
+            return push_extent(w, base + blocks - free_blocks, free_blocks);
+        }
+        return 0;
+    }
+
+    if (get_block_bitmap(fs_info, group, w->bitmap) != 0) {
+        w->unreadable = true;
+        return 0;
+    }
+
+    for (uint32_t pos = 0; pos < blocks;) {
+        uint32_t start = find_next_bit(w->bitmap, pos, blocks, false);
+        if (start >= blocks) {
+            break;
+        }
+        uint32_t end = find_next_bit(w->bitmap, start, blocks, true);
+        hist_add(hist, end - start);
+        if (push_extent(w, base + start, end - start) != 0) {
+            return -1;
+        }
+        pos = end;
+    }
+    return 0;
+}
+
+// Appends a group's extents in group order, which keeps the whole array sorted by start
+static int freespace_emit(uint32_t group, void *worker, void *arg) {
+    freespace_worker_t *w = (freespace_worker_t *)worker;
+    freespace_run_t *run = (freespace_run_t *)arg;
+    freespace_t *fs = run->fs;
+    (void)group;
+
+    if (fs->extent_count + w->count > run->capacity) {
+        uint32_t capacity = run->capacity ? run->capacity : 1024;
+        while (capacity < fs->extent_count + w->count) {
+            capacity *= 2;
+        }
+        free_extent_t *extents = (free_extent_t *)realloc(fs->extents, capacity * sizeof(free_extent_t));
+        if (!extents) {
+            return -1;
+        }
+        fs->extents = extents;
+        run->capacity = capacity;
+    }
+
+    memcpy(fs->extents + fs->extent_count, w->extents, w->count * sizeof(free_extent_t));
+    fs->extent_count += w->count;
+    fs->unreadable += w->unreadable;
+    return 0;
+}
+
+static int freespace_worker_finish(void *worker, void *arg) {
+    freespace_worker_t *w = (freespace_worker_t *)worker;
+    (void)arg;
+
+    free(w->bitmap);
+    free(w->extents);
+    return 0;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Builds the max-length segment tree and the length-sorted index with suffix block sums
+static int build_indexes(freespace_t *fs) {
+    uint32_t n = fs->extent_count;
+
+    fs->tree_leaves = 1;
+    while (fs->tree_leaves < n) {
+        fs->tree_leaves *= 2;
+    }
+    fs->tree = (uint32_t *)calloc(2 * (size_t)fs->tree_leaves, sizeof(uint32_t));
+    fs->by_length = (uint32_t *)malloc((n ? n : 1) * sizeof(uint32_t));
+    fs->blocks_from = (uint64_t *)malloc(((size_t)n + 1) * sizeof(uint64_t));
+    uint64_t *keys = (uint64_t *)malloc((n ? n : 1) * sizeof(uint64_t));
+    if (!fs->tree || !fs->by_length || !fs->blocks_from || !keys) {
+        free(keys);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        fs->tree[fs->tree_leaves + i] = fs->extents[i].length;
+        keys[i] = ((uint64_t)fs->extents[i].length << 32) | i;
+    }
+    for (uint32_t i = fs->tree_leaves - 1; i > 0; i--) {
+        uint32_t l = fs->tree[2 * i], r = fs->tree[2 * i + 1];
+        fs->tree[i] = l > r ? l : r;
+    }
+
+    // Extents are in start order, so the index breaks length ties by start
+    qsort(keys, n, sizeof(uint64_t), compare_u64);
+    fs->blocks_from[n] = 0;
+    for (uint32_t i = n; i > 0; i--) {
+        fs->by_length[i - 1] = (uint32_t)keys[i - 1];
+        fs->blocks_from[i - 1] = fs->blocks_from[i] + fs->extents[fs->by_length[i - 1]].length;
+    }
+
+    free(keys);
+    return 0;
+}
+
+// Reads every block bitmap on the group pool and indexes the free extents it finds
+freespace_t *freespace_scan(fs_info_t *fs_info, uint32_t threads, job_t *job) {
+    freespace_t *fs = (freespace_t *)calloc(1, sizeof(freespace_t));
+    struct timespec start, end;
+
+    if (!fs) {
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fs->groups = fs_info->groups_count;
+    fs->group_hist = (freespace_hist_t *)calloc(fs->groups ? fs->groups : 1, sizeof(freespace_hist_t));
+    if (!fs->group_hist) {
+        freespace_free(fs);
+        return NULL;
+    }
+
+    freespace_run_t run = { fs_info, fs, 0 };
+    parallel_t p;
+    memset(&p, 0, sizeof(p));
+    p.items = fs->groups;
+    p.threads = threads;
+    p.worker_size = sizeof(freespace_worker_t);
+    p.arg = &run;
+    p.job = job;
+    p.init = freespace_worker_init;
+    p.work = freespace_group;
+    p.emit = freespace_emit;
+    p.finish = freespace_worker_finish;
+    if (parallel_run(&p) != 0 || job_is_cancelled(job)) {
+        freespace_free(fs);
+        return NULL;
+    }
+
+    for (uint32_t g = 0; g < fs->groups; g++) {
+        hist_merge(&fs->total, &fs->group_hist[g]);
+    }
+    if (build_indexes(fs) != 0) {
+        freespace_free(fs);
+        return NULL;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    fs->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return fs;
+}
+
+void freespace_free(freespace_t *fs) {
+    if (!fs) {
+        return;
+    }
+
+    free(fs->extents);
+    free(fs->group_hist);
+    free(fs->tree);
+    free(fs->by_length);
+    free(fs->blocks_from);
+    free(fs);
+}
+
+void freespace_bucket_label(uint32_t bucket, char *buffer, size_t buffer_size) {
+    if (bucket == 0) {
+        snprintf(buffer, buffer_size, "1");
+    } else {
+        snprintf(buffer, buffer_size, "%lu-%lu", 1ul << bucket, (1ul << (bucket + 1)) - 1);
+    }
+}
+
+const free_extent_t *freespace_largest(const freespace_t *fs) {
+    return fs->extent_count ? &fs->extents[fs->by_length[fs->extent_count - 1]] : NULL;
+}
+
+// Position in by_length of the shortest extent holding at least blocks
+static uint32_t lower_bound_length(const freespace_t *fs, uint32_t blocks) {
+    uint32_t lo = 0, hi = fs->extent_count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (fs->extents[fs->by_length[mid]].length < blocks) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Smallest extent that holds blocks, the lowest one among equals; NULL if none does
+const free_extent_t *freespace_best_fit(const freespace_t *fs, uint32_t blocks) {
+    uint32_t pos = lower_bound_length(fs, blocks);
+    return pos < fs->extent_count ? &fs->extents[fs->by_length[pos]] : NULL;
+}
+
+// Number of extents that hold blocks, and in usable_blocks how many free blocks they have together
+uint32_t freespace_fit_count(const freespace_t *fs, uint32_t blocks, uint64_t *usable_blocks) {
+    uint32_t pos = lower_bound_length(fs, blocks);
+
+    if (usable_blocks) {
+        *usable_blocks = fs->blocks_from[pos];
+    }
+    return fs->extent_count - pos;
+}
+
+// First leaf at or after from whose length is at least blocks, or UINT32_MAX
+static uint32_t tree_find(const freespace_t *fs, uint32_t node, uint32_t lo, uint32_t hi, uint32_t from, uint32_t blocks) {
+    if (hi <= from || fs->tree[node] < blocks) {
+        return UINT32_MAX;
+    }
+    if (hi - lo == 1) {
+        return lo;
+    }
+
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint32_t found = tree_find(fs, 2 * node, lo, mid, from, blocks);
+    return found != UINT32_MAX ? found : tree_find(fs, 2 * node + 1, mid, hi, from, blocks);
+}
+
+// First extent at or after goal that holds blocks, wrapping around to the start of the
+// filesystem like a goal-directed allocator; NULL if none does
+const free_extent_t *freespace_first_fit(const freespace_t *fs, uint32_t goal, uint32_t blocks) {
+    uint32_t lo = 0, hi = fs->extent_count;
+
+    if (fs->extent_count == 0 || blocks == 0) {
+        return NULL;
+    }
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if ((uint64_t)fs->extents[mid].start + fs->extents[mid].length <= goal) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    uint32_t found = tree_find(fs, 1, 0, fs->tree_leaves, lo, blocks);
+    if (found == UINT32_MAX) {
+        found = tree_find(fs, 1, 0, fs->tree_leaves, 0, blocks);
+    }
+    return found < fs->extent_count ? &fs->extents[found] : NULL;
+}
+
+// Plain numbers are blocks, numbers with a K/M/G/T suffix are bytes rounded up to whole blocks
+int freespace_parse_size(const char *text, uint32_t block_size, uint32_t *blocks) {
+    char *end;
+    uint64_t value = strtoull(text, &end, 10);
+
+    if (end == text) {
+        return -1;
+    }
+    if (*end) {
+        const char *units = "KMGT";
+        const char *unit = strchr(units, toupper((unsigned char)*end));
+        if (!unit || end[1] != '\0') {
+            return -1;
+        }
+        value <<= 10 * (unit - units + 1);
+        value = (value + block_size - 1) / block_size;
+    }
+    if (value == 0 || value > UINT32_MAX) {
+        return -1;
+    }
+    *blocks = (uint32_t)value;
+    return 0;
+}
+
+// Text report: totals, the global length histogram, one line per group and, when fit_blocks is
+// not 0, where a contiguous allocation of that many blocks would go
+void freespace_print(const freespace_t *fs, uint32_t block_size, uint32_t fit_blocks, FILE *out) {
+    const freespace_hist_t *t = &fs->total;
+    const free_extent_t *largest = freespace_largest(fs);
+    char label[32];
+
+    fprintf(out, "Free blocks: %lu in %lu extent(s), mean %.1f blocks\n", (unsigned long)t->free_blocks,
+            (unsigned long)t->extents, t->extents ? (double)t->free_blocks / (double)t->extents : 0.0);
+    if (largest) {
+        fprintf(out, "Largest extent: %u blocks (%lu bytes) at block %u\n", largest->length,
+                (unsigned long)largest->length * block_size, largest->start);
+    }
+    if (fs->unreadable) {
+        fprintf(out, "Unreadable block bitmaps: %u\n", fs->unreadable);
+    }
+
+    fprintf(out, "\n%-14s %12s %14s %7s\n", "Length", "Extents", "Blocks", "Free%");
+    for (uint32_t b = 0; b < FREESPACE_BUCKETS; b++) {
+        if (t->count[b]) {
+            freespace_bucket_label(b, label, sizeof(label));
+            fprintf(out, "%-14s %12lu %14lu %6.2f%%\n", label, (unsigned long)t->count[b], (unsigned long)t->blocks[b],
+                    t->free_blocks ? 100.0 * (double)t->blocks[b] / (double)t->free_blocks : 0.0);
+        }
+    }
+
+    fprintf(out, "\n%-8s %10s %9s %10s\n", "Group", "Free", "Extents", "Largest");
+    for (uint32_t g = 0; g < fs->groups; g++) {
+        const freespace_hist_t *h = &fs->group_hist[g];
+        fprintf(out, "%-8u %10lu %9lu %10u\n", g, (unsigned long)h->free_blocks, (unsigned long)h->extents, h->largest);
+    }
+
+    if (fit_blocks) {
+        uint64_t usable;
+        uint32_t fits = freespace_fit_count(fs, fit_blocks, &usable);
+        const free_extent_t *best = freespace_best_fit(fs, fit_blocks);
+
+        fprintf(out, "\nContiguous allocation of %u blocks: ", fit_blocks);
+        if (!best) {
+            fprintf(out, "does not fit, the largest free extent is %u blocks\n", largest ? largest->length : 0);
+        } else {
+            fprintf(out, "fits in %u extent(s) holding %lu blocks, best fit %u blocks at block %u\n",
+                    fits, (unsigned long)usable, best->length, best->start);
+        }
+    }
+}
+
+// Job body: scans free space and publishes the result in the job_slot_t passed as arg
+int freespace_job(job_t *job, void *arg) {
+    job_slot_t *slot = (job_slot_t *)arg;
+
+    freespace_t *fs = freespace_scan((fs_info_t *)slot->source, 0, job);
+
+    if (fs) {
+        const free_extent_t *largest = freespace_largest(fs);
+        job_printf(job, "%lu free block(s) in %lu extent(s), largest %u, %.2f s", (unsigned long)fs->total.free_blocks,
+                   (unsigned long)fs->total.extents, largest ? largest->length : 0, fs->seconds);
+    } else {
+        job_printf(job, "%s", job_is_cancelled(job) ? "Free space scan cancelled" : "Free space scan failed");
+    }
+    // The slot owns the result from here on and a later job may free it, so this is the last use
+    job_slot_finish(slot, job, fs);
+    return fs || job_is_cancelled(job) ? 0 : -1;
+}
@@ -0,0 +1,62 @@
+#ifndef FREESPACE_H
+#define FREESPACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "analyzer.h"
+#include "job.h"
+
+#define FREESPACE_BUCKETS 33        // Extent lengths [2^b, 2^(b+1)) for b = 0..32
+
+typedef struct {
+    uint32_t start;             // First free block
+    uint32_t length;            // Free blocks in the run
+} free_extent_t;
+
+typedef struct {
+    uint64_t count[FREESPACE_BUCKETS];  // Extents per length bucket
+    uint64_t blocks[FREESPACE_BUCKETS]; // Free blocks in those extents
+    uint64_t extents;           // Total extents
+    uint64_t free_blocks;       // Total free blocks
+    uint32_t largest;           // Longest extent
+} freespace_hist_t;
+
+// All free extents of the filesystem, split at group boundaries as the allocator sees them
+typedef struct {
+    uint32_t groups;            // Number of block groups
+    free_extent_t *extents;     // Sorted by start
+    uint32_t extent_count;
+    freespace_hist_t total;     // Whole filesystem
+    freespace_hist_t *group_hist; // Per group
+    uint32_t *tree;             // Max-length segment tree over extents, leaves at tree_leaves
+    uint32_t tree_leaves;       // Leaf count, a power of two
+    uint32_t *by_length;        // Extent indices sorted by length, then start
+    uint64_t *blocks_from;      // Free blocks in by_length[i..], extent_count + 1 entries
+    uint32_t unreadable;        // Groups whose bitmap could not be read
+    double seconds;             // Wall time of the scan
+} freespace_t;
+
+freespace_t *freespace_scan(fs_info_t *fs_info, uint32_t threads, job_t *job);
+
+void freespace_free(freespace_t *fs);
+
+void freespace_bucket_label(uint32_t bucket, char *buffer, size_t buffer_size);
+
+const free_extent_t *freespace_largest(const freespace_t *fs);
+
+const free_extent_t *freespace_best_fit(const freespace_t *fs, uint32_t blocks);
+
+const free_extent_t *freespace_first_fit(const freespace_t *fs, uint32_t goal, uint32_t blocks);
+
+uint32_t freespace_fit_count(const freespace_t *fs, uint32_t blocks, uint64_t *usable_blocks);
+
+int freespace_parse_size(const char *text, uint32_t block_size, uint32_t *blocks);
+
+void freespace_print(const freespace_t *fs, uint32_t block_size, uint32_t fit_blocks, FILE *out);
+
+int freespace_job(job_t *job, void *arg);
+
+#endif /* FREESPACE_H */
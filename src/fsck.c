@@ -0,0 +1,833 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include "fsck.h"
+#include "blockmap.h"
+#include "inodeiter.h"
+#include "parallel.h"
+#include "refcount.h"
+#include "shardmap.h"
+#include "utils.h"
+
+typedef struct {
+    uint64_t block;             // Doubly claimed block
+    uint32_t ino;               // One of its claimants, 0 for filesystem metadata
+} fsck_owner_t;
+
+typedef struct {
+    fs_info_t *fs_info;
+    job_t *job;
+    fsck_result_t *result;
+    fsck_report_fn_t report;
+    void *report_arg;
+    _Atomic uint64_t *claimed;  // One bit per block from s_first_data_block on
+    unsigned char *used;        // Allocated inodes, bit ino - 1
+    unsigned char *dirs;        // Directories, bit ino - 1
+    uint16_t *links;            // Stored link counts, index ino - 1
+    refcount_t refs;            // Directory entries found per inode, index ino - 1
+    shardmap_t dups;            // Blocks claimed more than once, with the number of extra claims
+    shardmap_t xattrs;          // Extended attribute blocks, with the number of sharers
+    uint32_t checks;            // FSCK_CHECK_* flags
+    bool finding_owners;        // Second look at the doubly claimed blocks
+    fsck_owner_t *owners;       // Claimants of doubly claimed blocks, unsorted
+    size_t owner_count;
+    uint64_t first_block;       // s_first_data_block
+    uint64_t blocks;            // s_blocks_count
+    uint32_t first_ino;         // First inode that is not reserved
+    uint32_t desc_blocks;       // Blocks of one copy of the descriptor table
+    bool dir_nlink;             // Directories with too many subdirectories store 1
+} fsck_state_t;
+
+typedef struct {
+    fsck_state_t *st;
+    inode_iter_t it;            // Reads one group at a time
+    unsigned char *block;       // Scratch block for directories and bitmaps
+    fsck_problem_t *problems;   // Problems of the current group, reported in emit
+    uint32_t problem_count;
+    uint32_t problem_capacity;
+    uint32_t ino;               // Inode being walked, 0 for group metadata
+    bool is_dir;
+    uint64_t bad_first;         // First block of that inode outside the filesystem
+    uint32_t bad_count;
+    fsck_owner_t *owners;       // Claimants found by this worker
+    size_t owner_count;
+    size_t owner_capacity;
+    uint64_t inodes;
+    uint64_t dir_count;
+    uint64_t entries;
+    uint64_t claimed;
+    uint32_t uninit_groups;
+    uint32_t unreadable;
+    bool failed;                // Out of memory
+} fsck_worker_t;
+
+static void add_problem(fsck_worker_t *w, const fsck_problem_t *problem) {
+    if (w->problem_count == w->problem_capacity) {
+        uint32_t capacity = w->problem_capacity ? w->problem_capacity * 2 : 16;
+        fsck_problem_t *problems = (fsck_problem_t *)realloc(w->problems, capacity * sizeof(fsck_problem_t));
+        if (!problems) {
+            w->failed = true;
+            return;
+        }
+        w->problems = problems;
+        w->problem_capacity = capacity;
+    }
+    w->problems[w->problem_count++] = *problem;
+}
+
+// Records a problem in the result and hands it to the reporter, in report order
+static void publish(fsck_state_t *st, const fsck_problem_t *problem) {
+    fsck_result_t *r = st->result;
+
+    r->counts[problem->kind]++;
+    if (r->problem_count < FSCK_MAX_PROBLEMS) {
+        r->problems[r->problem_count++] = *problem;
+    } else {
+        r->dropped++;
+    }
+    if (st->report) {
+        st->report(problem, st->report_arg);
+    }
+}
+
+static bool in_range(const fsck_state_t *st, uint64_t block) {
+    return block >= st->first_block && block < st->blocks;
+}
+
+// Claims a block for the current owner. The first claim sets its bit in the usage map, any later
+// one lands in the duplicate map. While finding owners the claimant is noted instead.
+static void visit(fsck_worker_t *w, uint64_t block) {
+    fsck_state_t *st = w->st;
+
+    if (!in_range(st, block)) {
+        if (w->bad_count++ == 0) {
+            w->bad_first = block;
+        }
+        return;
+    }
+
+    if (st->finding_owners) {
+        if (!shardmap_get(&st->dups, block, NULL)) {
+            return;
+        }
+        if (w->owner_count == w->owner_capacity) {
+            size_t capacity = w->owner_capacity ? w->owner_capacity * 2 : 64;
+            fsck_owner_t *owners = (fsck_owner_t *)realloc(w->owners, capacity * sizeof(fsck_owner_t));
+            if (!owners) {
+                w->failed = true;
+                return;
+            }
+            w->owners = owners;
+            w->owner_capacity = capacity;
+        }
+        w->owners[w->owner_count++] = (fsck_owner_t){ block, w->ino };
+        return;
+    }
+
+    uint64_t bit = block - st->first_block;
+    uint64_t mask = 1ULL << (bit & 63);
+    if (atomic_fetch_or_explicit(&st->claimed[bit >> 6], mask, memory_order_relaxed) & mask) {
+        if (shardmap_add(&st->dups, block, 1, NULL) != 0) {
+            w->failed = true;
+        }
+    } else {
+        w->claimed++;
+    }
+}
+
+static bool block_claimed(const fsck_state_t *st, uint64_t bit) {
+    return atomic_load_explicit(&st->claimed[bit >> 6], memory_order_relaxed) & (1ULL << (bit & 63));
+}
+
+// Counts one reference per entry. The entries of an htree node are hidden behind one empty
+// entry spanning the block, so only real names are seen.
+static void count_dir_block(fsck_worker_t *w, uint64_t block_num, const unsigned char *block) {
+    fsck_state_t *st = w->st;
+    uint32_t block_size = st->fs_info->block_size;
+    uint32_t inodes = st->fs_info->sb.s_inodes_count;
+    uint32_t pos = 0;
+
+    while (block_size - pos >= 8) {
+        const struct ext2_dir_entry_2 *entry = (const struct ext2_dir_entry_2 *)(block + pos);
+        uint32_t rec_len = entry->rec_len;
+
+        if (rec_len < 8 || rec_len % 4 != 0 || rec_len > block_size - pos || entry->name_len + 8u > rec_len) {
+            add_problem(w, &(fsck_problem_t){ .kind = FSCK_BAD_DIR, .ino = w->ino, .block = block_num, .value = pos });
+            return;
+        }
+        pos += rec_len;
+
+        if (entry->inode == 0) {
+            continue;
+        }
+        w->entries++;
+        if (entry->inode > inodes) {
+            add_problem(w, &(fsck_problem_t){ .kind = FSCK_BAD_ENTRY, .ino = w->ino, .block = block_num,
+                                              .value = entry->inode });
+            continue;
+        }
+        if (refcount_inc(&st->refs, entry->inode - 1) != 0) {
+            w->failed = true;
+            return;
+        }
+    }
+}
+
+static int visit_run(uint64_t logical, uint64_t physical, uint32_t count, bool unwritten, void *arg) {
+    fsck_worker_t *w = (fsck_worker_t *)arg;
+    fsck_state_t *st = w->st;
+    (void)logical;
+    (void)unwritten;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (st->checks & FSCK_CHECK_BLOCKS) {
+            visit(w, physical + i);
+        }
+        if (w->is_dir && (st->checks & FSCK_CHECK_LINKS) && !st->finding_owners && in_range(st, physical + i)) {
+            if (read_block(st->fs_info, (uint32_t)(physical + i), w->block) == 0) {
+                count_dir_block(w, physical + i, w->block);
+            } else {
+                add_problem(w, &(fsck_problem_t){ .kind = FSCK_BAD_DIR, .ino = w->ino, .block = physical + i });
+            }
+        }
+    }
+    return w->failed ? -1 : 0;
+}
+
+static int visit_node(uint64_t block, const unsigned char *data, void *arg) {
+    fsck_worker_t *w = (fsck_worker_t *)arg;
+    (void)data;
+
+    if (w->st->checks & FSCK_CHECK_BLOCKS) {
+        visit(w, block);
+    }
+    return w->failed ? -1 : 0;
+}
+
+static bool group_has_super(const fs_info_t *fs_info, uint32_t group) {
+    if (group <= 1 || !(fs_info->sb.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER)) {
+        return true;
+    }
+    for (uint32_t base = 3; base <= 7; base += 2) {
+        uint64_t power = base;
+        while (power < group) {
+            power *= base;
+        }
+        if (power == group) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Superblock and descriptor copies, bitmaps and inode table of one group. Reserved descriptor
+// blocks belong to the resize inode and are claimed through its block map.
+static void visit_group_metadata(fsck_worker_t *w, uint32_t group) {
+    fs_info_t *fs_info = w->st->fs_info;
+    const struct ext2_group_desc *gd = &fs_info->group_desc[group];
+    uint32_t table = inode_table_blocks(fs_info);
+
+    w->ino = 0;
+    if (group_has_super(fs_info, group)) {
+        uint64_t base = fs_info->sb.s_first_data_block + (uint64_t)group * fs_info->blocks_per_group;
+        for (uint32_t b = 0; b <= w->st->desc_blocks; b++) {
+            visit(w, base + b);
+        }
+    }
+    visit(w, gd->bg_block_bitmap);
+    visit(w, gd->bg_inode_bitmap);
+    for (uint32_t b = 0; b < table; b++) {
+        visit(w, (uint64_t)gd->bg_inode_table + b);
+    }
+    w->bad_count = 0;
+}
+
+static int fsck_worker_init(void *worker, void *arg) {
+    fsck_worker_t *w = (fsck_worker_t *)worker;
+    fsck_state_t *st = (fsck_state_t *)arg;
+
+    w->st = st;
+    if (inode_iter_init(&w->it, st->fs_info, 0, 0, false) != 0) {
+        return -1;
+    }
+    w->block = (unsigned char *)malloc(st->fs_info->block_size);
+    if (!w->block) {
+        inode_iter_cleanup(&w->it);
+        return -1;
+    }
+    return 0;
+}
+
+// Pass 1 and the owner search: claims the blocks of every allocated inode of a group and,
+// in pass 1, counts the entries of its directories
+static int fsck_scan_group(uint32_t group, void *worker, void *arg) {
+    fsck_worker_t *w = (fsck_worker_t *)worker;
+    fsck_state_t *st = (fsck_state_t *)arg;
+    fs_info_t *fs_info = st->fs_info;
+    inode_iter_t *it = &w->it;
+    int rc;
+
+    w->problem_count = 0;
+    if (st->checks & FSCK_CHECK_BLOCKS) {
+        visit_group_metadata(w, group);
+    }
+
+    inode_iter_reset(it, group, group + 1);
+    while ((rc = inode_iter_next(it)) > 0) {
+        for (uint32_t i = 0; i < it->count; i++) {
+            if (!inode_iter_used(it, i)) {
+                continue;
+            }
+            const struct ext2_inode *inode = inode_iter_inode(it, i);
+            uint32_t ino = it->first_inode + i;
+
+            w->ino = ino;
+            w->is_dir = S_ISDIR(inode->i_mode);
+            w->bad_count = 0;
+            if (!st->finding_owners) {
+                set_bitmap_bit(st->used, ino - 1);
+                if (w->is_dir) {
+                    set_bitmap_bit(st->dirs, ino - 1);
+                    w->dir_count++;
+                }
+                st->links[ino - 1] = inode->i_links_count;
+                w->inodes++;
+            }
+            // Counting references only needs the directories
+            if (!(st->checks & FSCK_CHECK_BLOCKS) && !w->is_dir) {
+                continue;
+            }
+
+            // Attribute blocks may be shared, they are claimed once all sharers are known
+            if (inode->i_file_acl && (st->checks & FSCK_CHECK_BLOCKS)) {
+                if (st->finding_owners || !in_range(st, inode->i_file_acl)) {
+                    visit(w, inode->i_file_acl);
+                } else if (shardmap_add(&st->xattrs, inode->i_file_acl, 1, NULL) != 0) {
+                    return -1;
+                }
+            }
+
+            if (blockmap_has_blocks(inode) &&
+                blockmap_walk_nodes(fs_info, inode, visit_run, visit_node, w) != 0) {
+                if (w->failed) {
+                    return -1;
+                }
+                if (!st->finding_owners) {
+                    add_problem(w, &(fsck_problem_t){ .kind = FSCK_BAD_MAP, .ino = ino });
+                }
+            }
+            if (w->bad_count && !st->finding_owners) {
+                add_problem(w, &(fsck_problem_t){ .kind = FSCK_BAD_BLOCK, .ino = ino, .block = w->bad_first,
+                                                  .count = w->bad_count });
+            }
+        }
+    }
+    if (rc < 0 && !st->finding_owners) {
+        w->unreadable++;
+    }
+    return w->failed ? -1 : 0;
+}
+
+// Adds a mismatch between bitmap and usage map to the run being built, flushing the previous
+// run when the kind changes or the blocks stop being adjacent
+static void extend_run(fsck_worker_t *w, fsck_problem_t *run, int kind, uint64_t block) {
+    if (run->count && ((int)run->kind != kind || run->block + run->count != block)) {
+        add_problem(w, run);
+        run->count = 0;
+    }
+    if (kind < 0) {
+        return;
+    }
+    if (run->count == 0) {
+        *run = (fsck_problem_t){ .kind = (fsck_kind_t)kind, .block = block };
+    }
+    run->count++;
+}
+
+static void compare_block_bitmap(fsck_worker_t *w, uint32_t group) {
+    fsck_state_t *st = w->st;
+    fs_info_t *fs_info = st->fs_info;
+    uint32_t count = group_block_count(fs_info, group);
+    uint64_t first_bit = (uint64_t)group * fs_info->blocks_per_group;
+    fsck_problem_t run = { .count = 0 };
+
+    if (fs_info->group_desc[group].bg_flags & EXT2_BG_BLOCK_UNINIT) {
+        w->uninit_groups++;
+        return;
+    }
+    if (get_block_bitmap(fs_info, group, w->block) != 0) {
+        w->unreadable++;
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; ) {
+        // Whole words that agree are skipped without looking at single bits
+        if ((first_bit + i) % 64 == 0 && count - i >= 64) {
+            uint64_t marked;
+            memcpy(&marked, w->block + i / 8, 8);
+            if (marked == atomic_load_explicit(&st->claimed[(first_bit + i) >> 6], memory_order_relaxed)) {
+                extend_run(w, &run, -1, 0);
+                i += 64;
+                continue;
+            }
+        }
+        bool marked = check_bitmap_bit(w->block, i);
+        bool owned = block_claimed(st, first_bit + i);
+        extend_run(w, &run, marked == owned ? -1 : owned ? FSCK_UNMARKED : FSCK_LEAKED,
+                   st->first_block + first_bit + i);
+        i++;
+    }
+    extend_run(w, &run, -1, 0);
+}
+
+// Pass 2: compares the usage map with the block bitmap of a group and the references found with
+// the link counts of its inodes
+static int fsck_check_group(uint32_t group, void *worker, void *arg) {
+    fsck_worker_t *w = (fsck_worker_t *)worker;
+    fsck_state_t *st = (fsck_state_t *)arg;
+    fs_info_t *fs_info = st->fs_info;
+    uint32_t inodes = fs_info->sb.s_inodes_count;
+
+    w->problem_count = 0;
+    if (st->checks & FSCK_CHECK_BLOCKS) {
+        compare_block_bitmap(w, group);
+    }
+    if (!(st->checks & FSCK_CHECK_LINKS)) {
+        return w->failed ? -1 : 0;
+    }
+
+    for (uint32_t i = 0; i < fs_info->inodes_per_group; i++) {
+        uint32_t ino = group * fs_info->inodes_per_group + i + 1;
+        if (ino > inodes) {
+            break;
+        }
+        uint32_t refs = refcount_get(&st->refs, ino - 1);
+
+        if (!check_bitmap_bit(st->used, ino - 1)) {
+            if (refs) {
+                add_problem(w, &(fsck_problem_t){ .kind = FSCK_FREE_REFERENCED, .ino = ino, .count = refs });
+            }
+            continue;
+        }
+        if (ino < st->first_ino && ino != EXT2_ROOT_INO) {
+            continue;
+        }
+
+        uint32_t links = st->links[ino - 1];
+        bool many = st->dir_nlink && links == 1 && refs >= EXT2_LINK_MAX && check_bitmap_bit(st->dirs, ino - 1);
+        if (refs == 0) {
+            add_problem(w, &(fsck_problem_t){ .kind = FSCK_ORPHAN, .ino = ino, .value = links });
+        } else if (links != refs && !many) {
+            add_problem(w, &(fsck_problem_t){ .kind = FSCK_LINK_COUNT, .ino = ino, .count = refs, .value = links });
+        }
+    }
+    return w->failed ? -1 : 0;
+}
+
+static int fsck_emit(uint32_t group, void *worker, void *arg) {
+    fsck_worker_t *w = (fsck_worker_t *)worker;
+    (void)group;
+
+    for (uint32_t i = 0; i < w->problem_count; i++) {
+        publish((fsck_state_t *)arg, &w->problems[i]);
+    }
+    return 0;
+}
+
+static int fsck_worker_finish(void *worker, void *arg) {
+    fsck_worker_t *w = (fsck_worker_t *)worker;
+    fsck_state_t *st = (fsck_state_t *)arg;
+    fsck_result_t *r = st->result;
+    int rc = 0;
+
+    r->inodes += w->inodes;
+    r->dirs += w->dir_count;
+    r->entries += w->entries;
+    r->claimed += w->claimed;
+    r->uninit_groups += w->uninit_groups;
+    r->unreadable += w->unreadable;
+
+    if (w->owner_count) {
+        fsck_owner_t *owners = (fsck_owner_t *)realloc(st->owners, (st->owner_count + w->owner_count) * sizeof(fsck_owner_t));
+        if (owners) {
+            st->owners = owners;
+            memcpy(st->owners + st->owner_count, w->owners, w->owner_count * sizeof(fsck_owner_t));
+            st->owner_count += w->owner_count;
+        } else {
+            rc = -1;
+        }
+    }
+
+    free(w->owners);
+    free(w->problems);
+    free(w->block);
+    inode_iter_cleanup(&w->it);
+    return rc;
+}
+
+static int run_groups(fsck_state_t *st, uint32_t threads, int (*work)(uint32_t, void *, void *)) {
+    parallel_t p;
+
+    memset(&p, 0, sizeof(p));
+    p.items = st->fs_info->groups_count;
+    // Groups share bytes of st->used and st->dirs unless each one fills whole bytes
+    p.threads = st->fs_info->inodes_per_group % 8 ? 1 : threads;
+    p.worker_size = sizeof(fsck_worker_t);
+    p.arg = st;
+    p.job = st->job;
+    p.init = fsck_worker_init;
+    p.work = work;
+    p.emit = fsck_emit;
+    p.finish = fsck_worker_finish;
+    return parallel_run(&p) != 0 || job_is_cancelled(st->job) ? -1 : 0;
+}
+
+// Attribute blocks are claimed once each, however many inodes share them
+static int claim_xattr_blocks(fsck_state_t *st) {
+    shardmap_entry_t *entries;
+    size_t count;
+    fsck_worker_t w;
+
+    if (shardmap_collect(&st->xattrs, &entries, &count) != 0) {
+        return -1;
+    }
+    memset(&w, 0, sizeof(w));
+    w.st = st;
+    for (size_t i = 0; i < count; i++) {
+        visit(&w, entries[i].key);
+    }
+    st->result->claimed += w.claimed;
+    free(entries);
+    return w.failed ? -1 : 0;
+}
+
+static int compare_owner(const void *a, const void *b) {
+    const fsck_owner_t *x = (const fsck_owner_t *)a, *y = (const fsck_owner_t *)b;
+    if (x->block != y->block) {
+        return x->block < y->block ? -1 : 1;
+    }
+    return x->ino < y->ino ? -1 : x->ino > y->ino;
+}
+
+static bool same_owners(const fsck_owner_t *a, size_t a_count, const fsck_owner_t *b, size_t b_count) {
+    if (a_count != b_count) {
+        return false;
+    }
+    for (size_t i = 0; i < a_count; i++) {
+        if (a[i].ino != b[i].ino) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Pass 1b: looks at every owner again to name the claimants of the doubly claimed blocks,
+// reporting neighbouring blocks with the same claimants as one run. A shared attribute block
+// counts as claimed by each of its sharers.
+static int report_dups(fsck_state_t *st, uint32_t threads) {
+    st->finding_owners = true;
+    if (run_groups(st, threads, fsck_scan_group) != 0) {
+        return -1;
+    }
+
+    qsort(st->owners, st->owner_count, sizeof(fsck_owner_t), compare_owner);
+
+    size_t prev = 0, prev_count = 0;
+    fsck_problem_t run = { .kind = FSCK_DUP_BLOCK };
+    for (size_t i = 0; i < st->owner_count; ) {
+        size_t end = i;
+        while (end < st->owner_count && st->owners[end].block == st->owners[i].block) {
+            end++;
+        }
+        if (run.count && run.block + run.count == st->owners[i].block &&
+            same_owners(st->owners + prev, prev_count, st->owners + i, end - i)) {
+            run.count++;
+        } else {
+            if (run.count) {
+                publish(st, &run);
+            }
+            run = (fsck_problem_t){ .kind = FSCK_DUP_BLOCK, .block = st->owners[i].block, .count = 1,
+                                    .owner_count = (uint32_t)(end - i) };
+            for (size_t o = 0; o < end - i && o < FSCK_DUP_OWNERS; o++) {
+                run.owners[o] = st->owners[i + o].ino;
+            }
+            prev = i;
+            prev_count = end - i;
+        }
+        i = end;
+    }
+    if (run.count) {
+        publish(st, &run);
+    }
+    return 0;
+}
+
+// Read-only consistency check in the spirit of e2fsck passes 1, 1b, 2 and 5:
+//  - pass 1 claims every block of every allocated inode and group in an atomic bitmap, noting
+//    blocks claimed twice, and counts the directory entries referring to each inode;
+//  - pass 1b names the claimants of the doubly claimed blocks;
+//  - pass 2 compares the claims with the block bitmaps and the entries with the link counts.
+// checks picks the comparisons; with FSCK_CHECK_LINKS alone only directories are read.
+// Problems reach the reporter in group order while the passes run.
+fsck_result_t *fsck_check(fs_info_t *fs_info, uint32_t checks, uint32_t threads, job_t *job, fsck_report_fn_t report, void *report_arg) {
+    fsck_result_t *r = (fsck_result_t *)calloc(1, sizeof(fsck_result_t));
+    fsck_state_t st;
+    struct timespec start, end;
+    uint32_t inodes = fs_info->sb.s_inodes_count;
+    bool maps = false;
+    bool counters = false;
+
+    if (!r) {
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    memset(&st, 0, sizeof(st));
+    st.fs_info = fs_info;
+    st.job = job;
+    st.result = r;
+    st.report = report;
+    st.report_arg = report_arg;
+    st.checks = checks;
+    r->checks = checks;
+    st.first_block = fs_info->sb.s_first_data_block;
+    st.blocks = fs_info->sb.s_blocks_count;
+    st.first_ino = fs_info->sb.s_rev_level ? fs_info->sb.s_first_ino : EXT2_GOOD_OLD_FIRST_INO;
+    st.dir_nlink = fs_info->sb.s_feature_ro_compat & EXT4_FEATURE_RO_COMPAT_DIR_NLINK;
+    st.desc_blocks = (uint32_t)(((uint64_t)fs_info->groups_count * fs_info->desc_size + fs_info->block_size - 1) /
+                                fs_info->block_size);
+
+    size_t words = checks & FSCK_CHECK_BLOCKS ? (size_t)((st.blocks - st.first_block + 63) / 64) : 0;
+    size_t inode_bytes = ((size_t)inodes + 7) / 8;
+    r->problems = (fsck_problem_t *)malloc(FSCK_MAX_PROBLEMS * sizeof(fsck_problem_t));
+    st.claimed = (_Atomic uint64_t *)calloc(words ? words : 1, sizeof(uint64_t));
+    st.used = (unsigned char *)calloc(inode_bytes, 1);
+    st.dirs = (unsigned char *)calloc(inode_bytes, 1);
+    st.links = (uint16_t *)calloc(inodes, sizeof(uint16_t));
+    if (!r->problems || !st.claimed || !st.used || !st.dirs || !st.links) {
+        goto fail;
+    }
+    if (refcount_init(&st.refs, inodes) != 0) {
+        goto fail;
+    }
+    counters = true;
+    if (shardmap_init(&st.dups) != 0) {
+        goto fail;
+    }
+    if (shardmap_init(&st.xattrs) != 0) {
+        shardmap_free(&st.dups);
+        goto fail;
+    }
+    maps = true;
+    r->memory = words * sizeof(uint64_t) + inode_bytes * 2 + (size_t)inodes * sizeof(uint16_t);
+
+    job_printf(job, "Pass 1: %s", checks == FSCK_CHECK_LINKS ? "counting directory entries"
+                                  : checks == FSCK_CHECK_BLOCKS ? "claiming blocks"
+                                  : "claiming blocks and counting directory entries");
+    if (run_groups(&st, threads, fsck_scan_group) != 0 || claim_xattr_blocks(&st) != 0) {
+        goto fail;
+    }
+
+    if (shardmap_count(&st.dups) > 0) {
+        job_printf(job, "Pass 1b: finding the owners of %lu doubly claimed block(s)",
+                   (unsigned long)shardmap_count(&st.dups));
+        if (report_dups(&st, threads) != 0) {
+            goto fail;
+        }
+        st.finding_owners = false;
+    }
+    r->memory += shardmap_bytes(&st.dups) + shardmap_bytes(&st.xattrs) + st.owner_count * sizeof(fsck_owner_t) +
+                 refcount_bytes(&st.refs);
+
+    job_printf(job, "Pass 2: comparing %s", checks == FSCK_CHECK_LINKS ? "link counts"
+                                            : checks == FSCK_CHECK_BLOCKS ? "bitmaps"
+                                            : "bitmaps and link counts");
+    if (run_groups(&st, threads, fsck_check_group) != 0) {
+        goto fail;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    r->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    goto done;
+
+fail:
+    fsck_free(r);
+    r = NULL;
+done:
+    if (maps) {
+        shardmap_free(&st.dups);
+        shardmap_free(&st.xattrs);
+    }
+    free(st.owners);
+    free((void *)st.claimed);
+    free(st.used);
+    free(st.dirs);
+    free(st.links);
+    if (counters) {
+        refcount_free(&st.refs);
+    }
+    return r;
+}
+
+void fsck_free(fsck_result_t *result) {
+    if (!result) {
+        return;
+    }
+
+    free(result->problems);
+    free(result);
+}
+
+const char *fsck_kind_name(fsck_kind_t kind) {
+    switch (kind) {
+        case FSCK_BAD_BLOCK:        return "Blocks outside the filesystem";
+        case FSCK_BAD_MAP:          return "Unreadable block maps";
+        case FSCK_BAD_DIR:          return "Broken directory blocks";
+        case FSCK_BAD_ENTRY:        return "Entries with invalid inodes";
+        case FSCK_DUP_BLOCK:        return "Doubly claimed runs";
+        case FSCK_UNMARKED:         return "Used runs marked free";
+        case FSCK_LEAKED:           return "Free runs marked used";
+        case FSCK_FREE_REFERENCED:  return "Free inodes referenced";
+        case FSCK_LINK_COUNT:       return "Wrong link counts";
+        case FSCK_ORPHAN:           return "Unreferenced inodes";
+        default:                    return "Unknown";
+    }
+}
+
+static int format_blocks(char *buffer, size_t buffer_size, uint64_t block, uint32_t count) {
+    if (count <= 1) {
+        return snprintf(buffer, buffer_size, "Block %lu", (unsigned long)block);
+    }
+    return snprintf(buffer, buffer_size, "Blocks %lu-%lu", (unsigned long)block, (unsigned long)(block + count - 1));
+}
+
+void fsck_format_problem(const fsck_problem_t *p, char *buffer, size_t buffer_size) {
+    int n;
+
+    switch (p->kind) {
+        case FSCK_BAD_BLOCK:
+            snprintf(buffer, buffer_size, "Inode %u maps %u block(s) outside the filesystem, first %lu",
+                     p->ino, p->count, (unsigned long)p->block);
+            break;
+        case FSCK_BAD_MAP:
+            snprintf(buffer, buffer_size, "Inode %u: block map could not be read", p->ino);
+            break;
+        case FSCK_BAD_DIR:
+            snprintf(buffer, buffer_size, "Directory %u: broken entry in block %lu at offset %u",
+                     p->ino, (unsigned long)p->block, p->value);
+            break;
+        case FSCK_BAD_ENTRY:
+            snprintf(buffer, buffer_size, "Directory %u: entry in block %lu refers to invalid inode %u",
+                     p->ino, (unsigned long)p->block, p->value);
+            break;
+        case FSCK_DUP_BLOCK:
+            n = format_blocks(buffer, buffer_size, p->block, p->count);
+            for (uint32_t i = 0; i < p->owner_count && i < FSCK_DUP_OWNERS && n >= 0 && (size_t)n < buffer_size; i++) {
+                if (p->owners[i]) {
+                    n += snprintf(buffer + n, buffer_size - n, "%s inode %u", i ? "," : " claimed by", p->owners[i]);
+                } else {
+                    n += snprintf(buffer + n, buffer_size - n, "%s metadata", i ? "," : " claimed by");
+                }
+            }
+            if (p->owner_count > FSCK_DUP_OWNERS && n >= 0 && (size_t)n < buffer_size) {
+                snprintf(buffer + n, buffer_size - n, " and %u more", p->owner_count - FSCK_DUP_OWNERS);
+            }
+            break;
+        case FSCK_UNMARKED:
+            n = format_blocks(buffer, buffer_size, p->block, p->count);
+            if (n >= 0 && (size_t)n < buffer_size) {
+                snprintf(buffer + n, buffer_size - n, " in use but marked free");
+            }
+            break;
+        case FSCK_LEAKED:
+            n = format_blocks(buffer, buffer_size, p->block, p->count);
+            if (n >= 0 && (size_t)n < buffer_size) {
+                snprintf(buffer + n, buffer_size - n, " marked in use but not owned");
+            }
+            break;
+        case FSCK_FREE_REFERENCED:
+            snprintf(buffer, buffer_size, "Inode %u is free but %u entr%s refer to it",
+                     p->ino, p->count, p->count == 1 ? "y" : "ies");
+            break;
+        case FSCK_LINK_COUNT:
+            snprintf(buffer, buffer_size, "Inode %u has link count %u, %u entr%s found",
+                     p->ino, p->value, p->count, p->count == 1 ? "y" : "ies");
+            break;
+        case FSCK_ORPHAN:
+            snprintf(buffer, buffer_size, "Inode %u (link count %u) is not referenced by any directory",
+                     p->ino, p->value);
+            break;
+        default:
+            snprintf(buffer, buffer_size, "Unknown problem");
+            break;
+    }
+}
+
+uint64_t fsck_problem_total(const fsck_result_t *result) {
+    uint64_t total = 0;
+
+    for (int k = 0; k < FSCK_KINDS; k++) {
+        total += result->counts[k];
+    }
+    return total;
+}
+
+void fsck_print_summary(const fsck_result_t *result, FILE *out) {
+    char memory[32];
+
+    format_value(result->memory, memory, sizeof(memory), true);
+    fprintf(out, "Checked %lu inodes, %lu directories, %lu entries", (unsigned long)result->inodes,
+            (unsigned long)result->dirs, (unsigned long)result->entries);
+    if (result->checks & FSCK_CHECK_BLOCKS) {
+        fprintf(out, ", %lu claimed blocks", (unsigned long)result->claimed);
+    }
+    fprintf(out, " in %.2f s (%s of maps)\n", result->seconds, memory);
+    for (int k = 0; k < FSCK_KINDS; k++) {
+        if (result->counts[k]) {
+            fprintf(out, "  %-30s %lu\n", fsck_kind_name((fsck_kind_t)k), (unsigned long)result->counts[k]);
+        }
+    }
+    if (result->uninit_groups) {
+        fprintf(out, "Groups with uninitialized block bitmaps not compared: %u\n", result->uninit_groups);
+    }
+    if (result->unreadable) {
+        fprintf(out, "Unreadable bitmaps or inode tables: %u\n", result->unreadable);
+    }
+    fprintf(out, "%s\n", fsck_problem_total(result) ? "Problems found" : "No problems found");
+}
+
+static void fsck_report_job(const fsck_problem_t *problem, void *arg) {
+    char line[160];
+
+    fsck_format_problem(problem, line, sizeof(line));
+    job_printf((job_t *)arg, "%s", line);
+}
+
+static int run_job(job_t *job, fs_info_t *fs_info, uint32_t checks) {
+    fsck_result_t *result = fsck_check(fs_info, checks, 0, job, fsck_report_job, job);
+    if (!result) {
+        job_printf(job, "%s", job_is_cancelled(job) ? "Consistency check cancelled" : "Consistency check failed");
+        return job_is_cancelled(job) ? 0 : -1;
+    }
+
+    char memory[32];
+    format_value(result->memory, memory, sizeof(memory), true);
+    job_printf(job, "Check finished: %lu problem(s), %lu inodes, %lu entries, %lu claimed blocks, %s of maps, %.2f s",
+               (unsigned long)fsck_problem_total(result), (unsigned long)result->inodes,
+               (unsigned long)result->entries, (unsigned long)result->claimed, memory, result->seconds);
+    fsck_free(result);
+    return 0;
+}
+
+// Job body: checks the filesystem passed as arg, problems appear as they are found
+int fsck_job(job_t *job, void *arg) {
+    return run_job(job, (fs_info_t *)arg, FSCK_CHECK_ALL);
+}
+
+// Job body: only compares link counts with the directory entries, reading no file block maps
+int fsck_links_job(job_t *job, void *arg) {
+    return run_job(job, (fs_info_t *)arg, FSCK_CHECK_LINKS);
+}
@@ -0,0 +1,78 @@
+#ifndef FSCK_H
+#define FSCK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ext2fs/ext2_fs.h>
+#include "analyzer.h"
+#include "job.h"
+
+#define FSCK_MAX_PROBLEMS 1000      // Problems kept in a result, the rest are only counted
+#define FSCK_DUP_OWNERS 4           // Owners named per doubly claimed run
+
+#define FSCK_CHECK_BLOCKS 0x1       // Block ownership against the bitmaps
+#define FSCK_CHECK_LINKS 0x2        // Directory references against the link counts
+#define FSCK_CHECK_ALL (FSCK_CHECK_BLOCKS | FSCK_CHECK_LINKS)
+
+typedef enum {
+    FSCK_BAD_BLOCK,             // Inode maps blocks outside the filesystem
+    FSCK_BAD_MAP,               // Block map of an inode could not be read
+    FSCK_BAD_DIR,               // Directory block with a broken entry chain
+    FSCK_BAD_ENTRY,             // Directory entry with an inode number out of range
+    FSCK_DUP_BLOCK,             // Blocks claimed by more than one owner
+    FSCK_UNMARKED,              // Blocks in use but free in the bitmap
+    FSCK_LEAKED,                // Blocks marked used that nothing owns
+    FSCK_FREE_REFERENCED,       // Entries pointing to an unallocated inode
+    FSCK_LINK_COUNT,            // Stored link count differs from the entries found
+    FSCK_ORPHAN,                // Allocated inode no directory entry refers to
+    FSCK_KINDS
+} fsck_kind_t;
+
+typedef struct {
+    fsck_kind_t kind;
+    uint32_t ino;               // Inode concerned, 0 for bitmap problems
+    uint64_t block;             // First block concerned
+    uint32_t count;             // Blocks in the run, or directory entries found
+    uint32_t value;             // Stored link count, or the bad inode number of an entry
+    uint32_t owners[FSCK_DUP_OWNERS]; // Claimants of a doubly claimed run, 0 for filesystem metadata
+    uint32_t owner_count;       // Claimants in total
+} fsck_problem_t;
+
+// Receives every problem as soon as its place in the report is known
+typedef void (*fsck_report_fn_t)(const fsck_problem_t *problem, void *arg);
+
+typedef struct {
+    uint32_t checks;            // FSCK_CHECK_* flags the result covers
+    uint64_t inodes;            // Allocated inodes checked
+    uint64_t dirs;              // Directories read
+    uint64_t entries;           // Directory entries counted
+    uint64_t claimed;           // Blocks owned by inodes or filesystem metadata
+    uint64_t counts[FSCK_KINDS]; // Problems per kind
+    fsck_problem_t *problems;   // First FSCK_MAX_PROBLEMS in report order
+    uint32_t problem_count;
+    uint64_t dropped;           // Problems beyond FSCK_MAX_PROBLEMS
+    uint32_t uninit_groups;     // Groups whose uninitialized block bitmap was not compared
+    uint32_t unreadable;        // Bitmaps that could not be read
+    size_t memory;              // Bytes of usage map, counters and hash maps at their peak
+    double seconds;             // Wall time of the check
+} fsck_result_t;
+
+fsck_result_t *fsck_check(fs_info_t *fs_info, uint32_t checks, uint32_t threads, job_t *job, fsck_report_fn_t report, void *report_arg);
+
+void fsck_free(fsck_result_t *result);
+
+const char *fsck_kind_name(fsck_kind_t kind);
+
+void fsck_format_problem(const fsck_problem_t *problem, char *buffer, size_t buffer_size);
+
+uint64_t fsck_problem_total(const fsck_result_t *result);
+
+void fsck_print_summary(const fsck_result_t *result, FILE *out);
+
+int fsck_job(job_t *job, void *arg);
+
+int fsck_links_job(job_t *job, void *arg);
+
+#endif /* FSCK_H */
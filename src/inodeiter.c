@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "inodeiter.h"
+#include "utils.h"
+
+int inode_iter_init(inode_iter_t *it, fs_info_t *fs_info, uint32_t first_group, uint32_t end_group, bool all_inodes) {
+    if (!it || !fs_info) {
+        return -1;
+    }
+
+    memset(it, 0, sizeof(*it));
+    it->fs_info = fs_info;
+    inode_iter_reset(it, first_group, end_group);
+    it->all_inodes = all_inodes;
+    it->inode_size = fs_info->sb.s_inode_size ? fs_info->sb.s_inode_size : EXT2_GOOD_OLD_INODE_SIZE;
+
+    // Chunks always start on a block boundary of the inode table
+    uint32_t per_block = fs_info->block_size / it->inode_size;
+    it->per_chunk = per_block * INODE_ITER_CHUNK_BLOCKS;
+
+    it->bitmap = (unsigned char *)malloc(fs_info->block_size);
+    it->table = (uint8_t *)malloc((size_t)INODE_ITER_CHUNK_BLOCKS * fs_info->block_size);
+    if (!it->bitmap || !it->table) {
+        inode_iter_cleanup(it);
+        return -1;
+    }
+
+    return 0;
+}
+
+void inode_iter_cleanup(inode_iter_t *it) {
+    if (!it) {
+        return;
+    }
+
+    free(it->bitmap);
+    free(it->table);
+    it->bitmap = NULL;
+    it->table = NULL;
+}
+
+// Restarts the walk at first_group, keeping the buffers
+void inode_iter_reset(inode_iter_t *it, uint32_t first_group, uint32_t end_group) {
+    it->group = first_group;
+    it->end_group = end_group < it->fs_info->groups_count ? end_group : it->fs_info->groups_count;
+    it->group_loaded = false;
+    it->count = 0;
+}
+
+// First index at or after start whose bit is set, or limit if there is none
+static uint32_t next_used_index(const unsigned char *bitmap, uint32_t start, uint32_t limit) {
+    uint32_t i = start;
+
+    while (i < limit) {
+        if ((i & 7) == 0 && bitmap[i >> 3] == 0) {
+            i += 8;
+            continue;
+        }
+        if (check_bitmap_bit(bitmap, i)) {
+            return i;
+        }
+        i++;
+    }
+    return limit;
+}
+
+// Loads the next chunk of inode records. Returns 1 with a chunk loaded, 0 at the end and -1 on read errors.
+int inode_iter_next(inode_iter_t *it) {
+    fs_info_t *fs_info = it->fs_info;
+    uint32_t per_group = fs_info->inodes_per_group;
+    uint32_t per_block = fs_info->block_size / it->inode_size;
+
+    while (it->group < it->end_group) {
+        struct ext2_group_desc *gd = &fs_info->group_desc[it->group];
+
+        if (!it->group_loaded) {
+            if (gd->bg_flags & EXT2_BG_INODE_UNINIT) {
+                if (!it->all_inodes) {
+                    it->group++;
+                    continue;
+                }
+                memset(it->bitmap, 0, fs_info->block_size);
+            } else if (get_inode_bitmap(fs_info, it->group, it->bitmap) != 0) {
+                return -1;
+            }
+            it->group_loaded = true;
+            it->next_index = 0;
+        }
+
+        uint32_t start = it->next_index;
+        if (!it->all_inodes) {
+            start = next_used_index(it->bitmap, start, per_group);
+        }
+        if (start >= per_group) {
+            it->group++;
+            it->group_loaded = false;
+            continue;
+        }
+
+        start -= start % per_block;
+        uint32_t count = per_group - start < it->per_chunk ? per_group - start : it->per_chunk;
+        uint32_t blocks = (uint32_t)(((uint64_t)count * it->inode_size + fs_info->block_size - 1) / fs_info->block_size);
+
+        if (read_blocks(fs_info, gd->bg_inode_table + start / per_block, blocks, it->table) != 0) {
+            return -1;
+        }
+
+        it->first_index = start;
+        it->first_inode = it->group * per_group + start + 1;
+        it->count = count;
+        it->next_index = start + count;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Whether record i of the current chunk is marked in use in the inode bitmap
+bool inode_iter_used(const inode_iter_t *it, uint32_t i) {
+    return check_bitmap_bit(it->bitmap, it->first_index + i);
+}
+
+const struct ext2_inode *inode_iter_inode(const inode_iter_t *it, uint32_t i) {
+    return (const struct ext2_inode *)(it->table + (size_t)i * it->inode_size);
+}
@@ -0,0 +1,41 @@
+#ifndef INODEITER_H
+#define INODEITER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ext2fs/ext2_fs.h>
+#include "analyzer.h"
+
+#define INODE_ITER_CHUNK_BLOCKS 256     // Inode table blocks read per chunk
+
+typedef struct {
+    fs_info_t *fs_info;         // Filesystem to read from
+    uint32_t group;             // Group of the current chunk
+    uint32_t end_group;         // One past the last group to visit
+    uint32_t inode_size;        // On-disk inode record size
+    uint32_t per_chunk;         // Inodes that fit in one chunk
+    uint32_t next_index;        // Index inside the group where the next chunk starts
+    bool group_loaded;          // Bitmap of the current group has been read
+    bool all_inodes;            // Report free slots too
+    unsigned char *bitmap;      // Inode bitmap of the current group
+    uint8_t *table;             // Raw inode records of the current chunk
+    uint32_t first_inode;       // Inode number of the first record in table
+    uint32_t first_index;       // Index inside the group of the first record
+    uint32_t count;             // Records in the current chunk
+} inode_iter_t;
+
+int inode_iter_init(inode_iter_t *it, fs_info_t *fs_info, uint32_t first_group, uint32_t end_group, bool all_inodes);
+
+void inode_iter_cleanup(inode_iter_t *it);
+
+void inode_iter_reset(inode_iter_t *it, uint32_t first_group, uint32_t end_group);
+
+int inode_iter_next(inode_iter_t *it);
+
+bool inode_iter_used(const inode_iter_t *it, uint32_t i);
+
+const struct ext2_inode *inode_iter_inode(const inode_iter_t *it, uint32_t i);
+
+#endif /* INODEITER_H */
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "job.h"
+
+static void *job_thread_main(void *opaque) {
+    job_t *job = (job_t *)opaque;
+
+    int rc = job->func(job, job->arg);
+
+    if (atomic_load(&job->cancel)) {
+        atomic_store(&job->state, JOB_CANCELLED);
+    } else if (rc != 0) {
+        atomic_store(&job->state, JOB_FAILED);
+    } else {
+        atomic_store(&job->state, JOB_DONE);
+    }
+    atomic_fetch_add(&job->generation, 1);
+
+    return NULL;
+}
+
+static void job_destroy(job_t *job) {
+    if (!job) {
+        return;
+    }
+
+    pthread_join(job->thread, NULL);
+    if (job->free_arg) {
+        job->free_arg(job->arg);
+    }
+    pthread_mutex_destroy(&job->lock);
+    free(job->lines);
+    free(job);
+}
+
+job_manager_t *job_manager_init(void) {
+    return (job_manager_t *)calloc(1, sizeof(job_manager_t));
+}
+
+void job_manager_cleanup(job_manager_t *mgr) {
+    if (!mgr) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < mgr->count; i++) {
+        job_cancel(mgr->jobs[i]);
+    }
+    for (uint32_t i = 0; i < mgr->count; i++) {
+        job_destroy(mgr->jobs[i]);
+        mgr->jobs[i] = NULL;
+    }
+    free(mgr);
+}
+
+job_t *job_start(job_manager_t *mgr, const char *name, job_func_t func, void *arg, void (*free_arg)(void *)) {
+    if (!mgr || !func || mgr->count >= JOB_MAX) {
+        return NULL;
+    }
+
+    job_t *job = (job_t *)calloc(1, sizeof(job_t));
+    if (!job) {
+        return NULL;
+    }
+
+    job->lines = calloc(JOB_MAX_LINES, JOB_LINE_LEN);
+    if (!job->lines) {
+        free(job);
+        return NULL;
+    }
+
+    snprintf(job->name, sizeof(job->name), "%s", name);
+    job->func = func;
+    job->arg = arg;
+    job->free_arg = free_arg;
+    atomic_init(&job->state, JOB_RUNNING);
+    atomic_init(&job->cancel, false);
+    atomic_init(&job->done, 0);
+    atomic_init(&job->total, 0);
+    atomic_init(&job->generation, 0);
+    pthread_mutex_init(&job->lock, NULL);
+
+    if (pthread_create(&job->thread, NULL, job_thread_main, job) != 0) {
+        pthread_mutex_destroy(&job->lock);
+        free(job->lines);
+        free(job);
+        return NULL;
+    }
+
+    mgr->jobs[mgr->count++] = job;
+    return job;
+}
+
+void job_cancel(job_t *job) {
+    if (job) {
+        atomic_store(&job->cancel, true);
+    }
+}
+
+int job_dismiss(job_manager_t *mgr, uint32_t index) {
+    if (!mgr || index >= mgr->count) {
+        return -1;
+    }
+
+    job_t *job = mgr->jobs[index];
+    if (atomic_load(&job->state) == JOB_RUNNING) {
+        return -1;
+    }
+
+    job_destroy(job);
+    memmove(&mgr->jobs[index], &mgr->jobs[index + 1], (mgr->count - index - 1) * sizeof(job_t *));
+    mgr->count--;
+    mgr->jobs[mgr->count] = NULL;
+    return 0;
+}
+
+uint32_t job_running_count(job_manager_t *mgr) {
+    uint32_t running = 0;
+
+    if (!mgr) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < mgr->count; i++) {
+        if (atomic_load(&mgr->jobs[i]->state) == JOB_RUNNING) {
+            running++;
+        }
+    }
+    return running;
+}
+
+bool job_is_cancelled(job_t *job) {
+    return job && atomic_load_explicit(&job->cancel, memory_order_relaxed);
+}
+
+void job_set_total(job_t *job, uint64_t total) {
+    if (job) {
+        atomic_store(&job->total, total);
+    }
+}
+
+void job_advance(job_t *job, uint64_t units) {
+    if (job) {
+        atomic_fetch_add_explicit(&job->done, units, memory_order_relaxed);
+    }
+}
+
+double job_fraction(job_t *job) {
+    uint64_t total = atomic_load(&job->total);
+    uint64_t done = atomic_load(&job->done);
+
+    if (total == 0) {
+        return atomic_load(&job->state) == JOB_RUNNING ? 0.0 : 1.0;
+    }
+    if (done >= total) {
+        return 1.0;
+    }
+    return (double)done / (double)total;
+}
+
+void job_printf(job_t *job, const char *fmt, ...) {
+    if (!job) {
+        return;
+    }
+
+    pthread_mutex_lock(&job->lock);
+
+    uint32_t slot;
+    if (job->line_count < JOB_MAX_LINES) {
+        slot = (job->line_start + job->line_count) % JOB_MAX_LINES;
+        job->line_count++;
+    } else {
+        // Ring is full: drop the oldest line
+        slot = job->line_start;
+        job->line_start = (job->line_start + 1) % JOB_MAX_LINES;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(job->lines[slot], JOB_LINE_LEN, fmt, args);
+    va_end(args);
+
+    pthread_mutex_unlock(&job->lock);
+    atomic_fetch_add(&job->generation, 1);
+}
+
+void job_clear_lines(job_t *job) {
+    if (!job) {
+        return;
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->line_start = 0;
+    job->line_count = 0;
+    pthread_mutex_unlock(&job->lock);
+    atomic_fetch_add(&job->generation, 1);
+}
+
+uint32_t job_line_count(job_t *job) {
+    uint32_t count;
+
+    if (!job) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&job->lock);
+    count = job->line_count;
+    pthread_mutex_unlock(&job->lock);
+
+    return count;
+}
+
+uint32_t job_copy_lines(job_t *job, uint32_t first, uint32_t max, char (*out)[JOB_LINE_LEN]) {
+    uint32_t copied = 0;
+
+    if (!job || !out) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&job->lock);
+    for (uint32_t i = first; i < job->line_count && copied < max; i++) {
+        memcpy(out[copied++], job->lines[(job->line_start + i) % JOB_MAX_LINES], JOB_LINE_LEN);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    return copied;
+}
+
+const char *job_state_string(job_state_t state) {
+    switch (state) {
+        case JOB_RUNNING:   return "running";
+        case JOB_DONE:      return "done";
+        case JOB_FAILED:    return "failed";
+        case JOB_CANCELLED: return "cancelled";
+    }
+    return "unknown";
+}
+
+job_slot_t *job_slot_init(void *source, uint32_t top, void (*free_result)(void *)) {
+    job_slot_t *slot = (job_slot_t *)calloc(1, sizeof(job_slot_t));
+    if (!slot) {
+        return NULL;
+    }
+
+    slot->source = source;
+    slot->top = top;
+    slot->free_result = free_result;
+    pthread_mutex_init(&slot->lock, NULL);
+    return slot;
+}
+
+// Jobs writing into the slot must have been joined before this is called
+void job_slot_cleanup(job_slot_t *slot) {
+    if (!slot) {
+        return;
+    }
+
+    slot->free_result(slot->partial);
+    slot->free_result(slot->result);
+    pthread_mutex_destroy(&slot->lock);
+    free(slot);
+}
+
+// Replaces the result, NULL clears it
+void job_slot_publish(job_slot_t *slot, void *result) {
+    pthread_mutex_lock(&slot->lock);
+    slot->free_result(slot->result);
+    slot->result = result;
+    pthread_mutex_unlock(&slot->lock);
+}
+
+// Called by a job body when it is done: a non-NULL result replaces the last one, the
+// partial result is dropped and the slot turns idle unless a later job took it over
+void job_slot_finish(job_slot_t *slot, job_t *job, void *result) {
+    pthread_mutex_lock(&slot->lock);
+    if (result) {
+        slot->free_result(slot->result);
+        slot->result = result;
+    }
+    slot->free_result(slot->partial);
+    slot->partial = NULL;
+    if (slot->job == job) {
+        slot->job = NULL;
+    }
+    pthread_mutex_unlock(&slot->lock);
+}
+
+// Hands the result to the caller, who frees it; NULL while nothing new finished
+void *job_slot_take(job_slot_t *slot) {
+    pthread_mutex_lock(&slot->lock);
+    void *result = slot->result;
+    slot->result = NULL;
+    pthread_mutex_unlock(&slot->lock);
+    return result;
+}
@@ -0,0 +1,99 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define JOB_MAX 16
+#define JOB_MAX_LINES 512
+#define JOB_LINE_LEN 160
+
+typedef enum {
+    JOB_RUNNING,                // Worker thread is executing
+    JOB_DONE,                   // Finished successfully
+    JOB_FAILED,                 // Worker returned an error
+    JOB_CANCELLED               // Stopped on user request
+} job_state_t;
+
+typedef struct job job_t;
+
+typedef int (*job_func_t)(job_t *job, void *arg);
+
+struct job {
+    char name[64];              // Name shown in the jobs view
+    pthread_t thread;           // Worker thread
+    job_func_t func;            // Job body
+    void *arg;                  // Argument passed to the body
+    void (*free_arg)(void *);   // Releases arg once the job is joined
+    atomic_int state;           // job_state_t
+    atomic_bool cancel;         // Cancellation request flag
+    atomic_uint_fast64_t done;  // Units of work completed
+    atomic_uint_fast64_t total; // Units of work expected (0 = unknown)
+    atomic_uint generation;     // Bumped whenever output lines change
+    pthread_mutex_t lock;       // Protects lines
+    char (*lines)[JOB_LINE_LEN]; // Partial results, ring of JOB_MAX_LINES
+    uint32_t line_start;        // Index of the oldest line in the ring
+    uint32_t line_count;        // Number of valid lines
+};
+
+// Where the jobs of one view leave their result for the UI
+typedef struct {
+    void *source;               // What the jobs read, the filesystem for most scans
+    uint32_t top;               // Entries a ranking keeps, 0 for jobs that rank nothing
+    void (*free_result)(void *); // Releases result and partial
+    pthread_mutex_t lock;       // Protects the fields below
+    void *result;               // Last completed result, NULL before the first
+    void *partial;              // Result the running job is still filling in, NULL when it shows none
+    job_t *job;                 // Job filling the slot, claimed under lock by the starter, NULL when idle
+} job_slot_t;
+
+typedef struct {
+    job_t *jobs[JOB_MAX];       // Started jobs, oldest first
+    uint32_t count;             // Number of jobs in the table
+} job_manager_t;
+
+job_manager_t *job_manager_init(void);
+
+void job_manager_cleanup(job_manager_t *mgr);
+
+job_t *job_start(job_manager_t *mgr, const char *name, job_func_t func, void *arg, void (*free_arg)(void *));
+
+void job_cancel(job_t *job);
+
+int job_dismiss(job_manager_t *mgr, uint32_t index);
+
+uint32_t job_running_count(job_manager_t *mgr);
+
+bool job_is_cancelled(job_t *job);
+
+void job_set_total(job_t *job, uint64_t total);
+
+void job_advance(job_t *job, uint64_t units);
+
+double job_fraction(job_t *job);
+
+void job_printf(job_t *job, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void job_clear_lines(job_t *job);
+
+uint32_t job_line_count(job_t *job);
+
+uint32_t job_copy_lines(job_t *job, uint32_t first, uint32_t max, char (*out)[JOB_LINE_LEN]);
+
+const char *job_state_string(job_state_t state);
+
+job_slot_t *job_slot_init(void *source, uint32_t top, void (*free_result)(void *));
+
+void job_slot_cleanup(job_slot_t *slot);
+
+void job_slot_publish(job_slot_t *slot, void *result);
+
+void job_slot_finish(job_slot_t *slot, job_t *job, void *result);
+
+void *job_slot_take(job_slot_t *slot);
+
+#endif /* JOB_H */
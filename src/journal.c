@@ -0,0 +1,735 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "journal.h"
+#include "blockmap.h"
+#include "utils.h"
+
+#define JOURNAL_HEADER_SIZE 12          // h_magic, h_blocktype, h_sequence
+#define JOURNAL_TAIL_SIZE 4             // Checksum tail of descriptor and revoke blocks with csum v2/v3
+#define JOURNAL_FC_DEFAULT 256          // Fast commit blocks when the superblock leaves the count at 0
+
+typedef struct {
+    uint64_t target;
+    uint32_t sequence;          // Transaction of the record
+    uint32_t txn;               // Its index in the transaction list
+} journal_revoke_t;
+
+// Read-ahead over the log: refills with the longest physically contiguous run from the wanted block
+typedef struct {
+    fs_info_t *fs_info;
+    const journal_t *journal;
+    unsigned char *buffer;      // JOURNAL_WINDOW blocks
+    uint32_t first;             // Journal block at the start of the buffer
+    uint32_t count;             // Blocks buffered
+} journal_stream_t;
+
+typedef struct {
+    uint64_t *map;
+    uint32_t count;
+} journal_map_t;
+
+static uint16_t be16(const unsigned char *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t be32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint64_t be64(const unsigned char *p) {
+    return (uint64_t)be32(p) << 32 | be32(p + 4);
+}
+
+// Transaction IDs wrap, compare them like jbd2 does
+static bool tid_geq(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) >= 0;
+}
+
+static int map_run(uint64_t logical, uint64_t physical, uint32_t count, bool unwritten, void *arg) {
+    journal_map_t *m = (journal_map_t *)arg;
+    (void)unwritten;
+
+    for (uint32_t i = 0; i < count && logical + i < m->count; i++) {
+        m->map[logical + i] = physical + i;
+    }
+    return 0;
+}
+
+static const unsigned char *stream_block(journal_stream_t *s, uint32_t block) {
+    const journal_t *j = s->journal;
+    uint32_t bs = j->block_size;
+
+    if (block >= s->first && block < s->first + s->count) {
+        return s->buffer + (size_t)(block - s->first) * bs;
+    }
+
+    s->count = 0;
+    if (block >= j->map_count || j->map[block] == 0) {
+        return NULL;
+    }
+    uint64_t physical = j->map[block];
+    uint32_t n = 1;
+    while (n < JOURNAL_WINDOW && block + n < j->last && j->map[block + n] == physical + n) {
+        n++;
+    }
+    if (read_bytes(s->fs_info, physical * bs, s->buffer, (size_t)n * bs) != 0) {
+        return NULL;
+    }
+    s->first = block;
+    s->count = n;
+    return s->buffer;
+}
+
+static uint32_t next_block(const journal_t *j, uint32_t block) {
+    block++;
+    return block >= j->last ? j->first : block;
+}
+
+static int read_superblock(fs_info_t *fs_info, journal_t *j) {
+    unsigned char *buffer = (unsigned char *)malloc(fs_info->block_size);
+    if (!buffer) {
+        return -1;
+    }
+    if (j->map[0] == 0 || read_bytes(fs_info, j->map[0] * fs_info->block_size, buffer, fs_info->block_size) != 0) {
+        free(buffer);
+        return -1;
+    }
+
+    uint32_t type = be32(buffer + 4);
+    if (be32(buffer) != JOURNAL_MAGIC || (type != JOURNAL_SUPERBLOCK_V1 && type != JOURNAL_SUPERBLOCK_V2)) {
+        free(buffer);
+        return -1;
+    }
+    j->version = type == JOURNAL_SUPERBLOCK_V1 ? 1 : 2;
+    j->block_size = be32(buffer + 0x0C);
+    j->maxlen = be32(buffer + 0x10);
+    j->first = be32(buffer + 0x14);
+    j->sequence = be32(buffer + 0x18);
+    j->start = be32(buffer + 0x1C);
+    j->error = (int32_t)be32(buffer + 0x20);
+    if (j->version == 2) {
+        j->compat = be32(buffer + 0x24);
+        j->incompat = be32(buffer + 0x28);
+        j->ro_compat = be32(buffer + 0x2C);
+    }
+
+    j->last = j->maxlen;
+    if (j->incompat & JOURNAL_INCOMPAT_FAST_COMMIT) {
+        uint32_t fc = be32(buffer + 0x54);
+        fc = fc ? fc : JOURNAL_FC_DEFAULT;
+        j->last = j->maxlen > fc ? j->maxlen - fc : 0;
+    }
+    free(buffer);
+
+    if (j->block_size != fs_info->block_size || j->maxlen > j->map_count || j->first == 0 || j->first >= j->last) {
+        return -1;
+    }
+
+    if (j->incompat & JOURNAL_INCOMPAT_CSUM_V3) {
+        j->tag_size = 16;
+    } else {
+        j->tag_size = 12;
+        if (j->incompat & JOURNAL_INCOMPAT_CSUM_V2) {
+            j->tag_size += 2;
+        }
+        if (!(j->incompat & JOURNAL_INCOMPAT_64BIT)) {
+            j->tag_size -= 4;
+        }
+    }
+    return 0;
+}
+
+static journal_txn_t *add_txn(journal_t *j, uint32_t *capacity, uint32_t sequence, uint32_t start, bool pending) {
+    if (j->txn_count == *capacity) {
+        uint32_t grown = *capacity ? *capacity * 2 : 64;
+        journal_txn_t *txns = (journal_txn_t *)realloc(j->txns, grown * sizeof(journal_txn_t));
+        if (!txns) {
+            return NULL;
+        }
+        j->txns = txns;
+        *capacity = grown;
+    }
+
+    journal_txn_t *t = &j->txns[j->txn_count++];
+    memset(t, 0, sizeof(*t));
+    t->sequence = sequence;
+    t->start = start;
+    t->pending = pending;
+    t->first = j->block_count;
+    return t;
+}
+
+static int add_image(journal_t *j, uint32_t *capacity, uint64_t target, uint32_t jblock, uint32_t flags) {
+    if (j->block_count == *capacity) {
+        uint32_t grown = *capacity ? *capacity * 2 : 1024;
+        journal_block_t *blocks = (journal_block_t *)realloc(j->blocks, grown * sizeof(journal_block_t));
+        if (!blocks) {
+            return -1;
+        }
+        j->blocks = blocks;
+        *capacity = grown;
+    }
+
+    journal_block_t *b = &j->blocks[j->block_count++];
+    b->target = target;
+    b->jblock = jblock;
+    b->flags = flags;
+    b->revoked = false;
+    return 0;
+}
+
+static int add_revoke(journal_revoke_t **revokes, uint32_t *count, uint32_t *capacity, const journal_revoke_t *r) {
+    if (*count == *capacity) {
+        uint32_t grown = *capacity ? *capacity * 2 : 256;
+        journal_revoke_t *grown_revokes = (journal_revoke_t *)realloc(*revokes, grown * sizeof(journal_revoke_t));
+        if (!grown_revokes) {
+            return -1;
+        }
+        *revokes = grown_revokes;
+        *capacity = grown;
+    }
+    (*revokes)[(*count)++] = *r;
+    return 0;
+}
+
+static int compare_image(const void *a, const void *b) {
+    const journal_block_t *x = (const journal_block_t *)a;
+    const journal_block_t *y = (const journal_block_t *)b;
+
+    if (x->target != y->target) {
+        return x->target < y->target ? -1 : 1;
+    }
+    return x->jblock < y->jblock ? -1 : x->jblock > y->jblock;
+}
+
+static int compare_revoke(const void *a, const void *b) {
+    const journal_revoke_t *x = (const journal_revoke_t *)a;
+    const journal_revoke_t *y = (const journal_revoke_t *)b;
+
+    return x->target < y->target ? -1 : x->target > y->target;
+}
+
+// Applies the revoke records of committed transactions: an image is dropped when a record for its
+// target was written in the same or a later transaction
+static void apply_revokes(journal_t *j, journal_revoke_t *revokes, uint32_t count) {
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (j->txns[revokes[i].txn].committed) {
+            revokes[kept++] = revokes[i];
+        }
+    }
+    j->revokes = kept;
+    if (kept == 0) {
+        return;
+    }
+
+    // One record per target holding the latest sequence
+    qsort(revokes, kept, sizeof(journal_revoke_t), compare_revoke);
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < kept; i++) {
+        if (unique && revokes[unique - 1].target == revokes[i].target) {
+            if (tid_geq(revokes[i].sequence, revokes[unique - 1].sequence)) {
+                revokes[unique - 1].sequence = revokes[i].sequence;
+            }
+        } else {
+            revokes[unique++] = revokes[i];
+        }
+    }
+
+    for (uint32_t t = 0; t < j->txn_count; t++) {
+        const journal_txn_t *txn = &j->txns[t];
+        for (uint32_t i = txn->first; i < txn->first + txn->count; i++) {
+            journal_revoke_t key = { .target = j->blocks[i].target };
+            const journal_revoke_t *r = (const journal_revoke_t *)bsearch(&key, revokes, unique,
+                                                                          sizeof(journal_revoke_t), compare_revoke);
+            j->blocks[i].revoked = r && tid_geq(r->sequence, txn->sequence);
+        }
+    }
+}
+
+// Walks the log from s_start like the scan pass of jbd2 recovery, stopping at the first block that
+// is not the next expected metadata block. A clean journal is walked from s_first instead, taking the
+// sequence found there, so the transactions still in the log can be browsed.
+static int walk_log(fs_info_t *fs_info, journal_t *j, job_t *job) {
+    journal_stream_t s = { fs_info, j, NULL, 0, 0 };
+    journal_revoke_t *revokes = NULL;
+    uint32_t revoke_count = 0, revoke_capacity = 0, txn_capacity = 0, block_capacity = 0;
+    uint32_t bs = j->block_size;
+    uint32_t tail = j->incompat & (JOURNAL_INCOMPAT_CSUM_V2 | JOURNAL_INCOMPAT_CSUM_V3) ? JOURNAL_TAIL_SIZE : 0;
+    uint32_t record_size = j->incompat & JOURNAL_INCOMPAT_64BIT ? 8 : 4;
+    bool pending = j->start != 0;
+    uint32_t block = pending ? j->start : j->first;
+    uint32_t sequence = j->sequence;
+    uint32_t budget = j->last - j->first;
+    journal_txn_t *txn = NULL;
+    int rc = -1;
+
+    s.buffer = (unsigned char *)malloc((size_t)JOURNAL_WINDOW * bs);
+    if (!s.buffer) {
+        return -1;
+    }
+    job_set_total(job, budget);
+
+    if (!pending) {
+        const unsigned char *data = stream_block(&s, block);
+        if (data && be32(data) == JOURNAL_MAGIC) {
+            sequence = be32(data + 8);
+        }
+    }
+
+    j->end_reason = "log wrapped";
+    while (j->scanned < budget) {
+        if (job_is_cancelled(job)) {
+            goto out;
+        }
+
+        const unsigned char *data = stream_block(&s, block);
+        if (!data) {
+            j->end_reason = "unreadable log block";
+            break;
+        }
+        if (be32(data) != JOURNAL_MAGIC || be32(data + 8) != sequence) {
+            j->end_reason = "end of log";
+            break;
+        }
+        uint32_t type = be32(data + 4);
+        if (type != JOURNAL_DESCRIPTOR_BLOCK && type != JOURNAL_COMMIT_BLOCK && type != JOURNAL_REVOKE_BLOCK) {
+            j->end_reason = "unexpected block type";
+            break;
+        }
+
+        if (!txn) {
+            txn = add_txn(j, &txn_capacity, sequence, block, pending);
+            if (!txn) {
+                goto out;
+            }
+        }
+
+        uint32_t used = 1;
+        if (type == JOURNAL_DESCRIPTOR_BLOCK) {
+            uint32_t data_block = block;
+            uint32_t offset = JOURNAL_HEADER_SIZE;
+            while (offset + j->tag_size <= bs - tail && j->scanned + used < budget) {
+                const unsigned char *tag = data + offset;
+                uint64_t target = be32(tag);
+                uint32_t flags = j->incompat & JOURNAL_INCOMPAT_CSUM_V3 ? be32(tag + 4) : be16(tag + 6);
+                if (j->incompat & JOURNAL_INCOMPAT_64BIT) {
+                    target |= (uint64_t)be32(tag + 8) << 32;
+                }
+                data_block = next_block(j, data_block);
+                if (add_image(j, &block_capacity, target, data_block, flags) != 0) {
+                    goto out;
+                }
+                txn->count++;
+                used++;
+                offset += j->tag_size + (flags & JOURNAL_FLAG_SAME_UUID ? 0 : 16);
+                if (flags & JOURNAL_FLAG_LAST_TAG) {
+                    break;
+                }
+            }
+        } else if (type == JOURNAL_REVOKE_BLOCK) {
+            uint32_t end = be32(data + JOURNAL_HEADER_SIZE);
+            end = end > bs - tail ? bs - tail : end;
+            for (uint32_t offset = JOURNAL_HEADER_SIZE + 4; offset + record_size <= end; offset += record_size) {
+                journal_revoke_t r = { record_size == 8 ? be64(data + offset) : be32(data + offset), sequence,
+                                       j->txn_count - 1 };
+                if (add_revoke(&revokes, &revoke_count, &revoke_capacity, &r) != 0) {
+                    goto out;
+                }
+                txn->revokes++;
+            }
+        } else {
+            txn->committed = true;
+            txn->commit_sec = be64(data + 0x30);
+            txn->commit_nsec = be32(data + 0x38);
+        }
+
+        txn->length += used;
+        j->scanned += used;
+        job_advance(job, used);
+        for (uint32_t i = 0; i < used; i++) {
+            block = next_block(j, block);
+        }
+        if (type == JOURNAL_COMMIT_BLOCK) {
+            txn = NULL;
+            sequence++;
+        }
+    }
+
+    for (uint32_t t = 0; t < j->txn_count; t++) {
+        journal_txn_t *txn_sorted = &j->txns[t];
+        qsort(j->blocks + txn_sorted->first, txn_sorted->count, sizeof(journal_block_t), compare_image);
+    }
+    apply_revokes(j, revokes, revoke_count);
+    rc = 0;
+
+out:
+    free(revokes);
+    free(s.buffer);
+    return rc;
+}
+
+// Locates the internal journal, indexes every transaction still in the log and the block images
+// each one carries. Returns NULL without a readable internal journal or when cancelled.
+journal_t *journal_load(fs_info_t *fs_info, job_t *job) {
+    const struct ext2_super_block *sb = &fs_info->sb;
+    struct timespec start, end;
+
+    if (!(sb->s_feature_compat & EXT3_FEATURE_COMPAT_HAS_JOURNAL) || sb->s_journal_inum == 0) {
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    journal_t *j = (journal_t *)calloc(1, sizeof(journal_t));
+    if (!j) {
+        return NULL;
+    }
+    j->ino = sb->s_journal_inum;
+    j->needs_recovery = sb->s_feature_incompat & EXT3_FEATURE_INCOMPAT_RECOVER;
+
+    struct ext2_inode inode;
+    if (read_inode(fs_info, j->ino, &inode) != 0) {
+        journal_free(j);
+        return NULL;
+    }
+    uint64_t blocks = inode_file_size(&inode) / fs_info->block_size;
+    if (blocks == 0 || blocks > sb->s_blocks_count) {
+        journal_free(j);
+        return NULL;
+    }
+    j->map_count = (uint32_t)blocks;
+    j->map = (uint64_t *)calloc(j->map_count, sizeof(uint64_t));
+    journal_map_t m = { j->map, j->map_count };
+    if (!j->map || blockmap_walk(fs_info, &inode, map_run, &m) != 0 || read_superblock(fs_info, j) != 0 ||
+        walk_log(fs_info, j, job) != 0) {
+        journal_free(j);
+        return NULL;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    j->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return j;
+}
+
+void journal_free(journal_t *journal) {
+    if (!journal) {
+        return;
+    }
+
+    free(journal->map);
+    free(journal->txns);
+    free(journal->blocks);
+    free(journal);
+}
+
+// Reads a logged image as replay would write it, with an escaped magic number restored
+int journal_read_image(fs_info_t *fs_info, const journal_t *journal, const journal_block_t *image, unsigned char *buffer) {
+    if (image->jblock >= journal->map_count || journal->map[image->jblock] == 0) {
+        return -1;
+    }
+    if (read_bytes(fs_info, journal->map[image->jblock] * journal->block_size, buffer, journal->block_size) != 0) {
+        return -1;
+    }
+    if (image->flags & JOURNAL_FLAG_ESCAPE) {
+        buffer[0] = (unsigned char)(JOURNAL_MAGIC >> 24);
+        buffer[1] = (unsigned char)(JOURNAL_MAGIC >> 16);
+        buffer[2] = (unsigned char)(JOURNAL_MAGIC >> 8);
+        buffer[3] = (unsigned char)JOURNAL_MAGIC;
+    }
+    return 0;
+}
+
+// Image of target in transaction txn, the last one when the transaction logged it twice
+const journal_block_t *journal_find(const journal_t *journal, uint32_t txn, uint64_t target) {
+    if (txn >= journal->txn_count) {
+        return NULL;
+    }
+
+    const journal_txn_t *t = &journal->txns[txn];
+    uint32_t lo = t->first, hi = t->first + t->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (journal->blocks[mid].target <= target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo > t->first && journal->blocks[lo - 1].target == target ? &journal->blocks[lo - 1] : NULL;
+}
+
+static const char *block_kind(const fs_info_t *fs_info, uint64_t block) {
+    const struct ext2_super_block *sb = &fs_info->sb;
+
+    if (block >= sb->s_blocks_count) {
+        return "beyond end";
+    }
+    if (range_has_metadata(fs_info, block * fs_info->block_size, fs_info->block_size)) {
+        return "superblock";
+    }
+    if (block < sb->s_first_data_block) {
+        return "boot";
+    }
+
+    uint32_t group = (uint32_t)((block - sb->s_first_data_block) / fs_info->blocks_per_group);
+    const struct ext2_group_desc *gd = &fs_info->group_desc[group];
+    if (block == gd->bg_block_bitmap) {
+        return "block bitmap";
+    }
+    if (block == gd->bg_inode_bitmap) {
+        return "inode bitmap";
+    }
+    if (block >= gd->bg_inode_table && block < (uint64_t)gd->bg_inode_table + inode_table_blocks(fs_info)) {
+        return "inode table";
+    }
+    return "other";
+}
+
+static int compare_replay(const void *a, const void *b) {
+    const journal_replay_t *x = (const journal_replay_t *)a;
+    const journal_replay_t *y = (const journal_replay_t *)b;
+
+    if (x->target != y->target) {
+        return x->target < y->target ? -1 : 1;
+    }
+    return x->image < y->image ? -1 : x->image > y->image;
+}
+
+// Dry-run of recovery: the image replay would leave in each target block and how many of its bytes
+// differ from the device now. Nothing is written.
+journal_plan_t *journal_plan(fs_info_t *fs_info, const journal_t *journal, job_t *job) {
+    journal_plan_t *plan = (journal_plan_t *)calloc(1, sizeof(journal_plan_t));
+    uint32_t bs = journal->block_size;
+    unsigned char *image = (unsigned char *)malloc(bs);
+    unsigned char *current = (unsigned char *)malloc(bs);
+    if (!plan || !image || !current) {
+        goto fail;
+    }
+
+    // Transactions replay oldest first, so the last image of a target in the log wins
+    for (uint32_t t = 0; t < journal->txn_count; t++) {
+        const journal_txn_t *txn = &journal->txns[t];
+        if (!txn->pending || !txn->committed) {
+            continue;
+        }
+        for (uint32_t i = txn->first; i < txn->first + txn->count; i++) {
+            plan->images++;
+            plan->revoked += journal->blocks[i].revoked;
+        }
+    }
+    uint64_t live = plan->images - plan->revoked;
+    if (live) {
+        plan->entries = (journal_replay_t *)malloc(live * sizeof(journal_replay_t));
+        if (!plan->entries) {
+            goto fail;
+        }
+    }
+    for (uint32_t t = 0; t < journal->txn_count; t++) {
+        const journal_txn_t *txn = &journal->txns[t];
+        if (!txn->pending || !txn->committed) {
+            continue;
+        }
+        for (uint32_t i = txn->first; i < txn->first + txn->count; i++) {
+            const journal_block_t *b = &journal->blocks[i];
+            if (!b->revoked) {
+                plan->entries[plan->count++] = (journal_replay_t){ b->target, b->jblock, i, txn->sequence, 0, NULL };
+            }
+        }
+    }
+
+    // Image indices follow log order, so the last entry of each target is the one replayed
+    journal_replay_t *e = plan->entries;
+    qsort(e, plan->count, sizeof(journal_replay_t), compare_replay);
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < plan->count; i++) {
+        if (kept && e[kept - 1].target == e[i].target) {
+            e[kept - 1] = e[i];
+        } else {
+            e[kept++] = e[i];
+        }
+    }
+    plan->count = kept;
+
+    // Progress continues from the walk of the log
+    job_set_total(job, journal->scanned + plan->count);
+    for (uint32_t i = 0; i < plan->count; i++) {
+        if (job_is_cancelled(job)) {
+            goto fail;
+        }
+        journal_replay_t *r = &e[i];
+        r->kind = block_kind(fs_info, r->target);
+        job_advance(job, 1);
+        if (r->target >= fs_info->sb.s_blocks_count) {
+            plan->out_of_range++;
+            continue;
+        }
+        if (journal_read_image(fs_info, journal, &journal->blocks[r->image], image) != 0 ||
+            read_bytes(fs_info, r->target * bs, current, bs) != 0) {
+            plan->unreadable++;
+            continue;
+        }
+        for (uint32_t b = 0; b < bs; b++) {
+            r->changed += image[b] != current[b];
+        }
+        if (r->changed) {
+            plan->changed++;
+            plan->changed_bytes += r->changed;
+            plan->sb_changed |= range_has_metadata(fs_info, r->target * bs, bs);
+        }
+    }
+
+    free(image);
+    free(current);
+    return plan;
+
+fail:
+    free(image);
+    free(current);
+    journal_plan_free(plan);
+    return NULL;
+}
+
+void journal_plan_free(journal_plan_t *plan) {
+    if (!plan) {
+        return;
+    }
+
+    free(plan->entries);
+    free(plan);
+}
+
+static const char *txn_state(const journal_txn_t *txn) {
+    if (!txn->committed) {
+        return "uncommitted";
+    }
+    return txn->pending ? "pending" : "checkpointed";
+}
+
+static void format_commit_time(const journal_txn_t *txn, char *buffer, size_t buffer_size) {
+    time_t t = (time_t)txn->commit_sec;
+    struct tm tm;
+
+    if (!txn->commit_sec || !localtime_r(&t, &tm) || strftime(buffer, buffer_size, "%Y-%m-%d %H:%M:%S", &tm) == 0) {
+        snprintf(buffer, buffer_size, "-");
+    }
+}
+
+void journal_print(const journal_t *journal, FILE *out) {
+    static const struct {
+        uint32_t flag;
+        const char *name;
+    } features[] = {
+        { JOURNAL_INCOMPAT_REVOKE, "revoke" },
+        { JOURNAL_INCOMPAT_64BIT, "64bit" },
+        { JOURNAL_INCOMPAT_ASYNC_COMMIT, "async_commit" },
+        { JOURNAL_INCOMPAT_CSUM_V2, "csum_v2" },
+        { JOURNAL_INCOMPAT_CSUM_V3, "csum_v3" },
+        { JOURNAL_INCOMPAT_FAST_COMMIT, "fast_commit" },
+    };
+    uint32_t pending = 0;
+
+    fprintf(out, "Journal inode %u: %u blocks of %u bytes, log blocks %u-%u, superblock v%u\n", journal->ino,
+            journal->maxlen, journal->block_size, journal->first, journal->last - 1, journal->version);
+    fprintf(out, "Features:");
+    for (size_t i = 0; i < sizeof(features) / sizeof(features[0]); i++) {
+        if (journal->incompat & features[i].flag) {
+            fprintf(out, " %s", features[i].name);
+        }
+    }
+    fprintf(out, "%s\n", journal->incompat ? "" : " none");
+    if (journal->start) {
+        fprintf(out, "Pending transactions from block %u, sequence %u%s\n", journal->start, journal->sequence,
+                journal->needs_recovery ? "" : " (recover flag not set, mounted?)");
+    } else {
+        fprintf(out, "Clean, next sequence %u%s\n", journal->sequence,
+                journal->needs_recovery ? " (but the recover flag is set)" : "");
+    }
+    if (journal->error) {
+        fprintf(out, "Journal error %d recorded\n", journal->error);
+    }
+    for (uint32_t t = 0; t < journal->txn_count; t++) {
+        pending += journal->txns[t].pending && journal->txns[t].committed;
+    }
+    fprintf(out, "%u transaction(s), %u pending, %u image(s), %lu revoke record(s); walked %u block(s) in %.2f s, "
+            "stopped at %s\n", journal->txn_count, pending, journal->block_count, (unsigned long)journal->revokes,
+            journal->scanned, journal->seconds, journal->end_reason);
+    if (journal->txn_count == 0) {
+        return;
+    }
+
+    fprintf(out, "\n%10s %8s %7s %7s %8s  %-13s %s\n", "Sequence", "Start", "Blocks", "Images", "Revokes", "State",
+            "Committed");
+    for (uint32_t t = 0; t < journal->txn_count; t++) {
+        const journal_txn_t *txn = &journal->txns[t];
+        char when[32];
+        format_commit_time(txn, when, sizeof(when));
+        fprintf(out, "%10u %8u %7u %7u %8u  %-13s %s\n", txn->sequence, txn->start, txn->length, txn->count,
+                txn->revokes, txn_state(txn), when);
+    }
+}
+
+void journal_print_plan(const journal_plan_t *plan, FILE *out) {
+    fprintf(out, "Dry-run replay: %lu image(s) in pending transactions, %lu revoked, %u block(s) written, "
+            "%lu would change (%lu bytes)\n", (unsigned long)plan->images, (unsigned long)plan->revoked, plan->count,
+            (unsigned long)plan->changed, (unsigned long)plan->changed_bytes);
+    if (plan->out_of_range) {
+        fprintf(out, "Targets beyond the filesystem, skipped: %lu\n", (unsigned long)plan->out_of_range);
+    }
+    if (plan->unreadable) {
+        fprintf(out, "Unreadable images or targets: %lu\n", (unsigned long)plan->unreadable);
+    }
+    if (plan->sb_changed) {
+        fprintf(out, "The superblock or group descriptors would change\n");
+    }
+    if (plan->count == 0) {
+        return;
+    }
+
+    fprintf(out, "\n%12s %10s %8s %8s  %s\n", "Block", "Sequence", "Journal", "Changed", "Holds");
+    for (uint32_t i = 0; i < plan->count; i++) {
+        const journal_replay_t *r = &plan->entries[i];
+        fprintf(out, "%12lu %10u %8u %8u  %s\n", (unsigned long)r->target, r->sequence, r->jblock, r->changed, r->kind);
+    }
+}
+
+void journal_scan_free(journal_scan_t *scan) {
+    if (!scan) {
+        return;
+    }
+
+    journal_plan_free(scan->plan);
+    journal_free(scan->journal);
+    free(scan);
+}
+
+// Job body: indexes the journal, works out the dry-run replay and publishes both as a
+// journal_scan_t in the job_slot_t passed as arg
+int journal_job(job_t *job, void *arg) {
+    job_slot_t *slot = (job_slot_t *)arg;
+    fs_info_t *fs_info = (fs_info_t *)slot->source;
+
+    journal_t *result = journal_load(fs_info, job);
+    journal_plan_t *plan = result ? journal_plan(fs_info, result, job) : NULL;
+    journal_scan_t *scan = plan ? (journal_scan_t *)malloc(sizeof(journal_scan_t)) : NULL;
+    if (scan) {
+        scan->journal = result;
+        scan->plan = plan;
+    } else {
+        journal_plan_free(plan);
+        journal_free(result);
+        result = NULL;
+    }
+
+    if (scan) {
+        job_printf(job, "%u transaction(s), %u image(s), replay would change %lu block(s), %.2f s", result->txn_count,
+                   result->block_count, (unsigned long)plan->changed, result->seconds);
+    } else {
+        job_printf(job, "%s", job_is_cancelled(job) ? "Journal scan cancelled" : "No readable internal journal");
+    }
+    // The slot owns the result from here on and a later job may free it, so this is the last use
+    job_slot_finish(slot, job, scan);
+    return scan || job_is_cancelled(job) ? 0 : -1;
+}
@@ -0,0 +1,128 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <ext2fs/ext2_fs.h>
+#include "analyzer.h"
+#include "job.h"
+
+#define JOURNAL_MAGIC 0xC03B3998U       // h_magic of every jbd2 metadata block
+#define JOURNAL_DESCRIPTOR_BLOCK 1
+#define JOURNAL_COMMIT_BLOCK 2
+#define JOURNAL_SUPERBLOCK_V1 3
+#define JOURNAL_SUPERBLOCK_V2 4
+#define JOURNAL_REVOKE_BLOCK 5
+
+#define JOURNAL_INCOMPAT_REVOKE 0x01
+#define JOURNAL_INCOMPAT_64BIT 0x02
+#define JOURNAL_INCOMPAT_ASYNC_COMMIT 0x04
+#define JOURNAL_INCOMPAT_CSUM_V2 0x08
+#define JOURNAL_INCOMPAT_CSUM_V3 0x10
+#define JOURNAL_INCOMPAT_FAST_COMMIT 0x20
+
+#define JOURNAL_FLAG_ESCAPE 0x1         // First four bytes of the image were the magic, zeroed in the log
+#define JOURNAL_FLAG_SAME_UUID 0x2      // No UUID follows the tag
+#define JOURNAL_FLAG_DELETED 0x4
+#define JOURNAL_FLAG_LAST_TAG 0x8
+
+#define JOURNAL_WINDOW 64               // Blocks read at once while streaming the log
+
+// One block image logged by a transaction
+typedef struct {
+    uint64_t target;            // Filesystem block the image is written to on replay
+    uint32_t jblock;            // Journal logical block holding the image
+    uint32_t flags;             // JOURNAL_FLAG_* of the tag
+    bool revoked;               // A revoke record in this or a later transaction drops it
+} journal_block_t;
+
+typedef struct {
+    uint32_t sequence;          // Transaction ID
+    uint32_t start;             // Journal logical block of the first descriptor
+    uint32_t length;            // Log blocks from start to the commit block, inclusive
+    bool committed;             // Ends in a commit block
+    bool pending;               // Past s_start, replayed by the next mount
+    uint64_t commit_sec;        // Commit time, 0 without one
+    uint32_t commit_nsec;
+    uint32_t first;             // Index of the first image in the block index
+    uint32_t count;             // Images, sorted by target
+    uint32_t revokes;           // Revoke records carried
+} journal_txn_t;
+
+typedef struct {
+    uint32_t ino;               // Journal inode
+    uint32_t block_size;
+    uint32_t maxlen;            // Journal length in blocks
+    uint32_t first;             // First log block
+    uint32_t last;              // Log wraps back to first here, below the fast commit area
+    uint32_t start;             // First block of the oldest live transaction, 0 when clean
+    uint32_t sequence;          // First transaction ID expected at start
+    int32_t error;              // s_errno recorded by the kernel
+    uint32_t version;           // 1 or 2
+    uint32_t compat, incompat, ro_compat;
+    uint32_t tag_size;          // Bytes per descriptor tag
+    bool needs_recovery;        // Filesystem has the recover flag set
+    uint64_t *map;              // Journal logical block to device block, 0 for holes
+    uint32_t map_count;
+    journal_txn_t *txns;        // Oldest first
+    uint32_t txn_count;
+    journal_block_t *blocks;    // Images of all transactions, grouped by transaction
+    uint32_t block_count;
+    uint64_t revokes;           // Revoke records in committed transactions
+    uint32_t scanned;           // Log blocks walked
+    const char *end_reason;     // Why the walk stopped
+    double seconds;             // Wall time of the scan
+} journal_t;
+
+// One filesystem block a replay would write
+typedef struct {
+    uint64_t target;
+    uint32_t jblock;            // Journal block of the image that wins
+    uint32_t image;             // Its index in the journal's block index
+    uint32_t sequence;          // Transaction that logged it
+    uint32_t changed;           // Bytes differing from the device, 0 when the image is already there
+    const char *kind;           // Metadata the block holds
+} journal_replay_t;
+
+typedef struct {
+    journal_replay_t *entries;  // Sorted by target
+    uint32_t count;
+    uint64_t images;            // Images in pending committed transactions
+    uint64_t revoked;           // Of those, dropped by revoke records
+    uint64_t changed;           // Targets whose contents would change
+    uint64_t changed_bytes;
+    uint64_t out_of_range;      // Targets beyond the filesystem, never written
+    uint64_t unreadable;        // Images or targets that could not be read
+    bool sb_changed;            // Superblock or group descriptors would change
+} journal_plan_t;
+
+// What journal_job publishes: the index and its dry-run replay
+typedef struct {
+    journal_t *journal;         // Transactions and images
+    journal_plan_t *plan;       // Replay plan of journal
+} journal_scan_t;
+
+journal_t *journal_load(fs_info_t *fs_info, job_t *job);
+
+void journal_free(journal_t *journal);
+
+int journal_read_image(fs_info_t *fs_info, const journal_t *journal, const journal_block_t *image, unsigned char *buffer);
+
+const journal_block_t *journal_find(const journal_t *journal, uint32_t txn, uint64_t target);
+
+journal_plan_t *journal_plan(fs_info_t *fs_info, const journal_t *journal, job_t *job);
+
+void journal_plan_free(journal_plan_t *plan);
+
+void journal_print(const journal_t *journal, FILE *out);
+
+void journal_print_plan(const journal_plan_t *plan, FILE *out);
+
+void journal_scan_free(journal_scan_t *scan);
+
+int journal_job(job_t *job, void *arg);
+
+#endif /* JOURNAL_H */
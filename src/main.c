@@ -1,32 +1,213 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <ncurses.h>
 #include <ext2fs/ext2_fs.h>
 #include "analyzer.h"
+#include "carve.h"
+#include "content.h"
+#include "du.h"
 #include "editor.h"
+#include "estimate.h"
+#include "export.h"
+#include "frag.h"
+#include "csum.h"
+#include "fsck.h"
+#include "journal.h"
+#include "freespace.h"
+#include "query.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "txn.h"
+#include "undelete.h"
 #include "ui.h"
 #include "utils.h"
 #define _POSIX_C_SOURCE 200809L
 
 void print_usage(const char *program_name) {
-    printf("Usage: %s <device>\n", program_name);
+    printf("Usage: %s [options] <device>\n", program_name);
+    printf("\n");
+    printf("Options:\n");
+    printf("  -o FILE   Send all writes to the copy-on-write overlay FILE, the device stays untouched\n");
+    printf("  -c        Write the overlay given with -o to the device and exit\n");
+    printf("  -L        Replay the changes of an interrupted save to the device (or the -o overlay) and exit\n");
+    printf("  -e FILE   Export all allocated inodes to FILE (- for stdout) and exit\n");
+    printf("  -F FORMAT Export format: csv (default) or ndjson\n");
+    printf("  -q EXPR   Print the inodes matching EXPR and exit, or restrict -e to them\n");
+    printf("            e.g. \"size > 1G && uid == 0 && mtime < 2024-01-01 && type == reg\"\n");
+    printf("  -a        Estimate file counts, sizes and free space fragmentation by sampling, print JSON and exit\n");
+    printf("  -f SIZE   Print the free extent histogram and where SIZE blocks (or bytes with K/M/G/T) fit, and exit\n");
+    printf("  -d N      Print the fragmentation distribution and the N most fragmented files, and exit\n");
+    printf("  -m INO    Print the data block runs of inode INO and exit\n");
+    printf("  -C        Check block ownership, bitmaps and link counts read-only, print problems as found and exit\n");
+    printf("  -l        Compare link counts with the directory entries only, like -C\n");
+    printf("  -j        List the journal transactions still in the log and exit\n");
+    printf("  -R        Print which blocks a journal replay would write and change, without writing, and exit\n");
+    printf("  -D N      Rank the N most recoverable deleted inodes by how many of their blocks are still free, and exit\n");
+    printf("  -r DIR    Extract every fully or partly recoverable deleted inode into DIR and exit\n");
+    printf("  -S        Search unallocated blocks for file signatures (JPEG, PDF, SQLite, gzip...), print hits as found and exit\n");
+    printf("  -Z        Count zero and incompressible data blocks per group and file, and exit\n");
+    printf("  -k        Verify all metadata checksums, print mismatches and exit (status 1 if any)\n");
+    printf("  -u N      Print the N largest directories and files (du -b style) and exit\n");
+    printf("  -s        Print size, age, type, owner and per-group statistics as JSON and exit\n");
     printf("\n");
     printf("Examples:\n");
     printf("  %s /dev/sda1           # Open interactive UI for /dev/sda1\n", program_name);
+    printf("  %s -o fix.ovl big.img  # Try edits on big.img without modifying it\n", program_name);
+    printf("  %s -o fix.ovl -c big.img # Apply those edits to big.img\n", program_name);
+    printf("  %s -e - -F ndjson /dev/sda1 > inodes.json # Dump the inode table\n", program_name);
+    printf("  %s -q 'type == dir && links > 100' /dev/sda1 # Find busy directories\n", program_name);
+}
+
+// Prints each hit of -S the moment the scan reaches it
+static void print_carve_hit(const carve_hit_t *hit, void *arg) {
+    char line[128];
+
+    carve_format_hit(hit, line, sizeof(line));
+    fprintf((FILE *)arg, "%s\n", line);
+}
+
+// Prints each problem of -C the moment the check reaches it
+static void print_fsck_problem(const fsck_problem_t *problem, void *arg) {
+    char line[160];
+
+    fsck_format_problem(problem, line, sizeof(line));
+    fprintf((FILE *)arg, "%s\n", line);
+    fflush((FILE *)arg);
 }
 
 int main(int argc, char *argv[]) {
     char *device_path = NULL;
+    const char *overlay_path = NULL;
+    const char *export_path = NULL;
+    const char *query_text = NULL;
+    export_format_t export_format = EXPORT_CSV;
+    bool commit_overlay = false;
+    bool replay_log = false;
+    bool print_stats = false;
+    bool print_estimate = false;
+    int usage_top = 0;
+    const char *fit_size = NULL;
+    int frag_top = 0;
+    uint32_t map_inode = 0;
+    bool verify_csums = false;
+    uint32_t fsck_checks = 0;
+    bool print_journal = false;
+    bool print_replay = false;
+    int deleted_top = 0;
+    const char *recover_dir = NULL;
+    bool carve = false;
+    bool classify = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:cLe:F:q:asu:f:d:m:kCljRD:r:SZh")) != -1) {
+        switch (opt) {
+            case 'o':
+                overlay_path = optarg;
+                break;
+            case 'c':
+                commit_overlay = true;
+                break;
+            case 'L':
+                replay_log = true;
+                break;
+            case 'e':
+                export_path = optarg;
+                break;
+            case 'q':
+                query_text = optarg;
+                break;
+            case 'a':
+                print_estimate = true;
+                break;
+            case 's':
+                print_stats = true;
+                break;
+            case 'u':
+                usage_top = atoi(optarg);
+                if (usage_top <= 0) {
+                    fprintf(stderr, "Error: -u needs a positive count\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'f':
+                fit_size = optarg;
+                break;
+            case 'd':
+                frag_top = atoi(optarg);
+                if (frag_top <= 0) {
+                    fprintf(stderr, "Error: -d needs a positive count\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'm':
+                map_inode = (uint32_t)strtoul(optarg, NULL, 10);
+                if (map_inode == 0) {
+                    fprintf(stderr, "Error: -m needs an inode number\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'k':
+                verify_csums = true;
+                break;
+            case 'C':
+                fsck_checks = FSCK_CHECK_ALL;
+                break;
+            case 'l':
+                fsck_checks = FSCK_CHECK_LINKS;
+                break;
+            case 'j':
+                print_journal = true;
+                break;
+            case 'R':
+                print_replay = true;
+                break;
+            case 'D':
+                deleted_top = atoi(optarg);
+                if (deleted_top <= 0) {
+                    fprintf(stderr, "Error: -D needs a positive count\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r':
+                recover_dir = optarg;
+                break;
+            case 'S':
+                carve = true;
+                break;
+            case 'Z':
+                classify = true;
+                break;
+            case 'F':
+                if (export_parse_format(optarg, &export_format) != 0) {
+                    fprintf(stderr, "Error: Unknown export format %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
 
-    if (argc != 2) {
+    if (optind != argc - 1) {
         fprintf(stderr, "Error: Device path not specified\n");
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
+    if (commit_overlay && !overlay_path) {
+        fprintf(stderr, "Error: -c needs an overlay given with -o\n");
+        return EXIT_FAILURE;
+    }
 
-    device_path = argv[1];
+    device_path = argv[optind];
 
     fs_info_t *fs_info = analyzer_init(device_path);
     if (!fs_info) {
@@ -34,6 +215,297 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
+    if (overlay_path && analyzer_attach_overlay(fs_info, overlay_path) != 0) {
+        fprintf(stderr, "Error: Failed to open overlay %s\n", overlay_path);
+        analyzer_cleanup(fs_info);
+        return EXIT_FAILURE;
+    }
+
+    char log_dir[PATH_MAX];
+    if (txn_log_dir(log_dir, sizeof(log_dir)) != 0) {
+        snprintf(log_dir, sizeof(log_dir), "%s", TXN_LOG_DIR);
+    }
+
+    // Finishing an interrupted save writes to the device, so only -L or the UI prompt does it
+    if (replay_log) {
+        int recovered = txn_recover(fs_info);
+        if (recovered < 0) {
+            fprintf(stderr, "Error: Failed to replay pending changes from %s\n", log_dir);
+        } else {
+            printf("Replayed %d pending change(s) from an interrupted save\n", recovered);
+        }
+        analyzer_cleanup(fs_info);
+        return recovered < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    int pending = txn_pending(fs_info);
+    if (pending > 0) {
+        fprintf(stderr, "Warning: An interrupted save left %d change(s) in %s, run with -L to replay them\n",
+                pending, log_dir);
+    }
+
+    if (commit_overlay) {
+        uint32_t blocks = overlay_block_count(fs_info->overlay);
+        int rc = overlay_commit(fs_info->overlay, device_path);
+        if (rc == 0) {
+            printf("Wrote %u block(s) from %s to %s\n", blocks, overlay_path, device_path);
+        } else {
+            fprintf(stderr, "Error: Failed to commit overlay %s\n", overlay_path);
+        }
+        analyzer_cleanup(fs_info);
+        return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (print_estimate) {
+        fs_estimate_t est;
+        int rc = estimate_run(fs_info, ESTIMATE_PRECISION, 0, 0, NULL, NULL, &est) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (rc != EXIT_SUCCESS) {
+            fprintf(stderr, "Error: Failed to sample the filesystem\n");
+        } else {
+            estimate_write_json(&est, stdout);
+        }
+        analyzer_cleanup(fs_info);
+        return rc;
+    }
+
+    if (usage_top > 0) {
+        du_result_t *result = du_collect(fs_info, (uint32_t)usage_top, 0, NULL);
+        int rc = result ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (!result) {
+            fprintf(stderr, "Error: Failed to account space per directory\n");
+        } else {
+            du_print(result, stdout);
+            du_free(result);
+        }
+        analyzer_cleanup(fs_info);
+        return rc;
+    }
+
+    if (fit_size) {
+        uint32_t fit_blocks;
+        if (freespace_parse_size(fit_size, fs_info->block_size, &fit_blocks) != 0) {
+            fprintf(stderr, "Error: Invalid size %s\n", fit_size);
+            analyzer_cleanup(fs_info);
+            return EXIT_FAILURE;
+        }
+        freespace_t *fs = freespace_scan(fs_info, 0, NULL);
+        int rc = fs ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (!fs) {
+            fprintf(stderr, "Error: Failed to scan free space\n");
+        } else {
+            freespace_print(fs, fs_info->block_size, fit_blocks, stdout);
+            freespace_free(fs);
+        }
+        analyzer_cleanup(fs_info);
+        return rc;
+    }
+
+    if (frag_top > 0) {
+        frag_result_t *result = frag_scan(fs_info, (uint32_t)frag_top, 0, NULL);
+        int rc = result ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (!result) {
+            fprintf(stderr, "Error: Failed to scan file fragmentation\n");
+        } else {
+            frag_print(result, stdout);
+            frag_free(result);
+        }
+        analyzer_cleanup(fs_info);
+        return rc;
+    }
+
+    if (map_inode) {
+        int rc = frag_print_map(fs_info, map_inode, stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (rc != EXIT_SUCCESS) {
+            fprintf(stderr, "Error: Failed to read the block map of inode %u\n", map_inode);
+        }
+        analyzer_cleanup(fs_info);
+        return rc;
+    }
+
+    if (fsck_checks) {
+        fsck_result_t *result = fsck_check(fs_info, fsck_checks, 0, NULL, print_fsck_problem, stdout);
+        int rc = EXIT_FAILURE;
+        if (!result) {
+            fprintf(stderr, "Error: Consistency check failed\n");
+        } else {
+            fsck_print_summary(result, stdout);
+            if (fsck_problem_total(result) == 0 && result->unreadable == 0) {
+                rc = EXIT_SUCCESS;
+            }
+            fsck_free(result);
+        }
+        analyzer_cleanup(fs_info);
+        return rc;
+    }
+
+    if (print_journal || print_replay) {
+        journal_t *journal = journal_load(fs_info, NULL);
+        journal_plan_t *plan = journal && print_replay ? journal_plan(fs_info, journal, NULL) : NULL;
+        int rc = journal && (plan || !print_replay) ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (!journal) {
+            fprintf(stderr, "Error: No readable internal journal\n");
+        } else if (rc != EXIT_SUCCESS) {
+            fprintf(stderr, "Error: Failed to read the journal images\n");
+        } else {
+            if (print_journal) {
+                journal_print(journal, stdout);
+            }
+            if (plan) {
+                if (print_journal) {
+                    printf("\n");
+                }
+                journal_print_plan(plan, stdout);
+            }
+        }
+        journal_plan_free(plan);
+        journal_free(journal);
+        analyzer_cleanup(fs_info);
+        return rc;
+    }
+
+    if (deleted_top > 0 || recover_dir) {
+        undelete_result_t *result = undelete_scan(fs_info, recover_dir ? UNDELETE_EXTRACT_MAX : (uint32_t)deleted_top, 0, NULL);
+        int rc = result ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (!result) {
+            fprintf(stderr, "Error: Failed to scan for deleted inodes\n");
+        } else {
+            undelete_print(result, fs_info->block_size, stdout);
+            undelete_stats_t stats = { 0, 0, 0, 0, 0 };
+            if (recover_dir && undelete_extract_all(fs_info, result, recover_dir, NULL, &stats) != 0) {
+                fprintf(stderr, "Error: Extraction to %s failed after %lu file(s): %s\n", recover_dir,
+                        (unsigned long)stats.files, strerror(errno));
+                rc = EXIT_FAILURE;
+            } else if (recover_dir) {
+                printf("Extracted %lu file(s), %lu bytes in %lu read(s) to %s, %lu reallocated block(s) left as holes\n",
+                       (unsigned long)stats.files, (unsigned long)stats.bytes, (unsigned long)stats.reads, recover_dir,
+                       (unsigned long)stats.skipped);
+                if (stats.failed) {
+                    fprintf(stderr, "Warning: %lu file(s) could not be recovered\n", (unsigned long)stats.failed);
+                }
+            }
+            undelete_free(result);
+        }
+        analyzer_cleanup(fs_info);
+        return rc;
+    }
+
+    if (carve) {
+        carve_result_t *result = carve_scan(fs_info, 0, NULL, print_carve_hit, stdout);
+        int rc = result ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (!result) {
+            fprintf(stderr, "Error: Failed to carve free space\n");
+        } else {
+            if (result->hit_count) {
+                printf("\n");
+            }
+            carve_print_summary(result, fs_info->block_size, stdout);
+            carve_free(result);
+        }
+        analyzer_cleanup(fs_info);
+        return rc;
+    }
+
+    if (classify) {
+        content_result_t *result = content_scan(fs_info, CONTENT_DEFAULT_TOP, 0, NULL);
+        int rc = result ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (!result) {
+            fprintf(stderr, "Error: Failed to classify data blocks\n");
+        } else {
+            content_print(result, fs_info->block_size, stdout);
+            content_free(result);
+        }
+        analyzer_cleanup(fs_info);
+        return rc;
+    }
+
+    if (verify_csums) {
+        csum_report_t *report = csum_audit(fs_info, 0, NULL);
+        int rc = EXIT_FAILURE;
+        if (!report) {
+            fprintf(stderr, "Error: Failed to verify checksums\n");
+        } else {
+            csum_print(report, stdout);
+            if (report->error_count == 0 && report->unreadable == 0) {
+                rc = EXIT_SUCCESS;
+            }
+            csum_free(report);
+        }
+        analyzer_cleanup(fs_info);
+        return rc;
+    }
+
+    if (print_stats) {
+        fs_stats_t *stats = stats_collect(fs_info, 0, NULL);
+        int rc = stats ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (!stats) {
+            fprintf(stderr, "Error: Failed to collect statistics\n");
+        } else {
+            stats_write_json(stats, stdout);
+            stats_free(stats);
+        }
+        analyzer_cleanup(fs_info);
+        return rc;
+    }
+
+    unsigned char *matches = NULL;
+    if (query_text) {
+        query_t query;
+        char error[128];
+        uint64_t count = 0;
+        uint32_t bits = fs_info->sb.s_inodes_count;
+
+        if (query_compile(query_text, &query, error, sizeof(error)) != 0) {
+            fprintf(stderr, "Error: Bad query: %s\n", error);
+            analyzer_cleanup(fs_info);
+            return EXIT_FAILURE;
+        }
+
+        snapshot_t *snap = snapshot_load(fs_info, 0, NULL);
+        matches = (unsigned char *)malloc((bits + 7) / 8);
+        if (!snap || !matches || query_run(&query, snap, matches, bits, &count) != 0) {
+            fprintf(stderr, "Error: Failed to evaluate the query\n");
+            snapshot_free(snap);
+            free(matches);
+            analyzer_cleanup(fs_info);
+            return EXIT_FAILURE;
+        }
+        snapshot_free(snap);
+
+        if (!export_path) {
+            for (uint32_t bit = find_next_bit(matches, 0, bits, true); bit < bits;
+                 bit = find_next_bit(matches, bit + 1, bits, true)) {
+                printf("%u\n", bit + 1);
+            }
+            fprintf(stderr, "%lu inode(s) match\n", (unsigned long)count);
+            free(matches);
+            analyzer_cleanup(fs_info);
+            return EXIT_SUCCESS;
+        }
+    }
+
+    if (export_path) {
+        bool to_stdout = strcmp(export_path, "-") == 0;
+        int fd = to_stdout ? STDOUT_FILENO : open(export_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        uint64_t exported = 0;
+        int rc = -1;
+
+        if (fd < 0) {
+            perror("Failed to create export file");
+        } else {
+            rc = export_inodes(fs_info, fd, export_format, matches, 0, NULL, &exported);
+            if (!to_stdout && close(fd) != 0) {
+                rc = -1;
+            }
+        }
+        if (rc == 0) {
+            fprintf(stderr, "Exported %lu inode(s)\n", (unsigned long)exported);
+        } else {
+            fprintf(stderr, "Error: Export failed\n");
+        }
+        free(matches);
+        analyzer_cleanup(fs_info);
+        return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     // Initialize ncurses
     initscr();
     start_color();
@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "overlay.h"
+
+typedef struct {
+    char magic[8];              // OVERLAY_MAGIC
+    uint32_t version;           // OVERLAY_VERSION
+    uint32_t block_size;        // Block size the records are made of
+} overlay_header_t;
+
+typedef struct {
+    uint64_t block;             // Device block number
+    uint32_t record;            // Record index in the delta file
+} overlay_entry_t;
+
+static uint64_t overlay_record_offset(const overlay_t *ov, uint32_t record) {
+    return sizeof(overlay_header_t) + (uint64_t)record * (sizeof(uint64_t) + ov->block_size);
+}
+
+static int overlay_pread(int fd, void *buffer, size_t length, uint64_t offset) {
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t got = pread(fd, (uint8_t *)buffer + done, length - done, (off_t)(offset + done));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return -1;
+        }
+        done += got;
+    }
+    return 0;
+}
+
+static int overlay_pwrite(int fd, const void *buffer, size_t length, uint64_t offset) {
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t put = pwrite(fd, (const uint8_t *)buffer + done, length - done, (off_t)(offset + done));
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+        if (put <= 0) {
+            return -1;
+        }
+        done += put;
+    }
+    return 0;
+}
+
+static uint32_t overlay_hash(const overlay_t *ov, uint64_t key) {
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (ov->capacity - 1);
+}
+
+// Record index holding block, or -1 when the block reads from the base device
+static int64_t overlay_find(const overlay_t *ov, uint64_t block) {
+    if (ov->count == 0) {
+        return -1;
+    }
+
+    uint64_t key = block + 1;
+    for (uint32_t i = overlay_hash(ov, key); ov->keys[i] != 0; i = (i + 1) & (ov->capacity - 1)) {
+        if (ov->keys[i] == key) {
+            return ov->records[i];
+        }
+    }
+    return -1;
+}
+
+static void overlay_insert(overlay_t *ov, uint64_t block, uint32_t record) {
+    uint64_t key = block + 1;
+    uint32_t i = overlay_hash(ov, key);
+
+    while (ov->keys[i] != 0 && ov->keys[i] != key) {
+        i = (i + 1) & (ov->capacity - 1);
+    }
+    if (ov->keys[i] == 0) {
+        ov->count++;
+    }
+    ov->keys[i] = key;
+    ov->records[i] = record;
+}
+
+// Keeps the table at most half full
+static int overlay_reserve(overlay_t *ov, uint32_t needed) {
+    if (needed * 2 <= ov->capacity) {
+        return 0;
+    }
+
+    uint32_t capacity = ov->capacity ? ov->capacity : 1024;
+    while (needed * 2 > capacity) {
+        capacity *= 2;
+    }
+
+    uint64_t *keys = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+    uint32_t *records = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+    if (!keys || !records) {
+        free(keys);
+        free(records);
+        return -1;
+    }
+
+    uint64_t *old_keys = ov->keys;
+    uint32_t *old_records = ov->records;
+    uint32_t old_capacity = ov->capacity;
+
+    ov->keys = keys;
+    ov->records = records;
+    ov->capacity = capacity;
+    ov->count = 0;
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old_keys[i] != 0) {
+            overlay_insert(ov, old_keys[i] - 1, old_records[i]);
+        }
+    }
+
+    free(old_keys);
+    free(old_records);
+    return 0;
+}
+
+// Rebuilds the index with one sequential pass over the records. A record cut short
+// by a crash is dropped.
+static int overlay_load(overlay_t *ov, uint64_t file_size) {
+    uint64_t record_size = sizeof(uint64_t) + ov->block_size;
+    uint64_t records = (file_size - sizeof(overlay_header_t)) / record_size;
+
+    if (records > UINT32_MAX / 2) {
+        return -1;
+    }
+    if (overlay_reserve(ov, (uint32_t)records) != 0) {
+        return -1;
+    }
+
+    uint8_t *chunk = (uint8_t *)malloc(record_size * OVERLAY_COMMIT_RUN);
+    if (!chunk) {
+        return -1;
+    }
+
+    for (uint64_t first = 0; first < records; first += OVERLAY_COMMIT_RUN) {
+        uint64_t n = records - first < OVERLAY_COMMIT_RUN ? records - first : OVERLAY_COMMIT_RUN;
+        if (overlay_pread(ov->fd, chunk, n * record_size, overlay_record_offset(ov, (uint32_t)first)) != 0) {
+            free(chunk);
+            return -1;
+        }
+        for (uint64_t i = 0; i < n; i++) {
+            uint64_t block;
+            memcpy(&block, chunk + i * record_size, sizeof(block));
+            overlay_insert(ov, block, (uint32_t)(first + i));
+        }
+    }
+    free(chunk);
+
+    if (ov->count != records) {
+        fprintf(stderr, "Overlay %s holds duplicate blocks\n", ov->path);
+        return -1;
+    }
+
+    if (file_size != overlay_record_offset(ov, (uint32_t)records) &&
+        ftruncate(ov->fd, (off_t)overlay_record_offset(ov, (uint32_t)records)) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+overlay_t *overlay_open(const char *path, uint32_t block_size) {
+    if (!path || block_size == 0) {
+        return NULL;
+    }
+
+    overlay_t *ov = (overlay_t *)calloc(1, sizeof(overlay_t));
+    if (!ov) {
+        return NULL;
+    }
+
+    pthread_rwlock_init(&ov->lock, NULL);
+    ov->block_size = block_size;
+    ov->path = strdup(path);
+    ov->scratch = (uint8_t *)malloc(block_size);
+    ov->fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (!ov->path || !ov->scratch || ov->fd < 0) {
+        perror("Failed to open overlay");
+        overlay_close(ov);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(ov->fd, &st) != 0) {
+        perror("Failed to stat overlay");
+        overlay_close(ov);
+        return NULL;
+    }
+
+    overlay_header_t header;
+    if (st.st_size == 0) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, OVERLAY_MAGIC, sizeof(header.magic));
+        header.version = OVERLAY_VERSION;
+        header.block_size = block_size;
+        if (overlay_pwrite(ov->fd, &header, sizeof(header), 0) != 0 || overlay_reserve(ov, 1) != 0) {
+            perror("Failed to initialize overlay");
+            overlay_close(ov);
+            return NULL;
+        }
+        return ov;
+    }
+
+    if ((uint64_t)st.st_size < sizeof(header) ||
+        overlay_pread(ov->fd, &header, sizeof(header), 0) != 0 ||
+        memcmp(header.magic, OVERLAY_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != OVERLAY_VERSION) {
+        fprintf(stderr, "%s is not an overlay file\n", path);
+        overlay_close(ov);
+        return NULL;
+    }
+    if (header.block_size != block_size) {
+        fprintf(stderr, "Overlay %s was made for %u byte blocks, filesystem uses %u\n",
+                path, header.block_size, block_size);
+        overlay_close(ov);
+        return NULL;
+    }
+
+    if (overlay_load(ov, (uint64_t)st.st_size) != 0) {
+        fprintf(stderr, "Failed to load overlay %s\n", path);
+        overlay_close(ov);
+        return NULL;
+    }
+    return ov;
+}
+
+void overlay_close(overlay_t *ov) {
+    if (!ov) {
+        return;
+    }
+
+    if (ov->fd >= 0) {
+        fsync(ov->fd);
+        close(ov->fd);
+    }
+    pthread_rwlock_destroy(&ov->lock);
+    free(ov->keys);
+    free(ov->records);
+    free(ov->scratch);
+    free(ov->path);
+    free(ov);
+}
+
+// Reads [offset, offset + length) block by block from the delta, and runs of
+// blocks the delta does not hold with one read from the base device.
+int overlay_read(overlay_t *ov, int base_fd, uint64_t offset, void *buffer, size_t length) {
+    uint8_t *out = (uint8_t *)buffer;
+    uint64_t end = offset + length;
+    uint64_t pos = offset;
+    int rc = 0;
+
+    pthread_rwlock_rdlock(&ov->lock);
+
+    if (ov->count == 0) {
+        rc = overlay_pread(base_fd, out, length, offset);
+        pthread_rwlock_unlock(&ov->lock);
+        return rc;
+    }
+
+    while (rc == 0 && pos < end) {
+        uint64_t block = pos / ov->block_size;
+        uint64_t next = (block + 1) * ov->block_size < end ? (block + 1) * ov->block_size : end;
+        int64_t record = overlay_find(ov, block);
+
+        if (record >= 0) {
+            rc = overlay_pread(ov->fd, out + (pos - offset), next - pos,
+                               overlay_record_offset(ov, (uint32_t)record) + sizeof(uint64_t) + pos % ov->block_size);
+        } else {
+            while (next < end && overlay_find(ov, next / ov->block_size) < 0) {
+                next = next + ov->block_size < end ? next + ov->block_size : end;
+            }
+            rc = overlay_pread(base_fd, out + (pos - offset), next - pos, pos);
+        }
+        pos = next;
+    }
+
+    pthread_rwlock_unlock(&ov->lock);
+    return rc;
+}
+
+// Writes into the delta. A block written for the first time is copied from the
+// base device first so that partial writes keep the rest of the block.
+int overlay_write(overlay_t *ov, int base_fd, uint64_t offset, const void *buffer, size_t length) {
+    const uint8_t *in = (const uint8_t *)buffer;
+    uint64_t end = offset + length;
+    uint64_t pos = offset;
+    int rc = 0;
+
+    pthread_rwlock_wrlock(&ov->lock);
+
+    while (rc == 0 && pos < end) {
+        uint64_t block = pos / ov->block_size;
+        uint64_t next = (block + 1) * ov->block_size < end ? (block + 1) * ov->block_size : end;
+        uint32_t in_block = (uint32_t)(pos % ov->block_size);
+        int64_t record = overlay_find(ov, block);
+
+        if (record >= 0) {
+            rc = overlay_pwrite(ov->fd, in + (pos - offset), next - pos,
+                                overlay_record_offset(ov, (uint32_t)record) + sizeof(uint64_t) + in_block);
+        } else {
+            if (next - pos < ov->block_size &&
+                overlay_pread(base_fd, ov->scratch, ov->block_size, block * ov->block_size) != 0) {
+                rc = -1;
+                break;
+            }
+            memcpy(ov->scratch + in_block, in + (pos - offset), next - pos);
+
+            if (overlay_reserve(ov, ov->count + 1) != 0) {
+                rc = -1;
+                break;
+            }
+
+            // Records are appended, so the next record index is the block count
+            uint32_t index = ov->count;
+            uint64_t record_offset = overlay_record_offset(ov, index);
+            rc = overlay_pwrite(ov->fd, &block, sizeof(block), record_offset);
+            if (rc == 0) {
+                rc = overlay_pwrite(ov->fd, ov->scratch, ov->block_size, record_offset + sizeof(uint64_t));
+            }
+            if (rc == 0) {
+                overlay_insert(ov, block, index);
+            }
+        }
+        pos = next;
+    }
+
+    pthread_rwlock_unlock(&ov->lock);
+    return rc;
+}
+
+int overlay_sync(overlay_t *ov) {
+    return fsync(ov->fd);
+}
+
+// Empties the overlay; the caller holds the write lock
+static int overlay_truncate(overlay_t *ov) {
+    memset(ov->keys, 0, (size_t)ov->capacity * sizeof(uint64_t));
+    ov->count = 0;
+    int rc = ftruncate(ov->fd, (off_t)sizeof(overlay_header_t));
+    if (rc == 0) {
+        rc = fsync(ov->fd);
+    }
+    return rc;
+}
+
+static int overlay_compare_entry(const void *a, const void *b) {
+    const overlay_entry_t *ea = (const overlay_entry_t *)a;
+    const overlay_entry_t *eb = (const overlay_entry_t *)b;
+
+    return ea->block < eb->block ? -1 : ea->block > eb->block;
+}
+
+// Writes every overlay block to the device in ascending block order, merging
+// consecutive blocks into single writes, then empties the overlay.
+int overlay_commit(overlay_t *ov, const char *device_path) {
+    if (!ov || !device_path) {
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&ov->lock);
+
+    overlay_entry_t *entries = (overlay_entry_t *)malloc((ov->count ? ov->count : 1) * sizeof(overlay_entry_t));
+    uint8_t *run = (uint8_t *)malloc((size_t)ov->block_size * OVERLAY_COMMIT_RUN);
+    int device_fd = open(device_path, O_RDWR);
+    uint32_t n = 0;
+    int rc = 0;
+
+    if (!entries || !run || device_fd < 0) {
+        perror("Failed to prepare overlay commit");
+        rc = -1;
+    }
+
+    for (uint32_t i = 0; rc == 0 && i < ov->capacity; i++) {
+        if (ov->keys[i] != 0) {
+            entries[n].block = ov->keys[i] - 1;
+            entries[n].record = ov->records[i];
+            n++;
+        }
+    }
+    if (rc == 0) {
+        qsort(entries, n, sizeof(overlay_entry_t), overlay_compare_entry);
+    }
+
+    for (uint32_t i = 0; rc == 0 && i < n;) {
+        uint32_t length = 1;
+        while (i + length < n && length < OVERLAY_COMMIT_RUN &&
+               entries[i + length].block == entries[i].block + length) {
+            length++;
+        }
+
+        for (uint32_t k = 0; rc == 0 && k < length; k++) {
+            rc = overlay_pread(ov->fd, run + (size_t)k * ov->block_size, ov->block_size,
+                               overlay_record_offset(ov, entries[i + k].record) + sizeof(uint64_t));
+        }
+        if (rc == 0) {
+            rc = overlay_pwrite(device_fd, run, (size_t)length * ov->block_size, entries[i].block * ov->block_size);
+        }
+        i += length;
+    }
+
+    if (rc == 0 && fsync(device_fd) != 0) {
+        rc = -1;
+    }
+    if (device_fd >= 0) {
+        close(device_fd);
+    }
+    free(entries);
+    free(run);
+
+    // The device holds everything now; keep the overlay if anything went wrong. Emptying it
+    // under the same lock keeps a write that arrives meanwhile from being dropped uncommitted.
+    if (rc == 0) {
+        rc = overlay_truncate(ov);
+    }
+
+    pthread_rwlock_unlock(&ov->lock);
+    return rc;
+}
+
+int overlay_discard(overlay_t *ov) {
+    if (!ov) {
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&ov->lock);
+    int rc = overlay_truncate(ov);
+    pthread_rwlock_unlock(&ov->lock);
+    return rc;
+}
+
+uint32_t overlay_block_count(overlay_t *ov) {
+    if (!ov) {
+        return 0;
+    }
+
+    pthread_rwlock_rdlock(&ov->lock);
+    uint32_t count = ov->count;
+    pthread_rwlock_unlock(&ov->lock);
+    return count;
+}
@@ -0,0 +1,45 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define OVERLAY_MAGIC "FSAOVRLY"
+#define OVERLAY_VERSION 1
+#define OVERLAY_COMMIT_RUN 256      // Blocks written to the device per commit write
+
+// Copy-on-write delta over a read-only base device. Every block that was written
+// lives in the delta file as {block number, block data}; reads take the overlay
+// copy where there is one and the base device everywhere else.
+typedef struct {
+    int fd;                     // Delta file
+    char *path;                 // Path of the delta file
+    uint32_t block_size;        // Block size of the filesystem the delta belongs to
+    uint64_t *keys;             // Hash table of block number + 1, 0 marks an empty slot
+    uint32_t *records;          // Record index in the delta file for each key
+    uint32_t capacity;          // Hash table size, a power of two
+    uint32_t count;             // Number of blocks held in the delta
+    uint8_t *scratch;           // One block for read-modify-write of partial blocks
+    pthread_rwlock_t lock;      // Readers are scans and prefetchers, writers are saves
+} overlay_t;
+
+overlay_t *overlay_open(const char *path, uint32_t block_size);
+
+void overlay_close(overlay_t *ov);
+
+int overlay_read(overlay_t *ov, int base_fd, uint64_t offset, void *buffer, size_t length);
+
+int overlay_write(overlay_t *ov, int base_fd, uint64_t offset, const void *buffer, size_t length);
+
+int overlay_sync(overlay_t *ov);
+
+int overlay_commit(overlay_t *ov, const char *device_path);
+
+int overlay_discard(overlay_t *ov);
+
+uint32_t overlay_block_count(overlay_t *ov);
+
+#endif /* OVERLAY_H */
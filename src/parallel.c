@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "parallel.h"
+
+typedef struct {
+    const parallel_t *p;        // Work description
+    atomic_uint next_item;      // Next item to hand out
+    atomic_bool stop;           // Set on error or cancellation
+    bool failed;                // A callback returned an error
+    pthread_mutex_t lock;       // Serialises emit and protects next_emit and failed
+    pthread_cond_t turn;        // Signalled whenever next_emit moves or stop is set
+    uint32_t next_emit;         // Item whose emit runs next
+} parallel_run_t;
+
+typedef struct {
+    parallel_run_t *run;        // Shared run state
+    void *state;                // Per-worker state block
+    pthread_t thread;           // Worker thread, unused for worker 0
+    bool started;               // Thread was created
+} parallel_worker_t;
+
+uint32_t parallel_default_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cpus < 1) {
+        return 1;
+    }
+    return cpus > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : (uint32_t)cpus;
+}
+
+static void parallel_fail(parallel_run_t *run) {
+    pthread_mutex_lock(&run->lock);
+    run->failed = true;
+    atomic_store(&run->stop, true);
+    pthread_cond_broadcast(&run->turn);
+    pthread_mutex_unlock(&run->lock);
+}
+
+static void *parallel_worker(void *data) {
+    parallel_worker_t *worker = (parallel_worker_t *)data;
+    parallel_run_t *run = worker->run;
+    const parallel_t *p = run->p;
+
+    while (!atomic_load(&run->stop)) {
+        if (p->job && job_is_cancelled(p->job)) {
+            pthread_mutex_lock(&run->lock);
+            atomic_store(&run->stop, true);
+            pthread_cond_broadcast(&run->turn);
+            pthread_mutex_unlock(&run->lock);
+            break;
+        }
+
+        uint32_t item = atomic_fetch_add(&run->next_item, 1);
+        if (item >= p->items) {
+            break;
+        }
+
+        if (p->work(item, worker->state, p->arg) != 0) {
+            parallel_fail(run);
+            break;
+        }
+
+        if (p->emit) {
+            // Items finish in any order but are handed to emit strictly in sequence
+            pthread_mutex_lock(&run->lock);
+            while (run->next_emit != item && !atomic_load(&run->stop)) {
+                pthread_cond_wait(&run->turn, &run->lock);
+            }
+            if (atomic_load(&run->stop)) {
+                pthread_mutex_unlock(&run->lock);
+                break;
+            }
+            int rc = p->emit(item, worker->state, p->arg);
+            if (rc != 0) {
+                run->failed = true;
+                atomic_store(&run->stop, true);
+            }
+            run->next_emit++;
+            pthread_cond_broadcast(&run->turn);
+            pthread_mutex_unlock(&run->lock);
+            if (rc != 0) {
+                break;
+            }
+        }
+
+        if (p->job) {
+            job_advance(p->job, 1);
+        }
+    }
+
+    return NULL;
+}
+
+// Returns 0 when every item was processed or the job was cancelled, -1 if a callback failed
+int parallel_run(const parallel_t *p) {
+    if (!p || !p->work) {
+        return -1;
+    }
+
+    uint32_t threads = p->threads ? p->threads : parallel_default_threads();
+    if (threads > PARALLEL_MAX_THREADS) {
+        threads = PARALLEL_MAX_THREADS;
+    }
+    if (threads > p->items) {
+        threads = p->items ? p->items : 1;
+    }
+
+    parallel_run_t run;
+    memset(&run, 0, sizeof(run));
+    run.p = p;
+    atomic_init(&run.next_item, 0);
+    atomic_init(&run.stop, false);
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.turn, NULL);
+
+    parallel_worker_t workers[PARALLEL_MAX_THREADS];
+    // Cache-line sized slots keep workers from sharing lines
+    size_t state_size = (p->worker_size + 63) & ~(size_t)63;
+    if (state_size == 0) {
+        state_size = 64;
+    }
+    uint8_t *states = (uint8_t *)calloc(threads, state_size);
+    uint32_t ready = 0;
+
+    if (!states) {
+        run.failed = true;
+    }
+
+    for (uint32_t i = 0; i < threads && states; i++) {
+        workers[i].run = &run;
+        workers[i].state = states + (size_t)i * state_size;
+        workers[i].started = false;
+        if (p->init && p->init(workers[i].state, p->arg) != 0) {
+            run.failed = true;
+            break;
+        }
+        ready++;
+    }
+
+    if (!run.failed) {
+        if (p->job) {
+            job_set_total(p->job, p->items);
+        }
+
+        // Worker 0 runs on the calling thread, the pool shrinks if threads cannot be created
+        for (uint32_t i = 1; i < ready; i++) {
+            workers[i].started = pthread_create(&workers[i].thread, NULL, parallel_worker, &workers[i]) == 0;
+        }
+        parallel_worker(&workers[0]);
+        for (uint32_t i = 1; i < ready; i++) {
+            if (workers[i].started) {
+                pthread_join(workers[i].thread, NULL);
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < ready; i++) {
+        if (p->finish && p->finish(workers[i].state, p->arg) != 0) {
+            run.failed = true;
+        }
+    }
+
+    free(states);
+    pthread_cond_destroy(&run.turn);
+    pthread_mutex_destroy(&run.lock);
+
+    return run.failed ? -1 : 0;
+}
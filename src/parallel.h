@@ -0,0 +1,30 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "job.h"
+
+#define PARALLEL_MAX_THREADS 64
+
+// Runs a body once per block group on a pool of worker threads.
+// Every worker owns a zeroed state block of worker_size bytes that the callbacks receive.
+typedef struct {
+    uint32_t items;             // Number of work items, usually groups_count
+    uint32_t threads;           // Worker threads, 0 = one per online CPU
+    size_t worker_size;         // Bytes of per-worker state
+    void *arg;                  // Shared argument passed to every callback
+    job_t *job;                 // Progress and cancellation, may be NULL
+    int (*init)(void *worker, void *arg);               // Prepares a worker, optional
+    int (*work)(uint32_t item, void *worker, void *arg); // Processes one item in any order
+    int (*emit)(uint32_t item, void *worker, void *arg); // Called in item order after work, optional
+    int (*finish)(void *worker, void *arg);             // Merges and releases a worker, serially, optional
+} parallel_t;
+
+uint32_t parallel_default_threads(void);
+
+int parallel_run(const parallel_t *p);
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ext2fs/ext2_fs.h>
+#include "prefetch.h"
+
+#define PREFETCH_INVALID UINT64_MAX
+
+uint64_t prefetch_map_block(const fs_info_t *fs_info, uint64_t block_num) {
+    return block_num < fs_info->sb.s_blocks_count ? block_num : PREFETCH_INVALID;
+}
+
+uint64_t prefetch_map_inode(const fs_info_t *fs_info, uint64_t inode_num) {
+    if (inode_num == 0 || inode_num > fs_info->sb.s_inodes_count) {
+        return PREFETCH_INVALID;
+    }
+    return inode_offset(fs_info, (uint32_t)inode_num) / fs_info->block_size;
+}
+
+static bool prefetch_is_current(prefetcher_t *pf, uint32_t generation) {
+    pthread_mutex_lock(&pf->lock);
+    bool current = !pf->stop && pf->generation == generation;
+    pthread_mutex_unlock(&pf->lock);
+    return current;
+}
+
+static void *prefetch_thread_main(void *opaque) {
+    prefetcher_t *pf = (prefetcher_t *)opaque;
+
+    pthread_mutex_lock(&pf->lock);
+    while (!pf->stop) {
+        if (pf->request_count == 0) {
+            pthread_cond_wait(&pf->wake, &pf->lock);
+            continue;
+        }
+
+        uint32_t generation = pf->generation;
+        uint64_t position = pf->request_position;
+        int64_t stride = pf->stride;
+        uint32_t count = pf->request_count;
+        pf->request_count = 0;
+        pthread_mutex_unlock(&pf->lock);
+
+        uint64_t previous = PREFETCH_INVALID;
+        for (uint32_t k = 1; k <= count && prefetch_is_current(pf, generation); k++) {
+            int64_t next = (int64_t)position + stride * (int64_t)k;
+            if (next < 0) {
+                break;
+            }
+
+            uint64_t block = pf->map(pf->fs_info, (uint64_t)next);
+            if (block == PREFETCH_INVALID) {
+                break;
+            }
+            // Consecutive inodes usually share an inode table block
+            if (block == previous) {
+                continue;
+            }
+            previous = block;
+
+            uint64_t *slot = &pf->recent[block % PREFETCH_RECENT_SLOTS];
+            if (*slot == block + 1) {
+                continue;
+            }
+
+            // The read only has to pull the block into the page cache; the data is discarded
+            if (read_bytes(pf->fs_info, block * pf->fs_info->block_size, pf->scratch, pf->fs_info->block_size) == 0) {
+                *slot = block + 1;
+            }
+        }
+
+        pthread_mutex_lock(&pf->lock);
+    }
+    pthread_mutex_unlock(&pf->lock);
+
+    return NULL;
+}
+
+prefetcher_t *prefetch_init(fs_info_t *fs_info, prefetch_map_t map, uint32_t depth) {
+    if (!fs_info || !map) {
+        return NULL;
+    }
+
+    prefetcher_t *pf = (prefetcher_t *)calloc(1, sizeof(prefetcher_t));
+    if (!pf) {
+        return NULL;
+    }
+
+    pf->scratch = (uint8_t *)malloc(fs_info->block_size);
+    if (!pf->scratch) {
+        free(pf);
+        return NULL;
+    }
+
+    pf->fs_info = fs_info;
+    pf->map = map;
+    pf->depth = depth ? depth : PREFETCH_DEFAULT_DEPTH;
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->wake, NULL);
+
+    if (pthread_create(&pf->thread, NULL, prefetch_thread_main, pf) != 0) {
+        pthread_cond_destroy(&pf->wake);
+        pthread_mutex_destroy(&pf->lock);
+        free(pf->scratch);
+        free(pf);
+        return NULL;
+    }
+
+    return pf;
+}
+
+void prefetch_cleanup(prefetcher_t *pf) {
+    if (!pf) {
+        return;
+    }
+
+    pthread_mutex_lock(&pf->lock);
+    pf->stop = true;
+    pthread_cond_signal(&pf->wake);
+    pthread_mutex_unlock(&pf->lock);
+
+    pthread_join(pf->thread, NULL);
+    pthread_cond_destroy(&pf->wake);
+    pthread_mutex_destroy(&pf->lock);
+    free(pf->scratch);
+    free(pf);
+}
+
+// Records a navigation step. A step that repeats the previous stride is trusted
+// and warms the full depth ahead; a new stride warms half of it.
+void prefetch_hint(prefetcher_t *pf, uint64_t position) {
+    if (!pf) {
+        return;
+    }
+
+    pthread_mutex_lock(&pf->lock);
+
+    if (pf->have_last && position != pf->last_position) {
+        int64_t delta = (int64_t)(position - pf->last_position);
+
+        if (delta >= -PREFETCH_MAX_STRIDE && delta <= PREFETCH_MAX_STRIDE) {
+            if (delta == pf->stride) {
+                pf->confidence++;
+            } else {
+                pf->stride = delta;
+                pf->confidence = 1;
+            }
+
+            uint32_t count = pf->confidence >= 2 ? pf->depth : pf->depth / 2;
+            pf->request_position = position;
+            pf->request_count = count ? count : 1;
+            pf->generation++;
+            pthread_cond_signal(&pf->wake);
+        } else {
+            // A long jump (e.g. Go to) says nothing about where we go next
+            pf->stride = 0;
+            pf->confidence = 0;
+        }
+    }
+
+    pf->last_position = position;
+    pf->have_last = true;
+
+    pthread_mutex_unlock(&pf->lock);
+}
@@ -0,0 +1,47 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "analyzer.h"
+
+#define PREFETCH_DEFAULT_DEPTH 8
+#define PREFETCH_MAX_STRIDE 4096
+#define PREFETCH_RECENT_SLOTS 256
+
+// Maps a navigation position (block or inode number) to the block that backs it
+typedef uint64_t (*prefetch_map_t)(const fs_info_t *fs_info, uint64_t position);
+
+typedef struct {
+    fs_info_t *fs_info;         // Filesystem to read from
+    prefetch_map_t map;         // Position -> block mapping
+    uint32_t depth;             // Number of positions to warm ahead
+    pthread_t thread;           // Worker that issues the reads
+    pthread_mutex_t lock;       // Protects the fields below
+    pthread_cond_t wake;        // Signalled when a new request arrives
+    bool stop;                  // Asks the worker to exit
+    bool have_last;             // Whether last_position is valid
+    uint64_t last_position;     // Previous navigation position
+    int64_t stride;             // Last observed step between positions
+    uint32_t confidence;        // How many times in a row the stride repeated
+    uint64_t request_position;  // Position the current request starts after
+    uint32_t request_count;     // Positions to warm for the current request
+    uint32_t generation;        // Bumped per request so stale work is abandoned
+    uint64_t recent[PREFETCH_RECENT_SLOTS]; // Recently warmed blocks (+1, 0 = empty)
+    uint8_t *scratch;           // Destination of warming reads
+} prefetcher_t;
+
+prefetcher_t *prefetch_init(fs_info_t *fs_info, prefetch_map_t map, uint32_t depth);
+
+void prefetch_cleanup(prefetcher_t *pf);
+
+void prefetch_hint(prefetcher_t *pf, uint64_t position);
+
+uint64_t prefetch_map_block(const fs_info_t *fs_info, uint64_t block_num);
+
+uint64_t prefetch_map_inode(const fs_info_t *fs_info, uint64_t inode_num);
+
+#endif /* PREFETCH_H */
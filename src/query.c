@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "query.h"
+
+#define QUERY_TYPE_MASK 0170000
+
+typedef enum {
+    QUERY_VALUE_NUMBER,         // Plain integer, 0x and leading 0 select hex and octal
+    QUERY_VALUE_SIZE,           // Integer with an optional K/M/G/T/P suffix
+    QUERY_VALUE_TIME,           // Epoch seconds or YYYY-MM-DD[THH:MM[:SS]] in UTC, _ also separates
+    QUERY_VALUE_TYPE            // reg, dir, lnk, chr, blk, fifo or sock
+} query_value_t;
+
+typedef struct {
+    const char *name;           // Name used in expressions
+    snapshot_col_t col;         // Column it reads
+    uint64_t mask;              // Bits compared, 0 = all
+    query_value_t kind;         // How the right-hand side is parsed
+} query_field_t;
+
+static const query_field_t query_fields[] = {
+    { "ino",    SNAP_INO,    0,               QUERY_VALUE_NUMBER },
+    { "inode",  SNAP_INO,    0,               QUERY_VALUE_NUMBER },
+    { "type",   SNAP_MODE,   QUERY_TYPE_MASK, QUERY_VALUE_TYPE },
+    { "mode",   SNAP_MODE,   0,               QUERY_VALUE_NUMBER },
+    { "perm",   SNAP_MODE,   07777,           QUERY_VALUE_NUMBER },
+    { "uid",    SNAP_UID,    0,               QUERY_VALUE_NUMBER },
+    { "gid",    SNAP_GID,    0,               QUERY_VALUE_NUMBER },
+    { "size",   SNAP_SIZE,   0,               QUERY_VALUE_SIZE },
+    { "blocks", SNAP_BLOCKS, 0,               QUERY_VALUE_NUMBER },
+    { "links",  SNAP_LINKS,  0,               QUERY_VALUE_NUMBER },
+    { "flags",  SNAP_FLAGS,  0,               QUERY_VALUE_NUMBER },
+    { "atime",  SNAP_ATIME,  0,               QUERY_VALUE_TIME },
+    { "ctime",  SNAP_CTIME,  0,               QUERY_VALUE_TIME },
+    { "mtime",  SNAP_MTIME,  0,               QUERY_VALUE_TIME },
+    { "dtime",  SNAP_DTIME,  0,               QUERY_VALUE_TIME },
+};
+
+static const struct {
+    const char *name;
+    uint64_t bits;
+} query_types[] = {
+    { "reg", 0100000 }, { "dir", 0040000 }, { "lnk", 0120000 }, { "chr", 0020000 },
+    { "blk", 0060000 }, { "fifo", 0010000 }, { "sock", 0140000 },
+};
+
+typedef struct {
+    const char *p;              // Next unread character
+    query_t *query;             // Program being built
+    char *error;                // Error message buffer
+    size_t error_size;          // Size of error
+    uint32_t depth;             // Stack depth after the code emitted so far
+} query_parser_t;
+
+static int parse_or(query_parser_t *ps);
+
+static int query_fail(query_parser_t *ps, const char *fmt, const char *what) {
+    if (ps->error && ps->error_size) {
+        snprintf(ps->error, ps->error_size, fmt, what);
+    }
+    return -1;
+}
+
+static void skip_space(query_parser_t *ps) {
+    while (isspace((unsigned char)*ps->p)) {
+        ps->p++;
+    }
+}
+
+static int emit(query_parser_t *ps, query_code_t code) {
+    query_t *q = ps->query;
+
+    if (q->code_len >= QUERY_MAX_CODE) {
+        return query_fail(ps, "%s", "expression too long");
+    }
+    q->code[q->code_len++] = (uint8_t)code;
+
+    if (code == QUERY_CODE_PRED) {
+        ps->depth++;
+    } else if (code != QUERY_CODE_NOT) {
+        ps->depth--;
+    }
+    if (ps->depth > q->depth) {
+        q->depth = ps->depth;
+    }
+    return 0;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+static bool parse_time(const char *text, uint64_t *value) {
+    int year, month, day, hour = 0, minute = 0, second = 0, used = 0;
+
+    if (sscanf(text, "%4d-%2d-%2d%n", &year, &month, &day, &used) != 3) {
+        return false;
+    }
+    if (text[used] == 'T' || text[used] == '_') {
+        int more = 0;
+        if (sscanf(text + used + 1, "%2d:%2d%n:%2d%n", &hour, &minute, &more, &second, &more) < 2) {
+            return false;
+        }
+        used += 1 + more;
+    }
+    if (text[used] || year < 1970 || month < 1 || month > 12 || day < 1 || day > 31 ||
+        hour > 23 || minute > 59 || second > 60) {
+        return false;
+    }
+
+    *value = (uint64_t)(days_from_civil(year, (unsigned)month, (unsigned)day) * 86400 +
+                        hour * 3600 + minute * 60 + second);
+    return true;
+}
+
+static bool parse_value(const query_field_t *field, const char *text, uint64_t *value) {
+    if (field->kind == QUERY_VALUE_TYPE) {
+        for (size_t i = 0; i < sizeof(query_types) / sizeof(query_types[0]); i++) {
+            if (strcmp(text, query_types[i].name) == 0) {
+                *value = query_types[i].bits;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (field->kind == QUERY_VALUE_TIME && strchr(text, '-')) {
+        return parse_time(text, value);
+    }
+
+    char *end;
+    errno = 0;
+    *value = strtoull(text, &end, field->kind == QUERY_VALUE_NUMBER ? 0 : 10);
+    if (end == text || errno == ERANGE) {
+        return false;
+    }
+
+    if (field->kind == QUERY_VALUE_SIZE && *end) {
+        const char *units = "KMGTP";
+        const char *unit = strchr(units, toupper((unsigned char)*end));
+        if (!unit) {
+            return false;
+        }
+        int shift = 10 * (int)(unit - units + 1);
+        // A size that does not fit 64 bits would wrap into a small one
+        if (*value > (UINT64_MAX >> shift)) {
+            return false;
+        }
+        *value <<= shift;
+        end++;
+        if (*end == 'i' || *end == 'I') end++;
+        if (*end == 'b' || *end == 'B') end++;
+    }
+    return *end == '\0';
+}
+
+static int parse_predicate(query_parser_t *ps) {
+    char name[16], text[32];
+    size_t n = 0;
+
+    while (isalpha((unsigned char)*ps->p) || *ps->p == '_') {
+        if (n + 1 >= sizeof(name)) {
+            return query_fail(ps, "%s", "field name too long");
+        }
+        name[n++] = (char)tolower((unsigned char)*ps->p++);
+    }
+    name[n] = '\0';
+    if (n == 0) {
+        return query_fail(ps, "unexpected '%.10s'", *ps->p ? ps->p : "end");
+    }
+
+    const query_field_t *field = NULL;
+    for (size_t i = 0; i < sizeof(query_fields) / sizeof(query_fields[0]); i++) {
+        if (strcmp(name, query_fields[i].name) == 0) {
+            field = &query_fields[i];
+        }
+    }
+    if (!field) {
+        return query_fail(ps, "unknown field '%s'", name);
+    }
+
+    skip_space(ps);
+    query_op_t op;
+    if (strncmp(ps->p, "==", 2) == 0)      { op = QUERY_EQ; ps->p += 2; }
+    else if (strncmp(ps->p, "!=", 2) == 0) { op = QUERY_NE; ps->p += 2; }
+    else if (strncmp(ps->p, "<=", 2) == 0) { op = QUERY_LE; ps->p += 2; }
+    else if (strncmp(ps->p, ">=", 2) == 0) { op = QUERY_GE; ps->p += 2; }
+    else if (*ps->p == '<')                { op = QUERY_LT; ps->p++; }
+    else if (*ps->p == '>')                { op = QUERY_GT; ps->p++; }
+    else if (*ps->p == '=')                { op = QUERY_EQ; ps->p++; }
+    else {
+        return query_fail(ps, "expected a comparison after '%s'", name);
+    }
+    if (field->kind == QUERY_VALUE_TYPE && op != QUERY_EQ && op != QUERY_NE) {
+        return query_fail(ps, "%s", "type only supports == and !=");
+    }
+
+    skip_space(ps);
+    n = 0;
+    while (*ps->p && !isspace((unsigned char)*ps->p) && !strchr("&|()", *ps->p)) {
+        if (n + 1 >= sizeof(text)) {
+            return query_fail(ps, "%s", "value too long");
+        }
+        text[n++] = *ps->p++;
+    }
+    text[n] = '\0';
+
+    query_t *q = ps->query;
+    if (q->pred_count >= QUERY_MAX_PREDICATES) {
+        return query_fail(ps, "%s", "too many comparisons");
+    }
+    query_pred_t *pred = &q->preds[q->pred_count];
+    if (!parse_value(field, text, &pred->value)) {
+        return query_fail(ps, "bad value '%s'", text);
+    }
+    pred->col = field->col;
+    pred->mask = field->mask;
+    pred->op = op;
+    q->pred_count++;
+
+    return emit(ps, QUERY_CODE_PRED);
+}
+
+static int parse_unary(query_parser_t *ps) {
+    skip_space(ps);
+
+    if (*ps->p == '!' && ps->p[1] != '=') {
+        ps->p++;
+        if (parse_unary(ps) != 0) {
+            return -1;
+        }
+        return emit(ps, QUERY_CODE_NOT);
+    }
+
+    if (*ps->p == '(') {
+        ps->p++;
+        if (parse_or(ps) != 0) {
+            return -1;
+        }
+        skip_space(ps);
+        if (*ps->p != ')') {
+            return query_fail(ps, "%s", "missing ')'");
+        }
+        ps->p++;
+        return 0;
+    }
+
+    return parse_predicate(ps);
+}
+
+static int parse_and(query_parser_t *ps) {
+    if (parse_unary(ps) != 0) {
+        return -1;
+    }
+    for (;;) {
+        skip_space(ps);
+        if (strncmp(ps->p, "&&", 2) != 0) {
+            return 0;
+        }
+        ps->p += 2;
+        if (parse_unary(ps) != 0 || emit(ps, QUERY_CODE_AND) != 0) {
+            return -1;
+        }
+    }
+}
+
+static int parse_or(query_parser_t *ps) {
+    if (parse_and(ps) != 0) {
+        return -1;
+    }
+    for (;;) {
+        skip_space(ps);
+        if (strncmp(ps->p, "||", 2) != 0) {
+            return 0;
+        }
+        ps->p += 2;
+        if (parse_and(ps) != 0 || emit(ps, QUERY_CODE_OR) != 0) {
+            return -1;
+        }
+    }
+}
+
+// Compiles text such as "size > 1G && uid == 0 && mtime < 2024-01-01 && type == reg"
+int query_compile(const char *text, query_t *query, char *error, size_t error_size) {
+    query_parser_t ps = { text, query, error, error_size, 0 };
+
+    memset(query, 0, sizeof(*query));
+    if (parse_or(&ps) != 0) {
+        return -1;
+    }
+    skip_space(&ps);
+    if (*ps.p) {
+        return query_fail(&ps, "unexpected '%.10s'", ps.p);
+    }
+    return 0;
+}
+
+// 1 if the comparison holds for every value in [lo, hi], 0 if for none, -1 if it depends
+static int zone_verdict(query_op_t op, uint64_t k, uint64_t lo, uint64_t hi) {
+    switch (op) {
+        case QUERY_EQ: return (k < lo || k > hi) ? 0 : (lo == hi ? 1 : -1);
+        case QUERY_NE: return (k < lo || k > hi) ? 1 : (lo == hi ? 0 : -1);
+        case QUERY_LT: return hi < k ? 1 : (lo >= k ? 0 : -1);
+        case QUERY_LE: return hi <= k ? 1 : (lo > k ? 0 : -1);
+        case QUERY_GT: return lo > k ? 1 : (hi <= k ? 0 : -1);
+        case QUERY_GE: return lo >= k ? 1 : (hi < k ? 0 : -1);
+    }
+    return -1;
+}
+
+#define COMPARE_LOOP(cmp)                       \
+    for (uint32_t i = 0; i < n; i++) {          \
+        out[i] = (uint8_t)(values[i] cmp k);    \
+    }
+
+// One predicate over a batch. Each loop body is branch free, so it compiles to vector compares.
+static void eval_predicate(const query_pred_t *pred, uint64_t *values, uint32_t n, uint8_t *out) {
+    uint64_t k = pred->value;
+
+    if (pred->mask) {
+        uint64_t mask = pred->mask;
+        for (uint32_t i = 0; i < n; i++) {
+            values[i] &= mask;
+        }
+    }
+
+    switch (pred->op) {
+        case QUERY_EQ: COMPARE_LOOP(==); break;
+        case QUERY_NE: COMPARE_LOOP(!=); break;
+        case QUERY_LT: COMPARE_LOOP(<); break;
+        case QUERY_LE: COMPARE_LOOP(<=); break;
+        case QUERY_GT: COMPARE_LOOP(>); break;
+        case QUERY_GE: COMPARE_LOOP(>=); break;
+    }
+}
+
+// Evaluates the query over the snapshot a chunk at a time and sets bit ino - 1 of matches
+// for every matching inode. Chunks whose zone maps decide a predicate skip decoding it.
+int query_run(const query_t *query, const snapshot_t *snap, unsigned char *matches, uint32_t match_bits, uint64_t *count) {
+    uint32_t depth = query->depth ? query->depth : 1;
+    uint8_t (*stack)[SNAPSHOT_CHUNK] = malloc((size_t)depth * SNAPSHOT_CHUNK);
+    uint64_t *values = (uint64_t *)malloc(SNAPSHOT_CHUNK * sizeof(uint64_t));
+    uint64_t found = 0;
+
+    if (!stack || !values) {
+        free(stack);
+        free(values);
+        return -1;
+    }
+    memset(matches, 0, (match_bits + 7) / 8);
+
+    for (uint32_t chunk = 0; chunk < snap->chunks; chunk++) {
+        uint32_t first = chunk * SNAPSHOT_CHUNK;
+        uint32_t n = snap->rows - first < SNAPSHOT_CHUNK ? snap->rows - first : SNAPSHOT_CHUNK;
+        uint32_t top = 0, next_pred = 0;
+
+        for (uint32_t pc = 0; pc < query->code_len; pc++) {
+            uint8_t *a = top >= 2 ? stack[top - 2] : NULL;
+            uint8_t *b = top >= 1 ? stack[top - 1] : NULL;
+
+            switch ((query_code_t)query->code[pc]) {
+                case QUERY_CODE_PRED: {
+                    const query_pred_t *pred = &query->preds[next_pred++];
+                    const snapshot_column_t *col = &snap->columns[pred->col];
+                    int verdict = pred->mask ? -1 : zone_verdict(pred->op, pred->value,
+                                                                 col->zone_min[chunk], col->zone_max[chunk]);
+                    if (verdict >= 0) {
+                        memset(stack[top], verdict, n);
+                    } else {
+                        snapshot_decode(snap, pred->col, first, n, values);
+                        eval_predicate(pred, values, n, stack[top]);
+                    }
+                    top++;
+                    break;
+                }
+                case QUERY_CODE_AND:
+                    for (uint32_t i = 0; i < n; i++) a[i] &= b[i];
+                    top--;
+                    break;
+                case QUERY_CODE_OR:
+                    for (uint32_t i = 0; i < n; i++) a[i] |= b[i];
+                    top--;
+                    break;
+                case QUERY_CODE_NOT:
+                    for (uint32_t i = 0; i < n; i++) b[i] ^= 1;
+                    break;
+            }
+        }
+
+        const uint8_t *result = stack[0];
+        uint32_t hits = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            hits += result[i];
+        }
+        if (hits == 0) {
+            continue;
+        }
+
+        snapshot_decode(snap, SNAP_INO, first, n, values);
+        for (uint32_t i = 0; i < n; i++) {
+            uint64_t bit = values[i] - 1;
+            if (result[i] && bit < match_bits) {
+                matches[bit >> 3] |= (unsigned char)(1u << (bit & 7));
+            }
+        }
+        found += hits;
+    }
+
+    free(stack);
+    free(values);
+    if (count) {
+        *count = found;
+    }
+    return 0;
+}
+
+void query_result_free(query_result_t *result) {
+    if (!result) {
+        return;
+    }
+
+    free(result->matches);
+    free(result);
+}
+
+// Job body: runs the query_request_t passed as arg against the cached snapshot
+int query_job(job_t *job, void *arg) {
+    query_request_t *request = (query_request_t *)arg;
+    job_slot_t *slot = request->slot;
+    snapshot_cache_t *cache = (snapshot_cache_t *)slot->source;
+    uint32_t bits = cache->fs_info->sb.s_inodes_count;
+
+    query_result_t *result = (query_result_t *)calloc(1, sizeof(query_result_t));
+    snapshot_t *snap = snapshot_acquire(cache, job);
+    uint64_t matched = 0;
+    int rc = -1;
+    if (result && snap) {
+        result->matches = (unsigned char *)malloc((bits + 7) / 8);
+        result->bits = bits;
+        snprintf(result->text, sizeof(result->text), "%s", request->text);
+        if (result->matches) {
+            rc = query_run(&request->query, snap, result->matches, bits, &result->count);
+            matched = result->count;
+        }
+    }
+    snapshot_release(cache, snap);
+
+    if (rc != 0 || job_is_cancelled(job)) {
+        query_result_free(result);
+        result = NULL;
+    }
+    job_slot_finish(slot, job, result);
+
+    if (job_is_cancelled(job)) {
+        job_printf(job, "Filter cancelled");
+        return 0;
+    }
+    if (rc != 0) {
+        job_printf(job, "Failed to evaluate the filter");
+        return -1;
+    }
+    job_printf(job, "%lu matching inode(s)", (unsigned long)matched);
+    return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "snapshot.h"
+
+#define QUERY_MAX_PREDICATES 32
+#define QUERY_MAX_CODE (QUERY_MAX_PREDICATES * 2)
+
+typedef enum {
+    QUERY_EQ,
+    QUERY_NE,
+    QUERY_LT,
+    QUERY_LE,
+    QUERY_GT,
+    QUERY_GE
+} query_op_t;
+
+typedef struct {
+    snapshot_col_t col;         // Column the predicate reads
+    uint64_t mask;              // Bits of the value compared, 0 = all
+    query_op_t op;              // Comparison
+    uint64_t value;             // Right-hand side
+} query_pred_t;
+
+typedef enum {
+    QUERY_CODE_PRED,            // Push the result of a predicate
+    QUERY_CODE_AND,             // Pop two results, push their conjunction
+    QUERY_CODE_OR,              // Pop two results, push their disjunction
+    QUERY_CODE_NOT              // Negate the top result
+} query_code_t;
+
+// A compiled expression: predicates plus a postfix program combining them
+typedef struct {
+    query_pred_t preds[QUERY_MAX_PREDICATES]; // Leaf comparisons
+    uint32_t pred_count;        // Number of predicates
+    uint8_t code[QUERY_MAX_CODE]; // query_code_t, predicates are pushed in order
+    uint32_t code_len;          // Instructions in code
+    uint32_t depth;             // Largest stack depth the program needs
+} query_t;
+
+// Inodes matching one filter expression
+typedef struct {
+    unsigned char *matches;     // Bit ino - 1 set for every match
+    uint32_t bits;              // Bits in matches
+    uint64_t count;             // Number of bits set
+    char text[128];             // Expression as typed
+} query_result_t;
+
+// Argument of query_job(), released with free() once the job is joined
+typedef struct {
+    job_slot_t *slot;           // Slot receiving the result, its source is the snapshot_cache_t
+    query_t query;              // Compiled expression
+    char text[128];             // Expression as typed
+} query_request_t;
+
+int query_compile(const char *text, query_t *query, char *error, size_t error_size);
+
+int query_run(const query_t *query, const snapshot_t *snap, unsigned char *matches, uint32_t match_bits, uint64_t *count);
+
+void query_result_free(query_result_t *result);
+
+int query_job(job_t *job, void *arg);
+
+#endif /* QUERY_H */
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "refcount.h"
+
+int refcount_init(refcount_t *rc, uint32_t size) {
+    memset(rc, 0, sizeof(*rc));
+    rc->counts = (_Atomic uint8_t *)calloc(size ? size : 1, sizeof(uint8_t));
+    if (!rc->counts) {
+        return -1;
+    }
+    if (shardmap_init(&rc->overflow) != 0) {
+        free((void *)rc->counts);
+        rc->counts = NULL;
+        return -1;
+    }
+    rc->size = size;
+    return 0;
+}
+
+void refcount_free(refcount_t *rc) {
+    if (!rc->counts) {
+        return;
+    }
+
+    shardmap_free(&rc->overflow);
+    free((void *)rc->counts);
+    rc->counts = NULL;
+    rc->size = 0;
+}
+
+// Safe to call from any number of threads at once
+int refcount_inc(refcount_t *rc, uint32_t index) {
+    _Atomic uint8_t *count = &rc->counts[index];
+    uint8_t value = atomic_load_explicit(count, memory_order_relaxed);
+
+    while (value < REFCOUNT_SATURATED) {
+        if (atomic_compare_exchange_weak_explicit(count, &value, (uint8_t)(value + 1), memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+            return 0;
+        }
+    }
+    return shardmap_add(&rc->overflow, index, 1, NULL);
+}
+
+// Only exact once all increments are done
+uint32_t refcount_get(refcount_t *rc, uint32_t index) {
+    uint8_t value = atomic_load_explicit(&rc->counts[index], memory_order_relaxed);
+    uint64_t extra = 0;
+
+    if (value < REFCOUNT_SATURATED) {
+        return value;
+    }
+    shardmap_get(&rc->overflow, index, &extra);
+    return REFCOUNT_SATURATED + (uint32_t)extra;
+}
+
+size_t refcount_bytes(refcount_t *rc) {
+    return rc->size + shardmap_bytes(&rc->overflow);
+}
@@ -0,0 +1,32 @@
+#ifndef REFCOUNT_H
+#define REFCOUNT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "shardmap.h"
+
+#define REFCOUNT_SATURATED 255      // Byte value of a counter that continues in the overflow map
+
+// One byte per counter for the common case of few references. Increments are a compare and
+// swap on the byte; a counter reaching REFCOUNT_SATURATED keeps its further increments in a
+// sharded hash map, which only the rare heavily referenced entries ever touch.
+typedef struct {
+    _Atomic uint8_t *counts;    // Exact below REFCOUNT_SATURATED
+    uint32_t size;              // Number of counters
+    shardmap_t overflow;        // Increments beyond REFCOUNT_SATURATED per index
+} refcount_t;
+
+int refcount_init(refcount_t *rc, uint32_t size);
+
+void refcount_free(refcount_t *rc);
+
+int refcount_inc(refcount_t *rc, uint32_t index);
+
+uint32_t refcount_get(refcount_t *rc, uint32_t index);
+
+size_t refcount_bytes(refcount_t *rc);
+
+#endif /* REFCOUNT_H */
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <ext2fs/ext2_fs.h>
+#include "scans.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define SCAN_CHUNK_BLOCKS 256
+#define SCAN_MAX_HITS 10000
+
+// Compares the free counters of every group descriptor against its bitmaps
+int scan_verify_job(job_t *job, void *arg) {
+    fs_info_t *fs_info = (fs_info_t *)arg;
+    uint32_t mismatches = 0;
+
+    unsigned char *bitmap = (unsigned char *)malloc(fs_info->block_size);
+    if (!bitmap) {
+        job_printf(job, "Memory allocation error");
+        return -1;
+    }
+
+    job_set_total(job, fs_info->groups_count);
+
+    for (uint32_t g = 0; g < fs_info->groups_count && !job_is_cancelled(job); g++) {
+        struct ext2_group_desc *gd = &fs_info->group_desc[g];
+
+        if (!(gd->bg_flags & EXT2_BG_BLOCK_UNINIT) && get_block_bitmap(fs_info, g, bitmap) == 0) {
+            uint32_t blocks = group_block_count(fs_info, g);
+            uint32_t free_blocks = blocks - count_bitmap_bits(bitmap, blocks);
+            if (free_blocks != gd->bg_free_blocks_count) {
+                job_printf(job, "Group %u: free blocks %u in descriptor, %u in bitmap",
+                           g, gd->bg_free_blocks_count, free_blocks);
+                mismatches++;
+            }
+        }
+
+        if (!(gd->bg_flags & EXT2_BG_INODE_UNINIT) && get_inode_bitmap(fs_info, g, bitmap) == 0) {
+            uint32_t free_inodes = fs_info->inodes_per_group - count_bitmap_bits(bitmap, fs_info->inodes_per_group);
+            if (free_inodes != gd->bg_free_inodes_count) {
+                job_printf(job, "Group %u: free inodes %u in descriptor, %u in bitmap",
+                           g, gd->bg_free_inodes_count, free_inodes);
+                mismatches++;
+            }
+        }
+
+        job_advance(job, 1);
+    }
+
+    free(bitmap);
+    job_printf(job, "Verify finished: %u mismatch(es)", mismatches);
+    return 0;
+}
+
+// Counts allocated inodes by file type and sums their sizes from the cached columnar snapshot
+int scan_stats_job(job_t *job, void *arg) {
+    snapshot_cache_t *cache = (snapshot_cache_t *)arg;
+    uint64_t files = 0, dirs = 0, links = 0, other = 0, bytes = 0;
+    uint64_t modes[SNAPSHOT_CHUNK], sizes[SNAPSHOT_CHUNK];
+
+    snapshot_t *snap = snapshot_acquire(cache, job);
+    if (!snap) {
+        if (!job_is_cancelled(job)) {
+            job_printf(job, "Failed to load the inode tables");
+        }
+        return job_is_cancelled(job) ? 0 : -1;
+    }
+
+    for (uint32_t first = 0; first < snap->rows; first += SNAPSHOT_CHUNK) {
+        uint32_t count = snap->rows - first < SNAPSHOT_CHUNK ? snap->rows - first : SNAPSHOT_CHUNK;
+
+        snapshot_decode(snap, SNAP_MODE, first, count, modes);
+        snapshot_decode(snap, SNAP_SIZE, first, count, sizes);
+        for (uint32_t i = 0; i < count; i++) {
+            if (S_ISREG(modes[i])) files++;
+            else if (S_ISDIR(modes[i])) dirs++;
+            else if (S_ISLNK(modes[i])) links++;
+            else other++;
+            bytes += sizes[i];
+        }
+    }
+
+    size_t unpacked;
+    size_t packed = snapshot_memory(snap, &unpacked);
+    snapshot_release(cache, snap);
+
+    char size_str[32], packed_str[32], unpacked_str[32];
+    format_value(bytes, size_str, sizeof(size_str), true);
+    format_value(packed, packed_str, sizeof(packed_str), true);
+    format_value(unpacked, unpacked_str, sizeof(unpacked_str), true);
+    job_printf(job, "Regular files: %lu", (unsigned long)files);
+    job_printf(job, "Directories: %lu", (unsigned long)dirs);
+    job_printf(job, "Symbolic links: %lu", (unsigned long)links);
+    job_printf(job, "Other: %lu", (unsigned long)other);
+    job_printf(job, "Total size: %s", size_str);
+    job_printf(job, "Snapshot: %s packed, %s unpacked", packed_str, unpacked_str);
+    return 0;
+}
+
+// Searches every block of the device for a byte pattern
+int scan_search_job(job_t *job, void *arg) {
+    scan_search_arg_t *search = (scan_search_arg_t *)arg;
+    fs_info_t *fs_info = search->fs_info;
+    size_t overlap = search->pattern_len - 1;
+    size_t chunk_size = (size_t)SCAN_CHUNK_BLOCKS * fs_info->block_size;
+    uint32_t hits = 0;
+
+    // Keep the tail of the previous chunk in front so matches across chunks are found
+    uint8_t *buffer = (uint8_t *)malloc(overlap + chunk_size);
+    if (!buffer) {
+        job_printf(job, "Memory allocation error");
+        return -1;
+    }
+
+    uint32_t first = fs_info->sb.s_first_data_block;
+    uint32_t blocks = fs_info->sb.s_blocks_count;
+    size_t carried = 0;
+
+    job_set_total(job, blocks - first);
+
+    for (uint32_t block = first; block < blocks && !job_is_cancelled(job); ) {
+        uint32_t count = blocks - block < SCAN_CHUNK_BLOCKS ? blocks - block : SCAN_CHUNK_BLOCKS;
+
+        if (read_blocks(fs_info, block, count, buffer + carried) != 0) {
+            job_printf(job, "Read error at block %u", block);
+            free(buffer);
+            return -1;
+        }
+
+        size_t length = carried + (size_t)count * fs_info->block_size;
+        uint64_t base = (uint64_t)block * fs_info->block_size - carried;
+        size_t pos = 0;
+        int64_t at;
+
+        while (hits < SCAN_MAX_HITS &&
+               (at = find_pattern(buffer + pos, length - pos, length - pos, search->pattern, search->pattern_len,
+                                  false)) >= 0) {
+            uint64_t offset = base + pos + (uint64_t)at;
+            job_printf(job, "Match at block %lu offset 0x%lx (byte 0x%lx)",
+                       (unsigned long)(offset / fs_info->block_size),
+                       (unsigned long)(offset % fs_info->block_size),
+                       (unsigned long)offset);
+            hits++;
+            pos += (size_t)at + 1;
+        }
+
+        carried = length < overlap ? length : overlap;
+        memmove(buffer, buffer + length - carried, carried);
+
+        job_advance(job, count);
+        block += count;
+    }
+
+    free(buffer);
+    job_printf(job, "Search finished: %u match(es)%s", hits, hits >= SCAN_MAX_HITS ? " (limit reached)" : "");
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef SCANS_H
+#define SCANS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "analyzer.h"
+#include "job.h"
+#include "utils.h"
+
+typedef struct {
+    fs_info_t *fs_info;                 // Filesystem to search
+    uint8_t pattern[SEARCH_PATTERN_MAX]; // Bytes to look for
+    size_t pattern_len;                 // Number of valid bytes in pattern
+} scan_search_arg_t;
+
+int scan_verify_job(job_t *job, void *arg);
+
+int scan_stats_job(job_t *job, void *arg);
+
+int scan_search_job(job_t *job, void *arg);
+
+#endif /* SCANS_H */
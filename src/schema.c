@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <ext2fs/ext2_fs.h>
+#include "schema.h"
+
+#define FIELD(st, member, label, type) \
+    { #member, label, offsetof(struct st, member), sizeof(((struct st *)0)->member), type, FIELD_LE }
+#define FIELD_AS(st, member, name, label, type) \
+    { name, label, offsetof(struct st, member), sizeof(((struct st *)0)->member), type, FIELD_LE }
+#define SCHEMA(name, st, table) \
+    { name, table, sizeof(table) / sizeof(table[0]), sizeof(struct st) }
+
+static const field_desc_t superblock_fields[] = {
+    FIELD(ext2_super_block, s_inodes_count, "Inodes count", FIELD_UINT),
+    FIELD(ext2_super_block, s_blocks_count, "Blocks count", FIELD_UINT),
+    FIELD(ext2_super_block, s_r_blocks_count, "Reserved blocks count", FIELD_UINT),
+    FIELD(ext2_super_block, s_free_blocks_count, "Free blocks count", FIELD_UINT),
+    FIELD(ext2_super_block, s_free_inodes_count, "Free inodes count", FIELD_UINT),
+    FIELD(ext2_super_block, s_first_data_block, "First data block", FIELD_UINT),
+    FIELD(ext2_super_block, s_log_block_size, "Block size", FIELD_LOG_BLOCK),
+    FIELD(ext2_super_block, s_log_cluster_size, "Cluster size", FIELD_LOG_BLOCK),
+    FIELD(ext2_super_block, s_blocks_per_group, "Blocks per group", FIELD_UINT),
+    FIELD(ext2_super_block, s_clusters_per_group, "Clusters per group", FIELD_UINT),
+    FIELD(ext2_super_block, s_inodes_per_group, "Inodes per group", FIELD_UINT),
+    FIELD(ext2_super_block, s_mtime, "Mount time", FIELD_TIME),
+    FIELD(ext2_super_block, s_wtime, "Write time", FIELD_TIME),
+    FIELD(ext2_super_block, s_mnt_count, "Mount count", FIELD_UINT),
+    FIELD(ext2_super_block, s_max_mnt_count, "Maximum mount count", FIELD_INT),
+    FIELD(ext2_super_block, s_magic, "Magic signature", FIELD_HEX),
+    FIELD(ext2_super_block, s_state, "Filesystem state", FIELD_HEX),
+    FIELD(ext2_super_block, s_errors, "Error behavior", FIELD_UINT),
+    FIELD(ext2_super_block, s_minor_rev_level, "Minor revision level", FIELD_UINT),
+    FIELD(ext2_super_block, s_lastcheck, "Last check time", FIELD_TIME),
+    FIELD(ext2_super_block, s_checkinterval, "Check interval", FIELD_UINT),
+    FIELD(ext2_super_block, s_creator_os, "Creator OS", FIELD_UINT),
+    FIELD(ext2_super_block, s_rev_level, "Revision level", FIELD_UINT),
+    FIELD(ext2_super_block, s_def_resuid, "Reserved blocks UID", FIELD_UINT),
+    FIELD(ext2_super_block, s_def_resgid, "Reserved blocks GID", FIELD_UINT),
+    FIELD(ext2_super_block, s_first_ino, "First inode", FIELD_UINT),
+    FIELD(ext2_super_block, s_inode_size, "Inode size", FIELD_UINT),
+    FIELD(ext2_super_block, s_block_group_nr, "Block group number", FIELD_UINT),
+    FIELD(ext2_super_block, s_feature_compat, "Compatible features", FIELD_HEX),
+    FIELD(ext2_super_block, s_feature_incompat, "Incompatible features", FIELD_HEX),
+    FIELD(ext2_super_block, s_feature_ro_compat, "Read-only compatible features", FIELD_HEX),
+    FIELD(ext2_super_block, s_uuid, "UUID", FIELD_UUID),
+    FIELD(ext2_super_block, s_volume_name, "Volume name", FIELD_STRING),
+    FIELD(ext2_super_block, s_last_mounted, "Last mounted on", FIELD_STRING),
+    FIELD(ext2_super_block, s_algorithm_usage_bitmap, "Compression algorithms", FIELD_HEX),
+    FIELD(ext2_super_block, s_prealloc_blocks, "Preallocated blocks", FIELD_UINT),
+    FIELD(ext2_super_block, s_prealloc_dir_blocks, "Preallocated directory blocks", FIELD_UINT),
+    FIELD(ext2_super_block, s_reserved_gdt_blocks, "Reserved GDT blocks", FIELD_UINT),
+    FIELD(ext2_super_block, s_journal_uuid, "Journal UUID", FIELD_UUID),
+    FIELD(ext2_super_block, s_journal_inum, "Journal inode", FIELD_UINT),
+    FIELD(ext2_super_block, s_journal_dev, "Journal device", FIELD_UINT),
+    FIELD(ext2_super_block, s_last_orphan, "First orphan inode", FIELD_UINT),
+    FIELD(ext2_super_block, s_hash_seed, "Directory hash seed", FIELD_UUID),
+    FIELD(ext2_super_block, s_def_hash_version, "Default hash version", FIELD_UINT),
+    FIELD(ext2_super_block, s_jnl_backup_type, "Journal backup type", FIELD_UINT),
+    FIELD(ext2_super_block, s_desc_size, "Group descriptor size", FIELD_UINT),
+    FIELD(ext2_super_block, s_default_mount_opts, "Default mount options", FIELD_HEX),
+    FIELD(ext2_super_block, s_first_meta_bg, "First metablock group", FIELD_UINT),
+    FIELD(ext2_super_block, s_mkfs_time, "Creation time", FIELD_TIME),
+    FIELD(ext2_super_block, s_jnl_blocks, "Journal inode backup", FIELD_BYTES),
+    FIELD(ext2_super_block, s_blocks_count_hi, "Blocks count (high)", FIELD_UINT),
+    FIELD(ext2_super_block, s_r_blocks_count_hi, "Reserved blocks count (high)", FIELD_UINT),
+    FIELD(ext2_super_block, s_free_blocks_hi, "Free blocks count (high)", FIELD_UINT),
+    FIELD(ext2_super_block, s_min_extra_isize, "Minimum extra inode size", FIELD_UINT),
+    FIELD(ext2_super_block, s_want_extra_isize, "Wanted extra inode size", FIELD_UINT),
+    FIELD(ext2_super_block, s_flags, "Flags", FIELD_HEX),
+    FIELD(ext2_super_block, s_raid_stride, "RAID stride", FIELD_UINT),
+    FIELD(ext2_super_block, s_mmp_update_interval, "MMP update interval", FIELD_UINT),
+    FIELD(ext2_super_block, s_mmp_block, "MMP block", FIELD_UINT),
+    FIELD(ext2_super_block, s_raid_stripe_width, "RAID stripe width", FIELD_UINT),
+    FIELD(ext2_super_block, s_log_groups_per_flex, "log2(groups per flex group)", FIELD_UINT),
+    FIELD(ext2_super_block, s_checksum_type, "Checksum type", FIELD_UINT),
+    FIELD(ext2_super_block, s_kbytes_written, "KiB written", FIELD_UINT),
+    FIELD(ext2_super_block, s_checksum, "Checksum", FIELD_HEX),
+};
+
+static const field_desc_t group_desc32_fields[] = {
+    FIELD(ext2_group_desc, bg_block_bitmap, "Block bitmap", FIELD_UINT),
+    FIELD(ext2_group_desc, bg_inode_bitmap, "Inode bitmap", FIELD_UINT),
+    FIELD(ext2_group_desc, bg_inode_table, "Inode table", FIELD_UINT),
+    FIELD(ext2_group_desc, bg_free_blocks_count, "Free blocks count", FIELD_UINT),
+    FIELD(ext2_group_desc, bg_free_inodes_count, "Free inodes count", FIELD_UINT),
+    FIELD(ext2_group_desc, bg_used_dirs_count, "Used directories count", FIELD_UINT),
+    FIELD(ext2_group_desc, bg_flags, "Flags", FIELD_HEX),
+    FIELD(ext2_group_desc, bg_exclude_bitmap_lo, "Snapshot exclude bitmap", FIELD_UINT),
+    FIELD(ext2_group_desc, bg_block_bitmap_csum_lo, "Block bitmap checksum", FIELD_HEX),
+    FIELD(ext2_group_desc, bg_inode_bitmap_csum_lo, "Inode bitmap checksum", FIELD_HEX),
+    FIELD(ext2_group_desc, bg_itable_unused, "Unused inodes count", FIELD_UINT),
+    FIELD(ext2_group_desc, bg_checksum, "Checksum", FIELD_HEX),
+};
+
+static const field_desc_t group_desc64_fields[] = {
+    FIELD(ext4_group_desc, bg_block_bitmap, "Block bitmap", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_inode_bitmap, "Inode bitmap", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_inode_table, "Inode table", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_free_blocks_count, "Free blocks count", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_free_inodes_count, "Free inodes count", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_used_dirs_count, "Used directories count", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_flags, "Flags", FIELD_HEX),
+    FIELD(ext4_group_desc, bg_exclude_bitmap_lo, "Snapshot exclude bitmap", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_block_bitmap_csum_lo, "Block bitmap checksum", FIELD_HEX),
+    FIELD(ext4_group_desc, bg_inode_bitmap_csum_lo, "Inode bitmap checksum", FIELD_HEX),
+    FIELD(ext4_group_desc, bg_itable_unused, "Unused inodes count", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_checksum, "Checksum", FIELD_HEX),
+    FIELD(ext4_group_desc, bg_block_bitmap_hi, "Block bitmap (high)", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_inode_bitmap_hi, "Inode bitmap (high)", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_inode_table_hi, "Inode table (high)", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_free_blocks_count_hi, "Free blocks count (high)", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_free_inodes_count_hi, "Free inodes count (high)", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_used_dirs_count_hi, "Used directories count (high)", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_itable_unused_hi, "Unused inodes count (high)", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_exclude_bitmap_hi, "Snapshot exclude bitmap (high)", FIELD_UINT),
+    FIELD(ext4_group_desc, bg_block_bitmap_csum_hi, "Block bitmap checksum (high)", FIELD_HEX),
+    FIELD(ext4_group_desc, bg_inode_bitmap_csum_hi, "Inode bitmap checksum (high)", FIELD_HEX),
+};
+
+#define INODE_FIELDS(st) \
+    FIELD(st, i_mode, "Mode", FIELD_MODE), \
+    FIELD(st, i_uid, "Owner", FIELD_UINT), \
+    FIELD(st, i_size, "Size", FIELD_UINT), \
+    FIELD(st, i_atime, "Access time", FIELD_TIME), \
+    FIELD(st, i_ctime, "Change time", FIELD_TIME), \
+    FIELD(st, i_mtime, "Modification time", FIELD_TIME), \
+    FIELD(st, i_dtime, "Deletion time", FIELD_TIME), \
+    FIELD(st, i_gid, "Group", FIELD_UINT), \
+    FIELD(st, i_links_count, "Links count", FIELD_UINT), \
+    FIELD(st, i_blocks, "Blocks count", FIELD_UINT), \
+    FIELD(st, i_flags, "Flags", FIELD_HEX), \
+    FIELD_AS(st, osd1.linux1.l_i_version, "l_i_version", "Version", FIELD_UINT), \
+    FIELD(st, i_block[0], "Direct block 0", FIELD_UINT), \
+    FIELD(st, i_block[1], "Direct block 1", FIELD_UINT), \
+    FIELD(st, i_block[2], "Direct block 2", FIELD_UINT), \
+    FIELD(st, i_block[3], "Direct block 3", FIELD_UINT), \
+    FIELD(st, i_block[4], "Direct block 4", FIELD_UINT), \
+    FIELD(st, i_block[5], "Direct block 5", FIELD_UINT), \
+    FIELD(st, i_block[6], "Direct block 6", FIELD_UINT), \
+    FIELD(st, i_block[7], "Direct block 7", FIELD_UINT), \
+    FIELD(st, i_block[8], "Direct block 8", FIELD_UINT), \
+    FIELD(st, i_block[9], "Direct block 9", FIELD_UINT), \
+    FIELD(st, i_block[10], "Direct block 10", FIELD_UINT), \
+    FIELD(st, i_block[11], "Direct block 11", FIELD_UINT), \
+    FIELD(st, i_block[12], "Singly-indirect block", FIELD_UINT), \
+    FIELD(st, i_block[13], "Doubly-indirect block", FIELD_UINT), \
+    FIELD(st, i_block[14], "Triply-indirect block", FIELD_UINT), \
+    FIELD(st, i_generation, "Generation", FIELD_UINT), \
+    FIELD(st, i_file_acl, "Extended attribute block", FIELD_UINT), \
+    FIELD(st, i_size_high, "Size (high)", FIELD_UINT), \
+    FIELD(st, i_faddr, "Fragment address", FIELD_UINT), \
+    FIELD_AS(st, osd2.linux2.l_i_blocks_hi, "l_i_blocks_hi", "Blocks count (high)", FIELD_UINT), \
+    FIELD_AS(st, osd2.linux2.l_i_file_acl_high, "l_i_file_acl_high", "Extended attribute block (high)", FIELD_UINT), \
+    FIELD_AS(st, osd2.linux2.l_i_uid_high, "l_i_uid_high", "Owner (high)", FIELD_UINT), \
+    FIELD_AS(st, osd2.linux2.l_i_gid_high, "l_i_gid_high", "Group (high)", FIELD_UINT), \
+    FIELD_AS(st, osd2.linux2.l_i_checksum_lo, "l_i_checksum_lo", "Checksum", FIELD_HEX)
+
+static const field_desc_t inode_fields[] = {
+    INODE_FIELDS(ext2_inode),
+};
+
+static const field_desc_t inode_large_fields[] = {
+    INODE_FIELDS(ext2_inode_large),
+    FIELD(ext2_inode_large, i_extra_isize, "Extra inode size", FIELD_UINT),
+    FIELD(ext2_inode_large, i_checksum_hi, "Checksum (high)", FIELD_HEX),
+    FIELD(ext2_inode_large, i_ctime_extra, "Change time (extra)", FIELD_HEX),
+    FIELD(ext2_inode_large, i_mtime_extra, "Modification time (extra)", FIELD_HEX),
+    FIELD(ext2_inode_large, i_atime_extra, "Access time (extra)", FIELD_HEX),
+    FIELD(ext2_inode_large, i_crtime, "Creation time", FIELD_TIME),
+    FIELD(ext2_inode_large, i_crtime_extra, "Creation time (extra)", FIELD_HEX),
+    FIELD(ext2_inode_large, i_version_hi, "Version (high)", FIELD_UINT),
+    FIELD(ext2_inode_large, i_projid, "Project ID", FIELD_UINT),
+};
+
+static const field_desc_t dir_entry_fields[] = {
+    FIELD(ext2_dir_entry_2, inode, "Inode", FIELD_UINT),
+    FIELD(ext2_dir_entry_2, rec_len, "Record length", FIELD_UINT),
+    FIELD(ext2_dir_entry_2, name_len, "Name length", FIELD_UINT),
+    FIELD(ext2_dir_entry_2, file_type, "File type", FIELD_UINT),
+    FIELD(ext2_dir_entry_2, name, "Name", FIELD_NAME),
+};
+
+const schema_t schema_superblock = SCHEMA("Superblock", ext2_super_block, superblock_fields);
+const schema_t schema_group_desc32 = SCHEMA("Group Descriptor", ext2_group_desc, group_desc32_fields);
+const schema_t schema_group_desc64 = SCHEMA("Group Descriptor", ext4_group_desc, group_desc64_fields);
+const schema_t schema_inode = SCHEMA("Inode", ext2_inode, inode_fields);
+const schema_t schema_inode_large = SCHEMA("Inode", ext2_inode_large, inode_large_fields);
+const schema_t schema_dir_entry = SCHEMA("Directory Entry", ext2_dir_entry_2, dir_entry_fields);
+
+// Field covering offset, or NULL for padding and reserved bytes
+const field_desc_t *schema_field_at(const schema_t *schema, uint32_t offset) {
+    if (!schema || offset >= schema->size) {
+        return NULL;
+    }
+
+    uint32_t lo = 0, hi = schema->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (schema->fields[mid].offset <= offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0) {
+        return NULL;
+    }
+    const field_desc_t *field = &schema->fields[lo - 1];
+    return offset < (uint32_t)field->offset + field->width ? field : NULL;
+}
+
+// Integer value of a field of up to 8 bytes; data points at the start of the structure
+uint64_t schema_read_uint(const field_desc_t *field, const void *data) {
+    const uint8_t *p = (const uint8_t *)data + field->offset;
+    uint32_t width = field->width < 8 ? field->width : 8;
+    uint64_t value = 0;
+
+    for (uint32_t i = 0; i < width; i++) {
+        uint32_t shift = field->endian == FIELD_LE ? i * 8 : (width - 1 - i) * 8;
+        value |= (uint64_t)p[i] << shift;
+    }
+    return value;
+}
+
+// Bytes a field occupies in this instance of the structure: names end at name_len
+uint32_t schema_field_width(const field_desc_t *field, const void *data) {
+    if (field->type == FIELD_NAME) {
+        uint32_t name_len = ((const uint8_t *)data)[offsetof(struct ext2_dir_entry_2, name_len)];
+        return name_len < field->width ? name_len : field->width;
+    }
+    return field->width;
+}
+
+static int schema_format_mode(uint16_t mode, char *buffer, size_t buffer_size) {
+    char mode_str[11] = "----------";
+
+    if (S_ISDIR(mode)) mode_str[0] = 'd';
+    else if (S_ISLNK(mode)) mode_str[0] = 'l';
+    else if (S_ISCHR(mode)) mode_str[0] = 'c';
+    else if (S_ISBLK(mode)) mode_str[0] = 'b';
+    else if (S_ISFIFO(mode)) mode_str[0] = 'p';
+    else if (S_ISSOCK(mode)) mode_str[0] = 's';
+
+    static const char perms[] = "rwxrwxrwx";
+    for (int i = 0; i < 9; i++) {
+        if (mode & (0400 >> i)) {
+            mode_str[i + 1] = perms[i];
+        }
+    }
+
+    // setuid/setgid/sticky replace the matching execute bit
+    if (mode & 04000) mode_str[3] = mode_str[3] == 'x' ? 's' : 'S';
+    if (mode & 02000) mode_str[6] = mode_str[6] == 'x' ? 's' : 'S';
+    if (mode & 01000) mode_str[9] = mode_str[9] == 'x' ? 't' : 'T';
+
+    return snprintf(buffer, buffer_size, "%s (0%o)", mode_str, mode & 0xFFF);
+}
+
+static int schema_format_text(const uint8_t *p, uint32_t length, char *buffer, size_t buffer_size) {
+    size_t pos = 0;
+
+    for (uint32_t i = 0; i < length && p[i] != '\0' && pos + 1 < buffer_size; i++) {
+        buffer[pos++] = (p[i] >= 0x20 && p[i] < 0x7F) ? (char)p[i] : '.';
+    }
+    if (buffer_size > 0) {
+        buffer[pos] = '\0';
+    }
+    return (int)pos;
+}
+
+// Writes the value of one field; data points at the start of the structure
+int schema_format_field(const field_desc_t *field, const void *data, char *buffer, size_t buffer_size) {
+    const uint8_t *p = (const uint8_t *)data + field->offset;
+    uint64_t value = field->width <= 8 ? schema_read_uint(field, data) : 0;
+
+    switch (field->type) {
+        case FIELD_UINT:
+            return snprintf(buffer, buffer_size, "%llu", (unsigned long long)value);
+
+        case FIELD_INT: {
+            int64_t signed_value = (int64_t)(value << (64 - field->width * 8)) >> (64 - field->width * 8);
+            return snprintf(buffer, buffer_size, "%lld", (long long)signed_value);
+        }
+
+        case FIELD_HEX:
+            return snprintf(buffer, buffer_size, "0x%0*llx", field->width * 2, (unsigned long long)value);
+
+        case FIELD_TIME: {
+            if (value == 0) {
+                return snprintf(buffer, buffer_size, "0 (never)");
+            }
+            time_t t = (time_t)value;
+            struct tm tm;
+            char date[32];
+            if (!gmtime_r(&t, &tm) || strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm) == 0) {
+                return snprintf(buffer, buffer_size, "%llu", (unsigned long long)value);
+            }
+            return snprintf(buffer, buffer_size, "%llu (%s UTC)", (unsigned long long)value, date);
+        }
+
+        case FIELD_MODE:
+            return schema_format_mode((uint16_t)value, buffer, buffer_size);
+
+        case FIELD_LOG_BLOCK:
+            if (value > 21) {
+                return snprintf(buffer, buffer_size, "%llu (invalid)", (unsigned long long)value);
+            }
+            return snprintf(buffer, buffer_size, "%u", 1024u << value);
+
+        case FIELD_UUID:
+            return snprintf(buffer, buffer_size,
+                            "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+                            p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7],
+                            p[8], p[9], p[10], p[11], p[12], p[13], p[14], p[15]);
+
+        case FIELD_STRING:
+            return schema_format_text(p, field->width, buffer, buffer_size);
+
+        case FIELD_NAME:
+            return schema_format_text(p, schema_field_width(field, data), buffer, buffer_size);
+
+        case FIELD_BYTES: {
+            int written = 0;
+            uint32_t shown = field->width < 16 ? field->width : 16;
+            for (uint32_t i = 0; i < shown && (size_t)written < buffer_size; i++) {
+                written += snprintf(buffer + written, buffer_size - written, "%02x", p[i]);
+            }
+            if (shown < field->width && (size_t)written < buffer_size) {
+                written += snprintf(buffer + written, buffer_size - written, "...");
+            }
+            return written;
+        }
+    }
+
+    return snprintf(buffer, buffer_size, "?");
+}
+
+// Appends "  Label: value" lines for every field inside data_len straight into buffer.
+// Returns the length of the text, which is cut short when the buffer is too small.
+size_t schema_format(const schema_t *schema, const void *data, size_t data_len, char *buffer, size_t buffer_size) {
+    if (!schema || !data || !buffer || buffer_size == 0) {
+        return 0;
+    }
+
+    size_t pos = 0;
+    int written = snprintf(buffer, buffer_size, "%s:\n", schema->name);
+    pos = written < 0 ? 0 : (size_t)written;
+
+    for (uint32_t i = 0; i < schema->count && pos + 1 < buffer_size; i++) {
+        const field_desc_t *field = &schema->fields[i];
+        if ((size_t)field->offset + schema_field_width(field, data) > data_len) {
+            break;
+        }
+
+        written = snprintf(buffer + pos, buffer_size - pos, "  %s: ", field->label);
+        pos += written < 0 ? 0 : (size_t)written;
+        if (pos + 1 >= buffer_size) {
+            break;
+        }
+
+        written = schema_format_field(field, data, buffer + pos, buffer_size - pos);
+        pos += written < 0 ? 0 : (size_t)written;
+        if (pos + 1 >= buffer_size) {
+            break;
+        }
+
+        buffer[pos++] = '\n';
+        buffer[pos] = '\0';
+    }
+
+    return pos < buffer_size ? pos : buffer_size - 1;
+}
+
+// Walks a block as a chain of directory entries. When the chain is well formed and
+// covers the whole block, returns true with the start of the entry holding offset.
+bool schema_dir_entry_at(const uint8_t *block, uint32_t block_size, uint32_t offset, uint32_t *entry_start) {
+    uint32_t pos = 0;
+    bool found = false;
+
+    while (pos < block_size) {
+        if (block_size - pos < 8) {
+            return false;
+        }
+
+        uint32_t rec_len = block[pos + 4] | ((uint32_t)block[pos + 5] << 8);
+        uint32_t name_len = block[pos + 6];
+        if (rec_len < 8 || rec_len % 4 != 0 || rec_len > block_size - pos || name_len + 8 > rec_len) {
+            return false;
+        }
+
+        if (offset >= pos && offset < pos + rec_len) {
+            *entry_start = pos;
+            found = true;
+        }
+        pos += rec_len;
+    }
+
+    return found;
+}
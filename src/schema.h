@@ -0,0 +1,62 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    FIELD_UINT,                 // Unsigned decimal
+    FIELD_INT,                  // Signed decimal
+    FIELD_HEX,                  // Flags, magic numbers and checksums
+    FIELD_TIME,                 // Seconds since the epoch
+    FIELD_MODE,                 // Inode mode, shown like ls -l
+    FIELD_LOG_BLOCK,            // log2(block size) - 10, shown as the block size
+    FIELD_UUID,                 // 16 raw bytes
+    FIELD_STRING,               // NUL padded text
+    FIELD_NAME,                 // Directory entry name, its length is in name_len
+    FIELD_BYTES                 // Anything else, shown as hex
+} field_type_t;
+
+typedef enum {
+    FIELD_LE,                   // Little endian, all ext2/3/4 metadata
+    FIELD_BE                    // Big endian, the jbd2 journal
+} field_endian_t;
+
+typedef struct {
+    const char *name;           // On-disk field name
+    const char *label;          // Human readable name
+    uint16_t offset;            // Byte offset inside the structure
+    uint16_t width;             // Width in bytes
+    field_type_t type;          // How the value is shown
+    field_endian_t endian;      // Byte order of integer fields
+} field_desc_t;
+
+typedef struct {
+    const char *name;           // Structure name
+    const field_desc_t *fields; // Fields sorted by offset, never overlapping
+    uint32_t count;             // Number of fields
+    uint32_t size;              // Size of the structure in bytes
+} schema_t;
+
+extern const schema_t schema_superblock;
+extern const schema_t schema_group_desc32;
+extern const schema_t schema_group_desc64;
+extern const schema_t schema_inode;
+extern const schema_t schema_inode_large;
+extern const schema_t schema_dir_entry;
+
+const field_desc_t *schema_field_at(const schema_t *schema, uint32_t offset);
+
+uint32_t schema_field_width(const field_desc_t *field, const void *data);
+
+uint64_t schema_read_uint(const field_desc_t *field, const void *data);
+
+int schema_format_field(const field_desc_t *field, const void *data, char *buffer, size_t buffer_size);
+
+size_t schema_format(const schema_t *schema, const void *data, size_t data_len, char *buffer, size_t buffer_size);
+
+bool schema_dir_entry_at(const uint8_t *block, uint32_t block_size, uint32_t offset, uint32_t *entry_start);
+
+#endif /* SCHEMA_H */
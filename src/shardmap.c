@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shardmap.h"
+
+#define SHARDMAP_SHARD_BITS 6       // log2(SHARDMAP_SHARDS)
+#define SHARDMAP_MIN_CAPACITY 64
+
+static uint64_t shardmap_hash(uint64_t key) {
+    return key * 0x9E3779B97F4A7C15ULL;
+}
+
+// The top bits pick the shard, the bits below them the slot, so both stay independent
+static shardmap_shard_t *shardmap_shard(shardmap_t *map, uint64_t hash) {
+    return &map->shards[hash >> (64 - SHARDMAP_SHARD_BITS)];
+}
+
+static uint32_t shardmap_slot(const shardmap_shard_t *shard, uint64_t hash) {
+    return (uint32_t)(hash >> (32 - SHARDMAP_SHARD_BITS)) & (shard->capacity - 1);
+}
+
+int shardmap_init(shardmap_t *map) {
+    memset(map, 0, sizeof(*map));
+    for (int s = 0; s < SHARDMAP_SHARDS; s++) {
+        if (pthread_mutex_init(&map->shards[s].lock, NULL) != 0) {
+            while (s-- > 0) {
+                pthread_mutex_destroy(&map->shards[s].lock);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void shardmap_free(shardmap_t *map) {
+    for (int s = 0; s < SHARDMAP_SHARDS; s++) {
+        free(map->shards[s].keys);
+        free(map->shards[s].values);
+        pthread_mutex_destroy(&map->shards[s].lock);
+    }
+    memset(map, 0, sizeof(*map));
+}
+
+// Slot holding key + 1, or the empty slot where it belongs
+static uint32_t shardmap_probe(const shardmap_shard_t *shard, uint64_t stored) {
+    uint32_t i = shardmap_slot(shard, shardmap_hash(stored - 1));
+
+    while (shard->keys[i] != 0 && shard->keys[i] != stored) {
+        i = (i + 1) & (shard->capacity - 1);
+    }
+    return i;
+}
+
+// Keeps the shard at most half full
+static int shardmap_reserve(shardmap_shard_t *shard, uint32_t needed) {
+    if ((uint64_t)needed * 2 <= shard->capacity) {
+        return 0;
+    }
+
+    uint32_t capacity = shard->capacity ? shard->capacity * 2 : SHARDMAP_MIN_CAPACITY;
+    uint64_t *keys = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+    uint64_t *values = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+    if (!keys || !values) {
+        free(keys);
+        free(values);
+        return -1;
+    }
+
+    uint64_t *old_keys = shard->keys;
+    uint64_t *old_values = shard->values;
+    uint32_t old_capacity = shard->capacity;
+
+    shard->keys = keys;
+    shard->values = values;
+    shard->capacity = capacity;
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old_keys[i] != 0) {
+            uint32_t slot = shardmap_probe(shard, old_keys[i]);
+            keys[slot] = old_keys[i];
+            values[slot] = old_values[i];
+        }
+    }
+    free(old_keys);
+    free(old_values);
+    return 0;
+}
+
+// Adds delta to the counter of key, creating it at 0 first. The new value goes to value if given.
+int shardmap_add(shardmap_t *map, uint64_t key, uint64_t delta, uint64_t *value) {
+    shardmap_shard_t *shard = shardmap_shard(map, shardmap_hash(key));
+    int rc = 0;
+
+    pthread_mutex_lock(&shard->lock);
+    if (shardmap_reserve(shard, shard->count + 1) != 0) {
+        rc = -1;
+    } else {
+        uint32_t i = shardmap_probe(shard, key + 1);
+        if (shard->keys[i] == 0) {
+            shard->keys[i] = key + 1;
+            shard->count++;
+        }
+        shard->values[i] += delta;
+        if (value) {
+            *value = shard->values[i];
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return rc;
+}
+
+bool shardmap_get(shardmap_t *map, uint64_t key, uint64_t *value) {
+    shardmap_shard_t *shard = shardmap_shard(map, shardmap_hash(key));
+    bool found = false;
+
+    pthread_mutex_lock(&shard->lock);
+    if (shard->count > 0) {
+        uint32_t i = shardmap_probe(shard, key + 1);
+        if (shard->keys[i] != 0) {
+            found = true;
+            if (value) {
+                *value = shard->values[i];
+            }
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return found;
+}
+
+uint64_t shardmap_count(shardmap_t *map) {
+    uint64_t count = 0;
+
+    for (int s = 0; s < SHARDMAP_SHARDS; s++) {
+        pthread_mutex_lock(&map->shards[s].lock);
+        count += map->shards[s].count;
+        pthread_mutex_unlock(&map->shards[s].lock);
+    }
+    return count;
+}
+
+// Memory held by the tables
+size_t shardmap_bytes(shardmap_t *map) {
+    size_t bytes = 0;
+
+    for (int s = 0; s < SHARDMAP_SHARDS; s++) {
+        pthread_mutex_lock(&map->shards[s].lock);
+        bytes += (size_t)map->shards[s].capacity * 2 * sizeof(uint64_t);
+        pthread_mutex_unlock(&map->shards[s].lock);
+    }
+    return bytes;
+}
+
+static int compare_entry(const void *a, const void *b) {
+    const shardmap_entry_t *x = (const shardmap_entry_t *)a, *y = (const shardmap_entry_t *)b;
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+// Copies all entries out sorted by key. The caller frees *entries.
+int shardmap_collect(shardmap_t *map, shardmap_entry_t **entries, size_t *count) {
+    size_t total = (size_t)shardmap_count(map), n = 0;
+    shardmap_entry_t *out = (shardmap_entry_t *)malloc((total ? total : 1) * sizeof(shardmap_entry_t));
+
+    if (!out) {
+        return -1;
+    }
+    for (int s = 0; s < SHARDMAP_SHARDS; s++) {
+        shardmap_shard_t *shard = &map->shards[s];
+        pthread_mutex_lock(&shard->lock);
+        for (uint32_t i = 0; i < shard->capacity && n < total; i++) {
+            if (shard->keys[i] != 0) {
+                out[n].key = shard->keys[i] - 1;
+                out[n].value = shard->values[i];
+                n++;
+            }
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    qsort(out, n, sizeof(shardmap_entry_t), compare_entry);
+    *entries = out;
+    *count = n;
+    return 0;
+}
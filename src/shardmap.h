@@ -0,0 +1,46 @@
+#ifndef SHARDMAP_H
+#define SHARDMAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define SHARDMAP_SHARDS 64          // Independently locked tables, a power of two
+
+typedef struct {
+    uint64_t key;
+    uint64_t value;
+} shardmap_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;       // Protects the fields below
+    uint64_t *keys;             // Key + 1 per slot, 0 for an empty slot
+    uint64_t *values;
+    uint32_t capacity;          // Slots, a power of two, 0 until the first insert
+    uint32_t count;             // Occupied slots
+} shardmap_shard_t;
+
+// Counters keyed by a 64-bit number that many threads update at once. Keys are spread over
+// SHARDMAP_SHARDS open addressing tables with a lock each, so writers rarely wait on each other
+// and memory grows with the number of keys only.
+typedef struct {
+    shardmap_shard_t shards[SHARDMAP_SHARDS];
+} shardmap_t;
+
+int shardmap_init(shardmap_t *map);
+
+void shardmap_free(shardmap_t *map);
+
+int shardmap_add(shardmap_t *map, uint64_t key, uint64_t delta, uint64_t *value);
+
+bool shardmap_get(shardmap_t *map, uint64_t key, uint64_t *value);
+
+uint64_t shardmap_count(shardmap_t *map);
+
+size_t shardmap_bytes(shardmap_t *map);
+
+int shardmap_collect(shardmap_t *map, shardmap_entry_t **entries, size_t *count);
+
+#endif /* SHARDMAP_H */
@@ -0,0 +1,450 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snapshot.h"
+#include "inodeiter.h"
+#include "parallel.h"
+#include "utils.h"
+
+#define SNAPSHOT_DICT_SLOTS (SNAPSHOT_DICT_MAX * 2)
+
+// Width of each column as loaded, before packing
+static const uint8_t raw_width[SNAP_COLUMNS] = {
+    [SNAP_INO] = 4, [SNAP_MODE] = 2, [SNAP_UID] = 4, [SNAP_GID] = 4,
+    [SNAP_SIZE] = 8, [SNAP_ATIME] = 4, [SNAP_CTIME] = 4, [SNAP_MTIME] = 4,
+    [SNAP_DTIME] = 4, [SNAP_LINKS] = 2, [SNAP_FLAGS] = 4, [SNAP_BLOCKS] = 8
+};
+
+static const char *column_names[SNAP_COLUMNS] = {
+    [SNAP_INO] = "ino", [SNAP_MODE] = "mode", [SNAP_UID] = "uid", [SNAP_GID] = "gid",
+    [SNAP_SIZE] = "size", [SNAP_ATIME] = "atime", [SNAP_CTIME] = "ctime", [SNAP_MTIME] = "mtime",
+    [SNAP_DTIME] = "dtime", [SNAP_LINKS] = "links", [SNAP_FLAGS] = "flags", [SNAP_BLOCKS] = "blocks"
+};
+
+typedef struct {
+    snapshot_t *snap;           // Snapshot being built
+    uint32_t *group_rows;       // First row of each group, groups_count + 1 entries
+} snapshot_build_t;
+
+typedef struct {
+    inode_iter_t it;            // Reads one group at a time
+} snapshot_worker_t;
+
+const char *snapshot_column_name(snapshot_col_t col) {
+    return col < SNAP_COLUMNS ? column_names[col] : "?";
+}
+
+static uint64_t stored_get(const void *data, uint8_t width, uint32_t i) {
+    switch (width) {
+        case 1: return ((const uint8_t *)data)[i];
+        case 2: return ((const uint16_t *)data)[i];
+        case 4: return ((const uint32_t *)data)[i];
+        default: return ((const uint64_t *)data)[i];
+    }
+}
+
+static void stored_put(void *data, uint8_t width, uint32_t i, uint64_t value) {
+    switch (width) {
+        case 1: ((uint8_t *)data)[i] = (uint8_t)value; break;
+        case 2: ((uint16_t *)data)[i] = (uint16_t)value; break;
+        case 4: ((uint32_t *)data)[i] = (uint32_t)value; break;
+        default: ((uint64_t *)data)[i] = value; break;
+    }
+}
+
+static uint8_t width_for(uint64_t range) {
+    if (range <= UINT8_MAX) return 1;
+    if (range <= UINT16_MAX) return 2;
+    if (range <= UINT32_MAX) return 4;
+    return 8;
+}
+
+static int snapshot_worker_init(void *worker, void *arg) {
+    snapshot_worker_t *w = (snapshot_worker_t *)worker;
+    snapshot_build_t *build = (snapshot_build_t *)arg;
+
+    return inode_iter_init(&w->it, build->snap->fs_info, 0, 0, false);
+}
+
+static int snapshot_worker_finish(void *worker, void *arg) {
+    snapshot_worker_t *w = (snapshot_worker_t *)worker;
+    (void)arg;
+
+    inode_iter_cleanup(&w->it);
+    return 0;
+}
+
+// First pass: how many rows each group contributes, from the inode bitmaps alone
+static int snapshot_count_group(uint32_t group, void *worker, void *arg) {
+    snapshot_worker_t *w = (snapshot_worker_t *)worker;
+    snapshot_build_t *build = (snapshot_build_t *)arg;
+    fs_info_t *fs_info = build->snap->fs_info;
+
+    build->group_rows[group + 1] = 0;
+    if (fs_info->group_desc[group].bg_flags & EXT2_BG_INODE_UNINIT) {
+        return 0;
+    }
+    if (get_inode_bitmap(fs_info, group, w->it.bitmap) != 0) {
+        return -1;
+    }
+    build->group_rows[group + 1] = count_bitmap_bits(w->it.bitmap, fs_info->inodes_per_group);
+    return 0;
+}
+
+// Second pass: every group owns a fixed row range, so workers never touch the same rows
+static int snapshot_fill_group(uint32_t group, void *worker, void *arg) {
+    snapshot_worker_t *w = (snapshot_worker_t *)worker;
+    snapshot_build_t *build = (snapshot_build_t *)arg;
+    snapshot_column_t *cols = build->snap->columns;
+    uint32_t row = build->group_rows[group];
+    uint32_t end = build->group_rows[group + 1];
+    inode_iter_t *it = &w->it;
+    int rc;
+
+    inode_iter_reset(it, group, group + 1);
+    while ((rc = inode_iter_next(it)) > 0) {
+        for (uint32_t i = 0; i < it->count; i++) {
+            if (!inode_iter_used(it, i)) {
+                continue;
+            }
+            if (row >= end) {
+                // The bitmap changed between the passes
+                return -1;
+            }
+
+            const struct ext2_inode *inode = inode_iter_inode(it, i);
+            ((uint32_t *)cols[SNAP_INO].data)[row] = it->first_inode + i;
+            ((uint16_t *)cols[SNAP_MODE].data)[row] = inode->i_mode;
+            ((uint32_t *)cols[SNAP_UID].data)[row] = inode_uid(inode);
+            ((uint32_t *)cols[SNAP_GID].data)[row] = inode_gid(inode);
+            ((uint64_t *)cols[SNAP_SIZE].data)[row] = inode_file_size(inode);
+            ((uint32_t *)cols[SNAP_ATIME].data)[row] = inode->i_atime;
+            ((uint32_t *)cols[SNAP_CTIME].data)[row] = inode->i_ctime;
+            ((uint32_t *)cols[SNAP_MTIME].data)[row] = inode->i_mtime;
+            ((uint32_t *)cols[SNAP_DTIME].data)[row] = inode->i_dtime;
+            ((uint16_t *)cols[SNAP_LINKS].data)[row] = inode->i_links_count;
+            ((uint32_t *)cols[SNAP_FLAGS].data)[row] = inode->i_flags;
+            ((uint64_t *)cols[SNAP_BLOCKS].data)[row] = inode_block_count(inode);
+            row++;
+        }
+    }
+
+    return rc < 0 || row != end ? -1 : 0;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t dict_slot(uint64_t value) {
+    return (uint32_t)((value * 0x9E3779B97F4A7C15ull) >> 55) & (SNAPSHOT_DICT_SLOTS - 1);
+}
+
+// Collects the distinct values of a column, giving up past SNAPSHOT_DICT_MAX
+static bool build_dict(const snapshot_column_t *col, uint32_t rows, uint64_t *keys, bool *taken, uint32_t *count) {
+    *count = 0;
+    memset(taken, 0, SNAPSHOT_DICT_SLOTS * sizeof(bool));
+
+    for (uint32_t i = 0; i < rows; i++) {
+        uint64_t value = stored_get(col->data, col->width, i);
+        uint32_t slot = dict_slot(value);
+        while (taken[slot] && keys[slot] != value) {
+            slot = (slot + 1) & (SNAPSHOT_DICT_SLOTS - 1);
+        }
+        if (!taken[slot]) {
+            if (*count == SNAPSHOT_DICT_MAX) {
+                return false;
+            }
+            taken[slot] = true;
+            keys[slot] = value;
+            (*count)++;
+        }
+    }
+    return true;
+}
+
+// Replaces a freshly loaded column with the narrowest of frame-of-reference or dictionary packing
+static int snapshot_pack_column(uint32_t item, void *worker, void *arg) {
+    snapshot_build_t *build = (snapshot_build_t *)arg;
+    snapshot_t *snap = build->snap;
+    snapshot_column_t *col = &snap->columns[item];
+    uint32_t rows = snap->rows;
+    (void)worker;
+
+    col->zone_min = (uint64_t *)malloc((snap->chunks + 1) * sizeof(uint64_t));
+    col->zone_max = (uint64_t *)malloc((snap->chunks + 1) * sizeof(uint64_t));
+    if (!col->zone_min || !col->zone_max) {
+        return -1;
+    }
+
+    col->min = rows ? UINT64_MAX : 0;
+    col->max = 0;
+    for (uint32_t c = 0; c < snap->chunks; c++) {
+        uint32_t first = c * SNAPSHOT_CHUNK;
+        uint32_t last = first + SNAPSHOT_CHUNK < rows ? first + SNAPSHOT_CHUNK : rows;
+        uint64_t lo = UINT64_MAX, hi = 0;
+        for (uint32_t i = first; i < last; i++) {
+            uint64_t value = stored_get(col->data, col->width, i);
+            lo = value < lo ? value : lo;
+            hi = value > hi ? value : hi;
+        }
+        col->zone_min[c] = lo;
+        col->zone_max[c] = hi;
+        col->min = lo < col->min ? lo : col->min;
+        col->max = hi > col->max ? hi : col->max;
+    }
+
+    uint8_t width = width_for(col->max - col->min);
+    uint64_t keys[SNAPSHOT_DICT_SLOTS];
+    bool taken[SNAPSHOT_DICT_SLOTS];
+    uint32_t distinct = 0;
+
+    if (width > 1 && build_dict(col, rows, keys, taken, &distinct)) {
+        col->dict = (uint64_t *)malloc(distinct * sizeof(uint64_t));
+        uint8_t *codes = (uint8_t *)malloc(rows ? rows : 1);
+        if (!col->dict || !codes) {
+            free(codes);
+            return -1;
+        }
+
+        uint32_t n = 0;
+        for (uint32_t s = 0; s < SNAPSHOT_DICT_SLOTS; s++) {
+            if (taken[s]) {
+                col->dict[n++] = keys[s];
+            }
+        }
+        qsort(col->dict, distinct, sizeof(uint64_t), compare_u64);
+
+        // Map each slot to the value's position in the sorted dictionary
+        uint8_t slot_code[SNAPSHOT_DICT_SLOTS];
+        for (uint32_t s = 0; s < SNAPSHOT_DICT_SLOTS; s++) {
+            if (taken[s]) {
+                uint64_t *hit = (uint64_t *)bsearch(&keys[s], col->dict, distinct, sizeof(uint64_t), compare_u64);
+                slot_code[s] = (uint8_t)(hit - col->dict);
+            }
+        }
+        for (uint32_t i = 0; i < rows; i++) {
+            uint64_t value = stored_get(col->data, col->width, i);
+            uint32_t slot = dict_slot(value);
+            while (keys[slot] != value) {
+                slot = (slot + 1) & (SNAPSHOT_DICT_SLOTS - 1);
+            }
+            codes[i] = slot_code[slot];
+        }
+
+        free(col->data);
+        col->data = codes;
+        col->encoding = COLUMN_DICT;
+        col->dict_count = distinct;
+        col->width = 1;
+        return 0;
+    }
+
+    if (width < col->width || col->min != 0) {
+        void *packed = malloc((size_t)(rows ? rows : 1) * width);
+        if (!packed) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < rows; i++) {
+            stored_put(packed, width, i, stored_get(col->data, col->width, i) - col->min);
+        }
+        free(col->data);
+        col->data = packed;
+        col->width = width;
+        col->base = col->min;
+    }
+    return 0;
+}
+
+// Reads the inode tables once and keeps every allocated inode as one row of packed columns
+snapshot_t *snapshot_load(fs_info_t *fs_info, uint32_t threads, job_t *job) {
+    uint64_t generation = atomic_load(&fs_info->generation);
+    snapshot_t *snap = (snapshot_t *)calloc(1, sizeof(snapshot_t));
+    uint32_t *group_rows = (uint32_t *)calloc(fs_info->groups_count + 1, sizeof(uint32_t));
+    if (!snap || !group_rows) {
+        free(snap);
+        free(group_rows);
+        return NULL;
+    }
+    snap->fs_info = fs_info;
+    snap->generation = generation;
+
+    snapshot_build_t build = { snap, group_rows };
+    parallel_t p;
+    memset(&p, 0, sizeof(p));
+    p.items = fs_info->groups_count;
+    p.threads = threads;
+    p.worker_size = sizeof(snapshot_worker_t);
+    p.arg = &build;
+    p.init = snapshot_worker_init;
+    p.work = snapshot_count_group;
+    p.finish = snapshot_worker_finish;
+
+    int rc = parallel_run(&p);
+    for (uint32_t g = 0; rc == 0 && g < fs_info->groups_count; g++) {
+        group_rows[g + 1] += group_rows[g];
+    }
+
+    snap->rows = group_rows[fs_info->groups_count];
+    snap->chunks = (snap->rows + SNAPSHOT_CHUNK - 1) / SNAPSHOT_CHUNK;
+    for (int c = 0; rc == 0 && c < SNAP_COLUMNS; c++) {
+        snap->columns[c].encoding = COLUMN_PLAIN;
+        snap->columns[c].width = raw_width[c];
+        snap->columns[c].data = malloc((size_t)(snap->rows ? snap->rows : 1) * raw_width[c]);
+        if (!snap->columns[c].data) {
+            rc = -1;
+        }
+    }
+
+    if (rc == 0) {
+        p.job = job;
+        p.work = snapshot_fill_group;
+        rc = parallel_run(&p);
+    }
+    if (rc == 0 && !(job && job_is_cancelled(job))) {
+        memset(&p, 0, sizeof(p));
+        p.items = SNAP_COLUMNS;
+        p.threads = threads;
+        p.arg = &build;
+        p.work = snapshot_pack_column;
+        rc = parallel_run(&p);
+    }
+
+    free(group_rows);
+    if (rc != 0 || (job && job_is_cancelled(job))) {
+        snapshot_free(snap);
+        return NULL;
+    }
+    return snap;
+}
+
+void snapshot_free(snapshot_t *snap) {
+    if (!snap) {
+        return;
+    }
+
+    for (int c = 0; c < SNAP_COLUMNS; c++) {
+        free(snap->columns[c].data);
+        free(snap->columns[c].dict);
+        free(snap->columns[c].zone_min);
+        free(snap->columns[c].zone_max);
+    }
+    free(snap);
+}
+
+uint64_t snapshot_value(const snapshot_t *snap, snapshot_col_t col, uint32_t row) {
+    const snapshot_column_t *c = &snap->columns[col];
+    uint64_t stored = stored_get(c->data, c->width, row);
+
+    return c->encoding == COLUMN_DICT ? c->dict[stored] : c->base + stored;
+}
+
+#define DECODE_LOOP(type, expr)                                 \
+    do {                                                        \
+        const type *src = (const type *)c->data + first;        \
+        for (uint32_t i = 0; i < count; i++) {                  \
+            out[i] = (expr);                                    \
+        }                                                       \
+    } while (0)
+
+// Unpacks count values starting at row first. The branch on the encoding is taken once per
+// batch, so each inner loop is a plain widening copy the compiler can vectorise.
+void snapshot_decode(const snapshot_t *snap, snapshot_col_t col, uint32_t first, uint32_t count, uint64_t *out) {
+    const snapshot_column_t *c = &snap->columns[col];
+    uint64_t base = c->base;
+
+    if (c->encoding == COLUMN_DICT) {
+        const uint64_t *dict = c->dict;
+        DECODE_LOOP(uint8_t, dict[src[i]]);
+        return;
+    }
+
+    switch (c->width) {
+        case 1: DECODE_LOOP(uint8_t, base + src[i]); break;
+        case 2: DECODE_LOOP(uint16_t, base + src[i]); break;
+        case 4: DECODE_LOOP(uint32_t, base + src[i]); break;
+        default: DECODE_LOOP(uint64_t, base + src[i]); break;
+    }
+}
+
+// Bytes held by the packed columns; unpacked receives what the same rows take at their natural widths
+size_t snapshot_memory(const snapshot_t *snap, size_t *unpacked) {
+    size_t packed = 0, raw = 0;
+
+    for (int c = 0; c < SNAP_COLUMNS; c++) {
+        const snapshot_column_t *col = &snap->columns[c];
+        packed += (size_t)snap->rows * col->width + col->dict_count * sizeof(uint64_t) +
+                  2 * (size_t)snap->chunks * sizeof(uint64_t);
+        raw += (size_t)snap->rows * raw_width[c];
+    }
+    if (unpacked) {
+        *unpacked = raw;
+    }
+    return packed;
+}
+
+snapshot_cache_t *snapshot_cache_init(fs_info_t *fs_info) {
+    snapshot_cache_t *cache = (snapshot_cache_t *)calloc(1, sizeof(snapshot_cache_t));
+    if (!cache) {
+        return NULL;
+    }
+
+    cache->fs_info = fs_info;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+void snapshot_cache_cleanup(snapshot_cache_t *cache) {
+    if (!cache) {
+        return;
+    }
+
+    snapshot_free(cache->snap);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+// The cached snapshot while nothing was written since it was taken, otherwise a fresh one
+// that replaces it. Every snapshot returned must be given back with snapshot_release().
+snapshot_t *snapshot_acquire(snapshot_cache_t *cache, job_t *job) {
+    pthread_mutex_lock(&cache->lock);
+    snapshot_t *snap = cache->snap;
+    if (snap && snap->generation == atomic_load(&cache->fs_info->generation)) {
+        snap->refs++;
+        pthread_mutex_unlock(&cache->lock);
+        return snap;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    // Read without the lock so holders of the old snapshot are not held up
+    snap = snapshot_load(cache->fs_info, 0, job);
+    if (!snap) {
+        return NULL;
+    }
+    snap->refs = 2;
+
+    pthread_mutex_lock(&cache->lock);
+    snapshot_t *old = cache->snap;
+    cache->snap = snap;
+    if (old && --old->refs == 0) {
+        snapshot_free(old);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return snap;
+}
+
+void snapshot_release(snapshot_cache_t *cache, snapshot_t *snap) {
+    if (!snap) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    bool last = --snap->refs == 0;
+    pthread_mutex_unlock(&cache->lock);
+    if (last) {
+        snapshot_free(snap);
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "analyzer.h"
+#include "job.h"
+
+#define SNAPSHOT_CHUNK 1024         // Rows per zone map entry and per batch of the query engine
+#define SNAPSHOT_DICT_MAX 256       // Columns with at most this many distinct values get one byte codes
+
+typedef enum {
+    SNAP_INO,                   // Inode number, rows are sorted by it
+    SNAP_MODE,                  // i_mode, type and permissions
+    SNAP_UID,                   // Owner, high bits included
+    SNAP_GID,                   // Group, high bits included
+    SNAP_SIZE,                  // Size in bytes
+    SNAP_ATIME,                 // Access time
+    SNAP_CTIME,                 // Change time
+    SNAP_MTIME,                 // Modification time
+    SNAP_DTIME,                 // Deletion time
+    SNAP_LINKS,                 // Hard link count
+    SNAP_FLAGS,                 // i_flags
+    SNAP_BLOCKS,                // Allocated 512-byte sectors
+    SNAP_COLUMNS
+} snapshot_col_t;
+
+typedef enum {
+    COLUMN_PLAIN,               // value = base + stored
+    COLUMN_DICT                 // value = dict[stored], dict is sorted so codes keep the value order
+} column_encoding_t;
+
+typedef struct {
+    column_encoding_t encoding; // How stored values map to real values
+    uint8_t width;              // Bytes per stored value: 1, 2, 4 or 8
+    uint64_t base;              // Frame of reference of plain columns
+    uint64_t *dict;             // Distinct values of dictionary columns
+    uint32_t dict_count;        // Entries in dict
+    void *data;                 // Packed values, one per row
+    uint64_t min;               // Smallest value in the column
+    uint64_t max;               // Largest value in the column
+    uint64_t *zone_min;         // Smallest value per SNAPSHOT_CHUNK rows
+    uint64_t *zone_max;         // Largest value per SNAPSHOT_CHUNK rows
+} snapshot_column_t;
+
+typedef struct {
+    fs_info_t *fs_info;         // Filesystem the snapshot was taken from
+    uint32_t rows;              // Allocated inodes captured
+    uint32_t chunks;            // Zone map entries per column
+    snapshot_column_t columns[SNAP_COLUMNS]; // One array per inode field
+    uint64_t generation;        // fs_info->generation before the tables were read
+    uint32_t refs;              // Holders of a cached snapshot, the cache included
+} snapshot_t;
+
+// Keeps the last snapshot of a filesystem so later queries run from memory. A snapshot
+// older than the last write is read again on the next acquire.
+typedef struct {
+    fs_info_t *fs_info;         // Filesystem to snapshot
+    pthread_mutex_t lock;       // Protects snap and the reference counts
+    snapshot_t *snap;           // Latest snapshot, NULL before the first acquire
+} snapshot_cache_t;
+
+snapshot_t *snapshot_load(fs_info_t *fs_info, uint32_t threads, job_t *job);
+
+void snapshot_free(snapshot_t *snap);
+
+const char *snapshot_column_name(snapshot_col_t col);
+
+uint64_t snapshot_value(const snapshot_t *snap, snapshot_col_t col, uint32_t row);
+
+void snapshot_decode(const snapshot_t *snap, snapshot_col_t col, uint32_t first, uint32_t count, uint64_t *out);
+
+size_t snapshot_memory(const snapshot_t *snap, size_t *unpacked);
+
+snapshot_cache_t *snapshot_cache_init(fs_info_t *fs_info);
+
+void snapshot_cache_cleanup(snapshot_cache_t *cache);
+
+snapshot_t *snapshot_acquire(snapshot_cache_t *cache, job_t *job);
+
+void snapshot_release(snapshot_cache_t *cache, snapshot_t *snap);
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,424 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "stats.h"
+#include "inodeiter.h"
+#include "parallel.h"
+#include "utils.h"
+
+#define STATS_OWNER_INITIAL 64
+#define DAY (24 * 3600)
+
+typedef struct {
+    inode_iter_t it;            // Reads one group at a time
+    stats_hist_t hist;          // Partial result of this worker
+} stats_worker_t;
+
+typedef struct {
+    fs_info_t *fs_info;         // Filesystem being scanned
+    fs_stats_t *stats;          // Result the workers merge into
+} stats_run_t;
+
+static const time_t age_limits[STATS_AGE_BUCKETS - 2] = {
+    DAY, 7 * DAY, 30 * DAY, 91 * DAY, 365 * DAY, 2 * 365 * DAY, 5 * 365 * DAY
+};
+
+static const char *age_labels[STATS_AGE_BUCKETS] = {
+    "future", "< 1 day", "< 1 week", "< 1 month", "< 3 months", "< 1 year", "< 2 years", "< 5 years", ">= 5 years"
+};
+
+static const char *type_labels[STATS_TYPES] = {
+    "reg", "dir", "lnk", "chr", "blk", "fifo", "sock", "unknown"
+};
+
+static int owner_map_init(stats_owner_map_t *map, uint32_t capacity) {
+    map->slots = (stats_owner_t *)calloc(capacity, sizeof(stats_owner_t));
+    map->capacity = map->slots ? capacity : 0;
+    map->count = 0;
+    return map->slots ? 0 : -1;
+}
+
+static stats_owner_t *owner_map_find(stats_owner_map_t *map, uint32_t id) {
+    uint32_t slot = (id * 2654435761u) & (map->capacity - 1);
+
+    while (map->slots[slot].used && map->slots[slot].id != id) {
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    return &map->slots[slot];
+}
+
+// Adds usage to an owner, doubling the table once it is 70% full
+static int owner_map_add(stats_owner_map_t *map, uint32_t id, uint64_t inodes, uint64_t bytes) {
+    if ((map->count + 1) * 10 > map->capacity * 7) {
+        stats_owner_map_t grown;
+        if (owner_map_init(&grown, map->capacity * 2) != 0) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < map->capacity; i++) {
+            if (map->slots[i].used) {
+                *owner_map_find(&grown, map->slots[i].id) = map->slots[i];
+                grown.count++;
+            }
+        }
+        free(map->slots);
+        *map = grown;
+    }
+
+    stats_owner_t *owner = owner_map_find(map, id);
+    if (!owner->used) {
+        owner->used = true;
+        owner->id = id;
+        map->count++;
+    }
+    owner->inodes += inodes;
+    owner->bytes += bytes;
+    return 0;
+}
+
+int stats_hist_init(stats_hist_t *hist) {
+    memset(hist, 0, sizeof(*hist));
+    if (owner_map_init(&hist->uids, STATS_OWNER_INITIAL) != 0 ||
+        owner_map_init(&hist->gids, STATS_OWNER_INITIAL) != 0) {
+        stats_hist_free(hist);
+        return -1;
+    }
+    return 0;
+}
+
+void stats_hist_free(stats_hist_t *hist) {
+    free(hist->uids.slots);
+    free(hist->gids.slots);
+    hist->uids.slots = NULL;
+    hist->gids.slots = NULL;
+}
+
+uint32_t stats_type_index(uint16_t mode) {
+    if (S_ISREG(mode)) return 0;
+    if (S_ISDIR(mode)) return 1;
+    if (S_ISLNK(mode)) return 2;
+    if (S_ISCHR(mode)) return 3;
+    if (S_ISBLK(mode)) return 4;
+    if (S_ISFIFO(mode)) return 5;
+    if (S_ISSOCK(mode)) return 6;
+    return 7;
+}
+
+// Bucket 0 holds empty files, bucket b > 0 sizes in [2^(b-1), 2^b)
+uint32_t stats_size_bucket(uint64_t size) {
+    return size ? 64 - (uint32_t)__builtin_clzll(size) : 0;
+}
+
+static uint32_t link_bucket(uint32_t links) {
+    return links < 4 ? links : 33 - (uint32_t)__builtin_clz(links);
+}
+
+static uint32_t age_bucket(time_t now, time_t mtime) {
+    if (mtime > now) {
+        return 0;
+    }
+    for (uint32_t b = 0; b < STATS_AGE_BUCKETS - 2; b++) {
+        if (now - mtime < age_limits[b]) {
+            return b + 1;
+        }
+    }
+    return STATS_AGE_BUCKETS - 1;
+}
+
+// Ownership counting only fails when the owner table cannot grow; the histograms are still updated
+void stats_hist_add(stats_hist_t *hist, const struct ext2_inode *inode, time_t now) {
+    uint64_t size = inode_file_size(inode);
+    uint32_t type = stats_type_index(inode->i_mode);
+    uint32_t sb = stats_size_bucket(size);
+    uint32_t ab = age_bucket(now, (time_t)inode->i_mtime);
+
+    hist->inodes++;
+    hist->bytes += size;
+    hist->sectors += inode_block_count(inode);
+    hist->size_count[sb]++;
+    hist->size_bytes[sb] += size;
+    hist->age_count[ab]++;
+    hist->age_bytes[ab] += size;
+    hist->link_count[link_bucket(inode->i_links_count)]++;
+    hist->type_count[type]++;
+    hist->type_bytes[type] += size;
+    owner_map_add(&hist->uids, inode_uid(inode), 1, size);
+    owner_map_add(&hist->gids, inode_gid(inode), 1, size);
+}
+
+int stats_hist_merge(stats_hist_t *into, const stats_hist_t *from) {
+    into->inodes += from->inodes;
+    into->bytes += from->bytes;
+    into->sectors += from->sectors;
+    for (uint32_t i = 0; i < STATS_SIZE_BUCKETS; i++) {
+        into->size_count[i] += from->size_count[i];
+        into->size_bytes[i] += from->size_bytes[i];
+    }
+    for (uint32_t i = 0; i < STATS_AGE_BUCKETS; i++) {
+        into->age_count[i] += from->age_count[i];
+        into->age_bytes[i] += from->age_bytes[i];
+    }
+    for (uint32_t i = 0; i < STATS_LINK_BUCKETS; i++) {
+        into->link_count[i] += from->link_count[i];
+    }
+    for (uint32_t i = 0; i < STATS_TYPES; i++) {
+        into->type_count[i] += from->type_count[i];
+        into->type_bytes[i] += from->type_bytes[i];
+    }
+
+    for (uint32_t i = 0; i < from->uids.capacity; i++) {
+        const stats_owner_t *o = &from->uids.slots[i];
+        if (o->used && owner_map_add(&into->uids, o->id, o->inodes, o->bytes) != 0) {
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < from->gids.capacity; i++) {
+        const stats_owner_t *o = &from->gids.slots[i];
+        if (o->used && owner_map_add(&into->gids, o->id, o->inodes, o->bytes) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+const char *stats_type_label(uint32_t index) {
+    return index < STATS_TYPES ? type_labels[index] : "?";
+}
+
+const char *stats_age_label(uint32_t bucket) {
+    return bucket < STATS_AGE_BUCKETS ? age_labels[bucket] : "?";
+}
+
+// Lower bound of a size bucket, "0" for empty files
+void stats_size_label(uint32_t bucket, char *buffer, size_t buffer_size) {
+    if (bucket == 0) {
+        snprintf(buffer, buffer_size, "0");
+        return;
+    }
+    format_value(1ull << (bucket - 1), buffer, buffer_size, true);
+}
+
+void stats_link_label(uint32_t bucket, char *buffer, size_t buffer_size) {
+    if (bucket < 4) {
+        snprintf(buffer, buffer_size, "%u", bucket);
+    } else {
+        snprintf(buffer, buffer_size, "%u-%u", 1u << (bucket - 2), (1u << (bucket - 1)) - 1);
+    }
+}
+
+static int compare_owner_bytes(const void *a, const void *b) {
+    const stats_owner_t *x = *(const stats_owner_t *const *)a;
+    const stats_owner_t *y = *(const stats_owner_t *const *)b;
+
+    if (x->bytes != y->bytes) {
+        return x->bytes < y->bytes ? 1 : -1;
+    }
+    return x->id < y->id ? -1 : x->id > y->id;
+}
+
+// Fills out with up to max owners, largest usage first, and returns how many were written
+uint32_t stats_owner_top(const stats_owner_map_t *map, const stats_owner_t **out, uint32_t max) {
+    const stats_owner_t **all = (const stats_owner_t **)malloc((map->count ? map->count : 1) * sizeof(*all));
+    uint32_t n = 0;
+
+    if (!all) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < map->capacity; i++) {
+        if (map->slots[i].used) {
+            all[n++] = &map->slots[i];
+        }
+    }
+    qsort(all, n, sizeof(*all), compare_owner_bytes);
+
+    n = n < max ? n : max;
+    memcpy(out, all, n * sizeof(*all));
+    free(all);
+    return n;
+}
+
+static int stats_worker_init(void *worker, void *arg) {
+    stats_worker_t *w = (stats_worker_t *)worker;
+    stats_run_t *run = (stats_run_t *)arg;
+
+    if (inode_iter_init(&w->it, run->fs_info, 0, 0, false) != 0) {
+        return -1;
+    }
+    if (stats_hist_init(&w->hist) != 0) {
+        inode_iter_cleanup(&w->it);
+        return -1;
+    }
+    return 0;
+}
+
+static int stats_group(uint32_t group, void *worker, void *arg) {
+    stats_worker_t *w = (stats_worker_t *)worker;
+    stats_run_t *run = (stats_run_t *)arg;
+    inode_iter_t *it = &w->it;
+    uint32_t used = 0;
+    int rc;
+
+    inode_iter_reset(it, group, group + 1);
+    while ((rc = inode_iter_next(it)) > 0) {
+        for (uint32_t i = 0; i < it->count; i++) {
+            if (inode_iter_used(it, i)) {
+                stats_hist_add(&w->hist, inode_iter_inode(it, i), run->stats->now);
+                used++;
+            }
+        }
+    }
+
+    // Each group is visited by exactly one worker, so no locking is needed
+    run->stats->group_inodes[group] = used;
+    return rc;
+}
+
+// Runs serially once all workers have stopped
+static int stats_worker_finish(void *worker, void *arg) {
+    stats_worker_t *w = (stats_worker_t *)worker;
+    stats_run_t *run = (stats_run_t *)arg;
+
+    int rc = stats_hist_merge(&run->stats->total, &w->hist);
+    stats_hist_free(&w->hist);
+    inode_iter_cleanup(&w->it);
+    return rc;
+}
+
+// Reads every inode table once on the group pool and merges the per-worker histograms
+fs_stats_t *stats_collect(fs_info_t *fs_info, uint32_t threads, job_t *job) {
+    fs_stats_t *stats = (fs_stats_t *)calloc(1, sizeof(fs_stats_t));
+    if (!stats) {
+        return NULL;
+    }
+
+    stats->groups = fs_info->groups_count;
+    stats->now = time(NULL);
+    stats->group_inodes = (uint32_t *)calloc(stats->groups, sizeof(uint32_t));
+    stats->group_blocks = (uint32_t *)calloc(stats->groups, sizeof(uint32_t));
+    if (!stats->group_inodes || !stats->group_blocks || stats_hist_init(&stats->total) != 0) {
+        stats_free(stats);
+        return NULL;
+    }
+
+    for (uint32_t g = 0; g < stats->groups; g++) {
+        uint32_t blocks = group_block_count(fs_info, g);
+        uint32_t free_blocks = fs_info->group_desc[g].bg_free_blocks_count;
+        stats->group_blocks[g] = free_blocks < blocks ? blocks - free_blocks : 0;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    stats_run_t run = { fs_info, stats };
+    parallel_t p;
+    memset(&p, 0, sizeof(p));
+    p.items = fs_info->groups_count;
+    p.threads = threads;
+    p.worker_size = sizeof(stats_worker_t);
+    p.arg = &run;
+    p.job = job;
+    p.init = stats_worker_init;
+    p.work = stats_group;
+    p.finish = stats_worker_finish;
+
+    if (parallel_run(&p) != 0 || job_is_cancelled(job)) {
+        stats_free(stats);
+        return NULL;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return stats;
+}
+
+void stats_free(fs_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+
+    stats_hist_free(&stats->total);
+    free(stats->group_inodes);
+    free(stats->group_blocks);
+    free(stats);
+}
+
+static void json_u64_array(FILE *out, const char *name, const uint64_t *values, uint32_t count) {
+    fprintf(out, "  \"%s\": [", name);
+    for (uint32_t i = 0; i < count; i++) {
+        fprintf(out, "%s%lu", i ? ", " : "", (unsigned long)values[i]);
+    }
+    fprintf(out, "],\n");
+}
+
+static void json_owners(FILE *out, const char *name, const stats_owner_map_t *map) {
+    const stats_owner_t **top = (const stats_owner_t **)malloc((map->count ? map->count : 1) * sizeof(*top));
+    uint32_t n = top ? stats_owner_top(map, top, map->count) : 0;
+
+    fprintf(out, "  \"%s\": [", name);
+    for (uint32_t i = 0; i < n; i++) {
+        fprintf(out, "%s\n    {\"id\": %u, \"inodes\": %lu, \"bytes\": %lu}", i ? "," : "",
+                top[i]->id, (unsigned long)top[i]->inodes, (unsigned long)top[i]->bytes);
+    }
+    fprintf(out, "%s],\n", n ? "\n  " : "");
+    free(top);
+}
+
+// Writes the statistics as one JSON object. Bucket i of size_* covers [2^(i-1), 2^i) bytes,
+// bucket 0 holds empty files.
+void stats_write_json(const fs_stats_t *stats, FILE *out) {
+    const stats_hist_t *h = &stats->total;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"time\": %ld,\n", (long)stats->now);
+    fprintf(out, "  \"seconds\": %.3f,\n", stats->seconds);
+    fprintf(out, "  \"inodes\": %lu,\n", (unsigned long)h->inodes);
+    fprintf(out, "  \"bytes\": %lu,\n", (unsigned long)h->bytes);
+    fprintf(out, "  \"sectors\": %lu,\n", (unsigned long)h->sectors);
+
+    fprintf(out, "  \"types\": {");
+    for (uint32_t i = 0; i < STATS_TYPES; i++) {
+        fprintf(out, "%s\"%s\": {\"inodes\": %lu, \"bytes\": %lu}", i ? ", " : "", type_labels[i],
+                (unsigned long)h->type_count[i], (unsigned long)h->type_bytes[i]);
+    }
+    fprintf(out, "},\n");
+
+    json_u64_array(out, "size_count", h->size_count, STATS_SIZE_BUCKETS);
+    json_u64_array(out, "size_bytes", h->size_bytes, STATS_SIZE_BUCKETS);
+
+    fprintf(out, "  \"age_labels\": [");
+    for (uint32_t i = 0; i < STATS_AGE_BUCKETS; i++) {
+        fprintf(out, "%s\"%s\"", i ? ", " : "", age_labels[i]);
+    }
+    fprintf(out, "],\n");
+    json_u64_array(out, "age_count", h->age_count, STATS_AGE_BUCKETS);
+    json_u64_array(out, "age_bytes", h->age_bytes, STATS_AGE_BUCKETS);
+    json_u64_array(out, "link_count", h->link_count, STATS_LINK_BUCKETS);
+
+    json_owners(out, "uids", &h->uids);
+    json_owners(out, "gids", &h->gids);
+
+    fprintf(out, "  \"groups\": [");
+    for (uint32_t g = 0; g < stats->groups; g++) {
+        fprintf(out, "%s\n    {\"group\": %u, \"inodes\": %u, \"blocks\": %u}", g ? "," : "",
+                g, stats->group_inodes[g], stats->group_blocks[g]);
+    }
+    fprintf(out, "%s]\n}\n", stats->groups ? "\n  " : "");
+}
+
+// Job body: collects statistics of the filesystem in the job_slot_t passed as arg and publishes them there
+int stats_job(job_t *job, void *arg) {
+    job_slot_t *slot = (job_slot_t *)arg;
+
+    fs_stats_t *stats = stats_collect((fs_info_t *)slot->source, 0, job);
+
+    if (stats) {
+        char size_str[32];
+        format_value(stats->total.bytes, size_str, sizeof(size_str), true);
+        job_printf(job, "%lu inode(s), %s in %.2f s", (unsigned long)stats->total.inodes, size_str, stats->seconds);
+    } else {
+        job_printf(job, "%s", job_is_cancelled(job) ? "Statistics cancelled" : "Statistics failed");
+    }
+    // The slot owns the result from here on and a later job may free it, so this is the last use
+    job_slot_finish(slot, job, stats);
+    return stats || job_is_cancelled(job) ? 0 : -1;
+}
@@ -0,0 +1,87 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <ext2fs/ext2_fs.h>
+#include "analyzer.h"
+#include "job.h"
+
+#define STATS_SIZE_BUCKETS 65       // 0, then [2^(b-1), 2^b) for b = 1..64
+#define STATS_LINK_BUCKETS 18       // 0, 1, 2, 3, then [2^(b-2), 2^(b-1)) up to 65535
+#define STATS_AGE_BUCKETS 9         // Future, then the ranges of stats_age_label
+#define STATS_TYPES 8               // reg, dir, lnk, chr, blk, fifo, sock, unknown
+
+typedef struct {
+    uint32_t id;                // uid or gid
+    bool used;                  // Slot holds an entry
+    uint64_t inodes;            // Inodes owned
+    uint64_t bytes;             // Sum of their sizes
+} stats_owner_t;
+
+typedef struct {
+    stats_owner_t *slots;       // Open addressing table
+    uint32_t capacity;          // Slots allocated, a power of two
+    uint32_t count;             // Slots in use
+} stats_owner_map_t;
+
+// Everything that is summed per inode. Partial results of workers merge by addition.
+typedef struct {
+    uint64_t inodes;                            // Allocated inodes seen
+    uint64_t bytes;                             // Sum of file sizes
+    uint64_t sectors;                           // Sum of allocated 512-byte sectors
+    uint64_t size_count[STATS_SIZE_BUCKETS];    // Inodes per size bucket
+    uint64_t size_bytes[STATS_SIZE_BUCKETS];    // Bytes per size bucket
+    uint64_t age_count[STATS_AGE_BUCKETS];      // Inodes per mtime age bucket
+    uint64_t age_bytes[STATS_AGE_BUCKETS];      // Bytes per mtime age bucket
+    uint64_t link_count[STATS_LINK_BUCKETS];    // Inodes per link count bucket
+    uint64_t type_count[STATS_TYPES];           // Inodes per file type
+    uint64_t type_bytes[STATS_TYPES];           // Bytes per file type
+    stats_owner_map_t uids;                     // Usage per owner
+    stats_owner_map_t gids;                     // Usage per group
+} stats_hist_t;
+
+typedef struct {
+    stats_hist_t total;         // Merged histograms
+    time_t now;                 // Reference time for ages
+    double seconds;             // Wall time the collection took
+    uint32_t groups;            // Number of block groups
+    uint32_t *group_inodes;     // Allocated inodes per group
+    uint32_t *group_blocks;     // Allocated blocks per group, from the descriptors
+} fs_stats_t;
+
+int stats_hist_init(stats_hist_t *hist);
+
+void stats_hist_free(stats_hist_t *hist);
+
+void stats_hist_add(stats_hist_t *hist, const struct ext2_inode *inode, time_t now);
+
+int stats_hist_merge(stats_hist_t *into, const stats_hist_t *from);
+
+uint32_t stats_type_index(uint16_t mode);
+
+uint32_t stats_size_bucket(uint64_t size);
+
+const char *stats_type_label(uint32_t index);
+
+const char *stats_age_label(uint32_t bucket);
+
+void stats_size_label(uint32_t bucket, char *buffer, size_t buffer_size);
+
+void stats_link_label(uint32_t bucket, char *buffer, size_t buffer_size);
+
+uint32_t stats_owner_top(const stats_owner_map_t *map, const stats_owner_t **out, uint32_t max);
+
+fs_stats_t *stats_collect(fs_info_t *fs_info, uint32_t threads, job_t *job);
+
+void stats_free(fs_stats_t *stats);
+
+void stats_write_json(const fs_stats_t *stats, FILE *out);
+
+int stats_job(job_t *job, void *arg);
+
+#endif /* STATS_H */
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "topn.h"
+
+int topn_init(topn_t *top, uint32_t capacity) {
+    top->heap = (topn_entry_t *)malloc((capacity ? capacity : 1) * sizeof(topn_entry_t));
+    top->capacity = top->heap ? capacity : 0;
+    top->count = 0;
+    return top->heap ? 0 : -1;
+}
+
+void topn_free(topn_t *top) {
+    free(top->heap);
+    top->heap = NULL;
+    top->capacity = 0;
+    top->count = 0;
+}
+
+// Smaller key first, ties broken by id so the kept set does not depend on arrival order
+static bool entry_less(const topn_entry_t *a, const topn_entry_t *b) {
+    return a->key != b->key ? a->key < b->key : a->id > b->id;
+}
+
+static void sift_down(topn_entry_t *heap, uint32_t count, uint32_t i) {
+    topn_entry_t item = heap[i];
+
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count && entry_less(&heap[child + 1], &heap[child])) {
+            child++;
+        }
+        if (!entry_less(&heap[child], &item)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = item;
+}
+
+// Offers an entry. Returns whether it was kept, possibly pushing out the smallest one.
+bool topn_push(topn_t *top, uint64_t key, uint32_t id, uint32_t aux) {
+    topn_entry_t item = { key, id, aux };
+
+    if (top->capacity == 0) {
+        return false;
+    }
+
+    if (top->count < top->capacity) {
+        uint32_t i = top->count++;
+        while (i > 0 && entry_less(&item, &top->heap[(i - 1) / 2])) {
+            top->heap[i] = top->heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        top->heap[i] = item;
+        return true;
+    }
+
+    if (!entry_less(&top->heap[0], &item)) {
+        return false;
+    }
+    top->heap[0] = item;
+    sift_down(top->heap, top->count, 0);
+    return true;
+}
+
+void topn_merge(topn_t *into, const topn_t *from) {
+    for (uint32_t i = 0; i < from->count; i++) {
+        topn_push(into, from->heap[i].key, from->heap[i].id, from->heap[i].aux);
+    }
+}
+
+// Sorts the kept entries in place, largest first, and returns their number. The heap is
+// consumed: push nothing after this.
+uint32_t topn_sorted(topn_t *top) {
+    uint32_t n = top->count;
+
+    // Heap sort on the min-heap leaves the array in descending order
+    for (uint32_t end = n; end > 1; end--) {
+        topn_entry_t smallest = top->heap[0];
+        top->heap[0] = top->heap[end - 1];
+        top->heap[end - 1] = smallest;
+        sift_down(top->heap, end - 1, 0);
+    }
+    return n;
+}
@@ -0,0 +1,33 @@
+#ifndef TOPN_H
+#define TOPN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint64_t key;               // Ranking value, largest kept
+    uint32_t id;                // Usually an inode number
+    uint32_t aux;               // Caller data carried along, e.g. the parent directory
+} topn_entry_t;
+
+// Keeps the capacity entries with the largest keys seen so far in a min-heap,
+// so memory does not grow with the number of entries offered
+typedef struct {
+    topn_entry_t *heap;         // heap[0] is the smallest entry kept
+    uint32_t capacity;          // Entries kept at most
+    uint32_t count;             // Entries currently kept
+} topn_t;
+
+int topn_init(topn_t *top, uint32_t capacity);
+
+void topn_free(topn_t *top);
+
+bool topn_push(topn_t *top, uint64_t key, uint32_t id, uint32_t aux);
+
+void topn_merge(topn_t *into, const topn_t *from);
+
+uint32_t topn_sorted(topn_t *top);
+
+#endif /* TOPN_H */
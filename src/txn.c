@@ -0,0 +1,577 @@
+#define _XOPEN_SOURCE 700   // realpath()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "txn.h"
+
+#define TXN_LOG_MAGIC "FSAINTNT"
+#define TXN_COMMIT_MAGIC "FSACOMIT"
+#define TXN_LOG_VERSION 1
+
+// On-disk intent log: header, count x (record + data), commit trailer.
+// The trailer is written last, so a log without a valid trailer was never acted on.
+typedef struct {
+    char magic[8];              // TXN_LOG_MAGIC
+    uint32_t version;           // TXN_LOG_VERSION
+    uint32_t count;             // Number of records
+    uint64_t payload;           // Bytes of records and data following the header
+} txn_log_header_t;
+
+typedef struct {
+    uint64_t offset;            // Device offset to write
+    uint32_t length;            // Bytes of data following the record
+    uint32_t reserved;
+} txn_log_record_t;
+
+typedef struct {
+    char magic[8];              // TXN_COMMIT_MAGIC
+    uint64_t checksum;          // FNV-1a of header, records and data
+} txn_log_commit_t;
+
+static uint64_t txn_checksum(uint64_t hash, const void *data, size_t length) {
+    const uint8_t *p = (const uint8_t *)data;
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+#define TXN_CHECKSUM_SEED 14695981039346656037ULL
+
+// Puts the directory of the intent logs into dir, creating it when missing. The logs are
+// replayed onto the device, so the directory must belong to us and be closed to everyone else.
+int txn_log_dir(char *dir, size_t size) {
+    const char *home = getenv("HOME");
+    int len = geteuid() == 0 || !home || !*home ? snprintf(dir, size, "%s", TXN_LOG_DIR)
+                                                : snprintf(dir, size, "%s/%s", home, TXN_USER_LOG_DIR);
+    if (len < 0 || (size_t)len >= size) {
+        return -1;
+    }
+
+    struct stat st;
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    if (lstat(dir, &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077)) {
+        return -1;
+    }
+    return 0;
+}
+
+char *txn_log_path(const char *device_path) {
+    char dir[PATH_MAX];
+    char resolved[PATH_MAX];
+    const char *name = realpath(device_path, resolved) ? resolved : device_path;
+
+    while (*name == '/') {
+        name++;
+    }
+    if (txn_log_dir(dir, sizeof(dir)) != 0) {
+        return NULL;
+    }
+
+    size_t size = strlen(dir) + strlen("/fs_analyzer_.intent") + strlen(name) + 1;
+    char *path = (char *)malloc(size);
+    if (!path) {
+        return NULL;
+    }
+
+    snprintf(path, size, "%s/fs_analyzer_%s.intent", dir, name);
+    for (char *p = path + strlen(dir) + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '_';
+        }
+    }
+    return path;
+}
+
+// The log belongs to whatever the writes land in, so an overlay session never
+// replays into the device itself
+static const char *txn_target_path(const fs_info_t *fs_info) {
+    return fs_info->overlay ? fs_info->overlay->path : fs_info->device_path;
+}
+
+static void txn_sync_log_dir(const char *path) {
+    char dir[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    int len = slash ? (int)(slash - path) : 0;
+
+    snprintf(dir, sizeof(dir), "%.*s", len, path);
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+static int txn_write_all(int fd, const void *data, size_t length) {
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t written = write(fd, (const uint8_t *)data + done, length - done);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return -1;
+        }
+        done += written;
+    }
+    return 0;
+}
+
+static int txn_read_all(int fd, void *data, size_t length) {
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t got = read(fd, (uint8_t *)data + done, length - done);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return -1;
+        }
+        done += got;
+    }
+    return 0;
+}
+
+txn_t *txn_begin(fs_info_t *fs_info) {
+    if (!fs_info) {
+        return NULL;
+    }
+
+    txn_t *txn = (txn_t *)calloc(1, sizeof(txn_t));
+    if (!txn) {
+        return NULL;
+    }
+
+    txn->fs_info = fs_info;
+    return txn;
+}
+
+void txn_abort(txn_t *txn) {
+    if (!txn) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < txn->count; i++) {
+        free(txn->writes[i].data);
+    }
+    free(txn->writes);
+    free(txn);
+}
+
+int txn_stage(txn_t *txn, uint64_t offset, const void *data, size_t length) {
+    if (!txn || !data || length == 0 || length > UINT32_MAX ||
+        offset + length > fs_total_bytes(txn->fs_info)) {
+        return -1;
+    }
+
+    if (txn->count == txn->capacity) {
+        uint32_t capacity = txn->capacity ? txn->capacity * 2 : 16;
+        txn_write_t *writes = (txn_write_t *)realloc(txn->writes, capacity * sizeof(txn_write_t));
+        if (!writes) {
+            return -1;
+        }
+        txn->writes = writes;
+        txn->capacity = capacity;
+    }
+
+    uint8_t *copy = (uint8_t *)malloc(length);
+    if (!copy) {
+        return -1;
+    }
+    memcpy(copy, data, length);
+
+    txn->writes[txn->count].offset = offset;
+    txn->writes[txn->count].length = (uint32_t)length;
+    txn->writes[txn->count].data = copy;
+    txn->count++;
+    return 0;
+}
+
+int txn_stage_superblock(txn_t *txn, const struct ext2_super_block *sb) {
+    return txn_stage(txn, 1024, sb, sizeof(struct ext2_super_block));
+}
+
+int txn_stage_group_desc(txn_t *txn, uint32_t group_num, const struct ext2_group_desc *gd) {
+    if (!txn || group_num >= txn->fs_info->groups_count) {
+        return -1;
+    }
+    return txn_stage(txn, group_desc_offset(txn->fs_info, group_num), gd, sizeof(struct ext2_group_desc));
+}
+
+int txn_stage_inode(txn_t *txn, uint32_t inode_num, const struct ext2_inode *inode) {
+    if (!txn || inode_num == 0 || inode_num > txn->fs_info->sb.s_inodes_count) {
+        return -1;
+    }
+    return txn_stage(txn, inode_offset(txn->fs_info, inode_num), inode, sizeof(struct ext2_inode));
+}
+
+int txn_stage_block(txn_t *txn, uint32_t block_num, const void *data) {
+    if (!txn || block_num >= txn->fs_info->sb.s_blocks_count) {
+        return -1;
+    }
+    return txn_stage(txn, (uint64_t)block_num * txn->fs_info->block_size, data, txn->fs_info->block_size);
+}
+
+int txn_stage_block_bitmap(txn_t *txn, uint32_t group_num, const unsigned char *bitmap) {
+    if (!txn || group_num >= txn->fs_info->groups_count) {
+        return -1;
+    }
+    return txn_stage_block(txn, txn->fs_info->group_desc[group_num].bg_block_bitmap, bitmap);
+}
+
+int txn_stage_inode_bitmap(txn_t *txn, uint32_t group_num, const unsigned char *bitmap) {
+    if (!txn || group_num >= txn->fs_info->groups_count) {
+        return -1;
+    }
+    return txn_stage_block(txn, txn->fs_info->group_desc[group_num].bg_inode_bitmap, bitmap);
+}
+
+// Reads bytes as they will be once the transaction is committed: the current contents with
+// every staged write laid over them in staging order
+int txn_read(txn_t *txn, uint64_t offset, void *buffer, size_t length) {
+    if (!txn || read_bytes(txn->fs_info, offset, buffer, length) != 0) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < txn->count; i++) {
+        const txn_write_t *w = &txn->writes[i];
+        uint64_t start = w->offset > offset ? w->offset : offset;
+        uint64_t end = w->offset + w->length < offset + length ? w->offset + w->length : offset + length;
+        if (start < end) {
+            memcpy((uint8_t *)buffer + (start - offset), w->data + (start - w->offset), end - start);
+        }
+    }
+    return 0;
+}
+
+static int txn_compare_offset(const void *a, const void *b) {
+    const txn_write_t *wa = *(const txn_write_t *const *)a;
+    const txn_write_t *wb = *(const txn_write_t *const *)b;
+
+    return wa->offset < wb->offset ? -1 : wa->offset > wb->offset;
+}
+
+static void txn_free_extents(txn_write_t *extents, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        free(extents[i].data);
+    }
+    free(extents);
+}
+
+// Merges overlapping and adjacent staged writes into sorted extents. Writes are
+// replayed in staging order into the extents, so the last stage of a byte wins.
+static txn_write_t *txn_coalesce(const txn_t *txn, uint32_t *extent_count) {
+    const txn_write_t **sorted = (const txn_write_t **)malloc(txn->count * sizeof(txn_write_t *));
+    txn_write_t *extents = (txn_write_t *)calloc(txn->count, sizeof(txn_write_t));
+    uint32_t count = 0;
+
+    if (!sorted || !extents) {
+        free(sorted);
+        free(extents);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < txn->count; i++) {
+        sorted[i] = &txn->writes[i];
+    }
+    qsort(sorted, txn->count, sizeof(txn_write_t *), txn_compare_offset);
+
+    for (uint32_t i = 0; i < txn->count; i++) {
+        const txn_write_t *w = sorted[i];
+        if (count > 0 && w->offset <= extents[count - 1].offset + extents[count - 1].length) {
+            uint64_t end = w->offset + w->length;
+            if (end > extents[count - 1].offset + extents[count - 1].length) {
+                extents[count - 1].length = (uint32_t)(end - extents[count - 1].offset);
+            }
+        } else {
+            extents[count].offset = w->offset;
+            extents[count].length = w->length;
+            count++;
+        }
+    }
+    free(sorted);
+
+    for (uint32_t i = 0; i < count; i++) {
+        extents[i].data = (uint8_t *)malloc(extents[i].length);
+        if (!extents[i].data) {
+            txn_free_extents(extents, count);
+            return NULL;
+        }
+    }
+
+    for (uint32_t i = 0; i < txn->count; i++) {
+        const txn_write_t *w = &txn->writes[i];
+        uint32_t lo = 0, hi = count - 1;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo + 1) / 2;
+            if (extents[mid].offset <= w->offset) lo = mid; else hi = mid - 1;
+        }
+        memcpy(extents[lo].data + (w->offset - extents[lo].offset), w->data, w->length);
+    }
+
+    *extent_count = count;
+    return extents;
+}
+
+static int txn_write_log(const char *path, const txn_write_t *extents, uint32_t count) {
+    txn_log_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TXN_LOG_MAGIC, sizeof(header.magic));
+    header.version = TXN_LOG_VERSION;
+    header.count = count;
+    for (uint32_t i = 0; i < count; i++) {
+        header.payload += sizeof(txn_log_record_t) + extents[i].length;
+    }
+
+    // Written under a fresh name and renamed into place, so nothing planted at path is followed
+    size_t size = strlen(path) + strlen(".XXXXXX") + 1;
+    char *temp = (char *)malloc(size);
+    if (!temp) {
+        return -1;
+    }
+    snprintf(temp, size, "%s.XXXXXX", path);
+
+    int fd = mkstemp(temp);
+    if (fd < 0) {
+        free(temp);
+        return -1;
+    }
+
+    uint64_t checksum = txn_checksum(TXN_CHECKSUM_SEED, &header, sizeof(header));
+    int rc = txn_write_all(fd, &header, sizeof(header));
+
+    for (uint32_t i = 0; rc == 0 && i < count; i++) {
+        txn_log_record_t record = { extents[i].offset, extents[i].length, 0 };
+        checksum = txn_checksum(checksum, &record, sizeof(record));
+        checksum = txn_checksum(checksum, extents[i].data, extents[i].length);
+        rc = txn_write_all(fd, &record, sizeof(record));
+        if (rc == 0) {
+            rc = txn_write_all(fd, extents[i].data, extents[i].length);
+        }
+    }
+
+    // Make the records durable before the trailer can claim they are complete
+    if (rc == 0) {
+        rc = fsync(fd);
+    }
+    if (rc == 0) {
+        txn_log_commit_t commit;
+        memcpy(commit.magic, TXN_COMMIT_MAGIC, sizeof(commit.magic));
+        commit.checksum = checksum;
+        rc = txn_write_all(fd, &commit, sizeof(commit));
+    }
+    if (rc == 0) {
+        rc = fsync(fd);
+    }
+
+    close(fd);
+    if (rc == 0) {
+        rc = rename(temp, path);
+    }
+    if (rc != 0) {
+        unlink(temp);
+        free(temp);
+        return -1;
+    }
+
+    free(temp);
+    txn_sync_log_dir(path);
+    return 0;
+}
+
+static int txn_apply(fs_info_t *fs_info, const txn_write_t *extents, uint32_t count) {
+    bool metadata_touched = false;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (write_bytes(fs_info, extents[i].offset, extents[i].data, extents[i].length) != 0) {
+            return -1;
+        }
+        if (range_has_metadata(fs_info, extents[i].offset, extents[i].length)) {
+            metadata_touched = true;
+        }
+    }
+
+    // One flush for the whole batch
+    if (analyzer_sync(fs_info) != 0) {
+        return -1;
+    }
+
+    if (metadata_touched && analyzer_reload_metadata(fs_info) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Writes every staged change as one sorted, coalesced batch. The batch is first
+// recorded in an intent log so txn_recover() can finish it after a crash.
+// The transaction is released whether or not the commit succeeds.
+int txn_commit(txn_t *txn) {
+    if (!txn) {
+        return -1;
+    }
+    if (txn->count == 0) {
+        txn_abort(txn);
+        return 0;
+    }
+
+    uint32_t count = 0;
+    txn_write_t *extents = txn_coalesce(txn, &count);
+    char *path = txn_log_path(txn_target_path(txn->fs_info));
+    int rc = -1;
+
+    if (extents && path && txn_write_log(path, extents, count) == 0) {
+        rc = txn_apply(txn->fs_info, extents, count);
+        // On failure the log stays behind so the commit can be redone on next start
+        if (rc == 0) {
+            unlink(path);
+            txn_sync_log_dir(path);
+        }
+    }
+
+    if (extents) {
+        txn_free_extents(extents, count);
+    }
+    free(path);
+    txn_abort(txn);
+    return rc;
+}
+
+// Loads the intent log at path. Returns the number of extents of a complete log, with
+// their data pointing into *payload, 0 when there is no usable log and -1 on error.
+// torn is set when a log exists but was cut short before any device write happened.
+// A log that is not a private regular file of ours is refused, it could hold anything.
+static int txn_load_log(const char *path, uint8_t **payload_out, txn_write_t **extents_out, bool *torn) {
+    *payload_out = NULL;
+    *extents_out = NULL;
+    *torn = false;
+
+    int fd = open(path, O_RDONLY | O_NOFOLLOW);
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 07777) != 0600) {
+        close(fd);
+        return -1;
+    }
+
+    txn_log_header_t header;
+    txn_log_commit_t commit;
+    uint8_t *payload = NULL;
+    bool valid = txn_read_all(fd, &header, sizeof(header)) == 0 &&
+                 memcmp(header.magic, TXN_LOG_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == TXN_LOG_VERSION && header.payload <= SIZE_MAX;
+
+    if (valid) {
+        payload = (uint8_t *)malloc(header.payload ? header.payload : 1);
+        valid = payload && txn_read_all(fd, payload, header.payload) == 0 &&
+                txn_read_all(fd, &commit, sizeof(commit)) == 0 &&
+                memcmp(commit.magic, TXN_COMMIT_MAGIC, sizeof(commit.magic)) == 0 &&
+                commit.checksum == txn_checksum(txn_checksum(TXN_CHECKSUM_SEED, &header, sizeof(header)),
+                                                payload, header.payload);
+    }
+    close(fd);
+
+    // An empty log is never written, treat one like a torn log
+    if (!valid || header.count == 0) {
+        free(payload);
+        *torn = true;
+        return 0;
+    }
+
+    txn_write_t *extents = (txn_write_t *)calloc(header.count, sizeof(txn_write_t));
+    size_t pos = 0;
+
+    for (uint32_t i = 0; extents && i < header.count; i++) {
+        txn_log_record_t record;
+        if (pos + sizeof(record) > header.payload) {
+            break;
+        }
+        memcpy(&record, payload + pos, sizeof(record));
+        pos += sizeof(record);
+        if (record.length > header.payload - pos) {
+            break;
+        }
+        extents[i].offset = record.offset;
+        extents[i].length = record.length;
+        extents[i].data = payload + pos;
+        pos += record.length;
+        if (i + 1 == header.count) {
+            *payload_out = payload;
+            *extents_out = extents;
+            return (int)header.count;
+        }
+    }
+
+    free(extents);
+    free(payload);
+    return -1;
+}
+
+// Number of changes an interrupted commit left to replay, without touching the device
+// or the log. Returns 0 when there is nothing to replay and -1 on error.
+int txn_pending(fs_info_t *fs_info) {
+    if (!fs_info) {
+        return -1;
+    }
+
+    char *path = txn_log_path(txn_target_path(fs_info));
+    if (!path) {
+        return -1;
+    }
+
+    uint8_t *payload;
+    txn_write_t *extents;
+    bool torn;
+    int rc = txn_load_log(path, &payload, &extents, &torn);
+
+    free(extents);
+    free(payload);
+    free(path);
+    return rc;
+}
+
+// Replays a complete intent log left by an interrupted commit. Returns the number
+// of replayed extents, 0 when there was nothing to do and -1 on error.
+int txn_recover(fs_info_t *fs_info) {
+    if (!fs_info) {
+        return -1;
+    }
+
+    char *path = txn_log_path(txn_target_path(fs_info));
+    if (!path) {
+        return -1;
+    }
+
+    uint8_t *payload;
+    txn_write_t *extents;
+    bool torn;
+    int rc = txn_load_log(path, &payload, &extents, &torn);
+
+    if (rc > 0 && txn_apply(fs_info, extents, (uint32_t)rc) != 0) {
+        rc = -1;
+    }
+    // A torn log never reached the device and is dropped like a replayed one
+    if (rc > 0 || torn) {
+        unlink(path);
+        txn_sync_log_dir(path);
+    }
+
+    free(extents);
+    free(payload);
+    free(path);
+    return rc;
+}
@@ -0,0 +1,57 @@
+#ifndef TXN_H
+#define TXN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ext2fs/ext2_fs.h>
+#include "analyzer.h"
+
+#define TXN_LOG_DIR "/var/lib/fs_analyzer"  // Intent logs of root, other users keep them in TXN_USER_LOG_DIR
+#define TXN_USER_LOG_DIR ".fs_analyzer"     // Under $HOME
+
+typedef struct {
+    uint64_t offset;            // Device offset of the staged bytes
+    uint32_t length;            // Number of staged bytes
+    uint8_t *data;              // Copy of the staged bytes
+} txn_write_t;
+
+typedef struct {
+    fs_info_t *fs_info;         // Filesystem the transaction applies to
+    txn_write_t *writes;        // Staged writes in staging order, later ones win on overlap
+    uint32_t count;
+    uint32_t capacity;
+} txn_t;
+
+txn_t *txn_begin(fs_info_t *fs_info);
+
+void txn_abort(txn_t *txn);
+
+int txn_stage(txn_t *txn, uint64_t offset, const void *data, size_t length);
+
+int txn_stage_superblock(txn_t *txn, const struct ext2_super_block *sb);
+
+int txn_stage_group_desc(txn_t *txn, uint32_t group_num, const struct ext2_group_desc *gd);
+
+int txn_stage_inode(txn_t *txn, uint32_t inode_num, const struct ext2_inode *inode);
+
+int txn_stage_block(txn_t *txn, uint32_t block_num, const void *data);
+
+int txn_stage_block_bitmap(txn_t *txn, uint32_t group_num, const unsigned char *bitmap);
+
+int txn_stage_inode_bitmap(txn_t *txn, uint32_t group_num, const unsigned char *bitmap);
+
+int txn_read(txn_t *txn, uint64_t offset, void *buffer, size_t length);
+
+int txn_commit(txn_t *txn);
+
+int txn_pending(fs_info_t *fs_info);
+
+int txn_recover(fs_info_t *fs_info);
+
+int txn_log_dir(char *dir, size_t size);
+
+char *txn_log_path(const char *device_path);
+
+#endif /* TXN_H */
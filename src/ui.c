@@ -3,10 +3,18 @@
 #include <ctype.h>
 #include <time.h>
 #include <stdarg.h>
+#include <math.h>
 #include <ncurses.h>
 #include "ui.h"
 #include "utils.h"
 #include "editor.h"
+#include "scans.h"
+#include "export.h"
+#include "query.h"
+#include "snapshot.h"
+#include "csum.h"
+#include "fsck.h"
+#include "txn.h"
 
 static bool ui_handle_binary_editor_input(ui_context_t *ui_ctx, int key);
 static void ui_display_menu(ui_context_t *ui_ctx);
@@ -14,6 +22,18 @@ static bool ui_handle_menu_input(ui_context_t *ui_ctx, int key);
 static bool ui_handle_analyzer_input(ui_context_t *ui_ctx, int key);
 static bool ui_handle_block_browser_input(ui_context_t *ui_ctx, int key);
 static bool ui_handle_inode_browser_input(ui_context_t *ui_ctx, int key);
+static bool ui_handle_jobs_input(ui_context_t *ui_ctx, int key);
+static bool ui_handle_bitmap_editor_input(ui_context_t *ui_ctx, int key);
+static bool ui_handle_stats_input(ui_context_t *ui_ctx, int key);
+static bool ui_handle_estimate_input(ui_context_t *ui_ctx, int key);
+static bool ui_handle_usage_input(ui_context_t *ui_ctx, int key);
+static bool ui_handle_freespace_input(ui_context_t *ui_ctx, int key);
+static bool ui_handle_frag_input(ui_context_t *ui_ctx, int key);
+static bool ui_handle_journal_input(ui_context_t *ui_ctx, int key);
+static bool ui_handle_deleted_input(ui_context_t *ui_ctx, int key);
+static bool ui_handle_carve_input(ui_context_t *ui_ctx, int key);
+static bool ui_handle_content_input(ui_context_t *ui_ctx, int key);
+static void ui_collect_inode_filter(ui_context_t *ui_ctx);
 
 ui_context_t *ui_init(fs_info_t *fs_info) {
     ui_context_t *ui_ctx = (ui_context_t *)malloc(sizeof(ui_context_t));
@@ -26,6 +46,46 @@ ui_context_t *ui_init(fs_info_t *fs_info) {
     ui_ctx->current_block = 0;
     ui_ctx->current_inode = 1; 
     ui_ctx->current_group = 0;
+    ui_ctx->bitmap_ed = NULL;
+    ui_ctx->jobs = NULL;
+    ui_ctx->block_prefetch = NULL;
+    ui_ctx->inode_prefetch = NULL;
+    ui_ctx->selected_job = 0;
+    ui_ctx->dirty = UI_DIRTY_ALL;
+    ui_ctx->jobs_stamp = 0;
+    ui_ctx->help_running = 0;
+    ui_ctx->inode_filter = NULL;
+    ui_ctx->filter_matches = 0;
+    ui_ctx->filter_text[0] = '\0';
+    ui_ctx->snapshots = NULL;
+    ui_ctx->filter = NULL;
+    ui_ctx->stats = NULL;
+    ui_ctx->stats_page = 0;
+    ui_ctx->stats_scroll = 0;
+    ui_ctx->estimate = NULL;
+    ui_ctx->estimate_scroll = 0;
+    ui_ctx->usage = NULL;
+    ui_ctx->usage_files = false;
+    ui_ctx->usage_scroll = 0;
+    ui_ctx->freespace = NULL;
+    ui_ctx->freespace_groups = false;
+    ui_ctx->freespace_scroll = 0;
+    ui_ctx->freespace_fit = 0;
+    ui_ctx->frag = NULL;
+    ui_ctx->frag_selected = 0;
+    ui_ctx->journal = NULL;
+    ui_ctx->journal_txn = 0;
+    ui_ctx->journal_image = 0;
+    ui_ctx->journal_images = false;
+    ui_ctx->journal_plan = false;
+    ui_ctx->journal_scroll = 0;
+    ui_ctx->deleted = NULL;
+    ui_ctx->deleted_selected = 0;
+    ui_ctx->carve = NULL;
+    ui_ctx->carve_selected = 0;
+    ui_ctx->content = NULL;
+    ui_ctx->content_page = 0;
+    ui_ctx->content_group = 0;
 
     int max_y, max_x;
     getmaxyx(stdscr, max_y, max_x);
@@ -42,6 +102,37 @@ ui_context_t *ui_init(fs_info_t *fs_info) {
         ui_cleanup(ui_ctx);
         return NULL;
     }
+    editor_set_window(ui_ctx->editor_ctx, ui_ctx->main_win);
+
+    ui_ctx->bitmap_ed = bitmap_editor_init(fs_info);
+    if (!ui_ctx->bitmap_ed) {
+        ui_cleanup(ui_ctx);
+        return NULL;
+    }
+    bitmap_editor_set_window(ui_ctx->bitmap_ed, ui_ctx->main_win);
+
+    ui_ctx->jobs = job_manager_init();
+    ui_ctx->snapshots = snapshot_cache_init(fs_info);
+    ui_ctx->filter = job_slot_init(ui_ctx->snapshots, 0, (void (*)(void *))query_result_free);
+    ui_ctx->stats = job_slot_init(fs_info, 0, (void (*)(void *))stats_free);
+    ui_ctx->estimate = job_slot_init(fs_info, 0, free);
+    ui_ctx->usage = job_slot_init(fs_info, 200, (void (*)(void *))du_free);
+    ui_ctx->freespace = job_slot_init(fs_info, 0, (void (*)(void *))freespace_free);
+    ui_ctx->frag = job_slot_init(fs_info, 200, (void (*)(void *))frag_free);
+    ui_ctx->journal = job_slot_init(fs_info, 0, (void (*)(void *))journal_scan_free);
+    ui_ctx->deleted = job_slot_init(fs_info, UNDELETE_DEFAULT_TOP, (void (*)(void *))undelete_free);
+    ui_ctx->carve = job_slot_init(fs_info, 0, (void (*)(void *))carve_free);
+    ui_ctx->content = job_slot_init(fs_info, 200, (void (*)(void *))content_free);
+    if (!ui_ctx->jobs || !ui_ctx->snapshots || !ui_ctx->filter || !ui_ctx->stats || !ui_ctx->estimate ||
+        !ui_ctx->usage || !ui_ctx->freespace || !ui_ctx->frag || !ui_ctx->journal || !ui_ctx->deleted || !ui_ctx->carve ||
+        !ui_ctx->content) {
+        ui_cleanup(ui_ctx);
+        return NULL;
+    }
+
+    // Prefetching is an optimisation only, browsing works without it
+    ui_ctx->block_prefetch = prefetch_init(fs_info, prefetch_map_block, PREFETCH_DEFAULT_DEPTH);
+    ui_ctx->inode_prefetch = prefetch_init(fs_info, prefetch_map_inode, PREFETCH_DEFAULT_DEPTH);
 
     return ui_ctx;
 }
@@ -51,9 +142,32 @@ void ui_cleanup(ui_context_t *ui_ctx) {
         return;
     }
 
+    // Workers read through fs_info, so stop them before anything is released
+    if (ui_ctx->jobs) {
+        job_manager_cleanup(ui_ctx->jobs);
+        ui_ctx->jobs = NULL;
+    }
+    prefetch_cleanup(ui_ctx->block_prefetch);
+    ui_ctx->block_prefetch = NULL;
+    prefetch_cleanup(ui_ctx->inode_prefetch);
+    ui_ctx->inode_prefetch = NULL;
+
     if (ui_ctx->editor_ctx) {
         editor_cleanup(ui_ctx->editor_ctx);
     }
+    bitmap_editor_cleanup(ui_ctx->bitmap_ed);
+    free(ui_ctx->inode_filter);
+    job_slot_cleanup(ui_ctx->filter);
+    snapshot_cache_cleanup(ui_ctx->snapshots);
+    job_slot_cleanup(ui_ctx->stats);
+    job_slot_cleanup(ui_ctx->estimate);
+    job_slot_cleanup(ui_ctx->usage);
+    job_slot_cleanup(ui_ctx->freespace);
+    job_slot_cleanup(ui_ctx->frag);
+    job_slot_cleanup(ui_ctx->journal);
+    job_slot_cleanup(ui_ctx->deleted);
+    job_slot_cleanup(ui_ctx->carve);
+    job_slot_cleanup(ui_ctx->content);
 
     if (ui_ctx->help_win) {
         delwin(ui_ctx->help_win);
@@ -84,7 +198,7 @@ static void ui_display_status(ui_context_t *ui_ctx, const char *message, ...) {
     vw_printw(ui_ctx->status_win, message, args);
     va_end(args);
     
-    wrefresh(ui_ctx->status_win);
+    wnoutrefresh(ui_ctx->status_win);
 }
 
 static void ui_display_detailed_help(ui_context_t *ui_ctx) {
@@ -115,48 +229,128 @@ static void ui_display_detailed_help(ui_context_t *ui_ctx) {
     mvwprintw(ui_ctx->main_win, y++, 0, "  - In edit mode, type hex digits (0-9, A-F)");
     mvwprintw(ui_ctx->main_win, y++, 0, "  - Each key press modifies a nibble (4 bits)");
     mvwprintw(ui_ctx->main_win, y++, 0, "  - Cursor moves automatically after edit");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - U undoes and R redoes edits, modified bytes are shown in red");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - / and ? find text or hex:DEADBEEF after or before the cursor, n and N repeat it");
     y++;
     
     mvwprintw(ui_ctx->main_win, y++, 0, "Saving Changes:");
     mvwprintw(ui_ctx->main_win, y++, 0, "  1. Make your changes in the editor");
     mvwprintw(ui_ctx->main_win, y++, 0, "  2. Press S to save changes");
-    mvwprintw(ui_ctx->main_win, y++, 0, "  3. Changes are written immediately to disk");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  3. Changes are written immediately to disk, or to the overlay (-o)");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - K makes S also recompute the inode, bitmap, descriptor and superblock checksums");
     mvwprintw(ui_ctx->main_win, y++, 0, "  - WARNING: Changes can corrupt filesystem!");
     y++;
     
+    mvwprintw(ui_ctx->main_win, y++, 0, "Bitmap Editor:");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - One cell per block or inode, # used and . free");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - V starts a selection, + and - mark it used or free, R marks a typed range");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - S saves the bitmap and fixes the group and superblock free counts");
+    y++;
+    
+    mvwprintw(ui_ctx->main_win, y++, 0, "Statistics:");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - One parallel pass over the inode tables, R runs it again");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - TAB switches between sizes, ages, owners and per-group density");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - Quick estimates sample random table blocks and bitmap words, with 95%% error bars");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - Space usage charges every inode to its directory and ranks the largest ones");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - Free space histograms extent lengths, F finds where an allocation of a given size fits");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - File fragmentation counts the pieces of every file, ENTER opens one of the worst in the inode browser");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - Deleted files ranks freed inodes by how many blocks are still free, E and X extract them");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - Signature carving searches free blocks for file headers, hits show up while the scan runs");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - Zero & entropy map reads every data block once and shades each group by its zero or incompressible share");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - Journal lists the logged transactions and their block images, P shows what a replay would change");
+    y++;
+    
+    mvwprintw(ui_ctx->main_win, y++, 0, "Background Jobs:");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - Scans run in worker threads while the UI stays responsive");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - K verifies every metadata checksum and lists the mismatches");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - F runs a read-only consistency check: block owners, bitmaps and link counts");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - L only compares link counts with the directory entries, reading no file maps");
+    mvwprintw(ui_ctx->main_win, y++, 0, "  - C cancels the selected job, D dismisses a finished one");
+    y++;
+    
     mvwprintw(ui_ctx->main_win, y++, 0, "Press any key to return...");
     
     wrefresh(ui_ctx->main_win);
+    timeout(-1);
     getch(); 
+    timeout(UI_POLL_MS);
+    
+    ui_ctx->dirty = UI_DIRTY_ALL;
+    editor_invalidate(ui_ctx->editor_ctx);
+    bitmap_editor_invalidate(ui_ctx->bitmap_ed);
 }
 
 void ui_display_help(ui_context_t *ui_ctx) {
     int max_y, max_x;
     getmaxyx(ui_ctx->help_win, max_y, max_x);
-    (void)max_y; (void)max_x;
+    (void)max_y;
     
     werase(ui_ctx->help_win);
     wbkgd(ui_ctx->help_win, COLOR_PAIR(1));
     
     switch (ui_ctx->current_mode) {
         case UI_MODE_MENU:
-            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | 1:Analyzer | 2:Block Browser | 3:Inode Browser | Q:Quit");
+            mvwprintw(ui_ctx->help_win, 0, 0, ui_ctx->fs_info->overlay
+                      ? "F1:Help | 0-9/D/J/U/S/Z:Select | W:Commit Overlay | X:Discard Overlay | Q:Quit"
+                      : "F1:Help | 0-9/D/J/U/S/Z:Select | Q:Quit");
             break;
         case UI_MODE_ANALYZER:
-            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | G:Group | Q:Quit");
+            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | G:Group | B/I:Edit Block/Inode Bitmap | Q:Quit");
             break;
         case UI_MODE_BLOCK_BROWSER:
             mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | ARROWS:Navigate | E:Edit Block | G:Go to Block | Q:Quit");
             break;
         case UI_MODE_INODE_BROWSER:
-            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | ARROWS:Navigate | E:Edit Inode | G:Go to Inode | Q:Quit");
+            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | ARROWS:Navigate | E:Edit Inode | G:Go to Inode | F:Filter | Q:Quit");
             break;
         case UI_MODE_BINARY_EDITOR:
-            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | ARROWS:Move | TAB:Edit Mode | S:Save | Q:Quit");
+            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | ARROWS/PGUP/PGDN:Move | TAB:Edit Mode | U/R:Undo/Redo | H:Fields | K:Fix Csums | /?:Find | N:Next | S:Save | Q:Quit");
+            break;
+        case UI_MODE_BITMAP_EDITOR:
+            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | SPACE:Toggle | V:Select | +/-:Used/Free | R:Range | [/]:Group | TAB:Kind | S:Save | X:Revert");
+            break;
+        case UI_MODE_STATS:
+            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | TAB/LEFT/RIGHT:Page | UP/DOWN:Scroll | R:Rescan | Q:Quit");
+            break;
+        case UI_MODE_ESTIMATE:
+            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | UP/DOWN:Scroll | R:Resample | Q:Quit");
+            break;
+        case UI_MODE_USAGE:
+            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | TAB:Directories/Files | UP/DOWN/PGUP/PGDN:Scroll | R:Rescan | Q:Quit");
             break;
+        case UI_MODE_FREESPACE:
+            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | TAB:Lengths/Groups | UP/DOWN/PGUP/PGDN:Scroll | F:Fit Size | R:Rescan | Q:Quit");
+            break;
+        case UI_MODE_FRAG:
+            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | UP/DOWN/PGUP/PGDN:Select | ENTER:Browse Inode | R:Rescan | Q:Quit");
+            break;
+        case UI_MODE_DELETED:
+            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | UP/DOWN/PGUP/PGDN:Select | ENTER:Browse Inode | X:Extract | E:Extract All | R:Rescan | Q:Quit");
+            break;
+        case UI_MODE_CARVE:
+            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | UP/DOWN/PGUP/PGDN:Select | ENTER:Browse Block | R:Rescan | Q:Quit");
+            break;
+        case UI_MODE_CONTENT:
+            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | TAB:Zero/Entropy/Dense/Files | ARROWS/PGUP/PGDN:Group | ENTER:Browse Group | R:Rescan | Q:Quit");
+            break;
+        case UI_MODE_JOURNAL:
+            mvwprintw(ui_ctx->help_win, 0, 0, ui_ctx->journal_plan
+                      ? "F1:Help | ESC:Back | UP/DOWN/PGUP/PGDN:Scroll | P:Transactions | R:Rescan | Q:Quit"
+                      : "F1:Help | ESC:Back | TAB:Transactions/Images | UP/DOWN:Select | PGUP/PGDN:Scroll Image | "
+                        "ENTER:Browse Block | P:Replay Plan | R:Rescan | Q:Quit");
+            break;
+        case UI_MODE_JOBS:
+            mvwprintw(ui_ctx->help_win, 0, 0, "F1:Help | ESC:Back | UP/DOWN:Select | V:Verify | S:Stats | K:Checksums | F:Fsck | L:Links | /:Search | E:Export | C:Cancel | D:Dismiss | Q:Quit");
+            break;
+    }
+    
+    uint32_t running = job_running_count(ui_ctx->jobs);
+    if (running > 0 && max_x > 16) {
+        mvwprintw(ui_ctx->help_win, 0, max_x - 16, "[%2u job%s run]", running, running == 1 ? " " : "s");
     }
+    ui_ctx->help_running = running;
     
-    wrefresh(ui_ctx->help_win);
+    wnoutrefresh(ui_ctx->help_win);
 }
 
 void ui_show_error(ui_context_t *ui_ctx, const char *message) {
@@ -186,7 +380,12 @@ bool ui_prompt(ui_context_t *ui_ctx, const char *prompt, char *buffer, size_t ma
 
 void ui_set_mode(ui_context_t *ui_ctx, ui_mode_t mode) {
     ui_ctx->current_mode = mode;
-    werase(ui_ctx->main_win);
+    ui_ctx->dirty = UI_DIRTY_ALL;
+    if (mode == UI_MODE_BINARY_EDITOR) {
+        editor_invalidate(ui_ctx->editor_ctx);
+    } else if (mode == UI_MODE_BITMAP_EDITOR) {
+        bitmap_editor_invalidate(ui_ctx->bitmap_ed);
+    }
     
     switch (mode) {
         case UI_MODE_MENU:
@@ -204,9 +403,40 @@ void ui_set_mode(ui_context_t *ui_ctx, ui_mode_t mode) {
         case UI_MODE_BINARY_EDITOR:
             ui_display_status(ui_ctx, "Binary Editor");
             break;
+        case UI_MODE_JOBS:
+            ui_display_status(ui_ctx, "Background Jobs - %s", ui_ctx->fs_info->device_path);
+            break;
+        case UI_MODE_BITMAP_EDITOR:
+            ui_display_status(ui_ctx, "Bitmap Editor - Group %u", ui_ctx->bitmap_ed->group);
+            break;
+        case UI_MODE_STATS:
+            ui_display_status(ui_ctx, "Statistics - %s", ui_ctx->fs_info->device_path);
+            break;
+        case UI_MODE_ESTIMATE:
+            ui_display_status(ui_ctx, "Estimates - %s", ui_ctx->fs_info->device_path);
+            break;
+        case UI_MODE_USAGE:
+            ui_display_status(ui_ctx, "Space Usage - %s", ui_ctx->fs_info->device_path);
+            break;
+        case UI_MODE_FREESPACE:
+            ui_display_status(ui_ctx, "Free Space - %s", ui_ctx->fs_info->device_path);
+            break;
+        case UI_MODE_FRAG:
+            ui_display_status(ui_ctx, "File Fragmentation - %s", ui_ctx->fs_info->device_path);
+            break;
+        case UI_MODE_JOURNAL:
+            ui_display_status(ui_ctx, "Journal - %s", ui_ctx->fs_info->device_path);
+            break;
+        case UI_MODE_DELETED:
+            ui_display_status(ui_ctx, "Deleted Files - %s", ui_ctx->fs_info->device_path);
+            break;
+        case UI_MODE_CARVE:
+            ui_display_status(ui_ctx, "Signature Carving - %s", ui_ctx->fs_info->device_path);
+            break;
+        case UI_MODE_CONTENT:
+            ui_display_status(ui_ctx, "Zero & Entropy Map - %s", ui_ctx->fs_info->device_path);
+            break;
     }
-    
-    ui_display_help(ui_ctx);
 }
 
 static void ui_display_menu(ui_context_t *ui_ctx) {
@@ -236,33 +466,82 @@ static void ui_display_menu(ui_context_t *ui_ctx) {
     snprintf(type_info, sizeof(type_info), "Type: %s", fs_type);
     mvwprintw(ui_ctx->main_win, y++, (max_x - strlen(type_info)) / 2, type_info);
     
+    if (ui_ctx->fs_info->overlay) {
+        char overlay_info[256];
+        snprintf(overlay_info, sizeof(overlay_info), "Overlay: %s (%u blocks pending)",
+                 ui_ctx->fs_info->overlay->path, overlay_block_count(ui_ctx->fs_info->overlay));
+        mvwprintw(ui_ctx->main_win, y++, (max_x - strlen(overlay_info)) / 2, "%s", overlay_info);
+    }
+    
     y++;
     const char *menu_items[] = {
         "1. Filesystem Analyzer",
         "2. Block Browser",
         "3. Inode Browser",
         "4. Edit Superblock",
+        "5. Background Jobs",
+        "6. Bitmap Editor",
+        "7. Statistics",
+        "8. Quick Estimates",
+        "9. Space Usage",
+        "0. Free Space",
+        "D. File Fragmentation",
+        "J. Journal",
+        "U. Deleted Files",
+        "S. Signature Carving",
+        "Z. Zero & Entropy Map",
         "",
+        ui_ctx->fs_info->overlay ? "W. Commit Overlay to Device" : NULL,
+        ui_ctx->fs_info->overlay ? "X. Discard Overlay" : NULL,
         "Q. Quit"
     };
     
     // Находим самую длинную строку меню для центрирования
     size_t max_len = 0;
     for (size_t i = 0; i < sizeof(menu_items)/sizeof(menu_items[0]); i++) {
-        size_t len = strlen(menu_items[i]);
+        size_t len = menu_items[i] ? strlen(menu_items[i]) : 0;
         if (len > max_len) max_len = len;
     }
     
     // Выводим пункты меню
+    int rows = 0, count = 0;
     for (size_t i = 0; i < sizeof(menu_items)/sizeof(menu_items[0]); i++) {
-        if (menu_items[i][0] == '\0') {
-            y++; // Пустая строка
-            continue;
+        if (menu_items[i]) {
+            rows++;
+            count += menu_items[i][0] != '\0';
         }
-        mvwprintw(ui_ctx->main_win, y++, (max_x - max_len) / 2, menu_items[i]);
     }
     
-    wrefresh(ui_ctx->main_win);
+    if (rows <= max_y - y) {
+        for (size_t i = 0; i < sizeof(menu_items)/sizeof(menu_items[0]); i++) {
+            if (!menu_items[i]) {
+                continue;
+            }
+            if (menu_items[i][0] == '\0') {
+                y++; // Пустая строка
+                continue;
+            }
+            mvwprintw(ui_ctx->main_win, y++, (max_x - max_len) / 2, "%s", menu_items[i]);
+        }
+    } else {
+        // Too short for one column: two columns without the blank line
+        int half = (count + 1) / 2;
+        int gap = 4;
+        int x = (max_x - (int)(2 * max_len) - gap) / 2;
+        int n = 0;
+        if (x < 0) {
+            x = 0;
+        }
+        for (size_t i = 0; i < sizeof(menu_items)/sizeof(menu_items[0]); i++) {
+            if (!menu_items[i] || menu_items[i][0] == '\0') {
+                continue;
+            }
+            mvwprintw(ui_ctx->main_win, y + n % half, x + (n / half) * ((int)max_len + gap), "%s", menu_items[i]);
+            n++;
+        }
+    }
+    
+    wnoutrefresh(ui_ctx->main_win);
 }
 
 void ui_display_fs_info(ui_context_t *ui_ctx) {
@@ -315,7 +594,7 @@ void ui_display_fs_info(ui_context_t *ui_ctx) {
         mvwprintw(ui_ctx->main_win, y++, 2, "Invalid block group number");
     }
     
-    wrefresh(ui_ctx->main_win);
+    wnoutrefresh(ui_ctx->main_win);
 }
 
 void ui_display_block_browser(ui_context_t *ui_ctx) {
@@ -408,7 +687,7 @@ void ui_display_block_browser(ui_context_t *ui_ctx) {
         mvwprintw(ui_ctx->main_win, 9, 0, "Memory allocation error");
     }
     
-    wrefresh(ui_ctx->main_win);
+    wnoutrefresh(ui_ctx->main_win);
 }
 
 void ui_display_inode_browser(ui_context_t *ui_ctx) {
@@ -418,6 +697,15 @@ void ui_display_inode_browser(ui_context_t *ui_ctx) {
               ui_ctx->current_inode, ui_ctx->fs_info->sb.s_inodes_count - 1);
     mvwprintw(ui_ctx->main_win, 1, 0, "===============================");
     
+    if (ui_ctx->inode_filter) {
+        bool match = check_bitmap_bit(ui_ctx->inode_filter, ui_ctx->current_inode - 1);
+        wattron(ui_ctx->main_win, COLOR_PAIR(match ? 3 : 4));
+        mvwprintw(ui_ctx->main_win, 2, 0, "Filter: %.60s (%lu match%s)%s", ui_ctx->filter_text,
+                  (unsigned long)ui_ctx->filter_matches, ui_ctx->filter_matches == 1 ? "" : "es",
+                  match ? "" : " - this inode does not match");
+        wattroff(ui_ctx->main_win, COLOR_PAIR(match ? 3 : 4));
+    }
+    
     bool is_allocated = is_inode_allocated(ui_ctx->fs_info, ui_ctx->current_inode);
     
     mvwprintw(ui_ctx->main_win, 3, 0, "Inode Status: %s", is_allocated ? "Allocated" : "Free");
@@ -475,216 +763,2373 @@ void ui_display_inode_browser(ui_context_t *ui_ctx) {
         mvwprintw(ui_ctx->main_win, 4, 0, "Error reading inode");
     }
     
-    wrefresh(ui_ctx->main_win);
+    wnoutrefresh(ui_ctx->main_win);
 }
 
 void ui_display_binary_editor(ui_context_t *ui_ctx) {
     editor_render(ui_ctx->editor_ctx);
 }
 
-static bool ui_handle_binary_editor_input(ui_context_t *ui_ctx, int key) {
-    switch (key) {
-        case 27: // ESC
-            ui_set_mode(ui_ctx, UI_MODE_MENU);
-            return true;
-        case 'q':
-        case 'Q':
-            return false;
-        default:
-            return editor_handle_key(ui_ctx->editor_ctx, key);
+void ui_display_bitmap_editor(ui_context_t *ui_ctx) {
+    bitmap_editor_render(ui_ctx->bitmap_ed);
+}
+
+#define UI_STATS_PAGES 5
+
+static const char *ui_stats_pages[UI_STATS_PAGES] = { "Overview", "Sizes", "Ages", "Owners", "Groups" };
+
+static void ui_draw_bar(WINDOW *win, int y, int x, int width, uint64_t value, uint64_t max) {
+    int filled = max ? (int)((double)value / (double)max * width + 0.5) : 0;
+
+    if (value && filled == 0) {
+        filled = 1;
     }
+    wattron(win, COLOR_PAIR(3));
+    for (int i = 0; i < filled && i < width; i++) {
+        mvwaddch(win, y, x + i, '#');
+    }
+    wattroff(win, COLOR_PAIR(3));
 }
 
-void ui_main_loop(ui_context_t *ui_ctx) {
-    bool running = true;
-    
-    ui_set_mode(ui_ctx, UI_MODE_MENU);
-    
-    while (running) {
-        switch (ui_ctx->current_mode) {
-            case UI_MODE_MENU:
-                ui_display_menu(ui_ctx);
-                break;
-            case UI_MODE_ANALYZER:
-                ui_display_fs_info(ui_ctx);
-                break;
-            case UI_MODE_BLOCK_BROWSER:
-                ui_display_block_browser(ui_ctx);
-                break;
-            case UI_MODE_INODE_BROWSER:
-                ui_display_inode_browser(ui_ctx);
-                break;
-            case UI_MODE_BINARY_EDITOR:
-                ui_display_binary_editor(ui_ctx);
-                break;
-        }
-        
-        ui_display_help(ui_ctx);
-        
-        int key = getch();
-        
-        if (key == KEY_F(1)) {
-            ui_display_detailed_help(ui_ctx);
-            continue; 
-        }
-        
-        switch (ui_ctx->current_mode) {
-            case UI_MODE_MENU:
-                running = ui_handle_menu_input(ui_ctx, key);
-                break;
-            case UI_MODE_ANALYZER:
-                running = ui_handle_analyzer_input(ui_ctx, key);
-                break;
-            case UI_MODE_BLOCK_BROWSER:
-                running = ui_handle_block_browser_input(ui_ctx, key);
-                break;
-            case UI_MODE_INODE_BROWSER:
-                running = ui_handle_inode_browser_input(ui_ctx, key);
-                break;
-            case UI_MODE_BINARY_EDITOR:
-                running = ui_handle_binary_editor_input(ui_ctx, key);
-                break;
-        }
+static uint64_t ui_max_u64(const uint64_t *values, uint32_t count) {
+    uint64_t max = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        max = values[i] > max ? values[i] : max;
     }
+    return max;
 }
 
-static bool ui_handle_menu_input(ui_context_t *ui_ctx, int key) {
-    switch (key) {
-        case '1':
-            ui_set_mode(ui_ctx, UI_MODE_ANALYZER);
-            return true;
-        case '2':
-            ui_set_mode(ui_ctx, UI_MODE_BLOCK_BROWSER);
-            return true;
-        case '3':
-            ui_set_mode(ui_ctx, UI_MODE_INODE_BROWSER);
-            return true;
-        case '4':
-            ui_set_mode(ui_ctx, UI_MODE_BINARY_EDITOR);
-            editor_open_structure(ui_ctx->editor_ctx, STRUCTURE_SUPERBLOCK, 0);
-            return true;
-        case 'q':
-        case 'Q':
-            return false;
-        default:
-            return true;
+// One histogram row: label, count, bytes (optional) and a bar scaled to max
+static void ui_stats_row(WINDOW *win, int y, int bar_width, const char *label, uint64_t count, const uint64_t *bytes,
+                         uint64_t max) {
+    char bytes_str[32] = "";
+
+    if (bytes) {
+        format_value(*bytes, bytes_str, sizeof(bytes_str), true);
     }
+    mvwprintw(win, y, 0, "  %-12s %12lu  %12s  ", label, (unsigned long)count, bytes_str);
+    ui_draw_bar(win, y, 44, bar_width, count, max);
 }
 
-static bool ui_handle_analyzer_input(ui_context_t *ui_ctx, int key) {
-    switch (key) {
-        case 27: // ESC
-            ui_set_mode(ui_ctx, UI_MODE_MENU);
-            return true;
-        case 'g': case 'G': {
-            char buffer[32];
-            if (ui_prompt(ui_ctx, "Enter group number: ", buffer, sizeof(buffer))) {
-                uint32_t group;
-                if (sscanf(buffer, "%u", &group) == 1 && group < ui_ctx->fs_info->groups_count) {
-                    ui_ctx->current_group = (int)group;
-                }
-            }
-            return true;
-        }
-        case 'q':
-        case 'Q':
-            return false;
-        default:
-            return true;
+static void ui_stats_owners(WINDOW *win, int *y, int rows, const char *title, const stats_owner_map_t *map, uint64_t total) {
+    const stats_owner_t *top[64];
+    uint32_t n = stats_owner_top(map, top, rows < 64 ? (uint32_t)rows : 64);
+
+    mvwprintw(win, (*y)++, 0, "%s (%u distinct)", title, map->count);
+    for (uint32_t i = 0; i < n; i++) {
+        char bytes_str[32];
+        format_value(top[i]->bytes, bytes_str, sizeof(bytes_str), true);
+        mvwprintw(win, (*y)++, 0, "  %-10u %12lu inodes  %12s  %5.1f%%", top[i]->id, (unsigned long)top[i]->inodes,
+                  bytes_str, total ? 100.0 * (double)top[i]->bytes / (double)total : 0.0);
     }
+    (*y)++;
 }
 
-static bool ui_handle_block_browser_input(ui_context_t *ui_ctx, int key) {
-    switch (key) {
-        case 27: // ESC
-            ui_set_mode(ui_ctx, UI_MODE_MENU);
-            return true;
-        case KEY_LEFT:
-            if (ui_ctx->current_block > 0) {
-                ui_ctx->current_block--;
-                ui_display_block_browser(ui_ctx);
-                ui_display_status(ui_ctx, "Block Browser - Block %d", ui_ctx->current_block);
+void ui_display_stats(ui_context_t *ui_ctx) {
+    WINDOW *win = ui_ctx->main_win;
+    job_slot_t *slot = ui_ctx->stats;
+    int max_y, max_x;
+    getmaxyx(win, max_y, max_x);
+    int bar_width = max_x - 46 > 10 ? max_x - 46 : 10;
+
+    werase(win);
+    mvwprintw(win, 0, 0, "Filesystem Statistics");
+    int x = 0;
+    for (uint32_t p = 0; p < UI_STATS_PAGES; p++) {
+        if (p == ui_ctx->stats_page) {
+            wattron(win, COLOR_PAIR(5) | A_BOLD);
+        }
+        mvwprintw(win, 1, x, "[%s]", ui_stats_pages[p]);
+        if (p == ui_ctx->stats_page) {
+            wattroff(win, COLOR_PAIR(5) | A_BOLD);
+        }
+        x += (int)strlen(ui_stats_pages[p]) + 3;
+    }
+
+    pthread_mutex_lock(&slot->lock);
+    const fs_stats_t *st = (const fs_stats_t *)slot->result;
+    if (slot->job) {
+        mvwprintw(win, 2, 0, "Scanning inode tables... %3.0f%%", job_fraction(slot->job) * 100.0);
+    }
+    if (!st) {
+        if (!slot->job) {
+            mvwprintw(win, 3, 0, "No statistics yet. Press R to scan the inode tables.");
+        }
+        pthread_mutex_unlock(&slot->lock);
+        wnoutrefresh(win);
+        return;
+    }
+
+    const stats_hist_t *h = &st->total;
+    char total_str[32], alloc_str[32], label[32];
+    format_value(h->bytes, total_str, sizeof(total_str), true);
+    format_value(h->sectors * 512, alloc_str, sizeof(alloc_str), true);
+    mvwprintw(win, 3, 0, "%lu inodes, %s in files, %s allocated, scanned in %.2f s",
+              (unsigned long)h->inodes, total_str, alloc_str, st->seconds);
+
+    int y = 5;
+    uint32_t scroll = ui_ctx->stats_scroll;
+    switch (ui_ctx->stats_page) {
+        case 0: {
+            mvwprintw(win, y++, 0, "  %-12s %12s  %12s", "Type", "Inodes", "Bytes");
+            uint64_t max = ui_max_u64(h->type_count, STATS_TYPES);
+            for (uint32_t i = 0; i < STATS_TYPES && y < max_y; i++) {
+                if (h->type_count[i]) {
+                    ui_stats_row(win, y++, bar_width, stats_type_label(i), h->type_count[i], &h->type_bytes[i], max);
+                }
             }
-            return true;
-        case KEY_RIGHT:
-            if ((uint32_t)ui_ctx->current_block < ui_ctx->fs_info->sb.s_blocks_count - 1) {
-                ui_ctx->current_block++;
-                ui_display_block_browser(ui_ctx);
-                ui_display_status(ui_ctx, "Block Browser - Block %d", ui_ctx->current_block);
+            y++;
+            mvwprintw(win, y++, 0, "  %-12s %12s", "Links", "Inodes");
+            max = ui_max_u64(h->link_count, STATS_LINK_BUCKETS);
+            for (uint32_t i = 0; i < STATS_LINK_BUCKETS && y < max_y; i++) {
+                if (h->link_count[i]) {
+                    stats_link_label(i, label, sizeof(label));
+                    ui_stats_row(win, y++, bar_width, label, h->link_count[i], NULL, max);
+                }
             }
-            return true;
-        case KEY_UP:
-            if (ui_ctx->current_block >= 10) {
-                ui_ctx->current_block -= 10;
-                ui_display_block_browser(ui_ctx);
-                ui_display_status(ui_ctx, "Block Browser - Block %d", ui_ctx->current_block);
+            break;
+        }
+        case 1: {
+            uint32_t first = STATS_SIZE_BUCKETS, last = 0;
+            for (uint32_t i = 0; i < STATS_SIZE_BUCKETS; i++) {
+                if (h->size_count[i]) {
+                    first = first < i ? first : i;
+                    last = i;
+                }
             }
-            return true;
-        case KEY_DOWN:
-            if ((uint32_t)ui_ctx->current_block + 10 < ui_ctx->fs_info->sb.s_blocks_count) {
-                ui_ctx->current_block += 10;
-                ui_display_block_browser(ui_ctx);
-                ui_display_status(ui_ctx, "Block Browser - Block %d", ui_ctx->current_block);
+            if (first == STATS_SIZE_BUCKETS) {
+                break;
             }
-            return true;
-        case 'e':
-        case 'E':
-            ui_set_mode(ui_ctx, UI_MODE_BINARY_EDITOR);
-            editor_open_structure(ui_ctx->editor_ctx, STRUCTURE_BLOCK, ui_ctx->current_block);
-            return true;
-        case 'g':
-        case 'G': {
-            char buffer[32];
-            if (ui_prompt(ui_ctx, "Enter block number: ", buffer, sizeof(buffer))) {
-                int block = atoi(buffer);
-                if ( (uint32_t)block < ui_ctx->fs_info->sb.s_blocks_count) {
-                    ui_ctx->current_block = block;
-                    ui_display_block_browser(ui_ctx);
-                    ui_display_status(ui_ctx, "Block Browser - Block %d", ui_ctx->current_block);
-                } else {
-                    ui_show_error(ui_ctx, "Invalid block number");
-                }
+            if (scroll > last - first) {
+                scroll = ui_ctx->stats_scroll = last - first;
             }
-            return true;
+            mvwprintw(win, y++, 0, "  %-12s %12s  %12s", "Size from", "Inodes", "Bytes");
+            uint64_t max = ui_max_u64(h->size_count, STATS_SIZE_BUCKETS);
+            for (uint32_t i = first + scroll; i <= last && y < max_y; i++) {
+                stats_size_label(i, label, sizeof(label));
+                ui_stats_row(win, y++, bar_width, label, h->size_count[i], &h->size_bytes[i], max);
+            }
+            break;
+        }
+        case 2: {
+            mvwprintw(win, y++, 0, "  %-12s %12s  %12s", "Modified", "Inodes", "Bytes");
+            uint64_t max = ui_max_u64(h->age_count, STATS_AGE_BUCKETS);
+            for (uint32_t i = 0; i < STATS_AGE_BUCKETS && y < max_y; i++) {
+                ui_stats_row(win, y++, bar_width, stats_age_label(i), h->age_count[i], &h->age_bytes[i], max);
+            }
+            break;
+        }
+        case 3: {
+            int rows = (max_y - y) / 2 - 2;
+            ui_stats_owners(win, &y, rows, "Top owners (uid)", &h->uids, h->bytes);
+            ui_stats_owners(win, &y, rows, "Top groups (gid)", &h->gids, h->bytes);
+            break;
+        }
+        case 4: {
+            fs_info_t *fs_info = ui_ctx->fs_info;
+            int half = (max_x - 41) / 2 > 5 ? (max_x - 41) / 2 : 5;
+            mvwprintw(win, y++, 0, "  %-7s %13s  %13s", "Group", "Inodes used", "Blocks used");
+            if (scroll >= st->groups) {
+                scroll = ui_ctx->stats_scroll = st->groups - 1;
+            }
+            for (uint32_t g = scroll; g < st->groups && y < max_y; g++) {
+                uint32_t blocks = group_block_count(fs_info, g);
+                double inode_pct = 100.0 * st->group_inodes[g] / fs_info->inodes_per_group;
+                double block_pct = blocks ? 100.0 * st->group_blocks[g] / blocks : 0.0;
+                mvwprintw(win, y, 0, "  %-7u %12.1f%%  %12.1f%%  ", g, inode_pct, block_pct);
+                ui_draw_bar(win, y, 41, half - 1, st->group_inodes[g], fs_info->inodes_per_group);
+                ui_draw_bar(win, y, 41 + half, half - 1, st->group_blocks[g], blocks);
+                y++;
+            }
+            break;
         }
-        case 'q':
-        case 'Q':
-            return false;
-        default:
-            return true;
     }
+    pthread_mutex_unlock(&slot->lock);
+
+    wnoutrefresh(win);
 }
 
-static bool ui_handle_inode_browser_input(ui_context_t *ui_ctx, int key) {
-    switch (key) {
-        case 27: // ESC
-            ui_set_mode(ui_ctx, UI_MODE_MENU);
-            return true;
-        case KEY_LEFT:
-            if (ui_ctx->current_inode > 1) {
-                ui_ctx->current_inode--;
-                ui_display_inode_browser(ui_ctx);
-                ui_display_status(ui_ctx, "Inode Browser - Inode %d", ui_ctx->current_inode);
-            }
-            return true;
+typedef enum {
+    UI_EST_COUNT,
+    UI_EST_SIZE,
+    UI_EST_PERCENT
+} ui_est_kind_t;
+
+static void ui_format_estimate(double value, ui_est_kind_t kind, char *buffer, size_t size) {
+    switch (kind) {
+        case UI_EST_COUNT:
+            snprintf(buffer, size, "%.0f", value);
+            break;
+        case UI_EST_SIZE:
+            format_value(value > 0 ? (uint64_t)value : 0, buffer, size, true);
+            break;
+        case UI_EST_PERCENT:
+            snprintf(buffer, size, "%.1f%%", value * 100.0);
+            break;
+    }
+}
+
+static void ui_estimate_row(WINDOW *win, int y, const char *label, estimate_value_t e, ui_est_kind_t kind,
+                            const char *reference) {
+    char value_str[32], margin_str[32] = "?";
+
+    ui_format_estimate(e.value, kind, value_str, sizeof(value_str));
+    if (isfinite(e.margin)) {
+        ui_format_estimate(e.margin, kind, margin_str, sizeof(margin_str));
+    }
+    mvwprintw(win, y, 0, "  %-22s %14s +/- %-12s", label, value_str, margin_str);
+    if (isfinite(e.margin) && e.value != 0) {
+        wprintw(win, " (%5.2f%%)", 100.0 * e.margin / fabs(e.value));
+    }
+    if (reference) {
+        wprintw(win, "  %s", reference);
+    }
+}
+
+// Bar up to the interval's lower bound, dashes across the interval and a mark at the estimate
+static void ui_draw_error_bar(WINDOW *win, int y, int x, int width, estimate_value_t e, double max) {
+    if (max <= 0) {
+        return;
+    }
+    double hi = isfinite(e.margin) ? fmin(e.value + e.margin, max) : e.value;
+    int lo_col = (int)(fmax(e.value - (isfinite(e.margin) ? e.margin : 0), 0) / max * width);
+    int hi_col = (int)(hi / max * width + 0.5);
+    int mark = (int)(e.value / max * width);
+
+    wattron(win, COLOR_PAIR(3));
+    for (int i = 0; i < lo_col && i < width; i++) {
+        mvwaddch(win, y, x + i, '#');
+    }
+    wattroff(win, COLOR_PAIR(3));
+    wattron(win, COLOR_PAIR(5));
+    for (int i = lo_col; i < hi_col && i < width; i++) {
+        mvwaddch(win, y, x + i, '-');
+    }
+    if (e.value > 0 && mark < width) {
+        mvwaddch(win, y, x + mark, '|' | A_BOLD);
+    }
+    wattroff(win, COLOR_PAIR(5));
+}
+
+void ui_display_estimate(ui_context_t *ui_ctx) {
+    WINDOW *win = ui_ctx->main_win;
+    job_slot_t *slot = ui_ctx->estimate;
+    fs_estimate_t est;
+    int max_y, max_x;
+    getmaxyx(win, max_y, max_x);
+
+    werase(win);
+    mvwprintw(win, 0, 0, "Sampled Estimates (95%% confidence)");
+
+    pthread_mutex_lock(&slot->lock);
+    bool valid = slot->result != NULL;
+    bool running = slot->job != NULL;
+    if (valid) {
+        est = *(const fs_estimate_t *)slot->result;
+    }
+    pthread_mutex_unlock(&slot->lock);
+
+    if (!valid) {
+        mvwprintw(win, 2, 0, running ? "Sampling..." : "No estimate yet. Press R to start sampling.");
+        wnoutrefresh(win);
+        return;
+    }
+
+    mvwprintw(win, 2, 0, "Inode table blocks: %lu of %lu (%.1f%%)   Bitmap words: %lu of %lu (%.1f%%)   %.2f s   ",
+              (unsigned long)est.blocks_sampled, (unsigned long)est.table_blocks,
+              100.0 * est.blocks_sampled / est.table_blocks, (unsigned long)est.words_sampled,
+              (unsigned long)est.bitmap_words, 100.0 * est.words_sampled / est.bitmap_words, est.seconds);
+    wattron(win, COLOR_PAIR(running ? 5 : 3));
+    wprintw(win, "%s", running ? "refining" : est.done ? "precise" : "stopped");
+    wattroff(win, COLOR_PAIR(running ? 5 : 3));
+
+    char reference[64];
+    int y = 4;
+    snprintf(reference, sizeof(reference), "superblock: %lu", (unsigned long)est.sb_used_inodes);
+    ui_estimate_row(win, y++, "Allocated inodes", est.files, UI_EST_COUNT, reference);
+    ui_estimate_row(win, y++, "Bytes in files", est.bytes, UI_EST_SIZE, NULL);
+    ui_estimate_row(win, y++, "Average file size", est.avg_size, UI_EST_SIZE, NULL);
+    ui_estimate_row(win, y++, "Fragmented files", est.fragmented, UI_EST_PERCENT, "of files with 2+ blocks");
+    snprintf(reference, sizeof(reference), "superblock: %lu", (unsigned long)est.sb_free_blocks);
+    ui_estimate_row(win, y++, "Free blocks", est.free_blocks, UI_EST_COUNT, reference);
+    ui_estimate_row(win, y++, "Free extents", est.free_extents, UI_EST_COUNT, NULL);
+    ui_estimate_row(win, y++, "Mean free extent", est.extent_length, UI_EST_COUNT, "blocks");
+    y++;
+
+    uint32_t first = STATS_SIZE_BUCKETS, last = 0;
+    double max = 0;
+    for (uint32_t i = 0; i < STATS_SIZE_BUCKETS; i++) {
+        const estimate_value_t *e = &est.sizes[i];
+        if (e->value > 0) {
+            first = first < i ? first : i;
+            last = i;
+            max = fmax(max, isfinite(e->margin) ? e->value + e->margin : e->value);
+        }
+    }
+    if (first == STATS_SIZE_BUCKETS) {
+        wnoutrefresh(win);
+        return;
+    }
+    if (ui_ctx->estimate_scroll > last - first) {
+        ui_ctx->estimate_scroll = last - first;
+    }
+
+    int bar_width = max_x - 46 > 10 ? max_x - 46 : 10;
+    mvwprintw(win, y++, 0, "  %-12s %12s  %12s", "Size from", "Inodes", "+/-");
+    for (uint32_t i = first + ui_ctx->estimate_scroll; i <= last && y < max_y; i++) {
+        const estimate_value_t *e = &est.sizes[i];
+        char label[32], margin_str[32] = "?";
+        stats_size_label(i, label, sizeof(label));
+        if (isfinite(e->margin)) {
+            snprintf(margin_str, sizeof(margin_str), "%.0f", e->margin);
+        }
+        mvwprintw(win, y, 0, "  %-12s %12.0f  %12s  ", label, e->value, margin_str);
+        ui_draw_error_bar(win, y, 44, bar_width, *e, max);
+        y++;
+    }
+
+    wnoutrefresh(win);
+}
+
+void ui_display_usage(ui_context_t *ui_ctx) {
+    WINDOW *win = ui_ctx->main_win;
+    job_slot_t *slot = ui_ctx->usage;
+    int max_y, max_x;
+    getmaxyx(win, max_y, max_x);
+
+    werase(win);
+    mvwprintw(win, 0, 0, "Space Usage");
+    wattron(win, ui_ctx->usage_files ? 0 : COLOR_PAIR(5) | A_BOLD);
+    mvwprintw(win, 1, 0, "[Directories]");
+    wattroff(win, COLOR_PAIR(5) | A_BOLD);
+    wattron(win, ui_ctx->usage_files ? COLOR_PAIR(5) | A_BOLD : 0);
+    mvwprintw(win, 1, 14, "[Files]");
+    wattroff(win, COLOR_PAIR(5) | A_BOLD);
+
+    pthread_mutex_lock(&slot->lock);
+    const du_result_t *r = (const du_result_t *)slot->result;
+    if (slot->job) {
+        mvwprintw(win, 1, 24, "Scanning... %3.0f%%", job_fraction(slot->job) * 100.0);
+    }
+    if (!r) {
+        if (!slot->job) {
+            mvwprintw(win, 3, 0, "No usage data yet. Press R to scan.");
+        }
+        pthread_mutex_unlock(&slot->lock);
+        wnoutrefresh(win);
+        return;
+    }
+
+    char tree_str[32], used_str[32], lost_str[32];
+    format_value(r->tree_bytes, tree_str, sizeof(tree_str), true);
+    format_value(r->used_bytes, used_str, sizeof(used_str), true);
+    format_value(r->unreachable_bytes, lost_str, sizeof(lost_str), true);
+    mvwprintw(win, 2, 0, "%s of %s allocated is under /, %s in %lu unreachable inode(s)%s", tree_str, used_str,
+              lost_str, (unsigned long)r->unreachable_inodes, r->bad_dirs || r->bad_blocks ? ", some directories unreadable" : "");
+
+    const du_entry_t *entries = ui_ctx->usage_files ? r->top_files : r->top_dirs;
+    uint32_t count = ui_ctx->usage_files ? r->top_file_count : r->top_dir_count;
+    int rows = max_y - 5;
+    if (count > 0 && ui_ctx->usage_scroll + (uint32_t)(rows > 0 ? rows : 1) > count) {
+        ui_ctx->usage_scroll = count > (uint32_t)rows ? count - rows : 0;
+    }
+
+    int path_width = max_x - 40 > 10 ? max_x - 40 : 10;
+    mvwprintw(win, 4, 0, "  %12s %6s %10s  %s", "Size", "%", ui_ctx->usage_files ? "Inode" : "Inodes", "Path");
+    for (int row = 0; row < rows && ui_ctx->usage_scroll + row < count; row++) {
+        const du_entry_t *e = &entries[ui_ctx->usage_scroll + row];
+        char size_str[32];
+        size_t len = strlen(e->path);
+        const char *path = len > (size_t)path_width ? e->path + len - path_width : e->path;
+
+        format_value(e->bytes, size_str, sizeof(size_str), true);
+        mvwprintw(win, 5 + row, 0, "  %12s %5.1f%% %10lu  %s", size_str,
+                  r->tree_bytes ? 100.0 * (double)e->bytes / (double)r->tree_bytes : 0.0,
+                  (unsigned long)(ui_ctx->usage_files ? e->ino : e->inodes), path);
+    }
+    pthread_mutex_unlock(&slot->lock);
+
+    wnoutrefresh(win);
+}
+
+void ui_display_freespace(ui_context_t *ui_ctx) {
+    WINDOW *win = ui_ctx->main_win;
+    job_slot_t *slot = ui_ctx->freespace;
+    uint32_t block_size = ui_ctx->fs_info->block_size;
+    int max_y, max_x;
+    getmaxyx(win, max_y, max_x);
+    int bar_width = max_x - 46 > 10 ? max_x - 46 : 10;
+
+    werase(win);
+    mvwprintw(win, 0, 0, "Free Space");
+    wattron(win, ui_ctx->freespace_groups ? 0 : COLOR_PAIR(5) | A_BOLD);
+    mvwprintw(win, 1, 0, "[Extent Lengths]");
+    wattroff(win, COLOR_PAIR(5) | A_BOLD);
+    wattron(win, ui_ctx->freespace_groups ? COLOR_PAIR(5) | A_BOLD : 0);
+    mvwprintw(win, 1, 17, "[Groups]");
+    wattroff(win, COLOR_PAIR(5) | A_BOLD);
+
+    pthread_mutex_lock(&slot->lock);
+    const freespace_t *fs = (const freespace_t *)slot->result;
+    if (slot->job) {
+        mvwprintw(win, 1, 28, "Scanning... %3.0f%%", job_fraction(slot->job) * 100.0);
+    }
+    if (!fs) {
+        if (!slot->job) {
+            mvwprintw(win, 3, 0, "No free space data yet. Press R to scan.");
+        }
+        pthread_mutex_unlock(&slot->lock);
+        wnoutrefresh(win);
+        return;
+    }
+
+    const freespace_hist_t *t = &fs->total;
+    const free_extent_t *largest = freespace_largest(fs);
+    char free_str[32], largest_str[32];
+    format_value(t->free_blocks * block_size, free_str, sizeof(free_str), true);
+    format_value(largest ? (uint64_t)largest->length * block_size : 0, largest_str, sizeof(largest_str), true);
+    mvwprintw(win, 2, 0, "%s free in %lu extent(s), mean %.1f blocks, largest %u blocks (%s)%s", free_str,
+              (unsigned long)t->extents, t->extents ? (double)t->free_blocks / (double)t->extents : 0.0,
+              largest ? largest->length : 0, largest_str, fs->unreadable ? ", some bitmaps unreadable" : "");
+
+    if (ui_ctx->freespace_fit) {
+        uint32_t blocks = ui_ctx->freespace_fit;
+        uint32_t goal = ui_ctx->fs_info->sb.s_first_data_block + ui_ctx->current_group * ui_ctx->fs_info->blocks_per_group;
+        const free_extent_t *best = freespace_best_fit(fs, blocks);
+        const free_extent_t *first = freespace_first_fit(fs, goal, blocks);
+        uint64_t usable;
+        uint32_t fits = freespace_fit_count(fs, blocks, &usable);
+
+        if (!best) {
+            mvwprintw(win, 3, 0, "%u blocks: no free extent is large enough", blocks);
+        } else {
+            mvwprintw(win, 3, 0, "%u blocks: best fit %u at %u, first fit from group %d %u at %u, %u extent(s) fit",
+                      blocks, best->length, best->start, ui_ctx->current_group, first->length, first->start, fits);
+        }
+    }
+
+    int rows = max_y - 6;
+    uint32_t count = 0, max = 0;
+    uint32_t index[FREESPACE_BUCKETS];
+    if (ui_ctx->freespace_groups) {
+        count = fs->groups;
+        for (uint32_t g = 0; g < fs->groups; g++) {
+            max = fs->group_hist[g].free_blocks > max ? (uint32_t)fs->group_hist[g].free_blocks : max;
+        }
+    } else {
+        for (uint32_t b = 0; b < FREESPACE_BUCKETS; b++) {
+            if (t->count[b]) {
+                index[count++] = b;
+            }
+        }
+    }
+    if (count > 0 && ui_ctx->freespace_scroll + (uint32_t)(rows > 0 ? rows : 1) > count) {
+        ui_ctx->freespace_scroll = count > (uint32_t)rows ? count - rows : 0;
+    }
+
+    if (ui_ctx->freespace_groups) {
+        mvwprintw(win, 5, 0, "  %-8s %10s  %9s  %10s  ", "Group", "Free", "Extents", "Largest");
+        for (int row = 0; row < rows && ui_ctx->freespace_scroll + row < count; row++) {
+            uint32_t g = ui_ctx->freespace_scroll + row;
+            const freespace_hist_t *h = &fs->group_hist[g];
+            mvwprintw(win, 6 + row, 0, "  %-8u %10lu  %9lu  %10u  ", g, (unsigned long)h->free_blocks,
+                      (unsigned long)h->extents, h->largest);
+            ui_draw_bar(win, 6 + row, 46, bar_width, h->free_blocks, max);
+        }
+    } else {
+        mvwprintw(win, 5, 0, "  %-14s %10s  %14s  %6s", "Blocks", "Extents", "Free blocks", "Free%");
+        for (int row = 0; row < rows && ui_ctx->freespace_scroll + row < count; row++) {
+            uint32_t b = index[ui_ctx->freespace_scroll + row];
+            char label[32];
+            freespace_bucket_label(b, label, sizeof(label));
+            mvwprintw(win, 6 + row, 0, "  %-14s %10lu  %14lu  %5.1f%%", label, (unsigned long)t->count[b],
+                      (unsigned long)t->blocks[b], t->free_blocks ? 100.0 * (double)t->blocks[b] / (double)t->free_blocks : 0.0);
+            ui_draw_bar(win, 6 + row, 55, bar_width - 9, t->blocks[b], t->free_blocks);
+        }
+    }
+    pthread_mutex_unlock(&slot->lock);
+
+    wnoutrefresh(win);
+}
+
+void ui_display_frag(ui_context_t *ui_ctx) {
+    WINDOW *win = ui_ctx->main_win;
+    job_slot_t *slot = ui_ctx->frag;
+    int max_y, max_x;
+    getmaxyx(win, max_y, max_x);
+    (void)max_x;
+
+    werase(win);
+    mvwprintw(win, 0, 0, "File Fragmentation");
+
+    pthread_mutex_lock(&slot->lock);
+    const frag_result_t *r = (const frag_result_t *)slot->result;
+    if (slot->job) {
+        mvwprintw(win, 1, 0, "Scanning... %3.0f%%", job_fraction(slot->job) * 100.0);
+    }
+    if (!r) {
+        if (!slot->job) {
+            mvwprintw(win, 3, 0, "No fragmentation data yet. Press R to scan.");
+        }
+        pthread_mutex_unlock(&slot->lock);
+        wnoutrefresh(win);
+        return;
+    }
+
+    double score = frag_volume_score(r);
+    mvwprintw(win, 2, 0, "%lu file(s), %lu block(s) in %lu piece(s), %lu fragmented (%.1f%%)%s", (unsigned long)r->files,
+              (unsigned long)r->blocks, (unsigned long)r->fragments, (unsigned long)r->fragmented,
+              r->files ? 100.0 * (double)r->fragmented / (double)r->files : 0.0,
+              r->bad_maps ? ", some block maps unreadable" : "");
+    mvwprintw(win, 3, 0, "Score %.1f: %s, average gap between pieces %.1f blocks", score, frag_verdict(score), r->avg_gap);
+
+    // Piece counts on the left, scores on the right, each with a bar against the file count
+    uint64_t max_count = 0;
+    for (uint32_t b = 0; b < FRAG_COUNT_BUCKETS; b++) {
+        max_count = r->by_count[b] > max_count ? r->by_count[b] : max_count;
+    }
+    for (uint32_t b = 0; b < FRAG_SCORE_BUCKETS; b++) {
+        max_count = r->by_score[b] > max_count ? r->by_score[b] : max_count;
+    }
+    int y = 5, left = 6;
+    char label[32];
+    mvwprintw(win, y, 0, "  %-12s %10s", "Pieces", "Files");
+    mvwprintw(win, y, 44, "%-8s %10s", "Score", "Files");
+    for (uint32_t b = 0; b < FRAG_COUNT_BUCKETS; b++) {
+        if (r->by_count[b] && left < max_y) {
+            frag_count_label(b, label, sizeof(label));
+            mvwprintw(win, left, 0, "  %-12s %10lu ", label, (unsigned long)r->by_count[b]);
+            ui_draw_bar(win, left, 26, 16, r->by_count[b], max_count);
+            left++;
+        }
+    }
+    for (uint32_t b = 0; b < FRAG_SCORE_BUCKETS && y + 1 < max_y; b++) {
+        y++;
+        frag_score_label(b, label, sizeof(label));
+        mvwprintw(win, y, 44, "%-8s %10lu ", label, (unsigned long)r->by_score[b]);
+        ui_draw_bar(win, y, 64, 16, r->by_score[b], max_count);
+    }
+    y = (left > y ? left : y) + 2;
+
+    int rows = max_y - y - 1;
+    uint32_t count = r->worst_count;
+    if (ui_ctx->frag_selected >= count) {
+        ui_ctx->frag_selected = count ? count - 1 : 0;
+    }
+    uint32_t first = rows > 0 && ui_ctx->frag_selected >= (uint32_t)rows ? ui_ctx->frag_selected - rows + 1 : 0;
+    mvwprintw(win, y++, 0, "  %-10s %12s %8s %6s %10s %7s", "Inode", "Blocks", "Pieces", "Ideal", "Avg gap", "Score");
+    for (int row = 0; row < rows && first + row < count; row++) {
+        const frag_file_t *f = &r->worst[first + row];
+        bool selected = first + row == ui_ctx->frag_selected;
+        if (selected) {
+            wattron(win, COLOR_PAIR(5));
+        }
+        mvwprintw(win, y + row, 0, "%c %-10u %12lu %8u %6u %10.1f %7.1f", selected ? '>' : ' ', f->ino,
+                  (unsigned long)f->layout.blocks, f->layout.fragments, f->layout.ideal, f->avg_gap, f->layout.score);
+        if (selected) {
+            wattroff(win, COLOR_PAIR(5));
+        }
+    }
+    pthread_mutex_unlock(&slot->lock);
+
+    wnoutrefresh(win);
+}
+
+// Hex dump of a logged image from its first_row, bytes that differ from the device highlighted
+static void ui_draw_journal_image(WINDOW *win, int y, int rows, uint32_t first_row, const unsigned char *image,
+                                  const unsigned char *current, uint32_t size) {
+    for (int row = 0; row < rows && (first_row + row) * 16 < size; row++) {
+        uint32_t offset = (first_row + row) * 16;
+        mvwprintw(win, y + row, 0, "%04X: ", offset);
+        for (uint32_t i = offset; i < offset + 16; i++) {
+            bool differs = current && image[i] != current[i];
+            if (differs) {
+                wattron(win, COLOR_PAIR(7));
+            }
+            wprintw(win, "%02X", image[i]);
+            if (differs) {
+                wattroff(win, COLOR_PAIR(7));
+            }
+            waddch(win, ' ');
+        }
+        wprintw(win, " | ");
+        for (uint32_t i = offset; i < offset + 16; i++) {
+            waddch(win, isprint(image[i]) ? image[i] : '.');
+        }
+    }
+}
+
+static void ui_display_journal_plan(ui_context_t *ui_ctx, const journal_plan_t *plan, int y) {
+    WINDOW *win = ui_ctx->main_win;
+    int max_y = getmaxy(win);
+
+    mvwprintw(win, y++, 0, "Dry-run replay: %lu image(s) pending, %lu revoked, %u block(s) written, %lu would change (%lu bytes)",
+              (unsigned long)plan->images, (unsigned long)plan->revoked, plan->count, (unsigned long)plan->changed,
+              (unsigned long)plan->changed_bytes);
+    if (plan->sb_changed || plan->out_of_range || plan->unreadable) {
+        wattron(win, COLOR_PAIR(4));
+        mvwprintw(win, y++, 0, "%s%lu target(s) beyond the filesystem, %lu unreadable",
+                  plan->sb_changed ? "Superblock or group descriptors would change; " : "",
+                  (unsigned long)plan->out_of_range, (unsigned long)plan->unreadable);
+        wattroff(win, COLOR_PAIR(4));
+    }
+    y++;
+
+    int rows = max_y - y - 1;
+    if (rows <= 0) {
+        return;
+    }
+    uint32_t limit = plan->count > (uint32_t)rows ? plan->count - rows : 0;
+    if (ui_ctx->journal_scroll > limit) {
+        ui_ctx->journal_scroll = limit;
+    }
+    mvwprintw(win, y++, 0, "  %12s %10s %8s %8s  %s", "Block", "Sequence", "Journal", "Changed", "Holds");
+    for (int row = 0; row < rows && ui_ctx->journal_scroll + row < plan->count; row++) {
+        const journal_replay_t *r = &plan->entries[ui_ctx->journal_scroll + row];
+        if (r->changed) {
+            wattron(win, COLOR_PAIR(3));
+        }
+        mvwprintw(win, y + row, 0, "  %12lu %10u %8u %8u  %s", (unsigned long)r->target, r->sequence, r->jblock,
+                  r->changed, r->kind);
+        if (r->changed) {
+            wattroff(win, COLOR_PAIR(3));
+        }
+    }
+}
+
+void ui_display_journal(ui_context_t *ui_ctx) {
+    WINDOW *win = ui_ctx->main_win;
+    job_slot_t *slot = ui_ctx->journal;
+    int max_y, max_x;
+    getmaxyx(win, max_y, max_x);
+
+    werase(win);
+    mvwprintw(win, 0, 0, "Journal");
+
+    pthread_mutex_lock(&slot->lock);
+    const journal_scan_t *scan = (const journal_scan_t *)slot->result;
+    const journal_t *j = scan ? scan->journal : NULL;
+    if (slot->job) {
+        mvwprintw(win, 1, 0, "Scanning... %3.0f%%", job_fraction(slot->job) * 100.0);
+    }
+    if (!j) {
+        if (!slot->job) {
+            mvwprintw(win, 3, 0, "No journal index yet. Press R to scan, the jobs view says why a scan failed.");
+        }
+        pthread_mutex_unlock(&slot->lock);
+        wnoutrefresh(win);
+        return;
+    }
+
+    if (j->start) {
+        mvwprintw(win, 2, 0, "Inode %u, %u blocks of %u bytes, replay pending from block %u, sequence %u", j->ino,
+                  j->maxlen, j->block_size, j->start, j->sequence);
+    } else {
+        mvwprintw(win, 2, 0, "Inode %u, %u blocks of %u bytes, clean, next sequence %u", j->ino, j->maxlen,
+                  j->block_size, j->sequence);
+    }
+    mvwprintw(win, 3, 0, "%u transaction(s), %u image(s), %lu revoke record(s), walk stopped at %s", j->txn_count,
+              j->block_count, (unsigned long)j->revokes, j->end_reason);
+
+    if (ui_ctx->journal_plan) {
+        ui_display_journal_plan(ui_ctx, scan->plan, 5);
+        pthread_mutex_unlock(&slot->lock);
+        wnoutrefresh(win);
+        return;
+    }
+
+    if (ui_ctx->journal_txn >= j->txn_count) {
+        ui_ctx->journal_txn = j->txn_count ? j->txn_count - 1 : 0;
+    }
+    const journal_txn_t *txn = j->txn_count ? &j->txns[ui_ctx->journal_txn] : NULL;
+    uint32_t images = txn ? txn->count : 0;
+    if (ui_ctx->journal_image >= images) {
+        ui_ctx->journal_image = images ? images - 1 : 0;
+    }
+
+    // Transactions on the left, the images of the selected one on the right
+    int y = 5, right = 52;
+    int list_rows = (max_y - y - 3) / 2;
+    list_rows = list_rows > 10 ? 10 : list_rows;
+    mvwprintw(win, y, 0, "  %10s %7s %6s %6s  %s", "Sequence", "Start", "Blocks", "Images", "State");
+    mvwprintw(win, y, right, "  %12s %8s  %s", "Block", "Journal", "Flags");
+    y++;
+    uint32_t first_txn = ui_ctx->journal_txn >= (uint32_t)list_rows ? ui_ctx->journal_txn - list_rows + 1 : 0;
+    for (int row = 0; row < list_rows && first_txn + row < j->txn_count; row++) {
+        const journal_txn_t *t = &j->txns[first_txn + row];
+        bool selected = first_txn + row == ui_ctx->journal_txn;
+        if (selected) {
+            wattron(win, COLOR_PAIR(5));
+        }
+        mvwprintw(win, y + row, 0, "%c %10u %7u %6u %6u  %s", selected && !ui_ctx->journal_images ? '>' : ' ',
+                  t->sequence, t->start, t->length, t->count,
+                  !t->committed ? "uncommitted" : t->pending ? "pending" : "checkpointed");
+        if (selected) {
+            wattroff(win, COLOR_PAIR(5));
+        }
+    }
+    uint32_t first_image = ui_ctx->journal_image >= (uint32_t)list_rows ? ui_ctx->journal_image - list_rows + 1 : 0;
+    for (int row = 0; txn && row < list_rows && first_image + row < images; row++) {
+        const journal_block_t *b = &j->blocks[txn->first + first_image + row];
+        bool selected = first_image + row == ui_ctx->journal_image;
+        if (selected) {
+            wattron(win, COLOR_PAIR(5));
+        }
+        mvwprintw(win, y + row, right, "%c %12lu %8u  %s%s", selected && ui_ctx->journal_images ? '>' : ' ',
+                  (unsigned long)b->target, b->jblock, b->revoked ? "revoked " : "",
+                  b->flags & JOURNAL_FLAG_ESCAPE ? "escaped" : "");
+        if (selected) {
+            wattroff(win, COLOR_PAIR(5));
+        }
+    }
+    y += list_rows + 1;
+
+    if (!images) {
+        mvwprintw(win, y, 0, "%s", txn ? "The selected transaction logs no block images" : "No transactions in the log");
+        pthread_mutex_unlock(&slot->lock);
+        wnoutrefresh(win);
+        return;
+    }
+
+    const journal_block_t *b = &j->blocks[txn->first + ui_ctx->journal_image];
+    unsigned char *image = (unsigned char *)malloc(j->block_size);
+    unsigned char *current = (unsigned char *)malloc(j->block_size);
+    if (!image || !current || journal_read_image(ui_ctx->fs_info, j, b, image) != 0) {
+        mvwprintw(win, y, 0, "Error reading journal block %u", b->jblock);
+    } else {
+        if (b->target >= ui_ctx->fs_info->sb.s_blocks_count ||
+            read_bytes(ui_ctx->fs_info, b->target * j->block_size, current, j->block_size) != 0) {
+            free(current);
+            current = NULL;
+        }
+        uint32_t differs = 0;
+        for (uint32_t i = 0; current && i < j->block_size; i++) {
+            differs += image[i] != current[i];
+        }
+        mvwprintw(win, y++, 0, "Image of block %lu in journal block %u: ", (unsigned long)b->target, b->jblock);
+        if (current) {
+            wprintw(win, "%u byte(s) differ from the device", differs);
+        } else {
+            wprintw(win, "target unreadable");
+        }
+
+        int rows = max_y - y;
+        uint32_t total = j->block_size / 16;
+        uint32_t limit = rows > 0 && total > (uint32_t)rows ? total - rows : 0;
+        if (ui_ctx->journal_scroll > limit) {
+            ui_ctx->journal_scroll = limit;
+        }
+        if (max_x >= 75) {
+            ui_draw_journal_image(win, y, rows, ui_ctx->journal_scroll, image, current, j->block_size);
+        }
+    }
+    free(image);
+    free(current);
+    pthread_mutex_unlock(&slot->lock);
+
+    wnoutrefresh(win);
+}
+
+void ui_display_deleted(ui_context_t *ui_ctx) {
+    WINDOW *win = ui_ctx->main_win;
+    job_slot_t *slot = ui_ctx->deleted;
+    int max_y = getmaxy(win);
+
+    werase(win);
+    mvwprintw(win, 0, 0, "Deleted Files");
+
+    pthread_mutex_lock(&slot->lock);
+    const undelete_result_t *r = (const undelete_result_t *)slot->result;
+    if (slot->job) {
+        mvwprintw(win, 1, 0, "Scanning... %3.0f%%", job_fraction(slot->job) * 100.0);
+    }
+    if (!r) {
+        if (!slot->job) {
+            mvwprintw(win, 3, 0, "No deleted inode scan yet. Press R to scan.");
+        }
+        pthread_mutex_unlock(&slot->lock);
+        wnoutrefresh(win);
+        return;
+    }
+
+    char bytes[32];
+    format_value(r->recoverable_bytes, bytes, sizeof(bytes), true);
+    mvwprintw(win, 2, 0, "%lu deleted inode(s) among %lu free: %lu full, %lu partial, %lu lost, %s recoverable",
+              (unsigned long)r->deleted, (unsigned long)r->scanned, (unsigned long)r->by_state[UNDELETE_FULL],
+              (unsigned long)r->by_state[UNDELETE_PARTIAL], (unsigned long)r->by_state[UNDELETE_LOST], bytes);
+    if (r->unreadable || r->unreadable_tables) {
+        mvwprintw(win, 3, 0, "%u unreadable block bitmap(s), their groups count as allocated; %u group(s) with "
+                  "unreadable inode tables", r->unreadable, r->unreadable_tables);
+    }
+
+    int y = 5;
+    int rows = max_y - y - 1;
+    uint32_t count = r->file_count;
+    if (ui_ctx->deleted_selected >= count) {
+        ui_ctx->deleted_selected = count ? count - 1 : 0;
+    }
+    uint32_t first = rows > 0 && ui_ctx->deleted_selected >= (uint32_t)rows ? ui_ctx->deleted_selected - rows + 1 : 0;
+    mvwprintw(win, y++, 0, "  %-10s %-5s %12s %-19s %10s %10s %7s  %s", "Inode", "Type", "Size", "Deleted", "Blocks",
+              "Free", "Score", "State");
+    for (int row = 0; row < rows && first + row < count; row++) {
+        const undelete_file_t *f = &r->files[first + row];
+        bool selected = first + row == ui_ctx->deleted_selected;
+        time_t t = (time_t)f->dtime;
+        struct tm *tm = localtime(&t);
+        char when[32] = "-";
+        if (tm) {
+            strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", tm);
+        }
+        int attr = selected ? COLOR_PAIR(5) : f->state == UNDELETE_FULL ? COLOR_PAIR(3) : 0;
+        wattron(win, attr);
+        mvwprintw(win, y + row, 0, "%c %-10u %-5s %12lu %-19s %10lu %10lu %6.1f%%  %s%s", selected ? '>' : ' ', f->ino,
+                  inode_type_name(f->mode), (unsigned long)(f->size ? f->size : f->blocks * ui_ctx->fs_info->block_size),
+                  when, (unsigned long)f->blocks, (unsigned long)f->free_blocks, f->score,
+                  undelete_state_name(f->state), f->map_damaged ? ", map damaged" : "");
+        wattroff(win, attr);
+    }
+    pthread_mutex_unlock(&slot->lock);
+
+    wnoutrefresh(win);
+}
+
+void ui_display_carve(ui_context_t *ui_ctx) {
+    WINDOW *win = ui_ctx->main_win;
+    job_slot_t *slot = ui_ctx->carve;
+    int max_y = getmaxy(win);
+
+    werase(win);
+    mvwprintw(win, 0, 0, "Signature Carving");
+
+    // A running scan shows its hits so far, the last completed one its totals
+    pthread_mutex_lock(&slot->lock);
+    const carve_result_t *r = (const carve_result_t *)slot->result;
+    const carve_result_t *live = (const carve_result_t *)slot->partial;
+    const carve_hit_t *hits = NULL;
+    uint32_t count = 0;
+    if (slot->job) {
+        count = live ? live->hit_count : 0;
+        mvwprintw(win, 1, 0, "Scanning... %3.0f%%, %u hit(s) so far", job_fraction(slot->job) * 100.0, count);
+        hits = live ? live->hits : NULL;
+    } else if (r) {
+        char bytes[32];
+        format_value(r->scanned * ui_ctx->fs_info->block_size, bytes, sizeof(bytes), true);
+        mvwprintw(win, 1, 0, "%u hit(s) listed in %lu free block(s) (%s) of %lu extent(s), %.2f s", r->hit_count,
+                  (unsigned long)r->scanned, bytes, (unsigned long)r->extents, r->seconds);
+        int x = 0;
+        wmove(win, 2, 0);
+        for (uint32_t i = 0; i < carve_signature_count(); i++) {
+            if (r->counts[i]) {
+                wprintw(win, "%s%s %lu (%lu aligned)", x++ ? ", " : "", carve_signature_name(i),
+                        (unsigned long)r->counts[i], (unsigned long)r->aligned[i]);
+            }
+        }
+        if (r->unreadable || r->unreadable_bitmaps || r->dropped) {
+            mvwprintw(win, 3, 0, "%lu unreadable block(s), %u unreadable bitmap(s), %lu hit(s) not listed",
+                      (unsigned long)r->unreadable, r->unreadable_bitmaps, (unsigned long)r->dropped);
+        }
+        hits = r->hits;
+        count = r->hit_count;
+    } else {
+        mvwprintw(win, 3, 0, "No carving scan yet. Press R to scan.");
+    }
+
+    int y = 5;
+    int rows = max_y - y - 1;
+    if (ui_ctx->carve_selected >= count) {
+        ui_ctx->carve_selected = count ? count - 1 : 0;
+    }
+    uint32_t first = rows > 0 && ui_ctx->carve_selected >= (uint32_t)rows ? ui_ctx->carve_selected - rows + 1 : 0;
+    if (count) {
+        mvwprintw(win, y++, 0, "  %-12s %12s %8s  %s", "Signature", "Block", "Offset", "Byte");
+    }
+    for (int row = 0; row < rows && first + row < count; row++) {
+        const carve_hit_t *hit = &hits[first + row];
+        bool selected = first + row == ui_ctx->carve_selected;
+        // Files start on a block boundary, so aligned hits are the likely ones
+        int attr = selected ? COLOR_PAIR(5) : hit->offset == 0 ? COLOR_PAIR(3) : 0;
+        wattron(win, attr);
+        mvwprintw(win, y + row, 0, "%c %-12s %12lu %8u  %lu", selected ? '>' : ' ', carve_signature_name(hit->signature),
+                  (unsigned long)hit->block, hit->offset,
+                  (unsigned long)(hit->block * ui_ctx->fs_info->block_size + hit->offset));
+        wattroff(win, attr);
+    }
+    pthread_mutex_unlock(&slot->lock);
+
+    wnoutrefresh(win);
+}
+
+#define UI_CONTENT_PAGES 4
+
+static const char *ui_content_pages[UI_CONTENT_PAGES] = { "Zero", "Entropy", "Dense", "Files" };
+
+// Heatmap cells per row, after the group number label
+static uint32_t ui_content_columns(ui_context_t *ui_ctx) {
+    int max_x = getmaxx(ui_ctx->main_win);
+    return max_x > 9 ? (uint32_t)(max_x - 9) : 1;
+}
+
+// Value of a group on a heatmap page, 0 to 1, or below 0 when no data block lies in it
+static double ui_content_value(const content_counts_t *c, uint32_t page) {
+    if (!c->blocks) {
+        return -1.0;
+    }
+    switch (page) {
+        case 0:
+            return (double)c->zero / (double)c->blocks;
+        case 1:
+            return c->blocks > c->zero ? content_mean_entropy(c) / 8.0 : -1.0;
+        default:
+            return (double)c->dense / (double)c->blocks;
+    }
+}
+
+static void ui_content_files(WINDOW *win, int y, int rows, const char *title, const content_file_t *files,
+                             uint32_t count) {
+    mvwprintw(win, y++, 0, "%s", title);
+    mvwprintw(win, y++, 0, "  %-10s %12s %12s %7s", "Inode", "Blocks", "Count", "Share");
+    for (uint32_t i = 0; i < count && (int)i < rows - 2; i++) {
+        mvwprintw(win, y++, 0, "  %-10u %12lu %12lu %6.1f%%", files[i].ino, (unsigned long)files[i].blocks,
+                  (unsigned long)files[i].count, 100.0 * (double)files[i].count / (double)files[i].blocks);
+    }
+}
+
+void ui_display_content(ui_context_t *ui_ctx) {
+    WINDOW *win = ui_ctx->main_win;
+    job_slot_t *slot = ui_ctx->content;
+    uint32_t block_size = ui_ctx->fs_info->block_size;
+    int max_y = getmaxy(win);
+
+    werase(win);
+    mvwprintw(win, 0, 0, "Zero & Entropy Map");
+    int x = 0;
+    for (uint32_t p = 0; p < UI_CONTENT_PAGES; p++) {
+        if (p == ui_ctx->content_page) {
+            wattron(win, COLOR_PAIR(5) | A_BOLD);
+        }
+        mvwprintw(win, 1, x, "[%s]", ui_content_pages[p]);
+        if (p == ui_ctx->content_page) {
+            wattroff(win, COLOR_PAIR(5) | A_BOLD);
+        }
+        x += (int)strlen(ui_content_pages[p]) + 3;
+    }
+
+    pthread_mutex_lock(&slot->lock);
+    const content_result_t *r = (const content_result_t *)slot->result;
+    if (slot->job) {
+        mvwprintw(win, 2, 0, "Reading data blocks... %3.0f%%", job_fraction(slot->job) * 100.0);
+    }
+    if (!r) {
+        if (!slot->job) {
+            mvwprintw(win, 3, 0, "No content scan yet. Press R to read the data blocks.");
+        }
+        pthread_mutex_unlock(&slot->lock);
+        wnoutrefresh(win);
+        return;
+    }
+
+    const content_counts_t *t = &r->total;
+    char bytes[32];
+    format_value(t->blocks * block_size, bytes, sizeof(bytes), true);
+    mvwprintw(win, 3, 0, "%lu block(s) (%s) of %lu file(s): %.1f%% zero, %.1f%% incompressible, %.2f bits/byte, %.2f s",
+              (unsigned long)t->blocks, bytes, (unsigned long)r->files,
+              t->blocks ? 100.0 * (double)t->zero / (double)t->blocks : 0.0,
+              t->blocks ? 100.0 * (double)t->dense / (double)t->blocks : 0.0, content_mean_entropy(t), r->seconds);
+    if (r->bad_maps || r->unreadable || r->unreadable_tables) {
+        mvwprintw(win, 4, 0, "%u block map(s) not followed, %lu unreadable block(s), %u unreadable inode table(s)",
+                  r->bad_maps, (unsigned long)r->unreadable, r->unreadable_tables);
+    }
+
+    int y = 6;
+    if (ui_ctx->content_page == UI_CONTENT_PAGES - 1) {
+        int rows = (max_y - y) / 2;
+        ui_content_files(win, y, rows, "Most zero blocks", r->zero_files, r->zero_count);
+        ui_content_files(win, y + rows, rows, "Most incompressible blocks", r->dense_files, r->dense_count);
+        pthread_mutex_unlock(&slot->lock);
+        wnoutrefresh(win);
+        return;
+    }
+
+    // One cell per group, darker characters and warmer colors for larger shares
+    static const char shades[] = ".:-=+*#%@";
+    uint32_t columns = ui_content_columns(ui_ctx);
+    uint32_t total_rows = (r->groups + columns - 1) / columns;
+    int rows = max_y - y - 3;
+    if (ui_ctx->content_group >= r->groups) {
+        ui_ctx->content_group = r->groups ? r->groups - 1 : 0;
+    }
+    uint32_t selected_row = ui_ctx->content_group / columns;
+    uint32_t first = rows > 0 && selected_row >= (uint32_t)rows ? selected_row - rows + 1 : 0;
+    for (int row = 0; row < rows && first + row < total_rows; row++) {
+        uint32_t g0 = (first + row) * columns;
+        mvwprintw(win, y + row, 0, "%8u ", g0);
+        for (uint32_t c = 0; c < columns && g0 + c < r->groups; c++) {
+            double v = ui_content_value(&r->by_group[g0 + c], ui_ctx->content_page);
+            int level = v < 0.0 ? -1 : (int)(v * 9.0) > 8 ? 8 : (int)(v * 9.0);
+            int attr = g0 + c == ui_ctx->content_group ? COLOR_PAIR(2) : level >= 6 ? COLOR_PAIR(4) :
+                       level >= 3 ? COLOR_PAIR(5) : 0;
+            wattron(win, attr);
+            mvwaddch(win, y + row, 9 + (int)c, level < 0 ? ' ' : (chtype)shades[level]);
+            wattroff(win, attr);
+        }
+    }
+
+    y = max_y - 2;
+    mvwprintw(win, y - 1, 0, "Scale %s low to high, blank: no data blocks", shades);
+    if (ui_ctx->content_group < r->groups) {
+        const content_counts_t *c = &r->by_group[ui_ctx->content_group];
+        format_value(c->blocks * block_size, bytes, sizeof(bytes), true);
+        mvwprintw(win, y, 0, "Group %u: %lu data block(s) (%s), %lu zero (%.1f%%), %lu incompressible (%.1f%%), %.2f bits/byte",
+                  ui_ctx->content_group, (unsigned long)c->blocks, bytes, (unsigned long)c->zero,
+                  c->blocks ? 100.0 * (double)c->zero / (double)c->blocks : 0.0, (unsigned long)c->dense,
+                  c->blocks ? 100.0 * (double)c->dense / (double)c->blocks : 0.0, content_mean_entropy(c));
+    }
+    pthread_mutex_unlock(&slot->lock);
+
+    wnoutrefresh(win);
+}
+
+void ui_display_jobs(ui_context_t *ui_ctx) {
+    werase(ui_ctx->main_win);
+    
+    int max_y, max_x;
+    getmaxyx(ui_ctx->main_win, max_y, max_x);
+    
+    job_manager_t *mgr = ui_ctx->jobs;
+    
+    mvwprintw(ui_ctx->main_win, 0, 0, "Background Jobs (%u running)", job_running_count(mgr));
+    mvwprintw(ui_ctx->main_win, 1, 0, "===============================");
+    
+    if (mgr->count == 0) {
+        mvwprintw(ui_ctx->main_win, 3, 2, "No jobs. Press V, S, / or E to start a scan.");
+        wnoutrefresh(ui_ctx->main_win);
+        return;
+    }
+    
+    if (ui_ctx->selected_job >= mgr->count) {
+        ui_ctx->selected_job = mgr->count - 1;
+    }
+    
+    const int bar_width = 30;
+    int y = 3;
+    for (uint32_t i = 0; i < mgr->count; i++) {
+        job_t *job = mgr->jobs[i];
+        double fraction = job_fraction(job);
+        int filled = (int)(fraction * bar_width);
+        
+        if (i == ui_ctx->selected_job) {
+            wattron(ui_ctx->main_win, COLOR_PAIR(5));
+        }
+        mvwprintw(ui_ctx->main_win, y, 0, "%c %-28.28s [", i == ui_ctx->selected_job ? '>' : ' ', job->name);
+        for (int b = 0; b < bar_width; b++) {
+            waddch(ui_ctx->main_win, b < filled ? '#' : '-');
+        }
+        wprintw(ui_ctx->main_win, "] %3d%%  %s", (int)(fraction * 100.0), job_state_string(atomic_load(&job->state)));
+        if (i == ui_ctx->selected_job) {
+            wattroff(ui_ctx->main_win, COLOR_PAIR(5));
+        }
+        y++;
+    }
+    
+    job_t *job = mgr->jobs[ui_ctx->selected_job];
+    y++;
+    wattron(ui_ctx->main_win, COLOR_PAIR(6));
+    mvwprintw(ui_ctx->main_win, y++, 0, "Output of %s:", job->name);
+    wattroff(ui_ctx->main_win, COLOR_PAIR(6));
+    
+    // Show the most recent lines that fit below the job list
+    int rows = max_y - y;
+    if (rows <= 0) {
+        wnoutrefresh(ui_ctx->main_win);
+        return;
+    }
+    
+    char (*lines)[JOB_LINE_LEN] = malloc((size_t)rows * JOB_LINE_LEN);
+    if (lines) {
+        uint32_t total = job_line_count(job);
+        uint32_t first = total > (uint32_t)rows ? total - rows : 0;
+        uint32_t copied = job_copy_lines(job, first, rows, lines);
+        
+        for (uint32_t i = 0; i < copied; i++) {
+            mvwprintw(ui_ctx->main_win, y++, 2, "%.*s", max_x - 2, lines[i]);
+        }
+        free(lines);
+    }
+    
+    wnoutrefresh(ui_ctx->main_win);
+}
+
+static void ui_start_job(ui_context_t *ui_ctx, const char *name, job_func_t func, void *arg, void (*free_arg)(void *)) {
+    if (!job_start(ui_ctx->jobs, name, func, arg, free_arg)) {
+        if (free_arg) {
+            free_arg(arg);
+        }
+        ui_show_error(ui_ctx, "Cannot start job (dismiss finished jobs first)");
+        return;
+    }
+    ui_ctx->selected_job = ui_ctx->jobs->count - 1;
+}
+
+// Starts a job filling slot unless one already does, without force only while the slot holds no
+// result. The slot is claimed under its lock, so a second quick start finds it taken.
+static void ui_start_slot_job(ui_context_t *ui_ctx, job_slot_t *slot, const char *name, job_func_t func, bool force) {
+    bool failed = false;
+
+    pthread_mutex_lock(&slot->lock);
+    if (!slot->job && (force || !slot->result)) {
+        slot->job = job_start(ui_ctx->jobs, name, func, slot, NULL);
+        failed = !slot->job;
+    }
+    pthread_mutex_unlock(&slot->lock);
+
+    if (failed) {
+        ui_show_error(ui_ctx, "Cannot start job (dismiss finished jobs first)");
+    } else {
+        ui_ctx->selected_job = ui_ctx->jobs->count - 1;
+    }
+}
+
+static bool ui_handle_jobs_input(ui_context_t *ui_ctx, int key) {
+    job_manager_t *mgr = ui_ctx->jobs;
+    
+    ui_ctx->dirty |= UI_DIRTY_MAIN;
+    
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case KEY_UP:
+            if (ui_ctx->selected_job > 0) {
+                ui_ctx->selected_job--;
+            }
+            return true;
+        case KEY_DOWN:
+            if (ui_ctx->selected_job + 1 < mgr->count) {
+                ui_ctx->selected_job++;
+            }
+            return true;
+        case 'v':
+        case 'V':
+            ui_start_job(ui_ctx, "Verify group counters", scan_verify_job, ui_ctx->fs_info, NULL);
+            return true;
+        case 's':
+        case 'S':
+            ui_start_job(ui_ctx, "Inode statistics", scan_stats_job, ui_ctx->snapshots, NULL);
+            return true;
+        case 'k':
+        case 'K':
+            ui_start_job(ui_ctx, "Checksum audit", csum_job, ui_ctx->fs_info, NULL);
+            return true;
+        case 'f':
+        case 'F':
+            ui_start_job(ui_ctx, "Consistency check", fsck_job, ui_ctx->fs_info, NULL);
+            return true;
+        case 'l':
+        case 'L':
+            ui_start_job(ui_ctx, "Link counts", fsck_links_job, ui_ctx->fs_info, NULL);
+            return true;
+        case 'e':
+        case 'E': {
+            export_job_arg_t *ex = (export_job_arg_t *)calloc(1, sizeof(export_job_arg_t));
+            if (!ex) {
+                ui_show_error(ui_ctx, "Memory allocation error");
+                return true;
+            }
+            char format[16];
+            if (!ui_prompt(ui_ctx, "Export inodes to file: ", ex->path, sizeof(ex->path)) || !ex->path[0] ||
+                !ui_prompt(ui_ctx, "Format (csv/ndjson): ", format, sizeof(format))) {
+                free(ex);
+                return true;
+            }
+            if (format[0] && export_parse_format(format, &ex->format) != 0) {
+                free(ex);
+                ui_show_error(ui_ctx, "Unknown export format");
+                return true;
+            }
+            ex->fs_info = ui_ctx->fs_info;
+
+            char name[64];
+            snprintf(name, sizeof(name), "Export to %.50s", ex->path);
+            ui_start_job(ui_ctx, name, export_inodes_job, ex, free);
+            return true;
+        }
+        case '/': {
+            char buffer[128];
+            if (ui_prompt(ui_ctx, "Search text (or hex:DEADBEEF): ", buffer, sizeof(buffer))) {
+                scan_search_arg_t *search = (scan_search_arg_t *)calloc(1, sizeof(scan_search_arg_t));
+                if (!search) {
+                    ui_show_error(ui_ctx, "Memory allocation error");
+                    return true;
+                }
+                int len = parse_search_pattern(buffer, search->pattern, sizeof(search->pattern));
+                if (len <= 0) {
+                    free(search);
+                    ui_show_error(ui_ctx, "Invalid search pattern");
+                    return true;
+                }
+                search->fs_info = ui_ctx->fs_info;
+                search->pattern_len = (size_t)len;
+                
+                char name[64];
+                snprintf(name, sizeof(name), "Search \"%.40s\"", buffer);
+                ui_start_job(ui_ctx, name, scan_search_job, search, free);
+            }
+            return true;
+        }
+        case 'c':
+        case 'C':
+            if (ui_ctx->selected_job < mgr->count) {
+                job_cancel(mgr->jobs[ui_ctx->selected_job]);
+            }
+            return true;
+        case 'd':
+        case 'D':
+            if (job_dismiss(mgr, ui_ctx->selected_job) != 0) {
+                ui_show_error(ui_ctx, "Only finished jobs can be dismissed");
+            } else if (ui_ctx->selected_job > 0 && ui_ctx->selected_job >= mgr->count) {
+                ui_ctx->selected_job--;
+            }
+            return true;
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            return true;
+    }
+}
+
+static bool ui_handle_binary_editor_input(ui_context_t *ui_ctx, int key) {
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case 'q':
+        case 'Q':
+            return false;
+        case '/':
+        case '?': {
+            char buffer[128];
+            uint8_t pattern[SEARCH_PATTERN_MAX];
+            if (!ui_prompt(ui_ctx, key == '/' ? "Find forward, text or hex:DEADBEEF: "
+                                              : "Find backward, text or hex:DEADBEEF: ", buffer, sizeof(buffer))) {
+                return true;
+            }
+            int len = parse_search_pattern(buffer, pattern, sizeof(pattern));
+            if (len <= 0) {
+                ui_show_error(ui_ctx, "Invalid search pattern");
+                return true;
+            }
+            editor_set_search(ui_ctx->editor_ctx, pattern, (size_t)len);
+            editor_find(ui_ctx->editor_ctx, key == '?');
+            ui_ctx->dirty |= UI_DIRTY_MAIN;
+            return true;
+        }
+        default:
+            // The editor tracks its own damage, so a repaint here is incremental
+            ui_ctx->dirty |= UI_DIRTY_MAIN;
+            return editor_handle_key(ui_ctx->editor_ctx, key);
+    }
+}
+
+static bool ui_handle_bitmap_editor_input(ui_context_t *ui_ctx, int key) {
+    bitmap_editor_t *ed = ui_ctx->bitmap_ed;
+
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case 'r': case 'R': {
+            char buffer[64];
+            unsigned long first, last;
+            char op;
+            if (ui_prompt(ui_ctx, "Range to mark, e.g. 1000-5000 + (used) or - (free): ", buffer, sizeof(buffer))) {
+                if (sscanf(buffer, "%lu-%lu %c", &first, &last, &op) == 3 && (op == '+' || op == '-')) {
+                    if (bitmap_editor_fill(ed, first, last, op == '+') < 0) {
+                        ui_show_error(ui_ctx, "Range is outside this group");
+                    }
+                } else {
+                    ui_show_error(ui_ctx, "Expected FIRST-LAST followed by + or -");
+                }
+            }
+            ui_ctx->dirty |= UI_DIRTY_MAIN;
+            return true;
+        }
+        case 'g': case 'G': {
+            char buffer[32];
+            unsigned long number;
+            if (ui_prompt(ui_ctx, ed->kind == BITMAP_BLOCKS ? "Go to block: " : "Go to inode: ", buffer, sizeof(buffer)) &&
+                sscanf(buffer, "%lu", &number) == 1) {
+                uint64_t base = bitmap_editor_object(ed, 0);
+                if (number >= base && number < base + ed->bit_count) {
+                    bitmap_editor_set_cursor(ed, (uint32_t)(number - base));
+                } else {
+                    ui_show_error(ui_ctx, "Not in this group, use [ and ] to change group");
+                }
+            }
+            ui_ctx->dirty |= UI_DIRTY_MAIN;
+            return true;
+        }
+        default:
+            ui_ctx->dirty |= UI_DIRTY_MAIN;
+            return bitmap_editor_handle_key(ed, key);
+    }
+}
+
+// Starts a statistics collection unless one is running; without force only when nothing was collected yet
+static void ui_start_stats(ui_context_t *ui_ctx, bool force) {
+    ui_start_slot_job(ui_ctx, ui_ctx->stats, "Filesystem statistics", stats_job, force);
+}
+
+static bool ui_handle_stats_input(ui_context_t *ui_ctx, int key) {
+    ui_ctx->dirty |= UI_DIRTY_MAIN;
+
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case '\t':
+        case KEY_RIGHT:
+            ui_ctx->stats_page = (ui_ctx->stats_page + 1) % UI_STATS_PAGES;
+            ui_ctx->stats_scroll = 0;
+            return true;
+        case KEY_BTAB:
+        case KEY_LEFT:
+            ui_ctx->stats_page = (ui_ctx->stats_page + UI_STATS_PAGES - 1) % UI_STATS_PAGES;
+            ui_ctx->stats_scroll = 0;
+            return true;
+        case KEY_UP:
+            if (ui_ctx->stats_scroll > 0) {
+                ui_ctx->stats_scroll--;
+            }
+            return true;
+        case KEY_DOWN:
+            ui_ctx->stats_scroll++;
+            return true;
+        case 'r':
+        case 'R':
+            ui_start_stats(ui_ctx, true);
+            return true;
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            return true;
+    }
+}
+
+// Starts sampling unless a run is in progress; without force only when there is no estimate yet
+static void ui_start_estimate(ui_context_t *ui_ctx, bool force) {
+    ui_start_slot_job(ui_ctx, ui_ctx->estimate, "Sampling estimate", estimate_job, force);
+}
+
+static bool ui_handle_estimate_input(ui_context_t *ui_ctx, int key) {
+    ui_ctx->dirty |= UI_DIRTY_MAIN;
+
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case KEY_UP:
+            if (ui_ctx->estimate_scroll > 0) {
+                ui_ctx->estimate_scroll--;
+            }
+            return true;
+        case KEY_DOWN:
+            ui_ctx->estimate_scroll++;
+            return true;
+        case 'r':
+        case 'R':
+            ui_start_estimate(ui_ctx, true);
+            return true;
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            return true;
+    }
+}
+
+static void ui_start_usage(ui_context_t *ui_ctx, bool force) {
+    ui_start_slot_job(ui_ctx, ui_ctx->usage, "Space usage", du_job, force);
+}
+
+static bool ui_handle_usage_input(ui_context_t *ui_ctx, int key) {
+    int page = getmaxy(ui_ctx->main_win) - 6;
+
+    ui_ctx->dirty |= UI_DIRTY_MAIN;
+
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case '\t':
+        case KEY_BTAB:
+        case KEY_LEFT:
+        case KEY_RIGHT:
+            ui_ctx->usage_files = !ui_ctx->usage_files;
+            ui_ctx->usage_scroll = 0;
+            return true;
+        case KEY_UP:
+            if (ui_ctx->usage_scroll > 0) {
+                ui_ctx->usage_scroll--;
+            }
+            return true;
+        case KEY_DOWN:
+            ui_ctx->usage_scroll++;
+            return true;
+        case KEY_PPAGE:
+            ui_ctx->usage_scroll = ui_ctx->usage_scroll > (uint32_t)page ? ui_ctx->usage_scroll - page : 0;
+            return true;
+        case KEY_NPAGE:
+            ui_ctx->usage_scroll += page;
+            return true;
+        case 'r':
+        case 'R':
+            ui_start_usage(ui_ctx, true);
+            return true;
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            return true;
+    }
+}
+
+static void ui_start_freespace(ui_context_t *ui_ctx, bool force) {
+    ui_start_slot_job(ui_ctx, ui_ctx->freespace, "Free space", freespace_job, force);
+}
+
+static bool ui_handle_freespace_input(ui_context_t *ui_ctx, int key) {
+    int page = getmaxy(ui_ctx->main_win) - 7;
+
+    ui_ctx->dirty |= UI_DIRTY_MAIN;
+
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case '\t':
+        case KEY_BTAB:
+        case KEY_LEFT:
+        case KEY_RIGHT:
+            ui_ctx->freespace_groups = !ui_ctx->freespace_groups;
+            ui_ctx->freespace_scroll = 0;
+            return true;
+        case KEY_UP:
+            if (ui_ctx->freespace_scroll > 0) {
+                ui_ctx->freespace_scroll--;
+            }
+            return true;
+        case KEY_DOWN:
+            ui_ctx->freespace_scroll++;
+            return true;
+        case KEY_PPAGE:
+            ui_ctx->freespace_scroll = ui_ctx->freespace_scroll > (uint32_t)page ? ui_ctx->freespace_scroll - page : 0;
+            return true;
+        case KEY_NPAGE:
+            ui_ctx->freespace_scroll += page;
+            return true;
+        case 'f':
+        case 'F': {
+            char buffer[32];
+            uint32_t blocks;
+            if (ui_prompt(ui_ctx, "Allocation size (blocks, or bytes with K/M/G/T): ", buffer, sizeof(buffer))) {
+                if (freespace_parse_size(buffer, ui_ctx->fs_info->block_size, &blocks) == 0) {
+                    ui_ctx->freespace_fit = blocks;
+                } else {
+                    ui_show_error(ui_ctx, "Invalid size");
+                }
+            }
+            return true;
+        }
+        case 'r':
+        case 'R':
+            ui_start_freespace(ui_ctx, true);
+            return true;
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            return true;
+    }
+}
+
+static void ui_start_frag(ui_context_t *ui_ctx, bool force) {
+    ui_start_slot_job(ui_ctx, ui_ctx->frag, "Fragmentation", frag_job, force);
+}
+
+static bool ui_handle_frag_input(ui_context_t *ui_ctx, int key) {
+    job_slot_t *slot = ui_ctx->frag;
+    int page = getmaxy(ui_ctx->main_win) / 2;
+
+    ui_ctx->dirty |= UI_DIRTY_MAIN;
+
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case KEY_UP:
+            if (ui_ctx->frag_selected > 0) {
+                ui_ctx->frag_selected--;
+            }
+            return true;
+        case KEY_DOWN:
+            ui_ctx->frag_selected++;
+            return true;
+        case KEY_PPAGE:
+            ui_ctx->frag_selected = ui_ctx->frag_selected > (uint32_t)page ? ui_ctx->frag_selected - page : 0;
+            return true;
+        case KEY_NPAGE:
+            ui_ctx->frag_selected += page;
+            return true;
+        case '\n':
+        case KEY_ENTER: {
+            uint32_t ino = 0;
+            pthread_mutex_lock(&slot->lock);
+            const frag_result_t *r = (const frag_result_t *)slot->result;
+            if (r && ui_ctx->frag_selected < r->worst_count) {
+                ino = r->worst[ui_ctx->frag_selected].ino;
+            }
+            pthread_mutex_unlock(&slot->lock);
+            if (ino) {
+                ui_ctx->current_inode = (int)ino;
+                ui_set_mode(ui_ctx, UI_MODE_INODE_BROWSER);
+            }
+            return true;
+        }
+        case 'r':
+        case 'R':
+            ui_start_frag(ui_ctx, true);
+            return true;
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            return true;
+    }
+}
+
+static void ui_start_journal(ui_context_t *ui_ctx, bool force) {
+    ui_start_slot_job(ui_ctx, ui_ctx->journal, "Journal scan", journal_job, force);
+}
+
+static bool ui_handle_journal_input(ui_context_t *ui_ctx, int key) {
+    job_slot_t *slot = ui_ctx->journal;
+    int page = getmaxy(ui_ctx->main_win) / 2;
+
+    ui_ctx->dirty |= UI_DIRTY_MAIN;
+
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case '\t':
+            ui_ctx->journal_images = !ui_ctx->journal_images;
+            return true;
+        case KEY_UP:
+            if (ui_ctx->journal_plan) {
+                ui_ctx->journal_scroll -= ui_ctx->journal_scroll > 0;
+            } else if (ui_ctx->journal_images) {
+                ui_ctx->journal_image -= ui_ctx->journal_image > 0;
+                ui_ctx->journal_scroll = 0;
+            } else if (ui_ctx->journal_txn > 0) {
+                ui_ctx->journal_txn--;
+                ui_ctx->journal_image = 0;
+                ui_ctx->journal_scroll = 0;
+            }
+            return true;
+        case KEY_DOWN:
+            if (ui_ctx->journal_plan) {
+                ui_ctx->journal_scroll++;
+            } else if (ui_ctx->journal_images) {
+                ui_ctx->journal_image++;
+                ui_ctx->journal_scroll = 0;
+            } else {
+                ui_ctx->journal_txn++;
+                ui_ctx->journal_image = 0;
+                ui_ctx->journal_scroll = 0;
+            }
+            return true;
+        case KEY_PPAGE:
+            ui_ctx->journal_scroll = ui_ctx->journal_scroll > (uint32_t)page ? ui_ctx->journal_scroll - page : 0;
+            return true;
+        case KEY_NPAGE:
+            ui_ctx->journal_scroll += page;
+            return true;
+        case '\n':
+        case KEY_ENTER: {
+            uint64_t target = 0;
+            bool found = false;
+            pthread_mutex_lock(&slot->lock);
+            const journal_scan_t *scan = (const journal_scan_t *)slot->result;
+            const journal_t *j = scan ? scan->journal : NULL;
+            if (!ui_ctx->journal_plan && j && ui_ctx->journal_txn < j->txn_count &&
+                ui_ctx->journal_image < j->txns[ui_ctx->journal_txn].count) {
+                target = j->blocks[j->txns[ui_ctx->journal_txn].first + ui_ctx->journal_image].target;
+                found = true;
+            }
+            pthread_mutex_unlock(&slot->lock);
+            if (found && target < ui_ctx->fs_info->sb.s_blocks_count) {
+                ui_ctx->current_block = (int)target;
+                ui_set_mode(ui_ctx, UI_MODE_BLOCK_BROWSER);
+            }
+            return true;
+        }
+        case 'p':
+        case 'P':
+            ui_ctx->journal_plan = !ui_ctx->journal_plan;
+            ui_ctx->journal_scroll = 0;
+            ui_ctx->dirty |= UI_DIRTY_HELP;
+            return true;
+        case 'r':
+        case 'R':
+            ui_start_journal(ui_ctx, true);
+            return true;
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            return true;
+    }
+}
+
+static void ui_start_deleted(ui_context_t *ui_ctx, bool force) {
+    ui_start_slot_job(ui_ctx, ui_ctx->deleted, "Deleted inodes", undelete_job, force);
+}
+
+// Prompts for the output directory and extracts one inode, or every recoverable one when ino is 0
+static void ui_start_extract(ui_context_t *ui_ctx, uint32_t ino) {
+    undelete_job_arg_t *ex = (undelete_job_arg_t *)calloc(1, sizeof(undelete_job_arg_t));
+    if (!ex) {
+        ui_show_error(ui_ctx, "Memory allocation error");
+        return;
+    }
+    if (!ui_prompt(ui_ctx, "Extract to directory: ", ex->dir, sizeof(ex->dir))) {
+        free(ex);
+        return;
+    }
+    ex->fs_info = ui_ctx->fs_info;
+    ex->ino = ino;
+
+    char name[64];
+    if (ino) {
+        snprintf(name, sizeof(name), "Extract inode %u", ino);
+    } else {
+        snprintf(name, sizeof(name), "Extract deleted to %.40s", ex->dir);
+    }
+    ui_start_job(ui_ctx, name, undelete_extract_job, ex, free);
+}
+
+static bool ui_handle_deleted_input(ui_context_t *ui_ctx, int key) {
+    job_slot_t *slot = ui_ctx->deleted;
+    int page = getmaxy(ui_ctx->main_win) / 2;
+    uint32_t ino = 0;
+
+    ui_ctx->dirty |= UI_DIRTY_MAIN;
+
+    pthread_mutex_lock(&slot->lock);
+    const undelete_result_t *r = (const undelete_result_t *)slot->result;
+    if (r && ui_ctx->deleted_selected < r->file_count) {
+        ino = r->files[ui_ctx->deleted_selected].ino;
+    }
+    pthread_mutex_unlock(&slot->lock);
+
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case KEY_UP:
+            if (ui_ctx->deleted_selected > 0) {
+                ui_ctx->deleted_selected--;
+            }
+            return true;
+        case KEY_DOWN:
+            ui_ctx->deleted_selected++;
+            return true;
+        case KEY_PPAGE:
+            ui_ctx->deleted_selected = ui_ctx->deleted_selected > (uint32_t)page ? ui_ctx->deleted_selected - page : 0;
+            return true;
+        case KEY_NPAGE:
+            ui_ctx->deleted_selected += page;
+            return true;
+        case '\n':
+        case KEY_ENTER:
+            if (ino) {
+                ui_ctx->current_inode = (int)ino;
+                ui_set_mode(ui_ctx, UI_MODE_INODE_BROWSER);
+            }
+            return true;
+        case 'x':
+        case 'X':
+            if (ino) {
+                ui_start_extract(ui_ctx, ino);
+            }
+            return true;
+        case 'e':
+        case 'E':
+            ui_start_extract(ui_ctx, 0);
+            return true;
+        case 'r':
+        case 'R':
+            ui_start_deleted(ui_ctx, true);
+            return true;
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            return true;
+    }
+}
+
+static void ui_start_carve(ui_context_t *ui_ctx, bool force) {
+    ui_start_slot_job(ui_ctx, ui_ctx->carve, "Signature carving", carve_job, force);
+}
+
+static bool ui_handle_carve_input(ui_context_t *ui_ctx, int key) {
+    job_slot_t *slot = ui_ctx->carve;
+    int page = getmaxy(ui_ctx->main_win) / 2;
+    uint64_t block = 0;
+    bool found = false;
+
+    ui_ctx->dirty |= UI_DIRTY_MAIN;
+
+    pthread_mutex_lock(&slot->lock);
+    const carve_result_t *r = (const carve_result_t *)(slot->job ? slot->partial : slot->result);
+    if (r && ui_ctx->carve_selected < r->hit_count) {
+        block = r->hits[ui_ctx->carve_selected].block;
+        found = true;
+    }
+    pthread_mutex_unlock(&slot->lock);
+
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case KEY_UP:
+            if (ui_ctx->carve_selected > 0) {
+                ui_ctx->carve_selected--;
+            }
+            return true;
+        case KEY_DOWN:
+            ui_ctx->carve_selected++;
+            return true;
+        case KEY_PPAGE:
+            ui_ctx->carve_selected = ui_ctx->carve_selected > (uint32_t)page ? ui_ctx->carve_selected - page : 0;
+            return true;
+        case KEY_NPAGE:
+            ui_ctx->carve_selected += page;
+            return true;
+        case '\n':
+        case KEY_ENTER:
+            if (found && block < ui_ctx->fs_info->sb.s_blocks_count) {
+                ui_ctx->current_block = (int)block;
+                ui_set_mode(ui_ctx, UI_MODE_BLOCK_BROWSER);
+            }
+            return true;
+        case 'r':
+        case 'R':
+            ui_ctx->carve_selected = 0;
+            ui_start_carve(ui_ctx, true);
+            return true;
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            return true;
+    }
+}
+
+static void ui_start_content(ui_context_t *ui_ctx, bool force) {
+    ui_start_slot_job(ui_ctx, ui_ctx->content, "Content scan", content_job, force);
+}
+
+static bool ui_handle_content_input(ui_context_t *ui_ctx, int key) {
+    uint32_t columns = ui_content_columns(ui_ctx);
+    uint32_t page = columns * (uint32_t)(getmaxy(ui_ctx->main_win) / 2);
+    uint32_t last = ui_ctx->fs_info->groups_count ? ui_ctx->fs_info->groups_count - 1 : 0;
+    uint32_t *group = &ui_ctx->content_group;
+
+    ui_ctx->dirty |= UI_DIRTY_MAIN;
+
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case '\t':
+            ui_ctx->content_page = (ui_ctx->content_page + 1) % UI_CONTENT_PAGES;
+            return true;
+        case KEY_BTAB:
+            ui_ctx->content_page = (ui_ctx->content_page + UI_CONTENT_PAGES - 1) % UI_CONTENT_PAGES;
+            return true;
+        case KEY_LEFT:
+            *group = *group > 0 ? *group - 1 : 0;
+            return true;
         case KEY_RIGHT:
-            if ((uint32_t)ui_ctx->current_inode < ui_ctx->fs_info->sb.s_inodes_count - 1) {
+            *group = *group < last ? *group + 1 : last;
+            return true;
+        case KEY_UP:
+            *group = *group >= columns ? *group - columns : *group;
+            return true;
+        case KEY_DOWN:
+            *group = *group + columns <= last ? *group + columns : *group;
+            return true;
+        case KEY_PPAGE:
+            *group = *group >= page ? *group - page : *group % columns;
+            return true;
+        case KEY_NPAGE:
+            *group = *group + page <= last ? *group + page : last;
+            return true;
+        case '\n':
+        case KEY_ENTER: {
+            // Opens the first block of the selected group
+            fs_info_t *fs_info = ui_ctx->fs_info;
+            uint64_t block = (uint64_t)*group * fs_info->blocks_per_group + fs_info->sb.s_first_data_block;
+            if (block < fs_info->sb.s_blocks_count) {
+                ui_ctx->current_block = (int)block;
+                ui_set_mode(ui_ctx, UI_MODE_BLOCK_BROWSER);
+            }
+            return true;
+        }
+        case 'r':
+        case 'R':
+            ui_start_content(ui_ctx, true);
+            return true;
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            return true;
+    }
+}
+
+// Cheap fingerprint of everything the jobs view shows, used to skip idle repaints
+static uint64_t ui_jobs_stamp(const job_manager_t *mgr) {
+    uint64_t stamp = mgr->count;
+
+    for (uint32_t i = 0; i < mgr->count; i++) {
+        job_t *job = mgr->jobs[i];
+        stamp = stamp * 1000003u + atomic_load(&job->generation);
+        stamp = stamp * 1000003u + atomic_load(&job->done);
+        stamp = stamp * 1000003u + (uint64_t)atomic_load(&job->state);
+    }
+
+    return stamp;
+}
+
+// Offers to finish a save that was interrupted before it reached the device
+static void ui_offer_replay(ui_context_t *ui_ctx) {
+    int pending = txn_pending(ui_ctx->fs_info);
+    char prompt[128], answer[8];
+
+    if (pending <= 0) {
+        return;
+    }
+    snprintf(prompt, sizeof(prompt), "An interrupted save left %d change(s). Replay them to the %s now? (y/n): ",
+             pending, ui_ctx->fs_info->overlay ? "overlay" : "device");
+    if (!ui_prompt(ui_ctx, prompt, answer, sizeof(answer)) || tolower((unsigned char)answer[0]) != 'y') {
+        return;
+    }
+    if (txn_recover(ui_ctx->fs_info) < 0) {
+        ui_show_error(ui_ctx, "Failed to replay the interrupted save");
+    } else if (analyzer_reload_metadata(ui_ctx->fs_info) != 0) {
+        ui_show_error(ui_ctx, "Failed to reload metadata from device");
+    }
+    ui_ctx->dirty |= UI_DIRTY_ALL;
+}
+
+void ui_main_loop(ui_context_t *ui_ctx) {
+    bool running = true;
+    
+    ui_set_mode(ui_ctx, UI_MODE_MENU);
+    ui_offer_replay(ui_ctx);
+    
+    // Poll for input so job progress keeps updating while no key is pressed
+    timeout(UI_POLL_MS);
+    
+    while (running) {
+        ui_collect_inode_filter(ui_ctx);
+        if (ui_ctx->dirty & UI_DIRTY_MAIN) {
+            switch (ui_ctx->current_mode) {
+                case UI_MODE_MENU:
+                    ui_display_menu(ui_ctx);
+                    break;
+                case UI_MODE_ANALYZER:
+                    ui_display_fs_info(ui_ctx);
+                    break;
+                case UI_MODE_BLOCK_BROWSER:
+                    ui_display_block_browser(ui_ctx);
+                    break;
+                case UI_MODE_INODE_BROWSER:
+                    ui_display_inode_browser(ui_ctx);
+                    break;
+                case UI_MODE_BINARY_EDITOR:
+                    ui_display_binary_editor(ui_ctx);
+                    break;
+                case UI_MODE_JOBS:
+                    ui_ctx->jobs_stamp = ui_jobs_stamp(ui_ctx->jobs);
+                    ui_display_jobs(ui_ctx);
+                    break;
+                case UI_MODE_BITMAP_EDITOR:
+                    ui_display_bitmap_editor(ui_ctx);
+                    break;
+                case UI_MODE_STATS:
+                    ui_ctx->jobs_stamp = ui_jobs_stamp(ui_ctx->jobs);
+                    ui_display_stats(ui_ctx);
+                    break;
+                case UI_MODE_ESTIMATE:
+                    ui_ctx->jobs_stamp = ui_jobs_stamp(ui_ctx->jobs);
+                    ui_display_estimate(ui_ctx);
+                    break;
+                case UI_MODE_USAGE:
+                    ui_ctx->jobs_stamp = ui_jobs_stamp(ui_ctx->jobs);
+                    ui_display_usage(ui_ctx);
+                    break;
+                case UI_MODE_FREESPACE:
+                    ui_ctx->jobs_stamp = ui_jobs_stamp(ui_ctx->jobs);
+                    ui_display_freespace(ui_ctx);
+                    break;
+                case UI_MODE_FRAG:
+                    ui_ctx->jobs_stamp = ui_jobs_stamp(ui_ctx->jobs);
+                    ui_display_frag(ui_ctx);
+                    break;
+                case UI_MODE_JOURNAL:
+                    ui_ctx->jobs_stamp = ui_jobs_stamp(ui_ctx->jobs);
+                    ui_display_journal(ui_ctx);
+                    break;
+                case UI_MODE_DELETED:
+                    ui_ctx->jobs_stamp = ui_jobs_stamp(ui_ctx->jobs);
+                    ui_display_deleted(ui_ctx);
+                    break;
+                case UI_MODE_CARVE:
+                    ui_ctx->jobs_stamp = ui_jobs_stamp(ui_ctx->jobs);
+                    ui_display_carve(ui_ctx);
+                    break;
+                case UI_MODE_CONTENT:
+                    ui_ctx->jobs_stamp = ui_jobs_stamp(ui_ctx->jobs);
+                    ui_display_content(ui_ctx);
+                    break;
+            }
+        }
+        if (ui_ctx->dirty & UI_DIRTY_HELP) {
+            ui_display_help(ui_ctx);
+        }
+        ui_ctx->dirty = 0;
+
+        // All windows were staged with wnoutrefresh(); push them in one terminal update
+        doupdate();
+
+        int key = getch();
+
+        if (key == ERR) {
+            // No input within the poll interval: repaint only what job progress changed
+            if ((ui_ctx->current_mode == UI_MODE_JOBS || ui_ctx->current_mode == UI_MODE_STATS ||
+                 ui_ctx->current_mode == UI_MODE_ESTIMATE || ui_ctx->current_mode == UI_MODE_USAGE ||
+                 ui_ctx->current_mode == UI_MODE_FREESPACE || ui_ctx->current_mode == UI_MODE_FRAG ||
+                 ui_ctx->current_mode == UI_MODE_JOURNAL || ui_ctx->current_mode == UI_MODE_DELETED ||
+                 ui_ctx->current_mode == UI_MODE_CARVE || ui_ctx->current_mode == UI_MODE_CONTENT) &&
+                ui_jobs_stamp(ui_ctx->jobs) != ui_ctx->jobs_stamp) {
+                ui_ctx->dirty |= UI_DIRTY_MAIN;
+            }
+            if (job_running_count(ui_ctx->jobs) != ui_ctx->help_running) {
+                ui_ctx->dirty |= UI_DIRTY_HELP;
+            }
+            continue;
+        }
+
+        if (key == KEY_F(1)) {
+            ui_display_detailed_help(ui_ctx);
+            continue; 
+        }
+        
+        switch (ui_ctx->current_mode) {
+            case UI_MODE_MENU:
+                running = ui_handle_menu_input(ui_ctx, key);
+                break;
+            case UI_MODE_ANALYZER:
+                running = ui_handle_analyzer_input(ui_ctx, key);
+                break;
+            case UI_MODE_BLOCK_BROWSER:
+                running = ui_handle_block_browser_input(ui_ctx, key);
+                break;
+            case UI_MODE_INODE_BROWSER:
+                running = ui_handle_inode_browser_input(ui_ctx, key);
+                break;
+            case UI_MODE_BINARY_EDITOR:
+                running = ui_handle_binary_editor_input(ui_ctx, key);
+                break;
+            case UI_MODE_JOBS:
+                running = ui_handle_jobs_input(ui_ctx, key);
+                break;
+            case UI_MODE_BITMAP_EDITOR:
+                running = ui_handle_bitmap_editor_input(ui_ctx, key);
+                break;
+            case UI_MODE_STATS:
+                running = ui_handle_stats_input(ui_ctx, key);
+                break;
+            case UI_MODE_ESTIMATE:
+                running = ui_handle_estimate_input(ui_ctx, key);
+                break;
+            case UI_MODE_USAGE:
+                running = ui_handle_usage_input(ui_ctx, key);
+                break;
+            case UI_MODE_FREESPACE:
+                running = ui_handle_freespace_input(ui_ctx, key);
+                break;
+            case UI_MODE_FRAG:
+                running = ui_handle_frag_input(ui_ctx, key);
+                break;
+            case UI_MODE_JOURNAL:
+                running = ui_handle_journal_input(ui_ctx, key);
+                break;
+            case UI_MODE_DELETED:
+                running = ui_handle_deleted_input(ui_ctx, key);
+                break;
+            case UI_MODE_CARVE:
+                running = ui_handle_carve_input(ui_ctx, key);
+                break;
+            case UI_MODE_CONTENT:
+                running = ui_handle_content_input(ui_ctx, key);
+                break;
+        }
+    }
+}
+
+static bool ui_handle_menu_input(ui_context_t *ui_ctx, int key) {
+    switch (key) {
+        case '1':
+            ui_set_mode(ui_ctx, UI_MODE_ANALYZER);
+            return true;
+        case '2':
+            ui_set_mode(ui_ctx, UI_MODE_BLOCK_BROWSER);
+            return true;
+        case '3':
+            ui_set_mode(ui_ctx, UI_MODE_INODE_BROWSER);
+            return true;
+        case '4':
+            ui_set_mode(ui_ctx, UI_MODE_BINARY_EDITOR);
+            editor_open_structure(ui_ctx->editor_ctx, STRUCTURE_SUPERBLOCK, 0);
+            return true;
+        case '5':
+            ui_set_mode(ui_ctx, UI_MODE_JOBS);
+            return true;
+        case '6':
+            if (bitmap_editor_open(ui_ctx->bitmap_ed, BITMAP_BLOCKS, ui_ctx->current_group) == 0) {
+                ui_set_mode(ui_ctx, UI_MODE_BITMAP_EDITOR);
+            } else {
+                ui_show_error(ui_ctx, "Failed to read block bitmap");
+            }
+            return true;
+        case '7':
+            ui_ctx->stats_scroll = 0;
+            ui_set_mode(ui_ctx, UI_MODE_STATS);
+            ui_start_stats(ui_ctx, false);
+            return true;
+        case '8':
+            ui_ctx->estimate_scroll = 0;
+            ui_set_mode(ui_ctx, UI_MODE_ESTIMATE);
+            ui_start_estimate(ui_ctx, false);
+            return true;
+        case '9':
+            ui_ctx->usage_scroll = 0;
+            ui_set_mode(ui_ctx, UI_MODE_USAGE);
+            ui_start_usage(ui_ctx, false);
+            return true;
+        case '0':
+            ui_ctx->freespace_scroll = 0;
+            ui_set_mode(ui_ctx, UI_MODE_FREESPACE);
+            ui_start_freespace(ui_ctx, false);
+            return true;
+        case 'd': case 'D':
+            ui_ctx->frag_selected = 0;
+            ui_set_mode(ui_ctx, UI_MODE_FRAG);
+            ui_start_frag(ui_ctx, false);
+            return true;
+        case 'j': case 'J':
+            ui_ctx->journal_txn = 0;
+            ui_ctx->journal_image = 0;
+            ui_ctx->journal_scroll = 0;
+            ui_set_mode(ui_ctx, UI_MODE_JOURNAL);
+            ui_start_journal(ui_ctx, false);
+            return true;
+        case 'u': case 'U':
+            ui_ctx->deleted_selected = 0;
+            ui_set_mode(ui_ctx, UI_MODE_DELETED);
+            ui_start_deleted(ui_ctx, false);
+            return true;
+        case 's': case 'S':
+            ui_ctx->carve_selected = 0;
+            ui_set_mode(ui_ctx, UI_MODE_CARVE);
+            ui_start_carve(ui_ctx, false);
+            return true;
+        case 'z': case 'Z':
+            ui_set_mode(ui_ctx, UI_MODE_CONTENT);
+            ui_start_content(ui_ctx, false);
+            return true;
+        case 'w': case 'W':
+        case 'x': case 'X': {
+            overlay_t *ov = ui_ctx->fs_info->overlay;
+            bool commit = (key == 'w' || key == 'W');
+            char answer[8];
+            if (!ov || !ui_prompt(ui_ctx, commit ? "Write all overlay blocks to the device? (y/n): "
+                                                  : "Drop all overlay blocks? (y/n): ",
+                                  answer, sizeof(answer)) || tolower((unsigned char)answer[0]) != 'y') {
+                return true;
+            }
+            if (commit ? overlay_commit(ov, ui_ctx->fs_info->device_path) != 0 : overlay_discard(ov) != 0) {
+                ui_show_error(ui_ctx, commit ? "Failed to commit overlay" : "Failed to discard overlay");
+            } else if (!commit && analyzer_reload_metadata(ui_ctx->fs_info) != 0) {
+                ui_show_error(ui_ctx, "Failed to reload metadata from device");
+            }
+            // The editor window may still hold overlay bytes
+            if (editor_reload(ui_ctx->editor_ctx) != 0) {
+                ui_show_error(ui_ctx, "Failed to reload the editor window");
+            }
+            ui_ctx->dirty |= UI_DIRTY_ALL;
+            return true;
+        }
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            return true;
+    }
+}
+
+static bool ui_handle_analyzer_input(ui_context_t *ui_ctx, int key) {
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case 'g': case 'G': {
+            char buffer[32];
+            if (ui_prompt(ui_ctx, "Enter group number: ", buffer, sizeof(buffer))) {
+                uint32_t group;
+                if (sscanf(buffer, "%u", &group) == 1 && group < ui_ctx->fs_info->groups_count) {
+                    ui_ctx->current_group = (int)group;
+                    ui_ctx->dirty |= UI_DIRTY_MAIN;
+                }
+            }
+            return true;
+        }
+        case 'b': case 'B':
+        case 'i': case 'I': {
+            bitmap_kind_t kind = (key == 'b' || key == 'B') ? BITMAP_BLOCKS : BITMAP_INODES;
+            if (bitmap_editor_open(ui_ctx->bitmap_ed, kind, ui_ctx->current_group) == 0) {
+                ui_set_mode(ui_ctx, UI_MODE_BITMAP_EDITOR);
+            } else {
+                ui_show_error(ui_ctx, "Failed to read bitmap");
+            }
+            return true;
+        }
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            return true;
+    }
+}
+
+static bool ui_handle_block_browser_input(ui_context_t *ui_ctx, int key) {
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case KEY_LEFT:
+            if (ui_ctx->current_block > 0) {
+                ui_ctx->current_block--;
+                ui_ctx->dirty |= UI_DIRTY_MAIN;
+                prefetch_hint(ui_ctx->block_prefetch, ui_ctx->current_block);
+                ui_display_status(ui_ctx, "Block Browser - Block %d", ui_ctx->current_block);
+            }
+            return true;
+        case KEY_RIGHT:
+            if ((uint32_t)ui_ctx->current_block < ui_ctx->fs_info->sb.s_blocks_count - 1) {
+                ui_ctx->current_block++;
+                ui_ctx->dirty |= UI_DIRTY_MAIN;
+                prefetch_hint(ui_ctx->block_prefetch, ui_ctx->current_block);
+                ui_display_status(ui_ctx, "Block Browser - Block %d", ui_ctx->current_block);
+            }
+            return true;
+        case KEY_UP:
+            if (ui_ctx->current_block >= 10) {
+                ui_ctx->current_block -= 10;
+                ui_ctx->dirty |= UI_DIRTY_MAIN;
+                prefetch_hint(ui_ctx->block_prefetch, ui_ctx->current_block);
+                ui_display_status(ui_ctx, "Block Browser - Block %d", ui_ctx->current_block);
+            }
+            return true;
+        case KEY_DOWN:
+            if ((uint32_t)ui_ctx->current_block + 10 < ui_ctx->fs_info->sb.s_blocks_count) {
+                ui_ctx->current_block += 10;
+                ui_ctx->dirty |= UI_DIRTY_MAIN;
+                prefetch_hint(ui_ctx->block_prefetch, ui_ctx->current_block);
+                ui_display_status(ui_ctx, "Block Browser - Block %d", ui_ctx->current_block);
+            }
+            return true;
+        case 'e':
+        case 'E':
+            ui_set_mode(ui_ctx, UI_MODE_BINARY_EDITOR);
+            editor_open_structure(ui_ctx->editor_ctx, STRUCTURE_BLOCK, ui_ctx->current_block);
+            return true;
+        case 'g':
+        case 'G': {
+            char buffer[32];
+            if (ui_prompt(ui_ctx, "Enter block number: ", buffer, sizeof(buffer))) {
+                int block = atoi(buffer);
+                if ( (uint32_t)block < ui_ctx->fs_info->sb.s_blocks_count) {
+                    ui_ctx->current_block = block;
+                    ui_ctx->dirty |= UI_DIRTY_MAIN;
+                    prefetch_hint(ui_ctx->block_prefetch, ui_ctx->current_block);
+                    ui_display_status(ui_ctx, "Block Browser - Block %d", ui_ctx->current_block);
+                } else {
+                    ui_show_error(ui_ctx, "Invalid block number");
+                }
+            }
+            return true;
+        }
+        case 'q':
+        case 'Q':
+            return false;
+        default:
+            return true;
+    }
+}
+
+// Compiles text and starts a job marking the matching inodes; empty text clears the filter
+static void ui_apply_inode_filter(ui_context_t *ui_ctx, const char *text) {
+    job_slot_t *slot = ui_ctx->filter;
+    char error[128];
+
+    // Only the last filter typed counts, drop one still loading or not yet installed
+    pthread_mutex_lock(&slot->lock);
+    if (slot->job) {
+        job_cancel(slot->job);
+    }
+    pthread_mutex_unlock(&slot->lock);
+    query_result_free((query_result_t *)job_slot_take(slot));
+
+    if (!text[0]) {
+        free(ui_ctx->inode_filter);
+        ui_ctx->inode_filter = NULL;
+        ui_ctx->filter_text[0] = '\0';
+        ui_ctx->dirty |= UI_DIRTY_MAIN;
+        ui_display_status(ui_ctx, "Filter cleared");
+        return;
+    }
+
+    query_request_t *request = (query_request_t *)calloc(1, sizeof(query_request_t));
+    if (!request) {
+        ui_show_error(ui_ctx, "Out of memory");
+        return;
+    }
+    if (query_compile(text, &request->query, error, sizeof(error)) != 0) {
+        char message[160];
+        snprintf(message, sizeof(message), "Bad filter: %s", error);
+        free(request);
+        ui_show_error(ui_ctx, message);
+        return;
+    }
+    request->slot = slot;
+    snprintf(request->text, sizeof(request->text), "%s", text);
+
+    // Claimed under the lock like ui_start_slot_job, the cancelled job no longer owns the slot
+    pthread_mutex_lock(&slot->lock);
+    slot->job = job_start(ui_ctx->jobs, "Inode filter", query_job, request, free);
+    bool started = slot->job != NULL;
+    pthread_mutex_unlock(&slot->lock);
+
+    if (!started) {
+        free(request);
+        ui_show_error(ui_ctx, "Cannot start job (dismiss finished jobs first)");
+        return;
+    }
+    ui_ctx->selected_job = ui_ctx->jobs->count - 1;
+    ui_display_status(ui_ctx, "Filtering, the jobs view shows progress");
+}
+
+// Installs a filter whose job finished since the last call
+static void ui_collect_inode_filter(ui_context_t *ui_ctx) {
+    query_result_t *result = (query_result_t *)job_slot_take(ui_ctx->filter);
+    if (!result) {
+        return;
+    }
+
+    free(ui_ctx->inode_filter);
+    ui_ctx->inode_filter = result->matches;
+    ui_ctx->filter_matches = result->count;
+    snprintf(ui_ctx->filter_text, sizeof(ui_ctx->filter_text), "%s", result->text);
+    result->matches = NULL;
+    query_result_free(result);
+
+    // Land on the first match at or after the current inode
+    uint32_t bits = ui_ctx->fs_info->sb.s_inodes_count;
+    uint32_t bit = find_next_bit(ui_ctx->inode_filter, ui_ctx->current_inode - 1, bits, true);
+    if (bit >= bits) {
+        bit = find_next_bit(ui_ctx->inode_filter, 0, bits, true);
+    }
+    if (bit < bits) {
+        ui_ctx->current_inode = (int)bit + 1;
+    }
+    ui_ctx->dirty |= UI_DIRTY_MAIN;
+    ui_display_status(ui_ctx, "Filter: %lu matching inode(s)", (unsigned long)ui_ctx->filter_matches);
+}
+
+static bool ui_handle_inode_browser_input(ui_context_t *ui_ctx, int key) {
+    switch (key) {
+        case 27: // ESC
+            ui_set_mode(ui_ctx, UI_MODE_MENU);
+            return true;
+        case KEY_LEFT:
+            if (ui_ctx->inode_filter) {
+                int64_t bit = find_prev_bit(ui_ctx->inode_filter, ui_ctx->current_inode - 2, true);
+                if (ui_ctx->current_inode > 1 && bit >= 0) {
+                    ui_ctx->current_inode = (int)bit + 1;
+                    ui_ctx->dirty |= UI_DIRTY_MAIN;
+                    prefetch_hint(ui_ctx->inode_prefetch, ui_ctx->current_inode);
+                    ui_display_status(ui_ctx, "Inode Browser - Inode %d", ui_ctx->current_inode);
+                } else {
+                    ui_display_status(ui_ctx, "No earlier match");
+                }
+            } else if (ui_ctx->current_inode > 1) {
+                ui_ctx->current_inode--;
+                ui_ctx->dirty |= UI_DIRTY_MAIN;
+                prefetch_hint(ui_ctx->inode_prefetch, ui_ctx->current_inode);
+                ui_display_status(ui_ctx, "Inode Browser - Inode %d", ui_ctx->current_inode);
+            }
+            return true;
+        case KEY_RIGHT:
+            if (ui_ctx->inode_filter) {
+                uint32_t bits = ui_ctx->fs_info->sb.s_inodes_count;
+                uint32_t bit = find_next_bit(ui_ctx->inode_filter, ui_ctx->current_inode, bits, true);
+                if (bit < bits) {
+                    ui_ctx->current_inode = (int)bit + 1;
+                    ui_ctx->dirty |= UI_DIRTY_MAIN;
+                    prefetch_hint(ui_ctx->inode_prefetch, ui_ctx->current_inode);
+                    ui_display_status(ui_ctx, "Inode Browser - Inode %d", ui_ctx->current_inode);
+                } else {
+                    ui_display_status(ui_ctx, "No later match");
+                }
+            } else if ((uint32_t)ui_ctx->current_inode < ui_ctx->fs_info->sb.s_inodes_count - 1) {
                 ui_ctx->current_inode++;
-                ui_display_inode_browser(ui_ctx);
+                ui_ctx->dirty |= UI_DIRTY_MAIN;
+                prefetch_hint(ui_ctx->inode_prefetch, ui_ctx->current_inode);
                 ui_display_status(ui_ctx, "Inode Browser - Inode %d", ui_ctx->current_inode);
             }
             return true;
         case KEY_UP:
             if (ui_ctx->current_inode > 10) {
                 ui_ctx->current_inode -= 10;
-                ui_display_inode_browser(ui_ctx);
+                ui_ctx->dirty |= UI_DIRTY_MAIN;
+                prefetch_hint(ui_ctx->inode_prefetch, ui_ctx->current_inode);
                 ui_display_status(ui_ctx, "Inode Browser - Inode %d", ui_ctx->current_inode);
             }
             return true;
         case KEY_DOWN:
             if ((uint32_t)ui_ctx->current_inode + 10 < ui_ctx->fs_info->sb.s_inodes_count) {
                 ui_ctx->current_inode += 10;
-                ui_display_inode_browser(ui_ctx);
+                ui_ctx->dirty |= UI_DIRTY_MAIN;
+                prefetch_hint(ui_ctx->inode_prefetch, ui_ctx->current_inode);
                 ui_display_status(ui_ctx, "Inode Browser - Inode %d", ui_ctx->current_inode);
             }
             return true;
@@ -693,6 +3138,14 @@ static bool ui_handle_inode_browser_input(ui_context_t *ui_ctx, int key) {
             ui_set_mode(ui_ctx, UI_MODE_BINARY_EDITOR);
             editor_open_structure(ui_ctx->editor_ctx, STRUCTURE_INODE, ui_ctx->current_inode);
             return true;
+        case 'f':
+        case 'F': {
+            char buffer[128];
+            if (ui_prompt(ui_ctx, "Filter (empty clears): ", buffer, sizeof(buffer))) {
+                ui_apply_inode_filter(ui_ctx, buffer);
+            }
+            return true;
+        }
         case 'g':
         case 'G': {
             char buffer[32];
@@ -700,7 +3153,8 @@ static bool ui_handle_inode_browser_input(ui_context_t *ui_ctx, int key) {
                 int inode = atoi(buffer);
                 if ((uint32_t)inode > 0 && (uint32_t)inode < ui_ctx->fs_info->sb.s_inodes_count) {
                     ui_ctx->current_inode = inode;
-                    ui_display_inode_browser(ui_ctx);
+                    ui_ctx->dirty |= UI_DIRTY_MAIN;
+                    prefetch_hint(ui_ctx->inode_prefetch, ui_ctx->current_inode);
                     ui_display_status(ui_ctx, "Inode Browser - Inode %d", ui_ctx->current_inode);
                 } else {
                     ui_show_error(ui_ctx, "Invalid inode number");
@@ -3,14 +3,45 @@
 #define _POSIX_C_SOURCE 200809L
 #include <ncurses.h>
 #include "analyzer.h"
+#include "carve.h"
+#include "content.h"
+#include "du.h"
 #include "editor.h"
+#include "estimate.h"
+#include "frag.h"
+#include "freespace.h"
+#include "bitmapedit.h"
+#include "job.h"
+#include "journal.h"
+#include "prefetch.h"
+#include "query.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "undelete.h"
+
+#define UI_POLL_MS 100
+
+#define UI_DIRTY_MAIN 0x01      // Main window content must be redrawn
+#define UI_DIRTY_HELP 0x02      // Help bar must be redrawn
+#define UI_DIRTY_ALL  (UI_DIRTY_MAIN | UI_DIRTY_HELP)
 
 typedef enum {
     UI_MODE_MENU,               // Main menu
     UI_MODE_ANALYZER,           // Filesystem analyzer
     UI_MODE_BLOCK_BROWSER,      // Block browser
     UI_MODE_INODE_BROWSER,      // Inode browser
-    UI_MODE_BINARY_EDITOR       // Binary editor
+    UI_MODE_BINARY_EDITOR,      // Binary editor
+    UI_MODE_JOBS,               // Background jobs
+    UI_MODE_BITMAP_EDITOR,      // Bit-level bitmap editor
+    UI_MODE_STATS,              // Filesystem statistics
+    UI_MODE_ESTIMATE,           // Sampled estimates with error bars
+    UI_MODE_USAGE,              // Space used per directory, largest files
+    UI_MODE_FREESPACE,          // Free extent lengths and allocation fits
+    UI_MODE_FRAG,               // Per-file fragmentation, worst files
+    UI_MODE_JOURNAL,            // Journal transactions and the replay plan
+    UI_MODE_DELETED,            // Deleted inodes ranked by recoverability
+    UI_MODE_CARVE,              // File signatures found in unallocated blocks
+    UI_MODE_CONTENT             // Zero and incompressible blocks per group and file
 } ui_mode_t;
 
 typedef struct {
@@ -20,9 +51,49 @@ typedef struct {
     ui_mode_t current_mode;     // Current UI mode
     fs_info_t *fs_info;         // Filesystem information
     editor_context_t *editor_ctx; // Editor context
+    bitmap_editor_t *bitmap_ed; // Bitmap editor
     int current_block;          // Current block number (for block browser)
     int current_inode;          // Current inode number (for inode browser)
     int current_group;          // Current block group
+    job_manager_t *jobs;        // Background jobs
+    prefetcher_t *block_prefetch; // Read-ahead for the block browser
+    prefetcher_t *inode_prefetch; // Read-ahead of inode table blocks for the inode browser
+    uint32_t selected_job;      // Selected job in the jobs view
+    unsigned dirty;             // UI_DIRTY_* flags for the next repaint
+    uint64_t jobs_stamp;        // Job progress state painted last time
+    uint32_t help_running;      // Running job count painted in the help bar
+    unsigned char *inode_filter; // Inodes matching the browser filter, bit ino - 1, NULL without filter
+    uint64_t filter_matches;    // Number of bits set in inode_filter
+    char filter_text[128];      // Filter expression as typed
+    snapshot_cache_t *snapshots; // Inode table snapshot shared by the filter and the statistics job
+    job_slot_t *filter;         // Filter job whose matches replace inode_filter when it finishes
+    job_slot_t *stats;          // Result of the last statistics job
+    uint32_t stats_page;        // Page shown in the statistics view
+    uint32_t stats_scroll;      // First list row shown on the statistics page
+    job_slot_t *estimate;       // Latest refinement of the sampling estimate
+    uint32_t estimate_scroll;   // First size bucket shown in the estimate view
+    job_slot_t *usage;          // Result of the last space accounting job
+    bool usage_files;           // Usage view lists files instead of directories
+    uint32_t usage_scroll;      // First entry shown in the usage view
+    job_slot_t *freespace;      // Result of the last free space scan
+    bool freespace_groups;      // Free space view lists groups instead of extent lengths
+    uint32_t freespace_scroll;  // First row shown in the free space view
+    uint32_t freespace_fit;     // Allocation size asked for in blocks, 0 before the first question
+    job_slot_t *frag;           // Result of the last fragmentation scan
+    uint32_t frag_selected;     // Selected file in the worst files list
+    job_slot_t *journal;        // Journal index and replay plan of the last scan
+    uint32_t journal_txn;       // Selected transaction
+    uint32_t journal_image;     // Selected image within it
+    bool journal_images;        // Arrow keys move through the images instead of the transactions
+    bool journal_plan;          // Journal view shows the replay plan
+    uint32_t journal_scroll;    // First row of the hex dump, or of the replay plan
+    job_slot_t *deleted;        // Ranking of the last deleted inode scan
+    uint32_t deleted_selected;  // Selected inode in the ranking
+    job_slot_t *carve;          // Signature hits of the last or running carving scan
+    uint32_t carve_selected;    // Selected hit
+    job_slot_t *content;        // Block classification of the last content scan
+    uint32_t content_page;      // Heatmap shown, or the file rankings
+    uint32_t content_group;     // Group selected in the heatmap
 } ui_context_t;
 
 ui_context_t *ui_init(fs_info_t *fs_info);
@@ -41,6 +112,28 @@ void ui_display_inode_browser(ui_context_t *ui_ctx);
 
 void ui_display_binary_editor(ui_context_t *ui_ctx);
 
+void ui_display_jobs(ui_context_t *ui_ctx);
+
+void ui_display_bitmap_editor(ui_context_t *ui_ctx);
+
+void ui_display_stats(ui_context_t *ui_ctx);
+
+void ui_display_estimate(ui_context_t *ui_ctx);
+
+void ui_display_usage(ui_context_t *ui_ctx);
+
+void ui_display_freespace(ui_context_t *ui_ctx);
+
+void ui_display_frag(ui_context_t *ui_ctx);
+
+void ui_display_journal(ui_context_t *ui_ctx);
+
+void ui_display_deleted(ui_context_t *ui_ctx);
+
+void ui_display_carve(ui_context_t *ui_ctx);
+
+void ui_display_content(ui_context_t *ui_ctx);
+
 void ui_display_help(ui_context_t *ui_ctx);
 
 void ui_show_error(ui_context_t *ui_ctx, const char *message);
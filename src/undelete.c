@@ -0,0 +1,654 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "undelete.h"
+#include "blockmap.h"
+#include "inodeiter.h"
+#include "parallel.h"
+#include "topn.h"
+#include "utils.h"
+
+typedef struct {
+    fs_info_t *fs_info;
+    unsigned char *used;        // Bit block - s_first_data_block set while allocated
+    uint32_t unreadable;
+} undelete_bitmap_t;
+
+typedef struct {
+    inode_iter_t it;            // Reads one group at a time, free slots included
+    topn_t top;                 // Most recoverable inodes seen by this worker
+    undelete_result_t counts;   // Totals, files unused
+} undelete_worker_t;
+
+typedef struct {
+    fs_info_t *fs_info;
+    const unsigned char *used;
+    uint32_t top;
+    topn_t ranked;              // Merged from the workers
+    undelete_result_t *result;
+} undelete_scan_state_t;
+
+typedef struct {
+    const fs_info_t *fs_info;
+    const unsigned char *used;
+    undelete_file_t *file;
+} undelete_walk_t;
+
+// Free runs of one file to copy, contiguous both in the file and on disk
+typedef struct {
+    uint64_t logical;
+    uint64_t physical;
+    uint32_t count;
+} undelete_run_t;
+
+typedef struct {
+    const fs_info_t *fs_info;
+    const unsigned char *used;
+    undelete_run_t *runs;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t max_blocks;        // Longest run, so one run always fits a read
+    uint64_t end;               // Logical block after the last mapped one
+    undelete_stats_t *stats;
+} undelete_collect_t;
+
+static bool block_used(const fs_info_t *fs_info, const unsigned char *used, uint64_t block) {
+    return check_bitmap_bit(used, (uint32_t)(block - fs_info->sb.s_first_data_block));
+}
+
+static bool block_valid(const fs_info_t *fs_info, uint64_t block) {
+    return block >= fs_info->sb.s_first_data_block && block < fs_info->sb.s_blocks_count;
+}
+
+static int bitmap_worker_init(void *worker, void *arg) {
+    undelete_bitmap_t *b = (undelete_bitmap_t *)arg;
+
+    *(unsigned char **)worker = (unsigned char *)malloc(b->fs_info->block_size);
+    return *(unsigned char **)worker ? 0 : -1;
+}
+
+// Groups start on byte boundaries of the filesystem bitmap, so workers never share a byte
+static int bitmap_load_group(uint32_t group, void *worker, void *arg) {
+    undelete_bitmap_t *b = (undelete_bitmap_t *)arg;
+    fs_info_t *fs_info = b->fs_info;
+    unsigned char *buffer = *(unsigned char **)worker;
+    const struct ext2_group_desc *gd = &fs_info->group_desc[group];
+    uint32_t blocks = group_block_count(fs_info, group);
+    uint32_t first = group * fs_info->blocks_per_group;
+
+    if (gd->bg_flags & EXT2_BG_BLOCK_UNINIT) {
+        // Never initialised: only the group's own metadata at its start is in use
+        uint32_t free_blocks = gd->bg_free_blocks_count < blocks ? gd->bg_free_blocks_count : blocks;
+        fill_bitmap_range(b->used, first, blocks - free_blocks, true);
+        return 0;
+    }
+    if (get_block_bitmap(fs_info, group, buffer) != 0) {
+        // Treat the group as fully allocated so nothing in it is offered for recovery
+        fill_bitmap_range(b->used, first, blocks, true);
+        __atomic_fetch_add(&b->unreadable, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    memcpy(b->used + first / 8, buffer, (blocks + 7) / 8);
+    return 0;
+}
+
+static int bitmap_worker_finish(void *worker, void *arg) {
+    (void)arg;
+    free(*(unsigned char **)worker);
+    return 0;
+}
+
+// Reads every block bitmap into one map of the filesystem, bit block - s_first_data_block.
+// Returns NULL on allocation failure, unreadable groups count as allocated.
+unsigned char *undelete_load_bitmap(fs_info_t *fs_info, uint32_t *unreadable) {
+    uint64_t bits = (uint64_t)fs_info->groups_count * fs_info->blocks_per_group;
+    undelete_bitmap_t b = { fs_info, (unsigned char *)calloc((bits + 7) / 8, 1), 0 };
+
+    if (!b.used) {
+        return NULL;
+    }
+
+    parallel_t p;
+    memset(&p, 0, sizeof(p));
+    p.items = fs_info->groups_count;
+    p.worker_size = sizeof(unsigned char *);
+    p.arg = &b;
+    p.init = bitmap_worker_init;
+    p.work = bitmap_load_group;
+    p.finish = bitmap_worker_finish;
+    if (parallel_run(&p) != 0) {
+        free(b.used);
+        return NULL;
+    }
+    if (unreadable) {
+        *unreadable = b.unreadable;
+    }
+    return b.used;
+}
+
+static int measure_run(uint64_t logical, uint64_t physical, uint32_t count, bool unwritten, void *arg) {
+    undelete_walk_t *w = (undelete_walk_t *)arg;
+    undelete_file_t *f = w->file;
+    (void)logical;
+    (void)unwritten;
+
+    for (uint64_t block = physical; block < physical + count; block++) {
+        if (!block_valid(w->fs_info, block)) {
+            f->bad++;
+            continue;
+        }
+        f->blocks++;
+        f->free_blocks += !block_used(w->fs_info, w->used, block);
+    }
+    return 0;
+}
+
+// Sizes up what is left of a deleted inode: the blocks its map still points to and how many of
+// them no file has taken since. A map that breaks off part way counts the blocks reached.
+int undelete_measure(fs_info_t *fs_info, const unsigned char *used, uint32_t ino, const struct ext2_inode *inode,
+                     undelete_file_t *file) {
+    undelete_walk_t w = { fs_info, used, file };
+
+    memset(file, 0, sizeof(*file));
+    file->ino = ino;
+    file->mode = inode->i_mode;
+    file->size = inode_file_size(inode);
+    file->dtime = inode->i_dtime;
+    file->mtime = inode->i_mtime;
+    if (blockmap_has_blocks(inode) && blockmap_walk(fs_info, inode, measure_run, &w) != 0) {
+        file->map_damaged = true;
+    }
+
+    file->expected = file->size ? (file->size + fs_info->block_size - 1) / fs_info->block_size : 0;
+    uint64_t wanted = file->blocks + file->bad > file->expected ? file->blocks + file->bad : file->expected;
+    file->score = wanted ? 100.0 * (double)file->free_blocks / (double)wanted : 0.0;
+    if (file->free_blocks == 0) {
+        file->state = UNDELETE_LOST;
+    } else if (file->free_blocks == file->blocks && !file->bad && !file->map_damaged) {
+        file->state = UNDELETE_FULL;
+    } else {
+        file->state = UNDELETE_PARTIAL;
+    }
+    return 0;
+}
+
+// Full before partial before lost, then by score, then the most recent deletion
+static uint64_t rank_key(const undelete_file_t *f) {
+    uint64_t state = (uint64_t)(UNDELETE_LOST - f->state);
+    uint64_t permille = (uint64_t)(f->score * 10.0 + 0.5);
+
+    return state << 42 | (permille > 1000 ? 1000 : permille) << 32 | f->dtime;
+}
+
+static int undelete_worker_init(void *worker, void *arg) {
+    undelete_worker_t *w = (undelete_worker_t *)worker;
+    undelete_scan_state_t *st = (undelete_scan_state_t *)arg;
+
+    if (inode_iter_init(&w->it, st->fs_info, 0, 0, true) != 0) {
+        return -1;
+    }
+    if (topn_init(&w->top, st->top) != 0) {
+        inode_iter_cleanup(&w->it);
+        return -1;
+    }
+    return 0;
+}
+
+static int undelete_scan_group(uint32_t group, void *worker, void *arg) {
+    undelete_worker_t *w = (undelete_worker_t *)worker;
+    undelete_scan_state_t *st = (undelete_scan_state_t *)arg;
+    undelete_result_t *c = &w->counts;
+    inode_iter_t *it = &w->it;
+    uint32_t first_ino = st->fs_info->sb.s_rev_level ? st->fs_info->sb.s_first_ino : EXT2_GOOD_OLD_FIRST_INO;
+    int rc;
+
+    inode_iter_reset(it, group, group + 1);
+    while ((rc = inode_iter_next(it)) > 0) {
+        for (uint32_t i = 0; i < it->count; i++) {
+            if (inode_iter_used(it, i) || it->first_inode + i < first_ino) {
+                continue;
+            }
+            c->scanned++;
+            const struct ext2_inode *inode = inode_iter_inode(it, i);
+            if (inode->i_dtime == 0 || inode->i_mode == 0) {
+                continue;
+            }
+
+            undelete_file_t f;
+            undelete_measure(st->fs_info, st->used, it->first_inode + i, inode, &f);
+            c->deleted++;
+            c->by_state[f.state]++;
+            if (f.state != UNDELETE_LOST) {
+                c->recoverable_bytes += f.free_blocks * st->fs_info->block_size;
+            }
+            topn_push(&w->top, rank_key(&f), f.ino, 0);
+        }
+    }
+    if (rc < 0) {
+        c->unreadable_tables++;
+    }
+    return 0;
+}
+
+static int undelete_worker_finish(void *worker, void *arg) {
+    undelete_worker_t *w = (undelete_worker_t *)worker;
+    undelete_scan_state_t *st = (undelete_scan_state_t *)arg;
+    undelete_result_t *r = st->result;
+
+    r->scanned += w->counts.scanned;
+    r->deleted += w->counts.deleted;
+    r->recoverable_bytes += w->counts.recoverable_bytes;
+    r->unreadable_tables += w->counts.unreadable_tables;
+    for (int s = 0; s < UNDELETE_STATES; s++) {
+        r->by_state[s] += w->counts.by_state[s];
+    }
+    topn_merge(&st->ranked, &w->top);
+
+    topn_free(&w->top);
+    inode_iter_cleanup(&w->it);
+    return 0;
+}
+
+// Finds every free inode slot with a deletion time on the group pool, checks its blocks against
+// the bitmaps and ranks the top most recoverable ones
+undelete_result_t *undelete_scan(fs_info_t *fs_info, uint32_t top, uint32_t threads, job_t *job) {
+    undelete_scan_state_t st;
+    struct timespec start, end;
+    unsigned char *used = NULL;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(&st, 0, sizeof(st));
+    st.fs_info = fs_info;
+    st.top = top;
+    st.result = (undelete_result_t *)calloc(1, sizeof(undelete_result_t));
+    if (!st.result || topn_init(&st.ranked, top) != 0) {
+        goto fail;
+    }
+    used = undelete_load_bitmap(fs_info, &st.result->unreadable);
+    if (!used) {
+        goto fail;
+    }
+    st.used = used;
+
+    parallel_t p;
+    memset(&p, 0, sizeof(p));
+    p.items = fs_info->groups_count;
+    p.threads = threads;
+    p.worker_size = sizeof(undelete_worker_t);
+    p.arg = &st;
+    p.job = job;
+    p.init = undelete_worker_init;
+    p.work = undelete_scan_group;
+    p.finish = undelete_worker_finish;
+    if (parallel_run(&p) != 0 || job_is_cancelled(job)) {
+        goto fail;
+    }
+
+    // Only the ranked inodes are measured a second time, for their details
+    undelete_result_t *r = st.result;
+    uint32_t n = topn_sorted(&st.ranked);
+    r->files = (undelete_file_t *)calloc(n ? n : 1, sizeof(undelete_file_t));
+    if (!r->files) {
+        goto fail;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        struct ext2_inode inode;
+        uint32_t ino = st.ranked.heap[i].id;
+        if (read_inode(fs_info, ino, &inode) == 0) {
+            undelete_measure(fs_info, used, ino, &inode, &r->files[r->file_count++]);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    r->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    topn_free(&st.ranked);
+    free(used);
+    return r;
+
+fail:
+    topn_free(&st.ranked);
+    free(used);
+    undelete_free(st.result);
+    return NULL;
+}
+
+void undelete_free(undelete_result_t *result) {
+    if (!result) {
+        return;
+    }
+
+    free(result->files);
+    free(result);
+}
+
+const char *undelete_state_name(undelete_state_t state) {
+    switch (state) {
+        case UNDELETE_FULL: return "full";
+        case UNDELETE_PARTIAL: return "partial";
+        case UNDELETE_LOST: return "lost";
+        default: return "unknown";
+    }
+}
+
+static int push_run(undelete_collect_t *c, uint64_t logical, uint64_t physical) {
+    undelete_run_t *last = c->count ? &c->runs[c->count - 1] : NULL;
+
+    if (last && last->count < c->max_blocks && last->logical + last->count == logical &&
+        last->physical + last->count == physical) {
+        last->count++;
+        return 0;
+    }
+    if (c->count == c->capacity) {
+        uint32_t grown = c->capacity ? c->capacity * 2 : 64;
+        undelete_run_t *runs = (undelete_run_t *)realloc(c->runs, grown * sizeof(undelete_run_t));
+        if (!runs) {
+            return -1;
+        }
+        c->runs = runs;
+        c->capacity = grown;
+    }
+    c->runs[c->count++] = (undelete_run_t){ logical, physical, 1 };
+    return 0;
+}
+
+// Keeps the blocks still free, the ones allocated again become holes in the output
+static int collect_run(uint64_t logical, uint64_t physical, uint32_t count, bool unwritten, void *arg) {
+    undelete_collect_t *c = (undelete_collect_t *)arg;
+    (void)unwritten;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!block_valid(c->fs_info, physical + i) || block_used(c->fs_info, c->used, physical + i)) {
+            c->stats->skipped++;
+            continue;
+        }
+        if (push_run(c, logical + i, physical + i) != 0) {
+            return -1;
+        }
+    }
+    c->end = logical + count > c->end ? logical + count : c->end;
+    return 0;
+}
+
+// Fills buffer with the runs first..last-1, which lie in one window of the device in ascending
+// order. Without an overlay the window is one preadv() whose gaps land in scratch; reads through
+// an overlay, or a short read, fall back to one read per run.
+static int read_runs(fs_info_t *fs_info, const undelete_run_t *runs, uint32_t first, uint32_t last,
+                     unsigned char *buffer, unsigned char *scratch, undelete_stats_t *stats) {
+    uint32_t bs = fs_info->block_size;
+    struct iovec iov[UNDELETE_READ_IOVS];
+    int iovcnt = 0;
+    size_t total = 0, offset = 0;
+
+    if (!fs_info->overlay) {
+        for (uint32_t i = first; i < last; i++) {
+            if (i > first && runs[i].physical > runs[i - 1].physical + runs[i - 1].count) {
+                size_t gap = (size_t)(runs[i].physical - runs[i - 1].physical - runs[i - 1].count) * bs;
+                iov[iovcnt++] = (struct iovec){ scratch, gap };
+                total += gap;
+            }
+            iov[iovcnt++] = (struct iovec){ buffer + offset, (size_t)runs[i].count * bs };
+            offset += (size_t)runs[i].count * bs;
+            total += (size_t)runs[i].count * bs;
+        }
+        stats->reads++;
+        if (preadv(fs_info->fd, iov, iovcnt, (off_t)(runs[first].physical * bs)) == (ssize_t)total) {
+            return 0;
+        }
+        offset = 0;
+    }
+
+    for (uint32_t i = first; i < last; i++) {
+        size_t length = (size_t)runs[i].count * bs;
+        stats->reads++;
+        if (read_bytes(fs_info, runs[i].physical * bs, buffer + offset, length) != 0) {
+            return -1;
+        }
+        offset += length;
+    }
+    return 0;
+}
+
+// Copies the blocks of a deleted inode that are still free into dir_fd/inode_<ino>, at their
+// offsets in the file, and truncates it to i_size. Reads are batched over nearby runs.
+int undelete_extract(fs_info_t *fs_info, const unsigned char *used, uint32_t ino, int dir_fd, undelete_stats_t *stats) {
+    uint32_t bs = fs_info->block_size;
+    undelete_collect_t c = { fs_info, used, NULL, 0, 0, UNDELETE_READ_BYTES / bs, 0, stats };
+    struct ext2_inode inode;
+    unsigned char *buffer = NULL, *scratch = NULL;
+    char name[32];
+    int out = -1, rc = -1;
+
+    if (read_inode(fs_info, ino, &inode) != 0) {
+        return -1;
+    }
+    // A map that breaks off part way still yields the runs reached before it
+    if (blockmap_has_blocks(&inode)) {
+        blockmap_walk(fs_info, &inode, collect_run, &c);
+    }
+    uint64_t size = inode_file_size(&inode);
+    size = size ? size : c.end * bs;
+
+    buffer = (unsigned char *)malloc(UNDELETE_READ_BYTES);
+    scratch = (unsigned char *)malloc((size_t)UNDELETE_GAP_BLOCKS * bs);
+    snprintf(name, sizeof(name), "inode_%u", ino);
+    out = openat(dir_fd, name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (!buffer || !scratch || out < 0) {
+        goto out;
+    }
+
+    for (uint32_t first = 0; first < c.count;) {
+        // Extend the batch while the next run follows closely and the window stays in bounds
+        uint64_t window = c.runs[first].physical;
+        uint32_t last = first + 1;
+        int iovs = 1;
+        while (last < c.count && iovs + 2 <= UNDELETE_READ_IOVS) {
+            const undelete_run_t *prev = &c.runs[last - 1], *next = &c.runs[last];
+            uint64_t prev_end = prev->physical + prev->count;
+            if (next->physical < prev_end || next->physical - prev_end > UNDELETE_GAP_BLOCKS ||
+                (next->physical + next->count - window) * bs > UNDELETE_READ_BYTES) {
+                break;
+            }
+            iovs += next->physical > prev_end ? 2 : 1;
+            last++;
+        }
+
+        if (read_runs(fs_info, c.runs, first, last, buffer, scratch, stats) != 0) {
+            goto out;
+        }
+        size_t offset = 0;
+        for (uint32_t i = first; i < last; i++) {
+            uint64_t at = c.runs[i].logical * bs;
+            size_t length = (size_t)c.runs[i].count * bs;
+            if (at < size) {
+                length = at + length > size ? (size_t)(size - at) : length;
+                if (pwrite(out, buffer + offset, length, (off_t)at) != (ssize_t)length) {
+                    goto out;
+                }
+                stats->bytes += length;
+            }
+            offset += (size_t)c.runs[i].count * bs;
+        }
+        first = last;
+    }
+
+    if (ftruncate(out, (off_t)size) != 0) {
+        goto out;
+    }
+    struct timespec times[2] = { { (time_t)inode.i_atime, 0 }, { (time_t)inode.i_mtime, 0 } };
+    futimens(out, times);
+    stats->files++;
+    rc = 0;
+
+out:
+    if (out >= 0 && close(out) != 0) {
+        rc = -1;
+    }
+    free(buffer);
+    free(scratch);
+    free(c.runs);
+    return rc;
+}
+
+// Recovered files can hold anyone's data, so only the caller may read them. A directory on the
+// scanned device is refused, writing there could overwrite the free blocks still to be recovered.
+static bool on_device(const fs_info_t *fs_info, const struct stat *st) {
+    struct stat dev;
+
+    return fstat(fs_info->fd, &dev) == 0 && S_ISBLK(dev.st_mode) && st->st_dev == dev.st_rdev;
+}
+
+static int open_output_dir(const fs_info_t *fs_info, const char *dir) {
+    char parent[PATH_MAX];
+    struct stat st;
+
+    // A missing directory is checked through its parent before mkdir writes anything
+    if (stat(dir, &st) != 0) {
+        snprintf(parent, sizeof(parent), "%s", dir);
+        if (errno != ENOENT || stat(dirname(parent), &st) != 0) {
+            return -1;
+        }
+        if (on_device(fs_info, &st)) {
+            errno = EBUSY;
+            return -1;
+        }
+        if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+            return -1;
+        }
+    }
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0 && fstat(fd, &st) == 0 && on_device(fs_info, &st)) {
+        close(fd);
+        errno = EBUSY;
+        return -1;
+    }
+    return fd;
+}
+
+// Extracts every full or partial file of a scan into dir, checking the bitmaps again first.
+// Progress continues from the scan that produced result under the same job.
+int undelete_extract_all(fs_info_t *fs_info, const undelete_result_t *result, const char *dir, job_t *job,
+                         undelete_stats_t *stats) {
+    unsigned char *used = undelete_load_bitmap(fs_info, NULL);
+    int dir_fd = open_output_dir(fs_info, dir);
+    int rc = used && dir_fd >= 0 ? 0 : -1;
+
+    // A file that cannot be recovered is counted and the others still are
+    job_set_total(job, fs_info->groups_count + result->file_count);
+    for (uint32_t i = 0; rc == 0 && i < result->file_count && !job_is_cancelled(job); i++) {
+        if (result->files[i].state != UNDELETE_LOST &&
+            undelete_extract(fs_info, used, result->files[i].ino, dir_fd, stats) != 0) {
+            stats->failed++;
+        }
+        job_advance(job, 1);
+    }
+
+    if (dir_fd >= 0) {
+        close(dir_fd);
+    }
+    free(used);
+    return rc;
+}
+
+void undelete_print(const undelete_result_t *result, uint32_t block_size, FILE *out) {
+    char bytes[32];
+
+    format_value(result->recoverable_bytes, bytes, sizeof(bytes), true);
+    fprintf(out, "Scanned %lu free inode(s) in %.2f s: %lu deleted, %lu full, %lu partial, %lu lost, %s recoverable\n",
+            (unsigned long)result->scanned, result->seconds, (unsigned long)result->deleted,
+            (unsigned long)result->by_state[UNDELETE_FULL], (unsigned long)result->by_state[UNDELETE_PARTIAL],
+            (unsigned long)result->by_state[UNDELETE_LOST], bytes);
+    if (result->unreadable) {
+        fprintf(out, "Unreadable block bitmaps, their groups count as allocated: %u\n", result->unreadable);
+    }
+    if (result->unreadable_tables) {
+        fprintf(out, "Groups with unreadable inode bitmaps or tables, not fully scanned: %u\n",
+                result->unreadable_tables);
+    }
+    if (result->file_count == 0) {
+        return;
+    }
+
+    fprintf(out, "\n%10s %-5s %12s %-19s %10s %10s %6s  %s\n", "Inode", "Type", "Size", "Deleted", "Blocks", "Free",
+            "Score", "State");
+    for (uint32_t i = 0; i < result->file_count; i++) {
+        const undelete_file_t *f = &result->files[i];
+        time_t t = (time_t)f->dtime;
+        struct tm tm;
+        char when[32];
+        if (!localtime_r(&t, &tm) || strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm) == 0) {
+            snprintf(when, sizeof(when), "-");
+        }
+        fprintf(out, "%10u %-5s %12lu %-19s %10lu %10lu %5.1f%%  %s%s\n", f->ino, inode_type_name(f->mode),
+                (unsigned long)(f->size ? f->size : f->blocks * block_size), when, (unsigned long)f->blocks,
+                (unsigned long)f->free_blocks, f->score, undelete_state_name(f->state),
+                f->map_damaged ? ", map damaged" : "");
+    }
+}
+
+// Job body: ranks the deleted inodes and publishes the result in the job_slot_t passed as arg
+int undelete_job(job_t *job, void *arg) {
+    job_slot_t *slot = (job_slot_t *)arg;
+
+    undelete_result_t *result = undelete_scan((fs_info_t *)slot->source, slot->top, 0, job);
+
+    if (result) {
+        job_printf(job, "%lu deleted inode(s): %lu full, %lu partial, %.2f s", (unsigned long)result->deleted,
+                   (unsigned long)result->by_state[UNDELETE_FULL], (unsigned long)result->by_state[UNDELETE_PARTIAL],
+                   result->seconds);
+    } else {
+        job_printf(job, "%s", job_is_cancelled(job) ? "Deleted inode scan cancelled" : "Deleted inode scan failed");
+    }
+    // The slot owns the result from here on and a later job may free it, so this is the last use
+    job_slot_finish(slot, job, result);
+    return result || job_is_cancelled(job) ? 0 : -1;
+}
+
+// Job body: extracts the undelete_job_arg_t inode, or rescans and extracts every recoverable one
+int undelete_extract_job(job_t *job, void *arg) {
+    undelete_job_arg_t *ex = (undelete_job_arg_t *)arg;
+    undelete_stats_t stats = { 0, 0, 0, 0, 0 };
+    int rc = -1;
+
+    if (ex->ino) {
+        unsigned char *used = undelete_load_bitmap(ex->fs_info, NULL);
+        int dir_fd = open_output_dir(ex->fs_info, ex->dir);
+        if (used && dir_fd >= 0) {
+            rc = undelete_extract(ex->fs_info, used, ex->ino, dir_fd, &stats);
+        }
+        if (dir_fd >= 0) {
+            close(dir_fd);
+        }
+        free(used);
+    } else {
+        undelete_result_t *result = undelete_scan(ex->fs_info, UNDELETE_EXTRACT_MAX, 0, job);
+        if (result) {
+            rc = undelete_extract_all(ex->fs_info, result, ex->dir, job, &stats);
+            undelete_free(result);
+        }
+    }
+
+    char bytes[32];
+    format_value(stats.bytes, bytes, sizeof(bytes), true);
+    if (rc != 0) {
+        job_printf(job, "Extraction to %s failed after %lu file(s): %s", ex->dir, (unsigned long)stats.files,
+                   strerror(errno));
+        return job_is_cancelled(job) ? 0 : -1;
+    }
+    job_printf(job, "Extracted %lu file(s), %s in %lu read(s) to %s, %lu reallocated block(s) left as holes%s",
+               (unsigned long)stats.files, bytes, (unsigned long)stats.reads, ex->dir, (unsigned long)stats.skipped,
+               job_is_cancelled(job) ? " (cancelled, incomplete)" : "");
+    if (stats.failed) {
+        job_printf(job, "%lu file(s) could not be recovered", (unsigned long)stats.failed);
+    }
+    return 0;
+}
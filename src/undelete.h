@@ -0,0 +1,90 @@
+#ifndef UNDELETE_H
+#define UNDELETE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <ext2fs/ext2_fs.h>
+#include "analyzer.h"
+#include "job.h"
+
+#define UNDELETE_DEFAULT_TOP 1000   // Deleted inodes ranked unless asked otherwise
+#define UNDELETE_EXTRACT_MAX 65536  // Inodes an extract-all run ranks and writes at most
+#define UNDELETE_READ_BYTES (4u << 20) // Device bytes covered by one vectored read
+#define UNDELETE_READ_IOVS 64       // Buffers per vectored read
+#define UNDELETE_GAP_BLOCKS 16      // Blocks of a gap read and dropped rather than starting a new read
+
+typedef enum {
+    UNDELETE_FULL,              // Every mapped block is still free
+    UNDELETE_PARTIAL,           // Some blocks were allocated again since
+    UNDELETE_LOST,              // Nothing left, or the block map is gone
+    UNDELETE_STATES
+} undelete_state_t;
+
+typedef struct {
+    uint32_t ino;
+    uint16_t mode;
+    uint64_t size;              // i_size, often 0 after the kernel truncated the inode
+    uint32_t dtime;             // Deletion time
+    uint32_t mtime;
+    uint64_t blocks;            // Data blocks still mapped
+    uint64_t free_blocks;       // Of those, not allocated again
+    uint64_t expected;          // Blocks i_size needs, or the mapped blocks without a size
+    uint32_t bad;               // Pointers outside the filesystem
+    bool map_damaged;           // An indirect or extent block could not be followed
+    undelete_state_t state;
+    double score;               // Free blocks against expected, 0 to 100
+} undelete_file_t;
+
+typedef struct {
+    uint64_t scanned;           // Free inode slots examined
+    uint64_t deleted;           // Of those, with a deletion time and a mode
+    uint64_t by_state[UNDELETE_STATES];
+    uint64_t recoverable_bytes; // Free blocks of full and partial files
+    undelete_file_t *files;     // Most recoverable first, newest deletion first on ties
+    uint32_t file_count;
+    uint32_t unreadable;        // Groups whose block bitmap could not be read
+    uint32_t unreadable_tables; // Groups whose inode bitmap or table could not be read, not scanned further
+    double seconds;             // Wall time of the scan
+} undelete_result_t;
+
+typedef struct {
+    uint64_t files;             // Files written
+    uint64_t bytes;             // Bytes of free blocks copied
+    uint64_t skipped;           // Blocks allocated again, left as holes
+    uint64_t reads;             // Vectored reads issued
+    uint64_t failed;            // Files that could not be read or written, left out
+} undelete_stats_t;
+
+// Extraction request handed to undelete_extract_job
+typedef struct {
+    fs_info_t *fs_info;         // Filesystem to read
+    char dir[256];              // Output directory, created when missing
+    uint32_t ino;               // Inode to extract, 0 for every full or partial one
+} undelete_job_arg_t;
+
+unsigned char *undelete_load_bitmap(fs_info_t *fs_info, uint32_t *unreadable);
+
+int undelete_measure(fs_info_t *fs_info, const unsigned char *used, uint32_t ino, const struct ext2_inode *inode,
+                     undelete_file_t *file);
+
+undelete_result_t *undelete_scan(fs_info_t *fs_info, uint32_t top, uint32_t threads, job_t *job);
+
+void undelete_free(undelete_result_t *result);
+
+const char *undelete_state_name(undelete_state_t state);
+
+int undelete_extract(fs_info_t *fs_info, const unsigned char *used, uint32_t ino, int dir_fd, undelete_stats_t *stats);
+
+int undelete_extract_all(fs_info_t *fs_info, const undelete_result_t *result, const char *dir, job_t *job,
+                         undelete_stats_t *stats);
+
+void undelete_print(const undelete_result_t *result, uint32_t block_size, FILE *out);
+
+int undelete_job(job_t *job, void *arg);
+
+int undelete_extract_job(job_t *job, void *arg);
+
+#endif /* UNDELETE_H */
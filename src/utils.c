@@ -5,7 +5,7 @@
 #include <stdarg.h>
 #include <time.h>
 #include "utils.h"
-#define S_ISVTX 01000 
+#include "schema.h"
 
 void format_value(uint64_t value, char *buffer, size_t buffer_size, bool is_size) {
     if (!buffer || buffer_size <= 0) {
@@ -54,59 +54,107 @@ void clear_bitmap_bit(unsigned char *bitmap, uint32_t bit_num) {
     bitmap[byte_index] &= ~(1 << bit_offset);
 }
 
+uint32_t count_bitmap_bits(const unsigned char *bitmap, uint32_t bit_count) {
+    uint32_t count = 0;
+    uint32_t full_bytes = bit_count / 8;
+
+    for (uint32_t i = 0; i < full_bytes; i++) {
+        count += __builtin_popcount(bitmap[i]);
+    }
+    if (bit_count % 8) {
+        count += __builtin_popcount(bitmap[full_bytes] & ((1u << (bit_count % 8)) - 1));
+    }
+
+    return count;
+}
+
+// Sets or clears bits [first, first + count) and returns how many bits changed.
+// Whole 64-bit words are handled at once, so only the ragged ends go bit by bit.
+uint32_t fill_bitmap_range(unsigned char *bitmap, uint32_t first, uint32_t count, bool value) {
+    uint32_t changed = 0;
+    uint32_t bit = first;
+    uint32_t end = first + count;
+
+    for (; bit < end && bit % 64 != 0; bit++) {
+        if (check_bitmap_bit(bitmap, bit) != value) {
+            value ? set_bitmap_bit(bitmap, bit) : clear_bitmap_bit(bitmap, bit);
+            changed++;
+        }
+    }
+
+    const uint64_t fill = value ? UINT64_MAX : 0;
+    for (; end - bit >= 64; bit += 64) {
+        uint64_t word;
+        memcpy(&word, bitmap + bit / 8, sizeof(word));
+        changed += __builtin_popcountll(word ^ fill);
+        memcpy(bitmap + bit / 8, &fill, sizeof(fill));
+    }
+
+    for (; bit < end; bit++) {
+        if (check_bitmap_bit(bitmap, bit) != value) {
+            value ? set_bitmap_bit(bitmap, bit) : clear_bitmap_bit(bitmap, bit);
+            changed++;
+        }
+    }
+
+    return changed;
+}
+
+// First bit at or after start that equals value, or limit if there is none.
+// Words that cannot contain such a bit are skipped 64 bits at a time.
+uint32_t find_next_bit(const unsigned char *bitmap, uint32_t start, uint32_t limit, bool value) {
+    uint32_t bit = start;
+
+    for (; bit < limit && bit % 64 != 0; bit++) {
+        if (check_bitmap_bit(bitmap, bit) == value) {
+            return bit;
+        }
+    }
+
+    const uint64_t skip = value ? 0 : UINT64_MAX;
+    for (; limit - bit >= 64; bit += 64) {
+        uint64_t word;
+        memcpy(&word, bitmap + bit / 8, sizeof(word));
+        if (word != skip) {
+            return bit + (uint32_t)__builtin_ctzll(value ? word : ~word);
+        }
+    }
+
+    for (; bit < limit; bit++) {
+        if (check_bitmap_bit(bitmap, bit) == value) {
+            return bit;
+        }
+    }
+    return limit;
+}
+
+// Last bit at or before start that equals value, or -1 if there is none
+int64_t find_prev_bit(const unsigned char *bitmap, int64_t start, bool value) {
+    int64_t bit = start;
+
+    for (; bit >= 0 && bit % 64 != 63; bit--) {
+        if (check_bitmap_bit(bitmap, (uint32_t)bit) == value) {
+            return bit;
+        }
+    }
+
+    const uint64_t skip = value ? 0 : UINT64_MAX;
+    for (; bit >= 63; bit -= 64) {
+        uint64_t word;
+        memcpy(&word, bitmap + (bit - 63) / 8, sizeof(word));
+        if (word != skip) {
+            return bit - __builtin_clzll(value ? word : ~word);
+        }
+    }
+    return -1;
+}
+
 void superblock_to_string(const struct ext2_super_block *sb, char *buffer, size_t buffer_size) {
     if (!sb || !buffer || buffer_size <= 0) {
         return;
     }
     
-    char temp[1024];
-    snprintf(temp, sizeof(temp),
-             "Superblock:\n"
-             "  Inodes count: %u\n"
-             "  Blocks count: %u\n"
-             "  Reserved blocks count: %u\n"
-             "  Free blocks count: %u\n"
-             "  Free inodes count: %u\n"
-             "  First data block: %u\n"
-             "  Block size: %u\n"
-             "  Blocks per group: %u\n"
-             "  Inodes per group: %u\n"
-             "  Mount count: %u\n"
-             "  Maximum mount count: %u\n"
-             "  Magic signature: 0x%x\n"
-             "  Filesystem state: %u\n"
-             "  Error behavior: %u\n"
-             "  Minor revision level: %u\n"
-             "  Last check time: %u\n"
-             "  Check interval: %u\n"
-             "  Creator OS: %u\n"
-             "  Revision level: %u\n"
-             "  Reserved blocks UID: %u\n"
-             "  Reserved blocks GID: %u\n",
-             sb->s_inodes_count,
-             sb->s_blocks_count,
-             sb->s_r_blocks_count,
-             sb->s_free_blocks_count,
-             sb->s_free_inodes_count,
-             sb->s_first_data_block,
-             1024 << sb->s_log_block_size,
-             sb->s_blocks_per_group,
-             sb->s_inodes_per_group,
-             sb->s_mnt_count,
-             sb->s_max_mnt_count,
-             sb->s_magic,
-             sb->s_state,
-             sb->s_errors,
-             sb->s_minor_rev_level,
-             sb->s_lastcheck,
-             sb->s_checkinterval,
-             sb->s_creator_os,
-             sb->s_rev_level,
-             sb->s_def_resuid,
-             sb->s_def_resgid);
-    
-    strncpy(buffer, temp, buffer_size);
-    buffer[buffer_size - 1] = '\0';
+    schema_format(&schema_superblock, sb, sizeof(*sb), buffer, buffer_size);
 }
 
 void group_desc_to_string(const struct ext2_group_desc *gd, char *buffer, size_t buffer_size) {
@@ -114,24 +162,7 @@ void group_desc_to_string(const struct ext2_group_desc *gd, char *buffer, size_t
         return;
     }
     
-    char temp[512];
-    snprintf(temp, sizeof(temp),
-             "Group Descriptor:\n"
-             "  Block bitmap: %u\n"
-             "  Inode bitmap: %u\n"
-             "  Inode table: %u\n"
-             "  Free blocks count: %u\n"
-             "  Free inodes count: %u\n"
-             "  Used directories count: %u\n",
-             gd->bg_block_bitmap,
-             gd->bg_inode_bitmap,
-             gd->bg_inode_table,
-             gd->bg_free_blocks_count,
-             gd->bg_free_inodes_count,
-             gd->bg_used_dirs_count);
-    
-    strncpy(buffer, temp, buffer_size);
-    buffer[buffer_size - 1] = '\0';
+    schema_format(&schema_group_desc32, gd, sizeof(*gd), buffer, buffer_size);
 }
 
 void inode_to_string(const struct ext2_inode *inode, char *buffer, size_t buffer_size) {
@@ -139,101 +170,109 @@ void inode_to_string(const struct ext2_inode *inode, char *buffer, size_t buffer
         return;
     }
     
-    char temp[1024];
-    char mode_str[11] = "----------";
-    
-    // Set file type
-    if (S_ISREG(inode->i_mode)) mode_str[0] = '-';
-    else if (S_ISDIR(inode->i_mode)) mode_str[0] = 'd';
-    else if (S_ISLNK(inode->i_mode)) mode_str[0] = 'l';
-    else if (S_ISCHR(inode->i_mode)) mode_str[0] = 'c';
-    else if (S_ISBLK(inode->i_mode)) mode_str[0] = 'b';
-    else if (S_ISFIFO(inode->i_mode)) mode_str[0] = 'p';
-    else if (S_ISSOCK(inode->i_mode)) mode_str[0] = 's';
-    
-    // Set permissions
-    if (inode->i_mode & S_IRUSR) mode_str[1] = 'r';
-    if (inode->i_mode & S_IWUSR) mode_str[2] = 'w';
-    if (inode->i_mode & S_IXUSR) mode_str[3] = 'x';
-    if (inode->i_mode & S_IRGRP) mode_str[4] = 'r';
-    if (inode->i_mode & S_IWGRP) mode_str[5] = 'w';
-    if (inode->i_mode & S_IXGRP) mode_str[6] = 'x';
-    if (inode->i_mode & S_IROTH) mode_str[7] = 'r';
-    if (inode->i_mode & S_IWOTH) mode_str[8] = 'w';
-    if (inode->i_mode & S_IXOTH) mode_str[9] = 'x';
-    
-    // Apply setuid/setgid/sticky bits
-    if (inode->i_mode & S_ISUID) {
-        if (mode_str[3] == 'x') mode_str[3] = 's';
-        else mode_str[3] = 'S';
+    schema_format(&schema_inode, inode, sizeof(*inode), buffer, buffer_size);
+}
+
+// Short type name used by the exporter and the query language
+const char *inode_type_name(uint16_t mode) {
+    if (S_ISREG(mode)) return "reg";
+    if (S_ISDIR(mode)) return "dir";
+    if (S_ISLNK(mode)) return "lnk";
+    if (S_ISCHR(mode)) return "chr";
+    if (S_ISBLK(mode)) return "blk";
+    if (S_ISFIFO(mode)) return "fifo";
+    if (S_ISSOCK(mode)) return "sock";
+    return "unknown";
+}
+
+// i_size_high only extends the size of regular files, on ext2 directories keep an ACL there
+uint64_t inode_file_size(const struct ext2_inode *inode) {
+    uint64_t size = inode->i_size;
+
+    if (S_ISREG(inode->i_mode)) {
+        size |= (uint64_t)inode->i_size_high << 32;
     }
-    if (inode->i_mode & S_ISGID) {
-        if (mode_str[6] == 'x') mode_str[6] = 's';
-        else mode_str[6] = 'S';
+    return size;
+}
+
+uint32_t inode_uid(const struct ext2_inode *inode) {
+    return inode->i_uid | ((uint32_t)inode->osd2.linux2.l_i_uid_high << 16);
+}
+
+uint32_t inode_gid(const struct ext2_inode *inode) {
+    return inode->i_gid | ((uint32_t)inode->osd2.linux2.l_i_gid_high << 16);
+}
+
+// Allocated space in 512-byte sectors
+uint64_t inode_block_count(const struct ext2_inode *inode) {
+    return inode->i_blocks | ((uint64_t)inode->osd2.linux2.l_i_blocks_hi << 32);
+}
+
+// Accepts "hex:DE AD BE EF" for raw bytes, anything else is taken as literal text
+int parse_search_pattern(const char *text, uint8_t *pattern, size_t max_len) {
+    if (!text || !pattern || max_len == 0) {
+        return -1;
     }
-    if (inode->i_mode & S_ISVTX) {
-        if (mode_str[9] == 'x') mode_str[9] = 't';
-        else mode_str[9] = 'T';
+
+    if (strncmp(text, "hex:", 4) != 0) {
+        size_t len = strlen(text);
+        if (len == 0 || len > max_len) {
+            return -1;
+        }
+        memcpy(pattern, text, len);
+        return (int)len;
     }
-    
-    snprintf(temp, sizeof(temp),
-             "Inode:\n"
-             "  Mode: %s (0%o)\n"
-             "  Owner: %u\n"
-             "  Size: %u\n"
-             "  Access time: %u\n"
-             "  Creation time: %u\n"
-             "  Modification time: %u\n"
-             "  Deletion time: %u\n"
-             "  Links count: %u\n"
-             "  Blocks count: %u\n"
-             "  Flags: 0x%x\n"
-             "  Direct blocks:\n"
-             "    [0]: %u\n"
-             "    [1]: %u\n"
-             "    [2]: %u\n"
-             "    [3]: %u\n"
-             "    [4]: %u\n"
-             "    [5]: %u\n"
-             "    [6]: %u\n"
-             "    [7]: %u\n"
-             "    [8]: %u\n"
-             "    [9]: %u\n"
-             "    [10]: %u\n"
-             "    [11]: %u\n"
-             "  Singly-indirect block: %u\n"
-             "  Doubly-indirect block: %u\n"
-             "  Triply-indirect block: %u\n",
-             mode_str, inode->i_mode & 0xFFF,
-             inode->i_uid,
-             inode->i_size,
-             inode->i_atime,
-             inode->i_ctime,
-             inode->i_mtime,
-             inode->i_dtime,
-             inode->i_links_count,
-             inode->i_blocks,
-             inode->i_flags,
-             inode->i_block[0],
-             inode->i_block[1],
-             inode->i_block[2],
-             inode->i_block[3],
-             inode->i_block[4],
-             inode->i_block[5],
-             inode->i_block[6],
-             inode->i_block[7],
-             inode->i_block[8],
-             inode->i_block[9],
-             inode->i_block[10],
-             inode->i_block[11],
-             inode->i_block[12],
-             inode->i_block[13],
-             inode->i_block[14]);
-    
-    strncpy(buffer, temp, buffer_size);
-    buffer[buffer_size - 1] = '\0';
+
+    size_t len = 0;
+    int high = -1;
+    for (const char *p = text + 4; *p; p++) {
+        int value;
+        if (*p >= '0' && *p <= '9') value = *p - '0';
+        else if (*p >= 'a' && *p <= 'f') value = *p - 'a' + 10;
+        else if (*p >= 'A' && *p <= 'F') value = *p - 'A' + 10;
+        else if (*p == ' ') continue;
+        else return -1;
+
+        if (high < 0) {
+            high = value;
+        } else {
+            if (len >= max_len) {
+                return -1;
+            }
+            pattern[len++] = (uint8_t)((high << 4) | value);
+            high = -1;
+        }
+    }
+
+    return (high < 0 && len > 0) ? (int)len : -1;
 }
 
+// Offset in data of the first match, or the last one with last set, among those starting below
+// starts. data holds length bytes, a match may run past starts. Returns -1 without a match.
+int64_t find_pattern(const uint8_t *data, size_t starts, size_t length, const uint8_t *pattern, size_t len, bool last) {
+    if (len == 0 || length < len) {
+        return -1;
+    }
+    if (starts > length - len + 1) {
+        starts = length - len + 1;
+    }
+
+    // memchr finds candidates for the first byte, memcmp checks the rest. Looking for the last
+    // match still sweeps forward, remembering the latest, so both ways stay vectorised.
+    const uint8_t *p = data;
+    const uint8_t *end = data + starts;
+    int64_t found = -1;
+    while (p < end && (p = memchr(p, pattern[0], (size_t)(end - p))) != NULL) {
+        if (memcmp(p, pattern, len) == 0) {
+            found = p - data;
+            if (!last) {
+                break;
+            }
+        }
+        p++;
+    }
+    return found;
+}
 
 //БЛОЧКА
 void get_fs_type_string(const fs_info_t *fs_info, char *buffer, size_t buffer_size) {
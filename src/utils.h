@@ -11,6 +11,8 @@
 #include <unistd.h>
 #include "analyzer.h"
 
+#define SEARCH_PATTERN_MAX 64           // Longest search pattern in bytes
+
 void format_value(uint64_t value, char *buffer, size_t buffer_size, bool is_size);
 
 bool check_bitmap_bit(const unsigned char *bitmap, uint32_t bit_num);
@@ -19,12 +21,34 @@ void set_bitmap_bit(unsigned char *bitmap, uint32_t bit_num);
 
 void clear_bitmap_bit(unsigned char *bitmap, uint32_t bit_num);
 
+uint32_t count_bitmap_bits(const unsigned char *bitmap, uint32_t bit_count);
+
+uint32_t fill_bitmap_range(unsigned char *bitmap, uint32_t first, uint32_t count, bool value);
+
+uint32_t find_next_bit(const unsigned char *bitmap, uint32_t start, uint32_t limit, bool value);
+
+int64_t find_prev_bit(const unsigned char *bitmap, int64_t start, bool value);
+
 void superblock_to_string(const struct ext2_super_block *sb, char *buffer, size_t buffer_size);
 
 void group_desc_to_string(const struct ext2_group_desc *gd, char *buffer, size_t buffer_size);
 
 void inode_to_string(const struct ext2_inode *inode, char *buffer, size_t buffer_size);
 
+const char *inode_type_name(uint16_t mode);
+
+uint64_t inode_file_size(const struct ext2_inode *inode);
+
+uint32_t inode_uid(const struct ext2_inode *inode);
+
+uint32_t inode_gid(const struct ext2_inode *inode);
+
+uint64_t inode_block_count(const struct ext2_inode *inode);
+
+int parse_search_pattern(const char *text, uint8_t *pattern, size_t max_len);
+
+int64_t find_pattern(const uint8_t *data, size_t starts, size_t length, const uint8_t *pattern, size_t len, bool last);
+
 void get_fs_type_string(const fs_info_t *fs_info, char *buffer, size_t buffer_size);
 
 #endif /* UTILS_H */